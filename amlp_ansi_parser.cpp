@@ -0,0 +1,323 @@
+#include "amlp_ansi_parser.h"
+
+namespace {
+
+enum : quint8 {
+    IAC = 255, DONT = 254, DO = 253, WONT = 252, WILL = 251, SB = 250, SE = 240
+};
+
+const int MaxSubnegotiation = 64 * 1024;
+const char32_t Replacement = 0xFFFD;
+
+// The 16 base colours, normal then bright, as SGR 30-37 and 90-97 select them.
+const QRgb BaseColors[16] = {
+    qRgb(0x00, 0x00, 0x00), // black
+    qRgb(0xb2, 0x18, 0x18), // red
+    qRgb(0x1f, 0xb8, 0x39), // green
+    qRgb(0xd0, 0xa8, 0x00), // yellow
+    qRgb(0x1f, 0x4f, 0xb8), // blue
+    qRgb(0xb0, 0x30, 0xb0), // magenta
+    qRgb(0x18, 0xb0, 0xb8), // cyan
+    qRgb(0xe0, 0xe0, 0xe0), // white
+    // bright variants
+    qRgb(0x55, 0x55, 0x55),
+    qRgb(0xff, 0x6e, 0x6e),
+    qRgb(0x6e, 0xfc, 0x6e),
+    qRgb(0xff, 0xd8, 0x6e),
+    qRgb(0x6e, 0xa6, 0xff),
+    qRgb(0xff, 0x6e, 0xff),
+    qRgb(0x6e, 0xf6, 0xff),
+    qRgb(0xff, 0xff, 0xff),
+};
+
+} // namespace
+
+AnsiParser::AnsiParser() {
+    reset();
+}
+
+QRgb AnsiParser::paletteColor(int index) {
+    if (index < 16) return BaseColors[qMax(0, index)];
+    if (index < 232) {
+        static const int Levels[6] = { 0x00, 0x5f, 0x87, 0xaf, 0xd7, 0xff };
+        index -= 16;
+        return qRgb(Levels[index / 36], Levels[index / 6 % 6], Levels[index % 6]);
+    }
+    const int grey = 8 + 10 * (qMin(index, 255) - 232);
+    return qRgb(grey, grey, grey);
+}
+
+void AnsiParser::reset() {
+    tnState = TnData;
+    tnCommand = 0;
+    sbOption = 0;
+    sbBuffer.truncate(0);
+    ansiState = Ground;
+    paramCount = 0;
+    csiPrivate = false;
+    utf8Code = 0;
+    utf8Min = 0;
+    utf8Pending = 0;
+    style = TextStyle();
+    styleId = 0;
+}
+
+void AnsiParser::setEncoding(TextEncoding encoding) {
+    textEncoding = encoding;
+    utf8Pending = 0;
+}
+
+int AnsiParser::feed(const char *data, int len, StyledText &out) {
+    const quint8 *p = reinterpret_cast<const quint8 *>(data);
+    for (int i = 0; i < len; ++i) {
+        // Most server text is plain ASCII between escapes and line ends; with
+        // no sequence open, a run of it needs no per-byte state machine.
+        if (tnState == TnData && ansiState == Ground && utf8Pending == 0) {
+            const int run = printableAsciiRun(data + i, len - i);
+            if (run > 0) {
+                putAscii(data + i, run, out);
+                i += run;
+                if (i == len) break;
+            }
+        }
+        const quint8 b = p[i];
+
+        // Telnet framing sits below the terminal stream, so it is peeled off
+        // first even when it interrupts an escape or UTF-8 sequence.
+        switch (tnState) {
+        case TnData:
+            if (b == IAC) { tnState = TnIac; continue; }
+            break;
+        case TnIac:
+            if (b == IAC) {
+                tnState = TnData;
+                break; // escaped 0xFF is a data byte
+            }
+            if (b >= WILL && b <= DONT) {
+                tnCommand = b;
+                tnState = TnOption;
+            } else if (b == SB) {
+                tnState = TnSbOption;
+            } else {
+                tnState = TnData;
+                if (telnet) telnet->telnetCommand(b, 0);
+            }
+            continue;
+        case TnOption:
+            tnState = TnData;
+            if (telnet) telnet->telnetCommand(tnCommand, b);
+            continue;
+        case TnSbOption:
+            sbOption = b;
+            sbBuffer.truncate(0);
+            tnState = TnSb;
+            continue;
+        case TnSb:
+            if (b == IAC) tnState = TnSbIac;
+            else if (sbBuffer.size() < MaxSubnegotiation) sbBuffer.append(char(b));
+            continue;
+        case TnSbIac:
+            if (b == IAC) {
+                if (sbBuffer.size() < MaxSubnegotiation) sbBuffer.append(char(b));
+                tnState = TnSb;
+                continue;
+            }
+            tnState = TnData;
+            if (b == SE && telnet && !telnet->telnetSubnegotiation(sbOption, sbBuffer))
+                return i + 1;
+            continue;
+        }
+
+        putByte(b, out);
+    }
+    return len;
+}
+
+void AnsiParser::putByte(quint8 b, StyledText &out) {
+    switch (ansiState) {
+    case Ground:
+        break;
+    case Escape:
+        if (b == '[') {
+            ansiState = Csi;
+            paramCount = 0;
+            params[0] = 0;
+            colonParams = 0;
+            csiPrivate = false;
+        } else if (b == ']') {
+            ansiState = Osc;
+        } else if (b >= 0x20 && b <= 0x2f) {
+            ansiState = EscapeIntermediate; // e.g. ESC ( B, a charset select
+        } else {
+            ansiState = Ground; // two-byte sequence, nothing to render
+            if (b < 0x20) break; // a control cuts it short and still acts
+        }
+        return;
+    case EscapeIntermediate:
+        // More intermediates, then a final byte that ends it; nothing to render.
+        if (b < 0x20 || b > 0x2f) ansiState = Ground;
+        if (b < 0x20) break;
+        return;
+    case Csi:
+        if (b >= '0' && b <= '9') {
+            if (paramCount == 0) paramCount = 1;
+            int &v = params[paramCount - 1];
+            if (v < 100000) v = v * 10 + (b - '0');
+        } else if (b == ';' || b == ':') {
+            if (paramCount == 0) paramCount = 1;
+            if (paramCount < MaxParams) {
+                if (b == ':') colonParams |= 1u << paramCount;
+                params[paramCount++] = 0;
+            }
+        } else if (b >= '<' && b <= '?') {
+            csiPrivate = true;
+        } else if (b >= 0x40 && b <= 0x7e) {
+            if (b == 'm' && !csiPrivate) applySgr();
+            ansiState = Ground;
+        } else if (b < 0x20) {
+            // Malformed: drop the sequence, but a line end or a new ESC
+            // within it is acted on as ECMA-48 controls are.
+            ansiState = Ground;
+            break;
+        } else if (b > 0x7e) {
+            ansiState = Ground; // malformed, drop it
+        }
+        return;
+    case Osc:
+        if (b == 0x07) ansiState = Ground;
+        else if (b == 0x1b) ansiState = OscEscape;
+        return;
+    case OscEscape:
+        ansiState = (b == '\\') ? Ground : Osc;
+        return;
+    }
+
+    if (utf8Pending > 0) {
+        if ((b & 0xC0) == 0x80) {
+            utf8Code = (utf8Code << 6) | (b & 0x3F);
+            if (--utf8Pending == 0) {
+                if (utf8Code < utf8Min || utf8Code > 0x10FFFF || (utf8Code >= 0xD800 && utf8Code <= 0xDFFF))
+                    putChar(Replacement, out);
+                else
+                    putChar(utf8Code, out);
+            }
+            return;
+        }
+        // Truncated sequence: emit a replacement and reprocess this byte.
+        utf8Pending = 0;
+        putChar(Replacement, out);
+    }
+
+    if (b >= 0x80 && textEncoding != TextEncoding::Utf8) {
+        putChar(legacyCodePoint(textEncoding, b), out);
+        return;
+    }
+
+    if (b < 0x80) {
+        if (b == 0x1b) { ansiState = Escape; return; }
+        if (b == '\r' || b == 0) return;
+        if (b < 0x20 && b != '\n' && b != '\t') return;
+        putChar(b, out);
+    } else if ((b & 0xE0) == 0xC0) {
+        utf8Code = b & 0x1F; utf8Pending = 1; utf8Min = 0x80;
+    } else if ((b & 0xF0) == 0xE0) {
+        utf8Code = b & 0x0F; utf8Pending = 2; utf8Min = 0x800;
+    } else if ((b & 0xF8) == 0xF0) {
+        utf8Code = b & 0x07; utf8Pending = 3; utf8Min = 0x10000;
+    } else {
+        putChar(Replacement, out);
+    }
+}
+
+void AnsiParser::putChar(char32_t cp, StyledText &out) {
+    const int pos = out.text.size();
+    if (cp > 0xFFFF) {
+        out.text.append(QChar::highSurrogate(cp));
+        out.text.append(QChar::lowSurrogate(cp));
+    } else {
+        out.text.append(QChar(char16_t(cp)));
+    }
+    extendSpan(pos, out.text.size() - pos, out);
+}
+
+void AnsiParser::putAscii(const char *data, int length, StyledText &out) {
+    const int pos = out.text.size();
+    // Qt widens Latin-1 to UTF-16 with its own vector loop.
+    out.text.append(QLatin1String(data, length));
+    extendSpan(pos, length, out);
+}
+
+void AnsiParser::extendSpan(int pos, int added, StyledText &out) {
+    if (!out.spans.isEmpty()) {
+        StyleSpan &last = out.spans.last();
+        if (last.start + last.length == pos && last.style == styleId) {
+            last.length += added;
+            return;
+        }
+    }
+    out.spans.append(StyleSpan{pos, added, styleId});
+}
+
+void AnsiParser::applySgr() {
+    if (paramCount == 0) { // ESC[m is a reset
+        style = TextStyle();
+        styleId = 0;
+        return;
+    }
+    for (int i = 0; i < paramCount; ++i) {
+        const int code = params[i];
+        switch (code) {
+        case 0: style = TextStyle(); break;
+        case 1: style.set(TextStyle::Bold, true); break;
+        case 2: style.set(TextStyle::Dim, true); break;
+        case 3: style.set(TextStyle::Italic, true); break;
+        case 4: style.set(TextStyle::Underline, true); break;
+        case 7: style.set(TextStyle::Inverse, true); break;
+        case 22:
+            style.set(TextStyle::Bold, false);
+            style.set(TextStyle::Dim, false);
+            break;
+        case 23: style.set(TextStyle::Italic, false); break;
+        case 24: style.set(TextStyle::Underline, false); break;
+        case 27: style.set(TextStyle::Inverse, false); break;
+        case 38: i = extendedColor(i, style.fg); break;
+        case 39: style.fg = TextStyle().fg; break;
+        case 48: i = extendedColor(i, style.bg); break;
+        case 49: style.bg = TextStyle().bg; break;
+        default:
+            if (code >= 30 && code <= 37) style.fg = BaseColors[code - 30];
+            else if (code >= 90 && code <= 97) style.fg = BaseColors[code - 90 + 8];
+            else if (code >= 40 && code <= 47) style.bg = BaseColors[code - 40];
+            else if (code >= 100 && code <= 107) style.bg = BaseColors[code - 100 + 8];
+            break;
+        }
+    }
+    styleId = styles.intern(style);
+}
+
+// Accepts 38;5;n and 38;2;r;g;b, plus the colon forms 38:5:n, 38:2:r:g:b
+// and 38:2:cs:r:g:b with a colour-space id. A truncated sequence leaves
+// the colour alone and swallows the rest of the parameters.
+int AnsiParser::extendedColor(int i, QRgb &color) const {
+    if (i + 1 >= paramCount) return paramCount;
+    const int mode = params[i + 1];
+    if (mode == 5) {
+        if (i + 2 >= paramCount) return paramCount;
+        color = paletteColor(qBound(0, params[i + 2], 255));
+        return i + 2;
+    }
+    if (mode == 2) {
+        int first = i + 2;
+        // Four colon sub-parameters after the mode mean a colour-space id leads.
+        if (colonParams & (1u << (i + 1))) {
+            int subs = 0;
+            while (first + subs < paramCount && (colonParams & (1u << (first + subs)))) ++subs;
+            if (subs >= 4) ++first;
+        }
+        if (first + 2 >= paramCount) return paramCount;
+        color = qRgb(qBound(0, params[first], 255), qBound(0, params[first + 1], 255),
+                     qBound(0, params[first + 2], 255));
+        return first + 2;
+    }
+    return i + 1;
+}
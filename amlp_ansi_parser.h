@@ -0,0 +1,94 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include "amlp_style_table.h"
+#include "amlp_text_codec.h"
+
+// A contiguous run of text sharing one interned style; offsets index StyledText::text.
+struct StyleSpan {
+    int start = 0;
+    int length = 0;
+    StyleId style = 0;
+};
+
+// Decoded output of one feed() call. Reused between calls so the buffers keep their capacity.
+struct StyledText {
+    QString text;
+    QVector<StyleSpan> spans;
+
+    void clear() { text.truncate(0); spans.resize(0); }
+    bool isEmpty() const { return text.isEmpty(); }
+};
+
+// Receives telnet commands that the parser strips out of the inbound stream.
+class TelnetHandler {
+public:
+    virtual ~TelnetHandler() = default;
+    // WILL/WONT/DO/DONT carry an option; other commands (GA, NOP, ...) pass option 0.
+    virtual void telnetCommand(quint8 command, quint8 option) = 0;
+    // Return false to stop the current feed() right after this subnegotiation.
+    virtual bool telnetSubnegotiation(quint8 option, const QByteArray &payload) = 0;
+};
+
+// Incremental telnet/ANSI/UTF-8 decoder. Keeps its state for the lifetime of a
+// connection, so sequences split across reads decode the same as whole ones.
+class AnsiParser {
+public:
+    AnsiParser();
+
+    void setTelnetHandler(TelnetHandler *handler) { telnet = handler; }
+    // Resets the parser state; the encoding stays until set again.
+    void reset();
+    // How bytes 0x80-0xFF decode: UTF-8 (validated) or a single-byte code page.
+    void setEncoding(TextEncoding encoding);
+    TextEncoding encoding() const { return textEncoding; }
+
+    // Decodes len bytes and appends the result to out. Returns the number of
+    // bytes consumed, which is only less than len when the telnet handler
+    // asked to pause the stream.
+    int feed(const char *data, int len, StyledText &out);
+
+    const TextStyle &currentStyle() const { return style; }
+
+    // xterm's 256-colour palette: the 16 ANSI colours, a 6x6x6 cube and a grey ramp.
+    static QRgb paletteColor(int index);
+
+private:
+    enum TelnetState { TnData, TnIac, TnOption, TnSbOption, TnSb, TnSbIac };
+    enum AnsiState { Ground, Escape, EscapeIntermediate, Csi, Osc, OscEscape };
+
+    void putChar(char32_t cp, StyledText &out);
+    // Printable ASCII outside any sequence: appended as one block.
+    void putAscii(const char *data, int length, StyledText &out);
+    void extendSpan(int pos, int added, StyledText &out);
+    void putByte(quint8 b, StyledText &out);
+    void applySgr();
+    // Parses the colour after a 38/48 at params[i]; returns the index of its last parameter.
+    int extendedColor(int i, QRgb &color) const;
+
+    TelnetHandler *telnet = nullptr;
+    TelnetState tnState = TnData;
+    quint8 tnCommand = 0;
+    quint8 sbOption = 0;
+    QByteArray sbBuffer;
+
+    AnsiState ansiState = Ground;
+    static constexpr int MaxParams = 16;
+    int params[MaxParams];
+    int paramCount = 0;
+    // Bit n set when params[n] followed a ':' (ITU T.416 sub-parameters).
+    quint32 colonParams = 0;
+    bool csiPrivate = false;
+
+    TextEncoding textEncoding = TextEncoding::Utf8;
+    char32_t utf8Code = 0;
+    char32_t utf8Min = 0;
+    int utf8Pending = 0;
+
+    TextStyle style;
+    StyleId styleId = 0;
+    StyleCache styles;
+};
@@ -0,0 +1,267 @@
+#include "amlp_automapper.h"
+
+#include <QDir>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include "amlp_command_pipeline.h"
+
+namespace {
+const quint64 LocalKeyBase = quint64(1) << 62;
+// Passed for rooms the server gave no id; server ids are all below LocalKeyBase.
+const quint64 NoKey = ~quint64(0);
+// Unmatched movement commands are forgotten after this; the server
+// probably refused them.
+const int MoveTimeoutMs = 5000;
+const int SaveDelayMs = 30000;
+
+struct Direction {
+    const char *name;
+    const char *longName;
+    const char *reverse;
+    int dx, dy, dz;
+};
+const Direction Directions[] = {
+    {"n", "north", "s", 0, -1, 0},      {"s", "south", "n", 0, 1, 0},
+    {"e", "east", "w", 1, 0, 0},        {"w", "west", "e", -1, 0, 0},
+    {"ne", "northeast", "sw", 1, -1, 0}, {"nw", "northwest", "se", -1, -1, 0},
+    {"se", "southeast", "nw", 1, 1, 0}, {"sw", "southwest", "ne", -1, 1, 0},
+    {"u", "up", "d", 0, 0, 1},          {"d", "down", "u", 0, 0, -1},
+};
+
+const Direction *direction(const QString &name) {
+    for (const Direction &d : Directions)
+        if (name == QLatin1String(d.name)) return &d;
+    return nullptr;
+}
+
+quint64 keyOf(const OobField *f) {
+    if (f->isNumber) return quint64(qint64(f->number)) & (LocalKeyBase - 1);
+    return quint64(qHash(f->text, 0)) & (LocalKeyBase - 1);
+}
+}
+
+QString loadMapTitlePattern(QSettings &settings) {
+    return settings.value("mapper/titlePattern").toString();
+}
+
+void saveMapTitlePattern(QSettings &settings, const QString &pattern) {
+    settings.setValue("mapper/titlePattern", pattern);
+}
+
+Automapper::Automapper(OobDispatcher *dispatcher, QObject *parent)
+    : QObject(parent), nextLocalKey(LocalKeyBase) {
+    saveTimer.setSingleShot(true);
+    saveTimer.setInterval(SaveDelayMs);
+    connect(&saveTimer, &QTimer::timeout, this, &Automapper::save);
+    connect(&saveWatcher, &QFutureWatcher<void>::finished, this, &Automapper::saved);
+    dispatcher->subscribe("Room.Info", [this](const OobUpdate &u) { roomInfo(u); });
+}
+
+Automapper::~Automapper() {
+    flush();
+}
+
+void Automapper::openServer(const QString &host, int port) {
+    flush();
+    QString name = QString("%1_%2").arg(host).arg(port);
+    name.replace(QRegularExpression("[^A-Za-z0-9._-]"), "_");
+    const QDir dir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+    map.open(dir.filePath("maps/" + name + ".amlpmap"));
+    current = MapGraph::None;
+    pendingMoves.clear();
+    gmcpRooms = false;
+    // Keys are sorted in the file, so the last room holds the highest one.
+    const int count = map.roomCount();
+    nextLocalKey = qMax(LocalKeyBase, count > 0 ? map.room(quint32(count - 1)).key + 1 : 0);
+    emit mapChanged();
+    emit roomChanged(current);
+}
+
+void Automapper::setTitlePattern(const QString &pattern) {
+    titlePattern.setPattern(pattern);
+    if (pattern.isEmpty() || !titlePattern.isValid()) titlePattern = QRegularExpression();
+}
+
+QString Automapper::normalizeDirection(const QString &command) {
+    const QString word = command.trimmed().toLower();
+    for (const Direction &d : Directions)
+        if (word == QLatin1String(d.name) || word == QLatin1String(d.longName)) return QLatin1String(d.name);
+    return QString();
+}
+
+void Automapper::commandsSent(const QStringList &commands) {
+    // GMCP says where we are; guessing from commands would only get in the way.
+    if (gmcpRooms || titlePattern.pattern().isEmpty()) return;
+    for (const QString &command : commands) {
+        const QString word = command.trimmed().toLower();
+        QString dir = normalizeDirection(word);
+        // A look shows the room without moving; it places us on a fresh map.
+        if (dir.isEmpty() && (word == "l" || word == "look")) dir = QStringLiteral("look");
+        if (dir.isEmpty()) continue;
+        PendingMove move{dir, QElapsedTimer()};
+        move.sent.start();
+        pendingMoves.enqueue(move);
+    }
+}
+
+void Automapper::lineReceived(const TerminalLine &line) {
+    while (!pendingMoves.isEmpty() && pendingMoves.head().sent.elapsed() > MoveTimeoutMs) pendingMoves.dequeue();
+    if (pendingMoves.isEmpty()) return;
+    const QRegularExpressionMatch m = titlePattern.match(QString::fromUtf8(line.text));
+    if (!m.hasMatch()) return;
+    titleSeen(m.lastCapturedIndex() >= 1 ? m.captured(1).trimmed() : m.captured(0).trimmed());
+}
+
+void Automapper::titleSeen(const QString &title) {
+    const QString dir = pendingMoves.dequeue().direction;
+    if (current == MapGraph::None || dir == QLatin1String("look")) {
+        if (current == MapGraph::None) {
+            current = map.addRoom(nextLocalKey++, title, QString(), 0, 0, 0);
+            touched();
+            emit roomChanged(current);
+        }
+        return;
+    }
+    const quint32 next = roomFor(NoKey, current, dir);
+    map.updateRoom(next, title, QString());
+    moveTo(next);
+}
+
+// Follows a known exit, or maps a new room one step in that direction.
+quint32 Automapper::roomFor(quint64 key, quint32 from, const QString &dir) {
+    if (from != MapGraph::None && !dir.isEmpty()) {
+        const MapGraph::Exit *exits = nullptr;
+        const int count = map.exits(from, exits);
+        for (int i = 0; i < count; ++i)
+            if (map.string(exits[i].name) == dir && (key == NoKey || map.room(exits[i].to).key == key)) return exits[i].to;
+    }
+    if (key != NoKey) {
+        const quint32 known = map.find(key);
+        if (known != MapGraph::None) return known;
+    }
+
+    int x = 0, y = 0, z = 0;
+    const Direction *d = direction(dir);
+    if (from != MapGraph::None) {
+        const MapGraph::Room &origin = map.room(from);
+        x = origin.x + (d ? d->dx : 0);
+        y = origin.y + (d ? d->dy : 0);
+        z = origin.z + (d ? d->dz : 0);
+    }
+    const quint32 room = map.addRoom(key != NoKey ? key : nextLocalKey++, QString(), QString(), x, y, z);
+    if (from != MapGraph::None && !dir.isEmpty()) {
+        map.setExit(from, dir, room);
+        // Without GMCP the way back is assumed to be the opposite direction.
+        if (key == NoKey && d) map.setExit(room, QLatin1String(d->reverse), from);
+    }
+    return room;
+}
+
+void Automapper::roomInfo(const OobUpdate &update) {
+    const OobField *id = update.field("num");
+    if (!id) id = update.field("id");
+    if (!id) id = update.field("vnum");
+    if (!id || (!id->isNumber && id->text.isEmpty())) return;
+    gmcpRooms = true;
+    pendingMoves.clear();
+    const quint64 key = keyOf(id);
+
+    // Which exit of the previous room leads here, for placing a new room.
+    QString via;
+    if (current != MapGraph::None) {
+        const MapGraph::Exit *exits = nullptr;
+        const int count = map.exits(current, exits);
+        for (int i = 0; i < count && via.isEmpty(); ++i)
+            if (map.room(exits[i].to).key == key) via = map.string(exits[i].name);
+    }
+    const quint32 room = roomFor(key, via.isEmpty() ? MapGraph::None : current, via);
+    auto text = [&](const char *name) {
+        const OobField *f = update.field(name);
+        return f ? QString::fromUtf8(f->text) : QString();
+    };
+    map.updateRoom(room, text("name"), text("area").isEmpty() ? text("zone") : text("area"));
+
+    // Exits arrive as "exits.n": 1234. Unvisited targets are mapped as
+    // placeholders so routes can run through them.
+    for (const OobField &f : update.fields) {
+        if (!f.key.startsWith("exits.")) continue;
+        const QString dir = QString::fromUtf8(f.key.mid(6));
+        const QString normal = normalizeDirection(dir);
+        const quint64 target = keyOf(&f);
+        quint32 to = map.find(target);
+        if (to == MapGraph::None) to = roomFor(target, room, normal.isEmpty() ? dir : normal);
+        map.setExit(room, normal.isEmpty() ? dir : normal, to);
+    }
+    moveTo(room);
+}
+
+void Automapper::moveTo(quint32 room) {
+    touched();
+    if (room == current) return;
+    current = room;
+    emit roomChanged(current);
+}
+
+void Automapper::touched() {
+    if (!map.isDirty()) return;
+    emit mapChanged();
+    if (!saveTimer.isActive()) saveTimer.start();
+}
+
+// Sorting and writing a big map takes long enough to stall the output, so
+// it happens on a worker; the map stays in use and takes the new file after.
+void Automapper::save() {
+    saveTimer.stop();
+    if (saveJob || !map.isDirty()) return;
+    saveJob = map.startSave();
+    if (!saveJob) return;
+    const QSharedPointer<MapGraph::SaveJob> job = saveJob;
+    saveWatcher.setFuture(QtConcurrent::run([job]() { MapGraph::writeSave(*job); }));
+}
+
+void Automapper::saved() {
+    if (!saveJob) return;
+    // Saving re-sorts the rooms; find ours again by key.
+    const quint64 key = current != MapGraph::None ? map.room(current).key : NoKey;
+    map.finishSave(saveJob);
+    saveJob.reset();
+    current = key != NoKey ? map.find(key) : MapGraph::None;
+    emit mapChanged();
+    emit roomChanged(current);
+    // Whatever was learned while it was written goes out with the next one.
+    if (map.isDirty() && !saveTimer.isActive()) saveTimer.start();
+}
+
+// Before the map is closed: waits for a save under way, then writes the
+// rest here and now.
+void Automapper::flush() {
+    if (saveJob) {
+        saveWatcher.waitForFinished();
+        saved();
+    }
+    saveTimer.stop();
+    if (!map.isDirty()) return;
+    const quint64 key = current != MapGraph::None ? map.room(current).key : NoKey;
+    map.save();
+    current = key != NoKey ? map.find(key) : MapGraph::None;
+    emit mapChanged();
+    emit roomChanged(current);
+}
+
+quint32 Automapper::findRoom(const QString &query) const {
+    bool isNumber = false;
+    const qint64 id = query.toLongLong(&isNumber);
+    if (isNumber) return map.find(quint64(id));
+    if (current == MapGraph::None) return MapGraph::None;
+    return map.nearest(current, [this, query](quint32 r) {
+        return r != current && map.string(map.room(r).name).contains(query, Qt::CaseInsensitive);
+    });
+}
+
+QString Automapper::routeTo(quint32 room) const {
+    QStringList steps;
+    if (current == MapGraph::None || room == MapGraph::None || !map.route(current, room, steps)) return QString();
+    return CommandPipeline::speedwalkFor(steps);
+}
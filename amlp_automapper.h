@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QObject>
+#include <QQueue>
+#include <QRegularExpression>
+#include <QTimer>
+
+#include "amlp_gmcp.h"
+#include "amlp_line_store.h"
+#include "amlp_map_graph.h"
+
+class QSettings;
+
+// Builds and follows the map of the connected server. Servers that send
+// GMCP Room.Info are tracked from it alone. For the rest, a room-title
+// pattern stands in: a line that matches it after a movement command was
+// sent is taken as arriving through that exit. Maps are kept per server
+// in the application data directory and saved in the background.
+class Automapper : public QObject {
+    Q_OBJECT
+public:
+    explicit Automapper(OobDispatcher *dispatcher, QObject *parent = nullptr);
+    ~Automapper() override;
+
+    // Saves the current map and opens the one for this server.
+    void openServer(const QString &host, int port);
+    // A regular expression; capture 1, if any, is the room name. Empty turns
+    // pattern tracking off.
+    void setTitlePattern(const QString &pattern);
+
+    const MapGraph &graph() const { return map; }
+    quint32 currentRoom() const { return current; }
+    // Only lines after a movement command are of interest.
+    bool wantsLines() const { return !pendingMoves.isEmpty(); }
+    void lineReceived(const TerminalLine &line);
+    // Commands as sent to the server, after aliases and speedwalks.
+    void commandsSent(const QStringList &commands);
+
+    // A room id, or the nearest room whose name contains the text.
+    quint32 findRoom(const QString &query) const;
+    // Speedwalk from the current room (".3n2e(enter portal)"); empty if
+    // there is no known way.
+    QString routeTo(quint32 room) const;
+
+    static QString normalizeDirection(const QString &command);
+
+signals:
+    void roomChanged(quint32 room);
+    // Rooms or exits were added, or indices changed after a save.
+    void mapChanged();
+
+private:
+    struct PendingMove {
+        QString direction;
+        QElapsedTimer sent;
+    };
+
+    void roomInfo(const OobUpdate &update);
+    void titleSeen(const QString &title);
+    quint32 roomFor(quint64 key, quint32 from, const QString &direction);
+    void moveTo(quint32 room);
+    void touched();
+    void save();
+    void saved();
+    void flush();
+
+    MapGraph map;
+    quint32 current = MapGraph::None;
+    QRegularExpression titlePattern;
+    QQueue<PendingMove> pendingMoves;
+    // Servers without room ids get keys from here up, out of any real id's way.
+    quint64 nextLocalKey;
+    bool gmcpRooms = false;
+    QTimer saveTimer;
+    QSharedPointer<MapGraph::SaveJob> saveJob;
+    QFutureWatcher<void> saveWatcher;
+};
+
+QString loadMapTitlePattern(QSettings &settings);
+void saveMapTitlePattern(QSettings &settings, const QString &pattern);
@@ -0,0 +1,72 @@
+#include "amlp_capture_panes.h"
+
+#include <QTabBar>
+
+#include <algorithm>
+
+#include "amlp_terminal_view.h"
+
+namespace {
+const int PaneLines = 5000;
+}
+
+CapturePanes::CapturePanes(QWidget *parent) : QTabWidget(parent) {
+    setDocumentMode(true);
+    connect(this, &QTabWidget::currentChanged, this, &CapturePanes::markRead);
+    hide();
+}
+
+// The views read the stores, so they go first.
+CapturePanes::~CapturePanes() {
+    for (Pane &pane : panes) delete pane.view;
+}
+
+void CapturePanes::setPanes(const QStringList &names) {
+    std::vector<Pane> kept;
+    for (const QString &name : names) {
+        auto it = std::find_if(panes.begin(), panes.end(), [&](const Pane &p) { return p.name == name; });
+        if (it != panes.end()) {
+            kept.push_back(std::move(*it));
+            panes.erase(it);
+            continue;
+        }
+        Pane pane;
+        pane.name = name;
+        pane.store = std::make_unique<LineStore>(PaneLines, 0);
+        pane.view = new TerminalView(pane.store.get(), this);
+        kept.push_back(std::move(pane));
+    }
+    // Whatever is left was removed from the rules.
+    for (Pane &pane : panes) delete pane.view;
+    panes = std::move(kept);
+
+    blockSignals(true);
+    clear();
+    for (const Pane &pane : panes) addTab(pane.view, pane.name);
+    blockSignals(false);
+    setVisible(!panes.empty());
+}
+
+void CapturePanes::append(const QString &pane, TerminalLine &&line) {
+    for (Pane &p : panes) {
+        if (p.name != pane) continue;
+        p.store->append(std::move(line));
+        p.dirty = true;
+        return;
+    }
+}
+
+void CapturePanes::refresh() {
+    for (int i = 0; i < int(panes.size()); ++i) {
+        Pane &pane = panes[i];
+        if (!pane.dirty) continue;
+        pane.dirty = false;
+        pane.store->trim(pane.view->isFollowing());
+        pane.view->storeChanged();
+        if (i != currentIndex()) tabBar()->setTabTextColor(i, QColor("#f0c674"));
+    }
+}
+
+void CapturePanes::markRead(int index) {
+    if (index >= 0) tabBar()->setTabTextColor(index, QColor());
+}
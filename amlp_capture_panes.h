@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QStringList>
+#include <QTabWidget>
+#include <QVector>
+
+#include <memory>
+#include <vector>
+
+#include "amlp_line_store.h"
+
+class TerminalView;
+
+// Tabs above the main output holding the lines capture rules took out of it
+// (chat, tells, loot). Each pane is its own small store and view, capped so
+// a busy channel cannot grow without bound; a tab with unread lines is
+// highlighted until it is shown. Hidden while no rule names a pane.
+class CapturePanes : public QTabWidget {
+    Q_OBJECT
+public:
+    explicit CapturePanes(QWidget *parent = nullptr);
+    ~CapturePanes() override;
+
+    // Panes still named keep their lines; the others are dropped.
+    void setPanes(const QStringList &names);
+    // Lines for panes no longer configured are ignored.
+    void append(const QString &pane, TerminalLine &&line);
+    // Trims and repaints the panes that got lines since the last call; once per frame.
+    void refresh();
+
+private:
+    struct Pane {
+        QString name;
+        std::unique_ptr<LineStore> store;
+        TerminalView *view = nullptr;
+        bool dirty = false;
+    };
+
+    void markRead(int index);
+
+    std::vector<Pane> panes;
+};
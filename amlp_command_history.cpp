@@ -0,0 +1,48 @@
+#include "amlp_command_history.h"
+
+#include <QDir>
+#include <QFile>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+void CommandHistory::open(const QString &host, int port) {
+    QString name = QString("%1_%2").arg(host).arg(port);
+    name.replace(QRegularExpression("[^A-Za-z0-9._-]"), "_");
+    const QDir dir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+    dir.mkpath("history");
+    const QString fileName = dir.filePath("history/" + name + ".txt");
+    if (fileName == path) return;
+    path = fileName;
+
+    items.clear();
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return;
+    const QList<QByteArray> lines = file.readAll().split('\n');
+    file.close();
+    for (const QByteArray &line : lines)
+        if (!line.isEmpty()) items.append(QString::fromUtf8(line));
+    if (items.size() <= MaxEntries) return;
+
+    items = items.mid(items.size() - MaxEntries);
+    QSaveFile out(path);
+    if (!out.open(QIODevice::WriteOnly)) return;
+    out.write(items.join('\n').toUtf8() + '\n');
+    out.commit();
+}
+
+void CommandHistory::add(const QString &command) {
+    if (command.trimmed().isEmpty() || (!items.isEmpty() && items.last() == command)) return;
+    items.append(command);
+    // The file is trimmed on open; in memory, drop the oldest in chunks.
+    if (items.size() > MaxEntries + MaxEntries / 4) items = items.mid(items.size() - MaxEntries);
+    if (path.isEmpty()) return;
+    QFile file(path);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Append)) file.write(command.toUtf8() + '\n');
+}
+
+int CommandHistory::searchBack(const QString &text, int before) const {
+    for (int i = qMin(before, items.size()) - 1; i >= 0; --i)
+        if (items[i].contains(text, Qt::CaseInsensitive)) return i;
+    return -1;
+}
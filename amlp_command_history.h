@@ -0,0 +1,26 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+
+// Commands sent in one session, oldest first, kept per server in the
+// application data directory. Each command is appended to the file as it
+// is sent; the file is cut back to the last MaxEntries when it is opened.
+class CommandHistory {
+public:
+    static constexpr int MaxEntries = 2000;
+
+    // Loads the history for this server; until then commands are only kept in memory.
+    void open(const QString &host, int port);
+    void add(const QString &command);
+
+    int size() const { return items.size(); }
+    const QString &at(int index) const { return items.at(index); }
+    const QStringList &entries() const { return items; }
+    // Newest entry before `before` that contains the text, or -1.
+    int searchBack(const QString &text, int before) const;
+
+private:
+    QStringList items;
+    QString path;
+};
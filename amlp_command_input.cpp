@@ -0,0 +1,160 @@
+#include "amlp_command_input.h"
+
+#include <QKeyEvent>
+#include <QLabel>
+
+CommandInput::CommandInput(QWidget *parent) : QLineEdit(parent) {
+    searchLabel = new QLabel(this);
+    searchLabel->setStyleSheet("color: #f0c674; background: transparent;");
+    searchLabel->hide();
+    connect(this, &QLineEdit::cursorPositionChanged, this, [this]() {
+        if (!completing) candidate = -1;
+    });
+    connect(this, &QLineEdit::textEdited, this, [this]() { candidate = -1; });
+}
+
+void CommandInput::openHistory(const QString &host, int port) {
+    commands.open(host, port);
+    for (const QString &command : commands.entries()) words.addTyped(command);
+    browseIndex = commands.size();
+}
+
+void CommandInput::remember(const QString &command) {
+    commands.add(command);
+    words.addTyped(command);
+    browseIndex = commands.size();
+    draft.clear();
+    candidate = -1;
+}
+
+bool CommandInput::event(QEvent *event) {
+    if (event->type() == QEvent::ShortcutOverride) {
+        const auto *key = static_cast<QKeyEvent *>(event);
+        // Ctrl+R, and every key while searching, belong to the input line.
+        if (searching || (key->key() == Qt::Key_R && key->modifiers() == Qt::ControlModifier)) {
+            event->accept();
+            return true;
+        }
+    }
+    // Tab would move the focus; QWidget handles that before keyPressEvent.
+    if (event->type() == QEvent::KeyPress) {
+        const auto *key = static_cast<QKeyEvent *>(event);
+        const bool tab = key->key() == Qt::Key_Tab || key->key() == Qt::Key_Backtab;
+        if (tab && !(key->modifiers() & (Qt::ControlModifier | Qt::AltModifier)) && !isSecret()) {
+            if (searching) endSearch(true);
+            complete(key->key() == Qt::Key_Backtab ? -1 : 1);
+            return true;
+        }
+    }
+    return QLineEdit::event(event);
+}
+
+void CommandInput::keyPressEvent(QKeyEvent *event) {
+    if (isSecret()) {
+        QLineEdit::keyPressEvent(event);
+        return;
+    }
+    const bool ctrl = event->modifiers() == Qt::ControlModifier;
+    if (searching) {
+        if (ctrl && event->key() == Qt::Key_R) {
+            if (match >= 0) searchFrom(match);
+            return;
+        }
+        if (event->key() == Qt::Key_Escape || (ctrl && event->key() == Qt::Key_G)) {
+            endSearch(false);
+            return;
+        }
+        if (event->key() == Qt::Key_Backspace) {
+            query.chop(1);
+            searchFrom(commands.size());
+            return;
+        }
+        const QString typed = event->text();
+        if (!typed.isEmpty() && typed[0].isPrint() && !(event->modifiers() & (Qt::ControlModifier | Qt::AltModifier))) {
+            query += typed;
+            // The current match is still a candidate for the longer query.
+            searchFrom(match >= 0 ? match + 1 : commands.size());
+            return;
+        }
+        // Anything else (Enter, arrows) takes the match and carries on.
+        endSearch(true);
+    }
+    if (ctrl && event->key() == Qt::Key_R) {
+        startSearch();
+        return;
+    }
+    if (event->modifiers() == Qt::NoModifier && (event->key() == Qt::Key_Up || event->key() == Qt::Key_Down)) {
+        browse(event->key() == Qt::Key_Up ? -1 : 1);
+        return;
+    }
+    QLineEdit::keyPressEvent(event);
+}
+
+void CommandInput::browse(int step) {
+    const int next = browseIndex + step;
+    if (next < 0 || next > commands.size()) return;
+    if (browseIndex == commands.size()) draft = text();
+    browseIndex = next;
+    setText(next == commands.size() ? draft : commands.at(next));
+}
+
+// Candidates cycle, then come back round to the word as typed.
+void CommandInput::complete(int step) {
+    if (candidate < 0) {
+        const QString line = text();
+        const int end = cursorPosition();
+        int start = end;
+        while (start > 0 && !line[start - 1].isSpace() && line[start - 1] != ';') --start;
+        typedWord = line.mid(start, end - start);
+        if (typedWord.isEmpty()) return;
+        candidates = words.complete(typedWord);
+        if (candidates.isEmpty()) return;
+        wordStart = start;
+        candidate = step > 0 ? 0 : candidates.size() - 1;
+    } else {
+        const int cycle = candidates.size() + 1;
+        candidate = (candidate + step + cycle) % cycle;
+    }
+    const QString replacement = candidate < candidates.size() ? candidates[candidate] : typedWord;
+    QString line = text();
+    line.replace(wordStart, cursorPosition() - wordStart, replacement);
+    completing = true;
+    setText(line);
+    setCursorPosition(wordStart + replacement.size());
+    completing = false;
+}
+
+void CommandInput::startSearch() {
+    searching = true;
+    query.clear();
+    match = -1;
+    beforeSearch = text();
+    showSearch(true);
+}
+
+void CommandInput::searchFrom(int before) {
+    const int found = query.isEmpty() ? -1 : commands.searchBack(query, before);
+    if (found >= 0) {
+        match = found;
+        setText(commands.at(found));
+        setCursorPosition(commands.at(found).indexOf(query, 0, Qt::CaseInsensitive));
+    }
+    showSearch(found >= 0 || query.isEmpty());
+}
+
+void CommandInput::endSearch(bool keep) {
+    searching = false;
+    searchLabel->hide();
+    setTextMargins(0, 0, 0, 0);
+    if (!keep) setText(beforeSearch);
+    browseIndex = commands.size();
+}
+
+// The prompt sits inside the line edit, to the left of the text.
+void CommandInput::showSearch(bool found) {
+    searchLabel->setText(QString(found ? "reverse-i-search '%1':" : "failing reverse-i-search '%1':").arg(query));
+    searchLabel->adjustSize();
+    searchLabel->move(4, (height() - searchLabel->height()) / 2);
+    searchLabel->show();
+    setTextMargins(searchLabel->width() + 6, 0, 0, 0);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QLineEdit>
+
+#include "amlp_command_history.h"
+#include "amlp_completion.h"
+
+class QLabel;
+
+// The input line. Up/Down walk the session's command history; Ctrl+R
+// searches it backwards as you type (again for older matches, Esc to
+// cancel); Tab completes the word before the cursor from words typed or
+// seen in the output, and further Tabs (Shift+Tab back) cycle through the
+// other candidates. None of this applies while a password is being typed.
+class CommandInput : public QLineEdit {
+    Q_OBJECT
+public:
+    explicit CommandInput(QWidget *parent = nullptr);
+
+    // Loads the history kept for this server and learns its words.
+    void openHistory(const QString &host, int port);
+    // A command was sent.
+    void remember(const QString &command);
+    CompletionIndex &completion() { return words; }
+
+protected:
+    bool event(QEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+
+private:
+    bool isSecret() const { return echoMode() != QLineEdit::Normal; }
+    void browse(int step);
+    void complete(int step);
+    void startSearch();
+    void searchFrom(int before);
+    void endSearch(bool keep);
+    void showSearch(bool found);
+
+    CommandHistory commands;
+    CompletionIndex words;
+
+    // History position while browsing; size() when on the line being typed.
+    int browseIndex = 0;
+    QString draft;
+
+    // The Tab cycle: where the completed word starts, what was typed, and
+    // which candidate is shown (-1 when not cycling).
+    QStringList candidates;
+    int candidate = -1;
+    int wordStart = 0;
+    QString typedWord;
+    // Set while a completion is written, so the cursor move doesn't end the cycle.
+    bool completing = false;
+
+    QLabel *searchLabel;
+    bool searching = false;
+    QString query;
+    int match = -1;
+    QString beforeSearch;
+};
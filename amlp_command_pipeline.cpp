@@ -0,0 +1,206 @@
+#include "amlp_command_pipeline.h"
+
+#include <QSettings>
+
+namespace {
+// Guards against aliases that expand to themselves.
+const int MaxAliasDepth = 8;
+const int MaxSpeedwalkRepeat = 99;
+}
+
+QVector<Alias> loadAliases(QSettings &settings) {
+    QVector<Alias> aliases;
+    const int n = settings.beginReadArray("aliases");
+    for (int i = 0; i < n; ++i) {
+        settings.setArrayIndex(i);
+        aliases.append(Alias{settings.value("name").toString(), settings.value("expansion").toString()});
+    }
+    settings.endArray();
+    return aliases;
+}
+
+void saveAliases(QSettings &settings, const QVector<Alias> &aliases) {
+    settings.beginWriteArray("aliases", aliases.size());
+    for (int i = 0; i < aliases.size(); ++i) {
+        settings.setArrayIndex(i);
+        settings.setValue("name", aliases[i].name);
+        settings.setValue("expansion", aliases[i].expansion);
+    }
+    settings.endArray();
+}
+
+void CommandPipeline::setAliases(const QVector<Alias> &aliases) {
+    byName.clear();
+    order.clear();
+    for (const Alias &a : aliases) defineAlias(a.name, a.expansion);
+}
+
+QVector<Alias> CommandPipeline::aliases() const {
+    QVector<Alias> out;
+    for (const QString &name : order) out.append(Alias{name, byName.value(name)});
+    return out;
+}
+
+void CommandPipeline::defineAlias(const QString &name, const QString &expansion) {
+    if (name.isEmpty()) return;
+    if (!byName.contains(name)) order.append(name);
+    byName.insert(name, expansion);
+}
+
+bool CommandPipeline::removeAlias(const QString &name) {
+    if (!byName.remove(name)) return false;
+    order.removeOne(name);
+    return true;
+}
+
+void CommandPipeline::expand(const QString &line, QStringList &commands) const {
+    // A bare Enter is a command too.
+    if (line.isEmpty()) {
+        commands.append(QString());
+        return;
+    }
+    expandInto(line, commands, 0);
+}
+
+void CommandPipeline::expandInto(const QString &line, QStringList &commands, int depth) const {
+    if (line.startsWith('#')) {
+        commands.append(line);
+        return;
+    }
+    // Only a whole line walks, so a stacked part such as ".sun" is sent as typed.
+    const QString whole = line.trimmed();
+    if (whole.size() > 1 && whole.startsWith('.') && speedwalk(whole.mid(1), commands)) return;
+
+    for (const QString &raw : splitStack(line)) {
+        const QString part = raw.trimmed();
+        const int space = part.indexOf(' ');
+        const QString word = space < 0 ? part : part.left(space);
+        auto it = byName.constFind(word);
+        if (it == byName.constEnd() || depth >= MaxAliasDepth) {
+            commands.append(part);
+            continue;
+        }
+        QString args = space < 0 ? QString() : part.mid(space + 1).trimmed();
+        // The expansion is split again, so a semicolon typed as "\;" must
+        // stay escaped in it; a client command is not split at all.
+        if (!it.value().startsWith('#')) args.replace(";", "\\;");
+        expandInto(substitute(it.value(), args), commands, depth + 1);
+    }
+}
+
+QStringList CommandPipeline::splitStack(const QString &line) {
+    QStringList parts;
+    QString current;
+    for (int i = 0; i < line.size(); ++i) {
+        const QChar c = line.at(i);
+        if (c == '\\' && i + 1 < line.size() && line.at(i + 1) == ';') {
+            current.append(';');
+            ++i;
+        } else if (c == ';') {
+            parts.append(current);
+            current.clear();
+        } else {
+            current.append(c);
+        }
+    }
+    parts.append(current);
+    return parts;
+}
+
+// $1..$9 are words of the arguments, $* is all of them. An expansion that
+// references none gets the arguments appended, so "k" -> "kill" turns
+// "k orc" into "kill orc".
+QString CommandPipeline::substitute(const QString &expansion, const QString &args) {
+    const QStringList words = args.split(' ', Qt::SkipEmptyParts);
+    QString out;
+    bool referenced = false;
+    for (int i = 0; i < expansion.size(); ++i) {
+        const QChar c = expansion.at(i);
+        if (c == '$' && i + 1 < expansion.size()) {
+            const QChar n = expansion.at(i + 1);
+            if (n == '*') {
+                out += args;
+                referenced = true;
+                ++i;
+                continue;
+            }
+            if (n >= '1' && n <= '9') {
+                out += words.value(n.unicode() - '1');
+                referenced = true;
+                ++i;
+                continue;
+            }
+        }
+        out.append(c);
+    }
+    if (!referenced && !args.isEmpty()) out += ' ' + args;
+    return out;
+}
+
+bool CommandPipeline::speedwalk(const QString &path, QStringList &steps) {
+    QStringList out;
+    for (int i = 0; i < path.size();) {
+        int count = 0;
+        while (i < path.size() && path.at(i).isDigit()) {
+            count = count * 10 + path.at(i).digitValue();
+            if (count > MaxSpeedwalkRepeat) return false;
+            ++i;
+        }
+        if (i >= path.size()) return false;
+        QString dir;
+        const QChar c = path.at(i);
+        if (c == '(') {
+            // "(ne)" or any other exit name
+            const int close = path.indexOf(')', i);
+            if (close < 0) return false;
+            dir = path.mid(i + 1, close - i - 1).trimmed();
+            i = close + 1;
+        } else if (QStringLiteral("nsewud").contains(c)) {
+            dir = c;
+            ++i;
+        } else {
+            return false;
+        }
+        if (dir.isEmpty()) return false;
+        for (int n = qMax(1, count); n > 0; --n) out.append(dir);
+    }
+    if (out.isEmpty()) return false;
+    steps += out;
+    return true;
+}
+
+QString CommandPipeline::speedwalkFor(const QStringList &steps) {
+    if (steps.isEmpty()) return QString();
+    for (const QString &step : steps) {
+        if (step.trimmed().isEmpty() || step.contains(')') || step.contains(';')) {
+            QStringList escaped = steps;
+            for (QString &s : escaped) s.replace(";", "\\;");
+            return escaped.join(';');
+        }
+    }
+    QString out(QLatin1Char('.'));
+    for (int i = 0; i < steps.size();) {
+        const QString &dir = steps[i];
+        int run = 1;
+        while (i + run < steps.size() && steps[i + run] == dir && run < MaxSpeedwalkRepeat) ++run;
+        if (run > 1) out += QString::number(run);
+        if (dir.size() == 1 && QStringLiteral("nsewud").contains(dir))
+            out += dir;
+        else
+            out += '(' + dir.trimmed() + ')';
+        i += run;
+    }
+    return out;
+}
+
+QByteArray CommandPipeline::encode(const QString &command, TextEncoding encoding) {
+    const QByteArray bytes = encodeText(command, encoding);
+    QByteArray out;
+    out.reserve(bytes.size() + 2);
+    for (char c : bytes) {
+        out.append(c);
+        if (quint8(c) == 0xFF) out.append(c);
+    }
+    out.append("\r\n");
+    return out;
+}
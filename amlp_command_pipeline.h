@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "amlp_text_codec.h"
+
+struct Alias {
+    QString name;
+    QString expansion;
+};
+
+class QSettings;
+
+QVector<Alias> loadAliases(QSettings &settings);
+void saveAliases(QSettings &settings, const QVector<Alias> &aliases);
+
+// Turns one typed line into the commands to send: splits ';'-stacked
+// commands ("\;" is a literal semicolon), expands aliases by their first
+// word and unrolls speedwalks such as ".3n2e(ne)". A speedwalk must be the
+// whole line, or an alias's whole expansion; in a stack, ".news" is sent as
+// text. Alias expansions go through the same steps, up to a fixed depth.
+// Lines starting with '#' are left whole for the caller to run as client
+// commands.
+class CommandPipeline {
+public:
+    void setAliases(const QVector<Alias> &aliases);
+    QVector<Alias> aliases() const;
+    void defineAlias(const QString &name, const QString &expansion);
+    bool removeAlias(const QString &name);
+
+    void expand(const QString &line, QStringList &commands) const;
+
+    // Expands a speedwalk body ("3n2e(ne)") into single steps.
+    static bool speedwalk(const QString &path, QStringList &steps);
+    // The other way round: steps to ".3n2e(enter portal)". Steps that do not
+    // fit in parentheses make it a ';'-stacked line instead.
+    static QString speedwalkFor(const QStringList &steps);
+    // Encoded text plus CRLF, with IAC bytes doubled so they reach the server as data.
+    static QByteArray encode(const QString &command, TextEncoding encoding = TextEncoding::Utf8);
+
+private:
+    void expandInto(const QString &line, QStringList &commands, int depth) const;
+    static QStringList splitStack(const QString &line);
+    static QString substitute(const QString &expansion, const QString &args);
+
+    // Keyed by the alias's first word; a command's first word is one probe.
+    QHash<QString, QString> byName;
+    // Definition order, for listing and saving.
+    QStringList order;
+};
@@ -0,0 +1,214 @@
+#include "amlp_completion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+bool wordStart(quint8 c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+bool wordByte(quint8 c) {
+    return wordStart(c) || c == '\'' || c == '-' || c == '_';
+}
+}
+
+CompletionIndex::CompletionIndex() {
+    clear();
+}
+
+void CompletionIndex::clear() {
+    nodes.clear();
+    nodes.append(Node());
+    words.clear();
+    pool.clear();
+    caches.clear();
+    clock.start();
+    base = now();
+}
+
+void CompletionIndex::setClock(std::function<qint64()> ms) {
+    source = std::move(ms);
+    base = now();
+}
+
+// Seconds.
+double CompletionIndex::now() const {
+    return double(source ? source() : clock.elapsed()) / 1000;
+}
+
+void CompletionIndex::addTyped(const QString &command) {
+    const QByteArray utf8 = command.toUtf8();
+    char word[MaxWordLength];
+    int length = 0;
+    for (int i = 0; i <= utf8.size(); ++i) {
+        const char c = i < utf8.size() ? utf8[i] : ' ';
+        if (c != ' ' && c != ';') {
+            if (length < MaxWordLength) word[length] = char(fold(quint8(c)));
+            ++length;
+            continue;
+        }
+        if (length >= 2 && length <= MaxWordLength) touch(word, length, TypedWeight);
+        length = 0;
+    }
+}
+
+void CompletionIndex::addSeen(const QByteArray &utf8) {
+    const char *p = utf8.constData();
+    const int n = utf8.size();
+    char word[MaxWordLength];
+    int i = 0;
+    while (i < n) {
+        while (i < n && !wordStart(quint8(p[i]))) ++i;
+        const int start = i;
+        bool digitsOnly = true;
+        while (i < n && wordByte(quint8(p[i]))) {
+            if (quint8(p[i]) < '0' || quint8(p[i]) > '9') digitsOnly = false;
+            ++i;
+        }
+        int end = i;
+        while (end > start && (p[end - 1] == '\'' || p[end - 1] == '-')) --end;
+        const int length = end - start;
+        // Numbers change with every prompt; they would only crowd out names.
+        if (length < MinSeenLength || length > MaxWordLength || digitsOnly) continue;
+        for (int k = 0; k < length; ++k) word[k] = char(fold(quint8(p[start + k])));
+        touch(word, length, 1);
+    }
+}
+
+// A use at time t adds 2^(t / HalfLifeSec): comparing sums of those ranks
+// the same as comparing counts decayed to the present, without ever
+// touching the other words.
+void CompletionIndex::touch(const char *text, int length, double weight) {
+    const double t = now();
+    if ((t - base) / HalfLifeSec > 60) rescale();
+    add(text, length, weight * std::exp2((t - base) / HalfLifeSec));
+    if (words.size() > MaxWords) prune();
+}
+
+void CompletionIndex::add(const char *text, int length, double amount) {
+    qint32 path[CacheDepth];
+    int cached = 0;
+    qint32 node = 0;
+    for (int i = 0; i < length; ++i) {
+        const quint8 b = quint8(text[i]);
+        qint32 c = nodes[node].firstChild;
+        while (c >= 0 && nodes[c].byte != b) c = nodes[c].nextSibling;
+        if (c < 0) {
+            Node child;
+            child.byte = b;
+            child.nextSibling = nodes[node].firstChild;
+            if (i < CacheDepth) {
+                child.cache = caches.size();
+                caches.insert(caches.size(), CacheSlots, -1);
+            }
+            c = nodes.size();
+            nodes.append(child);
+            nodes[node].firstChild = c;
+        }
+        node = c;
+        if (i < CacheDepth) path[cached++] = node;
+    }
+
+    qint32 w = nodes[node].word;
+    if (w < 0) {
+        Word word;
+        word.text = quint32(pool.size());
+        word.length = quint8(length);
+        pool.append(text, length);
+        w = words.size();
+        words.append(word);
+        nodes[node].word = w;
+    }
+    words[w].score += amount;
+    for (int k = 0; k < cached; ++k) promote(nodes[path[k]].cache, w);
+}
+
+// Moves the word up the cache it just improved in, or into it.
+void CompletionIndex::promote(qint32 cache, qint32 word) {
+    qint32 *ranked = caches.data() + cache;
+    const double score = words[word].score;
+    int at = 0;
+    while (at < CacheSlots && ranked[at] >= 0 && ranked[at] != word) ++at;
+    if (at == CacheSlots) {
+        if (words[ranked[CacheSlots - 1]].score >= score) return;
+        at = CacheSlots - 1;
+    }
+    ranked[at] = word;
+    for (; at > 0 && words[ranked[at - 1]].score < score; --at) std::swap(ranked[at], ranked[at - 1]);
+}
+
+// Scaling every score by the same factor keeps every cache in order.
+void CompletionIndex::rescale() {
+    const double t = now();
+    const double factor = std::exp2(-(t - base) / HalfLifeSec);
+    for (Word &w : words) w.score *= factor;
+    base = t;
+}
+
+void CompletionIndex::prune() {
+    QVector<qint32> order(words.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](qint32 a, qint32 b) { return words[a].score > words[b].score; });
+    const QVector<Word> oldWords = words;
+    const QByteArray oldPool = pool;
+    const double oldBase = base;
+    const QElapsedTimer oldClock = clock;
+    clear();
+    base = oldBase;
+    clock = oldClock;
+    const int keep = MaxWords * 3 / 4;
+    for (int k = 0; k < keep; ++k) {
+        const Word &w = oldWords[order[k]];
+        add(oldPool.constData() + w.text, w.length, w.score);
+    }
+}
+
+QString CompletionIndex::wordText(qint32 word) const {
+    const Word &w = words[word];
+    return QString::fromUtf8(pool.constData() + w.text, w.length);
+}
+
+QStringList CompletionIndex::complete(const QString &prefix, int max) const {
+    const QByteArray key = prefix.toUtf8();
+    if (key.isEmpty() || max <= 0) return {};
+    qint32 node = 0;
+    for (char ch : key) {
+        const quint8 b = fold(quint8(ch));
+        qint32 c = nodes[node].firstChild;
+        while (c >= 0 && nodes[c].byte != b) c = nodes[c].nextSibling;
+        if (c < 0) return {};
+        node = c;
+    }
+
+    QVector<qint32> best;
+    const Node &at = nodes[node];
+    if (at.cache >= 0 && max <= CacheSize) {
+        const qint32 *ranked = caches.constData() + at.cache;
+        for (int k = 0; k < CacheSlots && ranked[k] >= 0 && best.size() < max; ++k)
+            if (ranked[k] != at.word) best.append(ranked[k]);
+    } else {
+        // Deeper prefixes have small subtrees; keep the best `max` on the way.
+        QVector<qint32> stack;
+        if (at.firstChild >= 0) stack.append(at.firstChild);
+        int scanned = 0;
+        while (!stack.isEmpty() && scanned++ < MaxScan) {
+            const qint32 n = stack.takeLast();
+            const Node &entry = nodes[n];
+            if (entry.nextSibling >= 0) stack.append(entry.nextSibling);
+            if (entry.firstChild >= 0) stack.append(entry.firstChild);
+            if (entry.word < 0) continue;
+            const double score = words[entry.word].score;
+            if (best.size() == max && words[best.last()].score >= score) continue;
+            if (best.size() == max) best.removeLast();
+            int pos = best.size();
+            while (pos > 0 && words[best[pos - 1]].score < score) --pos;
+            best.insert(pos, entry.word);
+        }
+    }
+
+    QStringList out;
+    for (qint32 w : best) out.append(wordText(w));
+    return out;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <functional>
+
+// Words for tab completion, from typed commands and server output, in a
+// byte trie over case-folded UTF-8. Each word's score is its use count
+// with older uses decaying (half-life HalfLifeSec), so mob and item names
+// from the current fight rank above last hour's. Typed words count more
+// than seen ones.
+//
+// Nodes down to CacheDepth keep their subtree's best words, kept exact as
+// scores change: a score only ever grows, so a word can only move up. Short
+// prefixes, which have the biggest subtrees, are answered from that cache;
+// longer ones walk their (small) subtree, capped at MaxScan nodes. Either
+// way a lookup stays well under a millisecond with hundreds of thousands
+// of words. Past MaxWords the lowest-ranked quarter is dropped.
+class CompletionIndex {
+public:
+    static constexpr int CacheSize = 8;
+
+    CompletionIndex();
+
+    void addTyped(const QString &command);
+    // One line of server output, UTF-8.
+    void addSeen(const QByteArray &utf8);
+    // Up to max words starting with the prefix, best first, excluding the
+    // prefix itself.
+    QStringList complete(const QString &prefix, int max = CacheSize) const;
+
+    int wordCount() const { return words.size(); }
+    int nodeCount() const { return nodes.size(); }
+    void clear();
+
+    // For tests: a clock in ms to use instead of the wall clock.
+    void setClock(std::function<qint64()> ms);
+
+private:
+    static constexpr int CacheDepth = 4;
+    // One more than is ever returned: a prefix that is a word itself is
+    // left out of its own completions.
+    static constexpr int CacheSlots = CacheSize + 1;
+    static constexpr int MaxWords = 400000;
+    static constexpr int MaxScan = 50000;
+    static constexpr double HalfLifeSec = 20 * 60;
+    static constexpr double TypedWeight = 4;
+    static constexpr int MinSeenLength = 3;
+    static constexpr int MaxWordLength = 40;
+
+    struct Node {
+        qint32 firstChild = -1;
+        qint32 nextSibling = -1;
+        qint32 word = -1;
+        // Offset into caches, for nodes down to CacheDepth.
+        qint32 cache = -1;
+        quint8 byte = 0;
+    };
+    struct Word {
+        double score = 0;
+        quint32 text;    // offset into the text pool
+        quint8 length;
+    };
+
+    static quint8 fold(quint8 c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; }
+    double now() const;
+    void touch(const char *text, int length, double weight);
+    void add(const char *text, int length, double amount);
+    void promote(qint32 cache, qint32 word);
+    void rescale();
+    void prune();
+    QString wordText(qint32 word) const;
+
+    QVector<Node> nodes;
+    QVector<Word> words;
+    QByteArray pool;
+    QVector<qint32> caches;
+    // Scores are kept relative to this time, which moves up now and then
+    // so they stay in range.
+    QElapsedTimer clock;
+    std::function<qint64()> source;
+    double base = 0;
+};
@@ -0,0 +1,98 @@
+#include "amlp_connection_bar.h"
+
+#include <QBoxLayout>
+#include <QLabel>
+#include <QToolButton>
+
+namespace {
+const int TickMs = 100;
+const int ShowReconnectedMs = 3000;
+}
+
+ConnectionBar::ConnectionBar(QWidget *parent) : QWidget(parent) {
+    auto *lay = new QHBoxLayout(this);
+    lay->setContentsMargins(4, 0, 0, 0);
+    status = new QLabel(this);
+    retryButton = new QToolButton(this);
+    retryButton->setText("Reconnect now");
+    stopButton = new QToolButton(this);
+    stopButton->setText("Stop");
+    stopButton->setToolTip("Stop trying to reconnect");
+    auto *closeBtn = new QToolButton(this);
+    closeBtn->setText("x");
+    closeBtn->setToolTip("Hide");
+
+    lay->addWidget(status, 1);
+    lay->addWidget(retryButton);
+    lay->addWidget(stopButton);
+    lay->addWidget(closeBtn);
+
+    tick.setInterval(TickMs);
+    connect(&tick, &QTimer::timeout, this, &ConnectionBar::updateCountdown);
+    hideLater.setSingleShot(true);
+    connect(&hideLater, &QTimer::timeout, this, &ConnectionBar::dismiss);
+    connect(retryButton, &QToolButton::clicked, this, [this]() {
+        tick.stop();
+        status->setText(error.isEmpty() ? QString("Reconnecting...") : error + "  Reconnecting...");
+        emit reconnectRequested();
+    });
+    connect(stopButton, &QToolButton::clicked, this, [this]() {
+        tick.stop();
+        stopButton->hide();
+        status->setText(error.isEmpty() ? QString("Not reconnecting.") : error);
+        emit stopRequested();
+    });
+    connect(closeBtn, &QToolButton::clicked, this, &ConnectionBar::dismiss);
+    hide();
+}
+
+void ConnectionBar::showError(const QString &message) {
+    error = message.endsWith('.') ? message : message + '.';
+    hideLater.stop();
+    tick.stop();
+    status->setStyleSheet("color: #ff6e6e;");
+    status->setText(error);
+    retryButton->show();
+    stopButton->hide();
+    show();
+}
+
+void ConnectionBar::showReconnect(int attemptNumber, int delay) {
+    attempt = attemptNumber;
+    delayMs = delay;
+    hideLater.stop();
+    countdown.start();
+    status->setStyleSheet("color: #ff6e6e;");
+    retryButton->show();
+    stopButton->show();
+    updateCountdown();
+    tick.start();
+    show();
+}
+
+void ConnectionBar::showConnected(const QString &address, int resolveMs, int connectMs) {
+    tick.stop();
+    error.clear();
+    // A plain connect needs no announcement; only recovering from trouble does.
+    if (isHidden()) return;
+    status->setStyleSheet("color: #6efc6e;");
+    status->setText(QString("Reconnected to %1 in %2 ms (lookup %3 ms).").arg(address).arg(resolveMs + connectMs)
+                        .arg(resolveMs));
+    retryButton->hide();
+    stopButton->hide();
+    hideLater.start(ShowReconnectedMs);
+}
+
+void ConnectionBar::dismiss() {
+    tick.stop();
+    hideLater.stop();
+    hide();
+}
+
+void ConnectionBar::updateCountdown() {
+    const double left = qMax<qint64>(0, delayMs - countdown.elapsed()) / 1000.0;
+    QString text = QString("Reconnecting in %1 s (attempt %2)").arg(left, 0, 'f', 1).arg(attempt);
+    if (!error.isEmpty()) text = error + "  " + text;
+    status->setText(text);
+    if (left <= 0) tick.stop();
+}
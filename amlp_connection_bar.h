@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QWidget>
+
+class QLabel;
+class QToolButton;
+
+// Connection trouble as one line under the output instead of a modal box:
+// the error, the countdown to the next reconnect attempt, and buttons to
+// retry now or stop retrying. After a reconnect it says how long that took
+// and hides itself a few seconds later.
+class ConnectionBar : public QWidget {
+    Q_OBJECT
+public:
+    explicit ConnectionBar(QWidget *parent = nullptr);
+
+public slots:
+    void showError(const QString &message);
+    void showReconnect(int attempt, int delayMs);
+    void showConnected(const QString &address, int resolveMs, int connectMs);
+    void dismiss();
+
+signals:
+    void reconnectRequested();
+    void stopRequested();
+
+private:
+    void updateCountdown();
+
+    QLabel *status;
+    QToolButton *retryButton;
+    QToolButton *stopButton;
+    QTimer tick;
+    QTimer hideLater;
+    QElapsedTimer countdown;
+    QString error;
+    int attempt = 0;
+    int delayMs = 0;
+};
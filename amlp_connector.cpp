@@ -0,0 +1,251 @@
+#include "amlp_connector.h"
+
+#include <QCoreApplication>
+#include <QHostInfo>
+#include <QMutexLocker>
+#include <QRandomGenerator>
+#include <QSettings>
+#include <QTcpSocket>
+#include <QTimer>
+
+namespace {
+// Addresses older than this are refreshed, but still used meanwhile.
+const qint64 FreshMs = 10 * 60 * 1000;
+// RFC 8305's recommended Connection Attempt Delay.
+const int AttemptDelayMs = 250;
+// Reconnect backoff. The ceiling is low on purpose: a probe costs one SYN,
+// and the point is to be back within a second of the server.
+const int FirstReconnectMs = 250;
+const int MaxReconnectMs = 1000;
+
+QString statsKey(const QString &host, int port) {
+    QString key = QString("%1:%2").arg(host.trimmed().toLower()).arg(port);
+    // '/' would open a settings group.
+    return "connectStats/" + key.replace('/', '_');
+}
+}
+
+HostCache::HostCache() {
+    clock.start();
+}
+
+HostCache &HostCache::instance() {
+    static HostCache cache;
+    return cache;
+}
+
+void HostCache::resolve(const QString &host, QObject *context, Callback done) {
+    const QHostAddress literal(host);
+    if (!literal.isNull()) {
+        done({literal}, QString());
+        return;
+    }
+    const QString key = host.trimmed().toLower();
+    QList<QHostAddress> cached;
+    bool refresh = false;
+    {
+        QMutexLocker lock(&mutex);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            cached = it->addresses;
+            refresh = !it->refreshing && now() - it->resolvedAt > FreshMs;
+            if (refresh) it->refreshing = true;
+        }
+    }
+    if (cached.isEmpty()) {
+        lookup(key, context, std::move(done));
+        return;
+    }
+    // The refresh belongs to the application, not to whoever asked.
+    if (refresh) lookup(key, QCoreApplication::instance(), nullptr);
+    done(cached, QString());
+}
+
+void HostCache::prefetch(const QStringList &hosts) {
+    for (const QString &host : hosts) {
+        const QString key = host.trimmed().toLower();
+        if (key.isEmpty() || !QHostAddress(key).isNull()) continue;
+        {
+            QMutexLocker lock(&mutex);
+            if (entries.contains(key)) continue;
+            entries[key].refreshing = true;
+        }
+        lookup(key, QCoreApplication::instance(), nullptr);
+    }
+}
+
+void HostCache::lookup(const QString &host, QObject *context, Callback done) {
+    if (resolver) {
+        resolver(host, [this, host, done](const QList<QHostAddress> &addresses, const QString &error) {
+            finished(host, addresses, error, done);
+        });
+        return;
+    }
+    QHostInfo::lookupHost(host, context, [this, host, done](const QHostInfo &info) {
+        finished(host, info.addresses(), info.error() != QHostInfo::NoError ? info.errorString() : QString(), done);
+    });
+}
+
+void HostCache::finished(const QString &host, const QList<QHostAddress> &addresses, const QString &error,
+                         const Callback &done) {
+    {
+        QMutexLocker lock(&mutex);
+        Entry &entry = entries[host];
+        entry.refreshing = false;
+        // A failed refresh keeps the old addresses: on a flaky link they
+        // are more use than nothing.
+        if (!addresses.isEmpty()) {
+            entry.addresses = addresses;
+            entry.resolvedAt = now();
+        } else if (entry.addresses.isEmpty()) {
+            entries.remove(host);
+        }
+    }
+    if (!done) return;
+    if (addresses.isEmpty())
+        done(addresses, error.isEmpty() ? QString("Host not found") : error);
+    else
+        done(addresses, QString());
+}
+
+Connector::Connector(QObject *parent) : QObject(parent) {
+    stagger = new QTimer(this);
+    stagger->setSingleShot(true);
+    connect(stagger, &QTimer::timeout, this, &Connector::startNext);
+    deadline = new QTimer(this);
+    deadline->setSingleShot(true);
+    connect(deadline, &QTimer::timeout, this, [this]() { fail("Connection timed out"); });
+}
+
+void Connector::start(const QString &host, int port, int timeoutMs) {
+    cancel();
+    this->port = quint16(port);
+    active = true;
+    lastError.clear();
+    resolveNs = 0;
+    clock.start();
+    deadline->start(timeoutMs);
+    const quint64 current = generation;
+    HostCache::instance().resolve(host, this, [this, current](const QList<QHostAddress> &addresses,
+                                                              const QString &error) {
+        if (current != generation || !active) return;
+        resolveNs = clock.nsecsElapsed();
+        if (addresses.isEmpty())
+            fail(error);
+        else
+            race(addresses);
+    });
+}
+
+void Connector::cancel() {
+    ++generation;
+    active = false;
+    stagger->stop();
+    deadline->stop();
+    clearAttempts();
+}
+
+QList<QHostAddress> Connector::interleave(const QList<QHostAddress> &addresses) {
+    QList<QHostAddress> first;
+    QList<QHostAddress> second;
+    if (addresses.isEmpty()) return first;
+    const QAbstractSocket::NetworkLayerProtocol lead = addresses.first().protocol();
+    for (const QHostAddress &address : addresses) (address.protocol() == lead ? first : second).append(address);
+    QList<QHostAddress> out;
+    for (int i = 0; i < first.size() || i < second.size(); ++i) {
+        if (i < first.size()) out.append(first[i]);
+        if (i < second.size()) out.append(second[i]);
+    }
+    return out;
+}
+
+void Connector::race(const QList<QHostAddress> &addresses) {
+    pending = interleave(addresses);
+    startNext();
+}
+
+void Connector::startNext() {
+    if (pending.isEmpty()) return;
+    auto *attempt = new QTcpSocket(this);
+    attempts.append(attempt);
+    connect(attempt, &QTcpSocket::connected, this, [this, attempt]() { won(attempt); });
+    connect(attempt, &QAbstractSocket::errorOccurred, this, [this, attempt]() { attemptFailed(attempt); });
+    attempt->connectToHost(pending.takeFirst(), port);
+    if (!pending.isEmpty()) stagger->start(AttemptDelayMs);
+}
+
+void Connector::attemptFailed(QTcpSocket *attempt) {
+    if (!attempts.removeOne(attempt)) return;
+    lastError = attempt->errorString();
+    attempt->disconnect(this);
+    attempt->deleteLater();
+    // A refused address hands over to the next one without waiting.
+    if (!pending.isEmpty())
+        startNext();
+    else if (attempts.isEmpty())
+        fail(lastError);
+}
+
+void Connector::won(QTcpSocket *attempt) {
+    attempts.removeOne(attempt);
+    attempt->disconnect(this);
+    attempt->setParent(nullptr);
+    const qint64 total = clock.nsecsElapsed();
+    cancel();
+    emit connected(attempt, attempt->peerAddress().toString(), resolveNs, total - resolveNs);
+}
+
+void Connector::fail(const QString &error) {
+    cancel();
+    emit failed(error.isEmpty() ? QString("Connection failed") : error);
+}
+
+void Connector::clearAttempts() {
+    pending.clear();
+    for (QTcpSocket *attempt : attempts) {
+        attempt->disconnect(this);
+        attempt->abort();
+        attempt->deleteLater();
+    }
+    attempts.clear();
+}
+
+int reconnectDelayMs(int attempt, QRandomGenerator &random) {
+    const int ceiling = qMin(MaxReconnectMs, FirstReconnectMs << qBound(0, attempt, 8));
+    return ceiling / 2 + int(random.bounded(ceiling / 2 + 1));
+}
+
+void LogoutWatch::setPattern(const QString &text) {
+    pattern = QRegularExpression(text, QRegularExpression::CaseInsensitiveOption);
+    if (!pattern.isValid()) pattern = QRegularExpression();
+}
+
+void LogoutWatch::commandSent(const QString &command) {
+    if (!sent && !pattern.pattern().isEmpty() && pattern.match(command).hasMatch()) sent = true;
+}
+
+QString ConnectStats::summary() const {
+    if (connects == 0) return QString();
+    return QString("%1 connects, last %2 ms, average %3 ms, best %4 ms").arg(connects).arg(lastMs).arg(averageMs)
+        .arg(bestMs);
+}
+
+ConnectStats loadConnectStats(QSettings &settings, const QString &host, int port) {
+    const QList<QVariant> values = settings.value(statsKey(host, port)).toList();
+    ConnectStats stats;
+    if (values.size() < 4) return stats;
+    stats.connects = values[0].toInt();
+    stats.lastMs = values[1].toInt();
+    stats.bestMs = values[2].toInt();
+    stats.averageMs = values[3].toInt();
+    return stats;
+}
+
+void recordConnect(QSettings &settings, const QString &host, int port, int ms) {
+    ConnectStats stats = loadConnectStats(settings, host, port);
+    ++stats.connects;
+    stats.lastMs = ms;
+    stats.bestMs = stats.bestMs < 0 ? ms : qMin(stats.bestMs, ms);
+    stats.averageMs = stats.averageMs < 0 ? ms : (stats.averageMs * 3 + ms) / 4;
+    settings.setValue(statsKey(host, port), QList<QVariant>{stats.connects, stats.lastMs, stats.bestMs, stats.averageMs});
+}
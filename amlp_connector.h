@@ -0,0 +1,155 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QRegularExpression>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+
+class QRandomGenerator;
+class QSettings;
+class QTcpSocket;
+class QTimer;
+
+// Resolved addresses of the hosts we connect to. Saved profiles are looked
+// up in the background at startup so the first connect skips DNS, and a
+// reconnect never waits on it: an entry past its age is still used at once
+// and refreshed behind the connection. Shared by every session; thread-safe.
+class HostCache {
+public:
+    using Callback = std::function<void(const QList<QHostAddress> &addresses, const QString &error)>;
+
+    // Answers a lookup in place of DNS, through the callback, at once or later.
+    using Resolver = std::function<void(const QString &host, Callback answer)>;
+
+    // Sessions share instance(); tests make their own.
+    HostCache();
+    static HostCache &instance();
+
+    // Calls done with the host's addresses: straight away for an IP literal
+    // or a cached host, otherwise once the lookup finishes, on context's thread.
+    void resolve(const QString &host, QObject *context, Callback done);
+    // Starts lookups for the hosts that are not cached yet.
+    void prefetch(const QStringList &hosts);
+
+    // For tests: a clock in ms to use instead of the wall clock, and a
+    // resolver to use instead of DNS.
+    void setClock(std::function<qint64()> ms) { source = std::move(ms); }
+    void setResolver(Resolver resolver) { this->resolver = std::move(resolver); }
+
+private:
+    struct Entry {
+        QList<QHostAddress> addresses;
+        qint64 resolvedAt = 0;
+        bool refreshing = false;
+    };
+
+    qint64 now() const { return source ? source() : clock.elapsed(); }
+    void lookup(const QString &host, QObject *context, Callback done);
+    void finished(const QString &host, const QList<QHostAddress> &addresses, const QString &error,
+                  const Callback &done);
+
+    QMutex mutex;
+    QHash<QString, Entry> entries;
+    QElapsedTimer clock;
+    std::function<qint64()> source;
+    Resolver resolver;
+};
+
+// Opens a TCP connection as RFC 8305 ("happy eyeballs") describes. The
+// host's addresses are tried alternating IPv6 and IPv4, a new attempt
+// starting every 250 ms, or as soon as one fails, while the earlier ones
+// are still pending. The first to connect wins and the rest are dropped, so
+// a dead address family costs a quarter of a second instead of a TCP timeout.
+class Connector : public QObject {
+    Q_OBJECT
+public:
+    // A first connect waits out a slow server; a reconnect gives up sooner
+    // and tries again, so a server that is back is found within moments.
+    static constexpr int ConnectTimeoutMs = 15000;
+    static constexpr int ReconnectTimeoutMs = 2500;
+
+    explicit Connector(QObject *parent = nullptr);
+
+    // Cancels any attempt in progress first. Fails after timeoutMs, the
+    // lookup included.
+    void start(const QString &host, int port, int timeoutMs = ConnectTimeoutMs);
+    void cancel();
+    bool isActive() const { return active; }
+
+    // IPv6 and IPv4 alternating, starting with the family listed first.
+    static QList<QHostAddress> interleave(const QList<QHostAddress> &addresses);
+
+signals:
+    // The receiver takes ownership of the socket. resolveNs is the name
+    // lookup, connectNs the race after it.
+    void connected(QTcpSocket *socket, const QString &address, qint64 resolveNs, qint64 connectNs);
+    void failed(const QString &error);
+
+private:
+    void race(const QList<QHostAddress> &addresses);
+    void startNext();
+    void attemptFailed(QTcpSocket *attempt);
+    void won(QTcpSocket *attempt);
+    void fail(const QString &error);
+    void clearAttempts();
+
+    quint16 port = 0;
+    // Bumped by cancel(), so a lookup finishing late is ignored.
+    quint64 generation = 0;
+    bool active = false;
+    QList<QHostAddress> pending;
+    QVector<QTcpSocket *> attempts;
+    QTimer *stagger;
+    QTimer *deadline;
+    QElapsedTimer clock;
+    qint64 resolveNs = 0;
+    QString lastError;
+};
+
+// Delay before reconnect attempt `attempt` (from 0): doubles from 250 ms up
+// to a 1 s ceiling, drawn from the upper half so sessions dropped together
+// don't all knock at once.
+int reconnectDelayMs(int attempt, QRandomGenerator &random);
+
+// Commands that log out: the server closing after one of them was asked to,
+// so the session is not reconnected.
+const char DefaultQuitPattern[] = "^\\s*(quit|qq|logout)\\s*$";
+
+// Tells a logout from a dropped connection. Once a command sent on the
+// connection matches the pattern, the close that follows is a logout, even
+// if a trigger, ticker or script sends more commands in between; only
+// reset(), for a new connection, forgets it.
+class LogoutWatch {
+public:
+    // Matched case-insensitively; empty or invalid never matches.
+    void setPattern(const QString &pattern);
+    void commandSent(const QString &command);
+    void reset() { sent = false; }
+    bool loggedOut() const { return sent; }
+
+private:
+    QRegularExpression pattern;
+    bool sent = false;
+};
+
+// Connect times kept per profile ("host:port") across runs.
+struct ConnectStats {
+    int connects = 0;
+    int lastMs = -1;
+    int bestMs = -1;
+    // Moving average, weighted towards recent connects.
+    int averageMs = -1;
+
+    // "12 connects, last 84 ms, average 97 ms, best 61 ms", or empty.
+    QString summary() const;
+};
+
+ConnectStats loadConnectStats(QSettings &settings, const QString &host, int port);
+void recordConnect(QSettings &settings, const QString &host, int port, int ms);
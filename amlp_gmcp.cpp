@@ -0,0 +1,335 @@
+#include "amlp_gmcp.h"
+
+#include <QList>
+
+namespace {
+
+enum : quint8 { MsdpVar = 1, MsdpVal = 2, MsdpTableOpen = 3, MsdpTableClose = 4, MsdpArrayOpen = 5, MsdpArrayClose = 6 };
+
+// Cap on fields per message so a hostile payload cannot balloon memory.
+const int MaxFields = 512;
+
+void addField(OobUpdate &update, const QByteArray &key, JsonReader::Token token, const JsonReader &reader) {
+    if (update.fields.size() >= MaxFields) return;
+    OobField f;
+    f.key = key;
+    switch (token) {
+    case JsonReader::Number:
+        f.text = QByteArray(reader.text().constData(), reader.text().size());
+        f.number = reader.number();
+        f.isNumber = true;
+        break;
+    case JsonReader::True:
+        f.text = "true";
+        f.number = 1;
+        f.isNumber = true;
+        break;
+    case JsonReader::False:
+        f.text = "false";
+        f.isNumber = true;
+        break;
+    case JsonReader::String:
+        f.text = QByteArray(reader.text().constData(), reader.text().size());
+        break;
+    default:
+        break;
+    }
+    update.fields.append(f);
+}
+
+QByteArray joinKey(const QByteArray &prefix, const QByteArray &key) {
+    // Always a deep copy: keys may be views into the reader's input.
+    if (prefix.isEmpty()) return QByteArray(key.constData(), key.size());
+    return prefix + '.' + key;
+}
+
+// Reads the value that starts with `token`, recursing into containers.
+bool flattenJson(JsonReader &reader, JsonReader::Token token, const QByteArray &prefix, OobUpdate &update, int depth) {
+    if (depth > 32) return false;
+    switch (token) {
+    case JsonReader::BeginObject:
+        for (;;) {
+            JsonReader::Token t = reader.next();
+            if (t == JsonReader::EndObject) return true;
+            if (t != JsonReader::Key) return false;
+            const QByteArray key = joinKey(prefix, reader.text());
+            if (!flattenJson(reader, reader.next(), key, update, depth + 1)) return false;
+        }
+    case JsonReader::BeginArray:
+        for (int i = 0;; ++i) {
+            JsonReader::Token t = reader.next();
+            if (t == JsonReader::EndArray) return true;
+            if (!flattenJson(reader, t, joinKey(prefix, QByteArray::number(i)), update, depth + 1)) return false;
+        }
+    case JsonReader::String:
+    case JsonReader::Number:
+    case JsonReader::True:
+    case JsonReader::False:
+    case JsonReader::Null:
+        addField(update, prefix, token, reader);
+        return true;
+    default:
+        return false;
+    }
+}
+
+const char *msdpValue(const char *p, const char *end, const QByteArray &key, OobUpdate &update, int depth);
+
+// Parses VAR name VAL value pairs until TABLE_CLOSE or the end of input.
+const char *msdpTable(const char *p, const char *end, const QByteArray &prefix, OobUpdate &update, int depth) {
+    while (p < end) {
+        const quint8 b = quint8(*p);
+        if (b == MsdpTableClose) return p + 1;
+        if (b != MsdpVar) { ++p; continue; }
+        const char *name = ++p;
+        while (p < end && quint8(*p) > MsdpArrayClose) ++p;
+        const QByteArray key = joinKey(prefix, QByteArray(name, int(p - name)));
+        // A VAR may carry several VALs; number them like an array once the
+        // second one shows up.
+        const int first = update.fields.size();
+        int index = 0;
+        while (p < end && quint8(*p) == MsdpVal) {
+            if (index == 1) {
+                const QByteArray renamed = joinKey(key, "0");
+                for (int i = first; i < update.fields.size(); ++i)
+                    update.fields[i].key = renamed + update.fields[i].key.mid(key.size());
+            }
+            const QByteArray valueKey = index == 0 ? key : joinKey(key, QByteArray::number(index));
+            p = msdpValue(p + 1, end, valueKey, update, depth + 1);
+            ++index;
+        }
+    }
+    return p;
+}
+
+const char *msdpValue(const char *p, const char *end, const QByteArray &key, OobUpdate &update, int depth) {
+    if (depth > 32 || p >= end) return end;
+    const quint8 b = quint8(*p);
+    if (b == MsdpTableOpen) return msdpTable(p + 1, end, key, update, depth);
+    if (b == MsdpArrayOpen) {
+        ++p;
+        int index = 0;
+        while (p < end) {
+            const quint8 c = quint8(*p);
+            if (c == MsdpArrayClose) return p + 1;
+            if (c != MsdpVal) { ++p; continue; }
+            p = msdpValue(p + 1, end, joinKey(key, QByteArray::number(index++)), update, depth + 1);
+        }
+        return p;
+    }
+    const char *start = p;
+    while (p < end && quint8(*p) > MsdpArrayClose) ++p;
+    if (update.fields.size() < MaxFields) {
+        OobField f;
+        f.key = key;
+        f.text = QByteArray(start, int(p - start));
+        bool ok = false;
+        f.number = f.text.toDouble(&ok);
+        f.isNumber = ok;
+        update.fields.append(f);
+    }
+    return p;
+}
+
+} // namespace
+
+const OobField *OobUpdate::field(const QByteArray &key) const {
+    for (const OobField &f : fields)
+        if (f.key == key) return &f;
+    return nullptr;
+}
+
+JsonReader::JsonReader(const char *data, int length)
+    : p(data), end(data + length) {
+}
+
+JsonReader::Token JsonReader::next() {
+    for (;;) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == ',' || *p == ':')) ++p;
+        if (p >= end) return depth == 0 ? End : Invalid;
+
+        const char c = *p;
+        if (c == '{' || c == '[') {
+            if (depth == MaxDepth) return Invalid;
+            objectStack[depth++] = c == '{';
+            expectKey = c == '{';
+            ++p;
+            return c == '{' ? BeginObject : BeginArray;
+        }
+        if (c == '}' || c == ']') {
+            if (depth == 0) return Invalid;
+            --depth;
+            expectKey = inObject();
+            ++p;
+            return c == '}' ? EndObject : EndArray;
+        }
+
+        // Anything else is a scalar; inside objects keys and values alternate.
+        const bool isKey = inObject() && expectKey;
+        if (inObject()) expectKey = !expectKey;
+
+        if (c == '"') {
+            if (!readString()) return Invalid;
+            return isKey ? Key : String;
+        }
+        if (isKey) return Invalid;
+        const char *start = p;
+        while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\r' && *p != '\n' && *p != '\t') ++p;
+        value = QByteArray::fromRawData(start, int(p - start));
+        if (value == "true") return True;
+        if (value == "false") return False;
+        if (value == "null") return Null;
+        bool ok = false;
+        numberValue = value.toDouble(&ok);
+        return ok ? Number : Invalid;
+    }
+}
+
+bool JsonReader::readString() {
+    const char *start = ++p;
+    // Fast path: no escapes, hand out a view of the input.
+    while (p < end && *p != '"' && *p != '\\') ++p;
+    if (p < end && *p == '"') {
+        value = QByteArray::fromRawData(start, int(p - start));
+        ++p;
+        return true;
+    }
+    value = QByteArray(start, int(p - start));
+    while (p < end) {
+        const char c = *p++;
+        if (c == '"') return true;
+        if (c != '\\') { value.append(c); continue; }
+        if (p >= end) return false;
+        const char e = *p++;
+        switch (e) {
+        case 'n': value.append('\n'); break;
+        case 't': value.append('\t'); break;
+        case 'r': value.append('\r'); break;
+        case 'b': value.append('\b'); break;
+        case 'f': value.append('\f'); break;
+        case 'u': {
+            if (end - p < 4) return false;
+            bool ok = false;
+            char32_t cp = QByteArray(p, 4).toUInt(&ok, 16);
+            if (!ok) return false;
+            p += 4;
+            // Surrogate pair
+            if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                const char32_t lo = QByteArray(p + 2, 4).toUInt(&ok, 16);
+                if (ok && lo >= 0xDC00 && lo <= 0xDFFF) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    p += 6;
+                }
+            }
+            value.append(QString::fromUcs4(&cp, 1).toUtf8());
+            break;
+        }
+        default: value.append(e); break;
+        }
+    }
+    return false;
+}
+
+bool decodeGmcp(const QByteArray &payload, OobUpdate &update) {
+    const int space = payload.indexOf(' ');
+    update.package = space < 0 ? payload : payload.left(space);
+    update.fields.clear();
+    update.raw = space < 0 ? QByteArray() : payload.mid(space + 1);
+    if (update.package.isEmpty()) return false;
+    if (update.raw.isEmpty()) return true;
+
+    JsonReader reader(update.raw.constData(), update.raw.size());
+    return flattenJson(reader, reader.next(), QByteArray(), update, 0);
+}
+
+bool decodeMsdp(const QByteArray &payload, OobUpdate &update) {
+    update.package = "MSDP";
+    update.fields.clear();
+    update.raw.clear();
+    msdpTable(payload.constData(), payload.constData() + payload.size(), QByteArray(), update, 0);
+    return !update.fields.isEmpty();
+}
+
+QByteArray msdpReport(const QList<QByteArray> &variables) {
+    QByteArray out;
+    out.append(char(MsdpVar));
+    out.append("REPORT");
+    for (const QByteArray &v : variables) {
+        out.append(char(MsdpVal));
+        out.append(v);
+    }
+    return out;
+}
+
+int OobDispatcher::subscribe(const QByteArray &package, Handler handler) {
+    const int id = nextId++;
+    byPackage[package.toLower()].append(Subscription{id, std::move(handler)});
+    return id;
+}
+
+void OobDispatcher::unsubscribe(int id) {
+    if (dispatching > 0) dropped.insert(id);
+    for (auto it = byPackage.begin(); it != byPackage.end(); ++it) {
+        QVector<Subscription> &subs = it.value();
+        for (int i = 0; i < subs.size(); ++i) {
+            if (subs[i].id == id) {
+                subs.remove(i);
+                return;
+            }
+        }
+    }
+}
+
+void OobDispatcher::dispatch(const OobUpdate &update) {
+    if (byPackage.isEmpty()) return;
+    ++dispatching;
+    QByteArray name = update.package.toLower();
+    for (;;) {
+        // Walks a shared copy of the list: a handler that subscribes or
+        // unsubscribes changes the hash, and would otherwise move or free
+        // the list, or the very handler running, under the loop.
+        const QVector<Subscription> subs = byPackage.value(name);
+        for (const Subscription &s : subs)
+            if (dropped.isEmpty() || !dropped.contains(s.id)) s.handler(update);
+        const int dot = name.lastIndexOf('.');
+        if (dot < 0) break;
+        name.truncate(dot);
+    }
+    if (--dispatching == 0) dropped.clear();
+}
+
+bool OobFrameQueue::isEvent(const QByteArray &package) {
+    return qstrnicmp(package.constData(), "Comm.", 5) == 0 || qstricmp(package.constData(), "Room.Info") == 0;
+}
+
+void OobFrameQueue::append(OobUpdate &&update) {
+    if (isEvent(update.package)) {
+        pending.append(std::move(update));
+        return;
+    }
+    auto it = byPackage.constFind(update.package);
+    if (it == byPackage.constEnd()) {
+        byPackage.insert(update.package, pending.size());
+        pending.append(std::move(update));
+        return;
+    }
+    OobUpdate &merged = pending[it.value()];
+    for (OobField &f : update.fields) {
+        bool replaced = false;
+        for (OobField &old : merged.fields) {
+            if (old.key == f.key) {
+                old = std::move(f);
+                replaced = true;
+                break;
+            }
+        }
+        if (!replaced) merged.fields.append(std::move(f));
+    }
+    merged.raw = std::move(update.raw);
+}
+
+void OobFrameQueue::dispatchTo(OobDispatcher &dispatcher) {
+    for (const OobUpdate &update : pending) dispatcher.dispatch(update);
+    pending.clear();
+    byPackage.clear();
+}
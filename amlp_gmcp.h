@@ -0,0 +1,109 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QVector>
+
+#include <functional>
+
+// One scalar from an out-of-band message. Nested objects and arrays are
+// flattened into dotted keys ("exits.n", "affects.0").
+struct OobField {
+    QByteArray key;
+    QByteArray text;
+    double number = 0;
+    bool isNumber = false;
+};
+
+// A decoded GMCP or MSDP message. GMCP keeps its package name
+// ("Char.Vitals"); MSDP messages use the package "MSDP".
+struct OobUpdate {
+    QByteArray package;
+    QVector<OobField> fields;
+    // The GMCP JSON document as received, for consumers that want the structure.
+    QByteArray raw;
+
+    const OobField *field(const QByteArray &key) const;
+};
+
+// Pull-style JSON tokenizer over a byte buffer. Builds no document; only
+// strings containing escapes are copied, into a buffer reused between tokens.
+class JsonReader {
+public:
+    enum Token { Invalid, End, BeginObject, EndObject, BeginArray, EndArray, Key, String, Number, True, False, Null };
+
+    JsonReader(const char *data, int length);
+
+    Token next();
+    // Key, String or Number token text.
+    const QByteArray &text() const { return value; }
+    double number() const { return numberValue; }
+
+private:
+    bool readString();
+    bool inObject() const { return depth > 0 && objectStack[depth - 1]; }
+
+    const char *p;
+    const char *end;
+    QByteArray value;
+    double numberValue = 0;
+    static constexpr int MaxDepth = 32;
+    bool objectStack[MaxDepth];
+    int depth = 0;
+    bool expectKey = false;
+};
+
+// Splits "Package.Name <json>" and flattens the JSON into fields.
+bool decodeGmcp(const QByteArray &payload, OobUpdate &update);
+// Flattens an MSDP subnegotiation (VAR/VAL/TABLE/ARRAY framing) into fields.
+bool decodeMsdp(const QByteArray &payload, OobUpdate &update);
+// Builds an MSDP payload asking the server to report the given variables.
+QByteArray msdpReport(const QList<QByteArray> &variables);
+
+// Routes updates to subscribers by package. A subscription to "Char" also
+// receives "Char.Vitals"; lookups walk up the dotted name, so dispatch costs
+// one hash probe per name segment regardless of how many subscribers exist.
+// Package names are matched case-insensitively, as GMCP asks.
+// Handlers may subscribe and unsubscribe while an update is dispatched: a
+// new subscriber hears from the next update on, and a removed one, even
+// later in the same list, is not called again.
+class OobDispatcher {
+public:
+    using Handler = std::function<void(const OobUpdate &)>;
+
+    int subscribe(const QByteArray &package, Handler handler);
+    void unsubscribe(int id);
+    void dispatch(const OobUpdate &update);
+
+private:
+    struct Subscription {
+        int id;
+        Handler handler;
+    };
+    QHash<QByteArray, QVector<Subscription>> byPackage;
+    int nextId = 1;
+    // Nested dispatches under way, and what was unsubscribed during them.
+    int dispatching = 0;
+    QSet<int> dropped;
+};
+
+// One display frame's out-of-band updates, in arrival order. State packages
+// sent many times a frame (vitals at 20 Hz and up) collapse into one update
+// whose fields hold the latest values. Events are kept one by one: Comm.*
+// messages, and Room.Info, where each message is a move and merging two
+// rooms would hand the last one the exits of both.
+class OobFrameQueue {
+public:
+    void append(OobUpdate &&update);
+    // Dispatches the queued updates in order and empties the queue.
+    void dispatchTo(OobDispatcher &dispatcher);
+    int size() const { return pending.size(); }
+
+    static bool isEvent(const QByteArray &package);
+
+private:
+    QVector<OobUpdate> pending;
+    QHash<QByteArray, int> byPackage;
+};
@@ -0,0 +1,223 @@
+#include "amlp_line_router.h"
+
+#include <QSettings>
+
+namespace {
+const char *const ActionNames[] = {"gag", "highlight", "substitute", "capture"};
+
+LineRule::Action actionFromName(const QString &name) {
+    for (int i = 0; i < 4; ++i)
+        if (name == QLatin1String(ActionNames[i])) return LineRule::Action(i);
+    return LineRule::Highlight;
+}
+
+// One style id per byte while a line is being rewritten; lines are short and
+// only the ones a rule hits get here.
+QVector<StyleId> expandRuns(const TerminalLine &line) {
+    QVector<StyleId> styles(line.text.size(), StyleId(0));
+    int at = 0;
+    for (const StyleRun &run : line.runs) {
+        const int end = qMin<int>(at + int(run.length), styles.size());
+        for (int i = at; i < end; ++i) styles[i] = run.style;
+        at = end;
+    }
+    return styles;
+}
+
+QVector<StyleRun> compressRuns(const QVector<StyleId> &styles) {
+    QVector<StyleRun> runs;
+    for (StyleId id : styles) {
+        if (!runs.isEmpty() && runs.last().style == id)
+            ++runs.last().length;
+        else
+            runs.append({1, id});
+    }
+    if (runs.size() == 1 && runs.first().style == 0) runs.clear();
+    return runs;
+}
+
+// UTF-8 byte offset of every UTF-16 position of text, plus its end.
+QVector<int> byteOffsets(const QString &text) {
+    QVector<int> offsets(text.size() + 1);
+    int bytes = 0;
+    for (int i = 0; i < text.size(); ++i) {
+        offsets[i] = bytes;
+        const char16_t c = text.at(i).unicode();
+        if (c < 0x80)
+            bytes += 1;
+        else if (c < 0x800)
+            bytes += 2;
+        else if (QChar::isHighSurrogate(c) && i + 1 < text.size() && text.at(i + 1).isLowSurrogate())
+            bytes += 4, offsets[++i] = bytes;
+        else
+            bytes += 3;
+    }
+    offsets[text.size()] = bytes;
+    return offsets;
+}
+
+QString expand(const QString &replacement, const QRegularExpressionMatch &m) {
+    QString out;
+    out.reserve(replacement.size());
+    for (int i = 0; i < replacement.size(); ++i) {
+        const QChar c = replacement.at(i);
+        if (c == '$' && i + 1 < replacement.size() && replacement.at(i + 1).isDigit()) {
+            out += m.captured(replacement.at(++i).digitValue());
+            continue;
+        }
+        out += c;
+    }
+    return out;
+}
+}
+
+QVector<LineRule> loadLineRules(QSettings &settings) {
+    QVector<LineRule> rules;
+    const int n = settings.beginReadArray("lineRules");
+    for (int i = 0; i < n; ++i) {
+        settings.setArrayIndex(i);
+        LineRule r;
+        r.pattern = settings.value("pattern").toString();
+        r.action = actionFromName(settings.value("action").toString());
+        r.replacement = settings.value("replacement").toString();
+        const QColor color(settings.value("color").toString());
+        if (color.isValid()) r.color = color.rgb();
+        r.pane = settings.value("pane").toString();
+        r.keep = settings.value("keep", false).toBool();
+        r.regex = settings.value("regex", false).toBool();
+        r.caseSensitive = settings.value("caseSensitive", false).toBool();
+        r.enabled = settings.value("enabled", true).toBool();
+        rules.append(r);
+    }
+    settings.endArray();
+    return rules;
+}
+
+void saveLineRules(QSettings &settings, const QVector<LineRule> &rules) {
+    settings.beginWriteArray("lineRules", rules.size());
+    for (int i = 0; i < rules.size(); ++i) {
+        const LineRule &r = rules[i];
+        settings.setArrayIndex(i);
+        settings.setValue("pattern", r.pattern);
+        settings.setValue("action", QString(ActionNames[r.action]));
+        settings.setValue("replacement", r.replacement);
+        settings.setValue("color", QColor(r.color).name());
+        settings.setValue("pane", r.pane);
+        settings.setValue("keep", r.keep);
+        settings.setValue("regex", r.regex);
+        settings.setValue("caseSensitive", r.caseSensitive);
+        settings.setValue("enabled", r.enabled);
+    }
+    settings.endArray();
+}
+
+void LineRouter::setRules(const QVector<LineRule> &rules) {
+    matcher.clear();
+    actions.clear();
+    for (const LineRule &r : rules) {
+        if (!r.enabled || r.pattern.isEmpty()) continue;
+        if (r.action == LineRule::Capture && r.pane.trimmed().isEmpty()) continue;
+        int flags = r.regex ? PatternMatcher::Regex : PatternMatcher::Literal;
+        if (r.caseSensitive) flags |= PatternMatcher::CaseSensitive;
+        matcher.add(r.pattern, flags);
+        Compiled c;
+        c.rule = r;
+        c.rule.pane = r.pane.trimmed();
+        if (r.action == LineRule::Substitute) {
+            c.expression.setPattern(r.regex ? r.pattern : QRegularExpression::escape(r.pattern));
+            if (!r.caseSensitive) c.expression.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+        }
+        actions.append(c);
+    }
+    matcher.compile();
+}
+
+QStringList LineRouter::paneNames(const QVector<LineRule> &rules) {
+    QStringList names;
+    for (const LineRule &r : rules) {
+        const QString pane = r.pane.trimmed();
+        if (r.enabled && r.action == LineRule::Capture && !pane.isEmpty() && !names.contains(pane))
+            names.append(pane);
+    }
+    return names;
+}
+
+bool LineRouter::route(TerminalLine &line, QVector<CapturedLine> &captured) {
+    if (actions.isEmpty()) return true;
+    hits.clear();
+    matcher.match(line.text, hits);
+    // Every rule sees the line as received; rewrites only change what is shown.
+    for (int index : hits) {
+        const LineRule &rule = actions[index].rule;
+        switch (rule.action) {
+        case LineRule::Gag:
+            return false;
+        case LineRule::Capture:
+            captured.append({rule.pane, line});
+            if (!rule.keep) return false;
+            break;
+        case LineRule::Highlight:
+            highlight(index, line);
+            break;
+        case LineRule::Substitute:
+            substitute(index, line);
+            break;
+        }
+    }
+    return true;
+}
+
+void LineRouter::highlight(int index, TerminalLine &line) {
+    const QString text = QString::fromUtf8(line.text);
+    const QVector<int> offsets = byteOffsets(text);
+    QVector<StyleId> styles = expandRuns(line);
+    const QRgb color = actions[index].rule.color;
+    bool changed = false;
+    int from = 0;
+    int start = 0;
+    int length = 0;
+    while (from < text.size() && matcher.locate(index, text, from, start, length) && length > 0) {
+        for (int i = offsets[start]; i < offsets[start + length]; ++i) {
+            TextStyle style = StyleTable::instance().style(styles[i]);
+            style.fg = color;
+            styles[i] = this->styles.intern(style);
+        }
+        changed = true;
+        from = start + length;
+    }
+    if (changed) line.runs = compressRuns(styles);
+}
+
+void LineRouter::substitute(int index, TerminalLine &line) {
+    const Compiled &c = actions[index];
+    if (!c.expression.isValid()) return;
+    const QString text = QString::fromUtf8(line.text);
+    const QVector<int> offsets = byteOffsets(text);
+    const QVector<StyleId> styles = expandRuns(line);
+    QByteArray outText;
+    QVector<StyleId> outStyles;
+    outText.reserve(line.text.size());
+    outStyles.reserve(styles.size());
+    int copied = 0;
+    bool replacedAny = false;
+    QRegularExpressionMatchIterator it = c.expression.globalMatch(text);
+    while (it.hasNext()) {
+        const QRegularExpressionMatch m = it.next();
+        if (m.capturedLength() == 0) continue;
+        const int begin = offsets[m.capturedStart()];
+        const int end = offsets[m.capturedEnd()];
+        outText.append(line.text.constData() + copied, begin - copied);
+        outStyles.append(styles.mid(copied, begin - copied));
+        // The replacement takes the style the match started with.
+        const QByteArray replaced = expand(c.rule.replacement, m).toUtf8();
+        outText.append(replaced);
+        outStyles.insert(outStyles.size(), replaced.size(), styles.value(begin));
+        copied = end;
+        replacedAny = true;
+    }
+    if (!replacedAny) return;
+    outText.append(line.text.constData() + copied, line.text.size() - copied);
+    outStyles.append(styles.mid(copied));
+    line.text = outText;
+    line.runs = compressRuns(outStyles);
+}
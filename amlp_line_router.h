@@ -0,0 +1,74 @@
+#pragma once
+
+#include <QColor>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "amlp_line_store.h"
+#include "amlp_pattern_matcher.h"
+#include "amlp_style_table.h"
+
+class QSettings;
+
+// A rule applied to each completed server line before it is shown.
+struct LineRule {
+    enum Action { Gag, Highlight, Substitute, Capture };
+
+    QString pattern;
+    Action action = Highlight;
+    // Substitute: replaces each match; $0 is the match, $1-$9 regex groups.
+    QString replacement;
+    // Highlight: foreground of the matched text.
+    QRgb color = qRgb(0xf0, 0xc6, 0x74);
+    // Capture: the pane the line goes to, and whether the main output keeps it too.
+    QString pane;
+    bool keep = false;
+    bool regex = false;
+    bool caseSensitive = false;
+    bool enabled = true;
+};
+
+QVector<LineRule> loadLineRules(QSettings &settings);
+void saveLineRules(QSettings &settings, const QVector<LineRule> &rules);
+
+// A line routed into a capture pane.
+struct CapturedLine {
+    QString pane;
+    TerminalLine line;
+};
+
+// Every enabled rule compiled into one PatternMatcher, so a line is scanned
+// once on its UTF-8 bytes however many rules there are; only lines a
+// highlight or substitution hits are decoded. Rules apply in order: a gag
+// drops the line, a capture copies it (as rewritten so far) to its pane and,
+// unless it keeps it, ends there. Lives on the network worker, so dropped
+// lines never reach the store or the views.
+class LineRouter {
+public:
+    void setRules(const QVector<LineRule> &rules);
+    bool isEmpty() const { return actions.isEmpty(); }
+
+    // Applies the rules to one line. Returns false when the line leaves the
+    // main output; captured copies are appended to `captured`.
+    bool route(TerminalLine &line, QVector<CapturedLine> &captured);
+
+    // The capture panes the rules name, in rule order.
+    static QStringList paneNames(const QVector<LineRule> &rules);
+
+private:
+    struct Compiled {
+        LineRule rule;
+        // Substitutions need the capture groups, so they keep their own.
+        QRegularExpression expression;
+    };
+
+    void highlight(int index, TerminalLine &line);
+    void substitute(int index, TerminalLine &line);
+
+    PatternMatcher matcher;
+    QVector<Compiled> actions;
+    StyleCache styles;
+    QVector<int> hits;
+};
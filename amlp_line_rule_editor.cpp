@@ -0,0 +1,245 @@
+#include "amlp_line_rule_editor.h"
+
+#include <QBoxLayout>
+#include <QCheckBox>
+#include <QColorDialog>
+#include <QComboBox>
+#include <QDialogButtonBox>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QRegularExpression>
+
+// Editor for a single line rule; only the fields its action uses are shown.
+class LineRuleEditor : public QDialog {
+    Q_OBJECT
+public:
+    LineRuleEditor(QWidget *parent = nullptr) : QDialog(parent) {
+        setWindowTitle("Line Rule");
+        auto *lay = new QVBoxLayout(this);
+        patternEdit = new QLineEdit(this);
+        actionBox = new QComboBox(this);
+        actionBox->addItems({"Gag (hide the line)", "Highlight the match", "Substitute the match",
+                             "Capture to a pane"});
+        replacementLabel = new QLabel("Replace with ($0 is the match, $1-$9 groups):", this);
+        replacementEdit = new QLineEdit(this);
+        colorButton = new QPushButton(this);
+        paneLabel = new QLabel("Pane:", this);
+        paneEdit = new QLineEdit(this);
+        paneEdit->setPlaceholderText("chat, tells, loot...");
+        keepBox = new QCheckBox("Also keep in the main output", this);
+        regexBox = new QCheckBox("Regular expression", this);
+        caseBox = new QCheckBox("Case sensitive", this);
+        enabledBox = new QCheckBox("Enabled", this);
+        enabledBox->setChecked(true);
+
+        lay->addWidget(new QLabel("Pattern:", this));
+        lay->addWidget(patternEdit);
+        lay->addWidget(new QLabel("Action:", this));
+        lay->addWidget(actionBox);
+        lay->addWidget(replacementLabel);
+        lay->addWidget(replacementEdit);
+        lay->addWidget(colorButton);
+        lay->addWidget(paneLabel);
+        lay->addWidget(paneEdit);
+        lay->addWidget(keepBox);
+        lay->addWidget(regexBox);
+        lay->addWidget(caseBox);
+        lay->addWidget(enabledBox);
+
+        auto *box = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+        connect(box, &QDialogButtonBox::accepted, this, &LineRuleEditor::validate);
+        connect(box, &QDialogButtonBox::rejected, this, &QDialog::reject);
+        lay->addWidget(box);
+
+        connect(actionBox, &QComboBox::currentIndexChanged, this, &LineRuleEditor::updateFields);
+        connect(colorButton, &QPushButton::clicked, this, [this]() {
+            const QColor chosen = QColorDialog::getColor(QColor(color), this, "Highlight Colour");
+            if (!chosen.isValid()) return;
+            color = chosen.rgb();
+            updateColorButton();
+        });
+        actionBox->setCurrentIndex(LineRule::Highlight);
+        updateColorButton();
+        updateFields();
+    }
+
+    void setRule(const LineRule &r) {
+        patternEdit->setText(r.pattern);
+        actionBox->setCurrentIndex(r.action);
+        replacementEdit->setText(r.replacement);
+        color = r.color;
+        paneEdit->setText(r.pane);
+        keepBox->setChecked(r.keep);
+        regexBox->setChecked(r.regex);
+        caseBox->setChecked(r.caseSensitive);
+        enabledBox->setChecked(r.enabled);
+        updateColorButton();
+        updateFields();
+    }
+
+    LineRule rule() const {
+        LineRule r;
+        r.pattern = patternEdit->text();
+        r.action = LineRule::Action(actionBox->currentIndex());
+        r.replacement = replacementEdit->text();
+        r.color = color;
+        r.pane = paneEdit->text().trimmed();
+        r.keep = keepBox->isChecked();
+        r.regex = regexBox->isChecked();
+        r.caseSensitive = caseBox->isChecked();
+        r.enabled = enabledBox->isChecked();
+        return r;
+    }
+
+private:
+    void updateFields() {
+        const int action = actionBox->currentIndex();
+        replacementLabel->setVisible(action == LineRule::Substitute);
+        replacementEdit->setVisible(action == LineRule::Substitute);
+        colorButton->setVisible(action == LineRule::Highlight);
+        paneLabel->setVisible(action == LineRule::Capture);
+        paneEdit->setVisible(action == LineRule::Capture);
+        keepBox->setVisible(action == LineRule::Capture);
+    }
+
+    void updateColorButton() {
+        const QString name = QColor(color).name();
+        colorButton->setText("Colour: " + name);
+        colorButton->setStyleSheet(QString("color: %1;").arg(name));
+    }
+
+    void validate() {
+        if (patternEdit->text().isEmpty()) {
+            QMessageBox::warning(this, "Invalid", "Please provide a pattern.");
+            return;
+        }
+        if (actionBox->currentIndex() == LineRule::Capture && paneEdit->text().trimmed().isEmpty()) {
+            QMessageBox::warning(this, "Invalid", "Please name the pane to capture to.");
+            return;
+        }
+        if (regexBox->isChecked()) {
+            QRegularExpression re(patternEdit->text());
+            if (!re.isValid()) {
+                QMessageBox::warning(this, "Invalid", "Invalid regular expression: " + re.errorString());
+                return;
+            }
+        }
+        accept();
+    }
+
+    QLineEdit *patternEdit;
+    QComboBox *actionBox;
+    QLabel *replacementLabel;
+    QLineEdit *replacementEdit;
+    QPushButton *colorButton;
+    QLabel *paneLabel;
+    QLineEdit *paneEdit;
+    QCheckBox *keepBox;
+    QCheckBox *regexBox;
+    QCheckBox *caseBox;
+    QCheckBox *enabledBox;
+    QRgb color = LineRule().color;
+};
+
+LineRuleDialog::LineRuleDialog(const QVector<LineRule> &rules, QWidget *parent)
+    : QDialog(parent), list(rules) {
+    setWindowTitle("Line Rules");
+    resize(520, 360);
+
+    auto *mainLay = new QVBoxLayout(this);
+    auto *hint = new QLabel("Rules run in order on every line before it is shown. Use Up/Down to reorder.", this);
+    hint->setWordWrap(true);
+    mainLay->addWidget(hint);
+    listWidget = new QListWidget(this);
+    for (int i = 0; i < list.size(); ++i) {
+        new QListWidgetItem(listWidget);
+        refreshItem(i);
+    }
+    mainLay->addWidget(listWidget);
+
+    auto *btnLay = new QHBoxLayout();
+    QPushButton *addBtn = new QPushButton("Add", this);
+    QPushButton *editBtn = new QPushButton("Edit", this);
+    QPushButton *removeBtn = new QPushButton("Remove", this);
+    QPushButton *upBtn = new QPushButton("Up", this);
+    QPushButton *downBtn = new QPushButton("Down", this);
+    btnLay->addWidget(addBtn);
+    btnLay->addWidget(editBtn);
+    btnLay->addWidget(removeBtn);
+    btnLay->addStretch();
+    btnLay->addWidget(upBtn);
+    btnLay->addWidget(downBtn);
+    mainLay->addLayout(btnLay);
+
+    auto *box = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    connect(box, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(box, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    mainLay->addWidget(box);
+
+    connect(addBtn, &QPushButton::clicked, this, [this]() {
+        LineRuleEditor ed(this);
+        if (ed.exec() != QDialog::Accepted) return;
+        list.append(ed.rule());
+        new QListWidgetItem(listWidget);
+        refreshItem(list.size() - 1);
+    });
+
+    auto edit = [this]() {
+        int row = listWidget->currentRow();
+        if (row < 0) return;
+        LineRuleEditor ed(this);
+        ed.setRule(list[row]);
+        if (ed.exec() != QDialog::Accepted) return;
+        list[row] = ed.rule();
+        refreshItem(row);
+    };
+    connect(editBtn, &QPushButton::clicked, this, edit);
+    connect(listWidget, &QListWidget::itemDoubleClicked, this, edit);
+
+    connect(removeBtn, &QPushButton::clicked, this, [this]() {
+        int row = listWidget->currentRow();
+        if (row < 0) return;
+        if (QMessageBox::question(this, "Confirm", "Delete selected rule?") == QMessageBox::Yes) {
+            list.removeAt(row);
+            delete listWidget->takeItem(row);
+        }
+    });
+
+    auto move = [this](int delta) {
+        const int row = listWidget->currentRow();
+        const int to = row + delta;
+        if (row < 0 || to < 0 || to >= list.size()) return;
+        list.swapItemsAt(row, to);
+        refreshItem(row);
+        refreshItem(to);
+        listWidget->setCurrentRow(to);
+    };
+    connect(upBtn, &QPushButton::clicked, this, [move]() { move(-1); });
+    connect(downBtn, &QPushButton::clicked, this, [move]() { move(1); });
+}
+
+void LineRuleDialog::refreshItem(int row) {
+    const LineRule &r = list[row];
+    QString label = r.regex ? "/" + r.pattern + "/" : r.pattern;
+    switch (r.action) {
+    case LineRule::Gag:
+        label += "  →  gag";
+        break;
+    case LineRule::Highlight:
+        label += "  →  highlight " + QColor(r.color).name();
+        break;
+    case LineRule::Substitute:
+        label += "  →  \"" + r.replacement + "\"";
+        break;
+    case LineRule::Capture:
+        label += "  →  pane " + r.pane + (r.keep ? " (kept)" : "");
+        break;
+    }
+    if (!r.enabled) label += "  (disabled)";
+    listWidget->item(row)->setText(label);
+}
+
+#include "amlp_line_rule_editor.moc"
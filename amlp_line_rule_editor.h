@@ -0,0 +1,21 @@
+#pragma once
+
+#include <QDialog>
+#include <QVector>
+
+#include "amlp_line_router.h"
+
+class QListWidget;
+
+class LineRuleDialog : public QDialog {
+    Q_OBJECT
+public:
+    explicit LineRuleDialog(const QVector<LineRule> &rules, QWidget *parent = nullptr);
+    QVector<LineRule> rules() const { return list; }
+
+private:
+    void refreshItem(int row);
+
+    QListWidget *listWidget;
+    QVector<LineRule> list;
+};
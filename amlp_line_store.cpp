@@ -0,0 +1,171 @@
+#include "amlp_line_store.h"
+
+#include <QDataStream>
+
+namespace {
+
+// Lines are evicted in batches so trimming is amortized O(1) per line.
+const int EvictBatch = 512;
+// A pinned reader keeps lines only until the store holds this many caps.
+const int PinnedCaps = 3;
+
+void serializeLines(QDataStream &out, const QList<TerminalLine> &lines, int count) {
+    out << quint32(count);
+    for (int i = 0; i < count; ++i) {
+        const TerminalLine &line = lines.at(i);
+        out << line.text << quint32(line.runs.size());
+        for (const StyleRun &run : line.runs)
+            out << run.length << run.style;
+    }
+}
+
+QList<TerminalLine> deserializeLines(const QByteArray &raw) {
+    QDataStream in(raw);
+    quint32 count = 0;
+    in >> count;
+    QList<TerminalLine> lines;
+    lines.reserve(int(count));
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        TerminalLine line;
+        quint32 runCount = 0;
+        in >> line.text >> runCount;
+        line.runs.reserve(int(runCount));
+        for (quint32 r = 0; r < runCount; ++r) {
+            StyleRun run{0, 0};
+            in >> run.length >> run.style;
+            line.runs.append(run);
+        }
+        lines.append(std::move(line));
+    }
+    return lines;
+}
+
+} // namespace
+
+void LineAssembler::feed(const StyledText &styled, QVector<TerminalLine> &completed) {
+    for (const StyleSpan &span : styled.spans)
+        feed(styled.text.constData() + span.start, span.length, span.style, completed);
+}
+
+void LineAssembler::feed(const QChar *text, int length, StyleId style, QVector<TerminalLine> &completed) {
+    int start = 0;
+    for (int i = 0; i < length; ++i) {
+        if (text[i] != QLatin1Char('\n')) continue;
+        appendRun(text + start, i - start, style);
+        // A single default-styled run carries no information; drop it.
+        if (current.runs.size() == 1 && current.runs.first().style == 0)
+            current.runs.clear();
+        completed.append(std::move(current));
+        current = TerminalLine();
+        start = i + 1;
+    }
+    appendRun(text + start, length - start, style);
+}
+
+bool LineAssembler::endPrompt(StyledText &pending) const {
+    const int lineStart = int(pending.text.lastIndexOf(QLatin1Char('\n'))) + 1;
+    if (lineStart == pending.text.size() && (lineStart > 0 || current.text.isEmpty())) return false;
+    pending.spans.append(StyleSpan{int(pending.text.size()), 1, 0});
+    pending.text.append(QLatin1Char('\n'));
+    return true;
+}
+
+void LineAssembler::appendRun(const QChar *text, int length, StyleId style) {
+    if (length <= 0) return;
+    QByteArray &out = current.text;
+    const int before = out.size();
+    for (int i = 0; i < length; ++i) {
+        char32_t cp = text[i].unicode();
+        if (cp < 0x80) {
+            out.append(char(cp));
+            continue;
+        }
+        if (QChar::isHighSurrogate(cp) && i + 1 < length && text[i + 1].isLowSurrogate())
+            cp = QChar::surrogateToUcs4(text[i].unicode(), text[++i].unicode());
+        if (cp < 0x800) {
+            out.append(char(0xC0 | (cp >> 6)));
+        } else if (cp < 0x10000) {
+            out.append(char(0xE0 | (cp >> 12)));
+            out.append(char(0x80 | ((cp >> 6) & 0x3F)));
+        } else {
+            out.append(char(0xF0 | (cp >> 18)));
+            out.append(char(0x80 | ((cp >> 12) & 0x3F)));
+            out.append(char(0x80 | ((cp >> 6) & 0x3F)));
+        }
+        out.append(char(0x80 | (cp & 0x3F)));
+    }
+
+    const quint32 added = quint32(out.size() - before);
+    if (!current.runs.isEmpty() && current.runs.last().style == style)
+        current.runs.last().length += added;
+    else
+        current.runs.append(StyleRun{added, style});
+}
+
+LineStore::LineStore(int maxLines, int archiveKB)
+    : lineCap(maxLines), archived(archiveKB) {
+}
+
+void LineStore::setLimits(int maxLines, int archiveKB) {
+    lineCap = maxLines;
+    archived.setMaxKB(archiveKB);
+}
+
+void LineStore::append(TerminalLine &&line) {
+    storedBytes += line.text.size();
+    lines.append(std::move(line));
+}
+
+const TerminalLine &LineStore::at(qint64 seq) const {
+    const qint64 i = seq - baseSeq;
+    if (i >= 0 && i < lines.size()) return lines.at(int(i));
+    return partialLine;
+}
+
+int LineStore::trim(bool following, qint64 pinned) {
+    if (lineCap <= 0) return 0;
+    const int limit = following ? lineCap : lineCap * 2;
+    if (lines.size() <= limit + EvictBatch) return 0;
+
+    int n = lines.size() - limit;
+    if (pinned >= 0 && pinned - baseSeq < n) {
+        const int overCeiling = qMax(0, lines.size() - lineCap * PinnedCaps);
+        n = int(qMax<qint64>(overCeiling, pinned - baseSeq));
+        if (n < EvictBatch) return 0;
+    }
+    // Serialized only when the archive would keep them; the capture panes
+    // have no archive and just drop their oldest lines.
+    if (archived.hasRoom()) {
+        QByteArray raw;
+        {
+            QDataStream out(&raw, QIODevice::WriteOnly);
+            serializeLines(out, lines, n);
+        }
+        archived.push(raw, n);
+    } else {
+        archived.clear();
+    }
+    for (int i = 0; i < n; ++i) storedBytes -= lines.at(i).text.size();
+    // QList keeps free space at the front, so this does not move the survivors.
+    lines.remove(0, n);
+    baseSeq += n;
+    return n;
+}
+
+QList<TerminalLine> LineStore::unpack(const QByteArray &chunk) {
+    return deserializeLines(qUncompress(chunk));
+}
+
+int LineStore::pageIn() {
+    QByteArray raw;
+    int n = 0;
+    if (!archived.takeNewest(raw, n)) return 0;
+    Q_UNUSED(n);
+    QList<TerminalLine> restored = deserializeLines(raw);
+    const int restoredCount = restored.size();
+    for (const TerminalLine &line : restored) storedBytes += line.text.size();
+    restored.append(std::move(lines));
+    lines = std::move(restored);
+    baseSeq -= restoredCount;
+    return restoredCount;
+}
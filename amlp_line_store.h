@@ -0,0 +1,98 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+
+#include "amlp_ansi_parser.h"
+#include "amlp_scrollback.h"
+
+// Run-length style: the next `length` bytes of a line's UTF-8 text share the
+// interned style `style` (see StyleTable).
+struct StyleRun {
+    quint32 length;
+    StyleId style;
+};
+
+// One output line stored as UTF-8 plus run-length styles. An empty run list
+// means the whole line uses the default style, which is the common case.
+struct TerminalLine {
+    QByteArray text;
+    QVector<StyleRun> runs;
+};
+
+// Splits decoded output into lines and encodes them for the store.
+class LineAssembler {
+public:
+    // Appends every line terminated by this chunk to `completed`; the
+    // unterminated remainder is kept and exposed as partial().
+    void feed(const QChar *text, int length, StyleId style, QVector<TerminalLine> &completed);
+    void feed(const QChar *text, int length, const TextStyle &style, QVector<TerminalLine> &completed) {
+        feed(text, length, styles.intern(style), completed);
+    }
+    void feed(const StyledText &styled, QVector<TerminalLine> &completed);
+
+    // A prompt mark (telnet GA/EOR) arrived after `pending` was decoded but
+    // before it was fed: ends the line in progress with a newline in
+    // `pending`, unless that line is empty. Returns whether it did.
+    bool endPrompt(StyledText &pending) const;
+
+    const TerminalLine &partial() const { return current; }
+    void reset() { current = TerminalLine(); }
+
+private:
+    void appendRun(const QChar *text, int length, StyleId style);
+
+    TerminalLine current;
+    StyleCache styles;
+};
+
+// Append-only line buffer addressed by absolute sequence numbers, so readers
+// keep valid positions while old lines are evicted from the front. Lines past
+// the cap are compressed into a ScrollbackArchive and can be paged back in.
+class LineStore {
+public:
+    explicit LineStore(int maxLines = DefaultScrollbackLines, int archiveKB = DefaultArchiveKB);
+
+    void setLimits(int maxLines, int archiveKB);
+    int maxLines() const { return lineCap; }
+
+    void append(TerminalLine &&line);
+    // The trailing line that has no newline yet (usually a prompt).
+    void setPartial(const TerminalLine &line) { partialLine = line; }
+
+    // Evicts whole batches of the oldest lines once over the cap. While the
+    // user is reading history the cap is doubled so lines do not vanish
+    // under them, and nothing from `pinned` on is evicted until the store
+    // holds three times the cap; past that the oldest lines go regardless
+    // and can be paged back in. Returns the number of lines evicted.
+    int trim(bool following, qint64 pinned = -1);
+    // Restores the most recently evicted batch in front of firstSeq().
+    int pageIn();
+
+    qint64 firstSeq() const { return baseSeq; }
+    // Sequence number of the partial line, one past the last complete line.
+    qint64 endSeq() const { return baseSeq + lines.size(); }
+    bool hasPartial() const { return !partialLine.text.isEmpty(); }
+    // Complete lines plus the partial line, if any.
+    int count() const { return lines.size() + (hasPartial() ? 1 : 0); }
+    const TerminalLine &at(qint64 seq) const;
+
+    qint64 textBytes() const { return storedBytes; }
+    const ScrollbackArchive &archive() const { return archived; }
+    // Index bytes kept for this store's lines, taken out of the archive cap.
+    void setArchiveReserve(qint64 bytes) { archived.setReservedBytes(bytes); }
+
+    // The complete lines, implicitly shared for reading on another thread.
+    QList<TerminalLine> snapshot() const { return lines; }
+    // Decodes one ScrollbackArchive chunk; safe on any thread.
+    static QList<TerminalLine> unpack(const QByteArray &chunk);
+
+private:
+    QList<TerminalLine> lines;
+    TerminalLine partialLine;
+    qint64 baseSeq = 0;
+    qint64 storedBytes = 0;
+    int lineCap;
+    ScrollbackArchive archived;
+};
@@ -0,0 +1,64 @@
+#include "amlp_log_settings.h"
+
+#include <QBoxLayout>
+#include <QCheckBox>
+#include <QComboBox>
+#include <QDialogButtonBox>
+#include <QFileDialog>
+#include <QIntValidator>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPushButton>
+
+LogSettingsDialog::LogSettingsDialog(const LogOptions &options, QWidget *parent) : QDialog(parent) {
+    setWindowTitle("Session Logging");
+    auto *lay = new QVBoxLayout(this);
+    enabledBox = new QCheckBox("Log every session", this);
+    enabledBox->setChecked(options.enabled);
+    directoryEdit = new QLineEdit(options.directory, this);
+    auto *browseBtn = new QPushButton("Browse...", this);
+    formatBox = new QComboBox(this);
+    formatBox->addItems({"Plain text", "ANSI (colours kept)", "HTML"});
+    formatBox->setCurrentIndex(int(options.format));
+    compressBox = new QCheckBox("Compress (gzip, with a block index for seeking)", this);
+    compressBox->setChecked(options.compress);
+    rotateMBEdit = new QLineEdit(QString::number(options.rotateMB), this);
+    rotateMBEdit->setValidator(new QIntValidator(0, 1024 * 1024, this));
+    rotateHoursEdit = new QLineEdit(QString::number(options.rotateHours), this);
+    rotateHoursEdit->setValidator(new QIntValidator(0, 24 * 365, this));
+
+    lay->addWidget(enabledBox);
+    lay->addWidget(new QLabel("Directory:", this));
+    auto *dirLay = new QHBoxLayout();
+    dirLay->addWidget(directoryEdit, 1);
+    dirLay->addWidget(browseBtn);
+    lay->addLayout(dirLay);
+    lay->addWidget(new QLabel("Format:", this));
+    lay->addWidget(formatBox);
+    lay->addWidget(compressBox);
+    lay->addWidget(new QLabel("Start a new file after (MB of text, 0 = never):", this));
+    lay->addWidget(rotateMBEdit);
+    lay->addWidget(new QLabel("Start a new file after (hours, 0 = never):", this));
+    lay->addWidget(rotateHoursEdit);
+
+    connect(browseBtn, &QPushButton::clicked, this, [this]() {
+        const QString dir = QFileDialog::getExistingDirectory(this, "Log directory", directoryEdit->text());
+        if (!dir.isEmpty()) directoryEdit->setText(dir);
+    });
+
+    auto *box = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    connect(box, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(box, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    lay->addWidget(box);
+}
+
+LogOptions LogSettingsDialog::options() const {
+    LogOptions o;
+    o.enabled = enabledBox->isChecked() && !directoryEdit->text().trimmed().isEmpty();
+    o.directory = directoryEdit->text().trimmed();
+    o.format = LogOptions::Format(formatBox->currentIndex());
+    o.compress = compressBox->isChecked();
+    o.rotateMB = rotateMBEdit->text().toInt();
+    o.rotateHours = rotateHoursEdit->text().toInt();
+    return o;
+}
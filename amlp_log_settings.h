@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QDialog>
+
+#include "amlp_session_log.h"
+
+class QCheckBox;
+class QComboBox;
+class QLineEdit;
+
+class LogSettingsDialog : public QDialog {
+    Q_OBJECT
+public:
+    explicit LogSettingsDialog(const LogOptions &options, QWidget *parent = nullptr);
+    LogOptions options() const;
+
+private:
+    QCheckBox *enabledBox;
+    QLineEdit *directoryEdit;
+    QComboBox *formatBox;
+    QCheckBox *compressBox;
+    QLineEdit *rotateMBEdit;
+    QLineEdit *rotateHoursEdit;
+};
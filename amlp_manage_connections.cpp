@@ -12,6 +12,15 @@
 #include <QLineEdit>
 #include <QLabel>
 #include <QIntValidator>
+#include <QComboBox>
+#include <QPlainTextEdit>
+#include <QSettings>
+
+#include "amlp_connector.h"
+#include "amlp_profile_store.h"
+#include "amlp_scrollback.h"
+#include "amlp_text_codec.h"
+#include "amlp_trigger_editor.h"
 
 // Simple editor dialog for single connection
 class ConnectionEditor : public QDialog {
@@ -24,6 +33,18 @@ public:
         ipEdit = new QLineEdit(this);
         portEdit = new QLineEdit(this);
         portEdit->setValidator(new QIntValidator(1, 65535, this));
+        linesEdit = new QLineEdit(QString::number(DefaultScrollbackLines), this);
+        linesEdit->setValidator(new QIntValidator(100, 10000000, this));
+        archiveEdit = new QLineEdit(QString::number(DefaultArchiveKB), this);
+        archiveEdit->setValidator(new QIntValidator(0, 4 * 1024 * 1024, this));
+        charsetBox = new QComboBox(this);
+        charsetBox->addItem("UTF-8", QString(encodingName(TextEncoding::Utf8)));
+        charsetBox->addItem("Latin-1 (ISO-8859-1)", QString(encodingName(TextEncoding::Latin1)));
+        charsetBox->addItem("DOS (CP437)", QString(encodingName(TextEncoding::Cp437)));
+        triggersButton = new QPushButton(this);
+        aliasesEdit = new QPlainTextEdit(this);
+        aliasesEdit->setPlaceholderText("One per line: name = expansion");
+        aliasesEdit->setMaximumHeight(80);
 
         lay->addWidget(new QLabel("Display name:", this));
         lay->addWidget(nameEdit);
@@ -31,45 +52,94 @@ public:
         lay->addWidget(ipEdit);
         lay->addWidget(new QLabel("Port:", this));
         lay->addWidget(portEdit);
+        lay->addWidget(new QLabel("Scrollback lines:", this));
+        lay->addWidget(linesEdit);
+        lay->addWidget(new QLabel("Scrollback archive (KB):", this));
+        lay->addWidget(archiveEdit);
+        lay->addWidget(new QLabel("Character set:", this));
+        lay->addWidget(charsetBox);
+        lay->addWidget(new QLabel("Aliases for this connection only:", this));
+        lay->addWidget(aliasesEdit);
+        lay->addWidget(triggersButton);
 
         auto *box = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
         connect(box, &QDialogButtonBox::accepted, this, &QDialog::accept);
         connect(box, &QDialogButtonBox::rejected, this, &QDialog::reject);
         lay->addWidget(box);
+
+        connect(triggersButton, &QPushButton::clicked, this, [this]() {
+            TriggerDialog dlg(triggers, this);
+            if (dlg.exec() != QDialog::Accepted) return;
+            triggers = dlg.triggers();
+            updateTriggersButton();
+        });
+        updateTriggersButton();
     }
 
-    void setValues(const QString &name, const QString &ip, int port) {
-        nameEdit->setText(name);
-        ipEdit->setText(ip);
-        portEdit->setText(QString::number(port));
+    void setProfile(const Profile &p) {
+        nameEdit->setText(p.name);
+        ipEdit->setText(p.host);
+        portEdit->setText(QString::number(p.port));
+        linesEdit->setText(QString::number(p.scrollbackLines));
+        archiveEdit->setText(QString::number(p.archiveKB));
+        charsetBox->setCurrentIndex(qMax(0, charsetBox->findData(QString(encodingName(p.encoding)))));
+        QStringList lines;
+        for (const Alias &a : p.aliases) lines.append(a.name + " = " + a.expansion);
+        aliasesEdit->setPlainText(lines.join('\n'));
+        triggers = p.triggers;
+        updateTriggersButton();
     }
 
-    QString name() const { return nameEdit->text().trimmed(); }
-    QString ip() const { return ipEdit->text().trimmed(); }
-    int port() const { return portEdit->text().toInt(); }
+    Profile profile() const {
+        Profile p;
+        p.name = nameEdit->text().trimmed();
+        p.host = ipEdit->text().trimmed();
+        p.port = portEdit->text().toInt();
+        p.scrollbackLines = linesEdit->text().toInt();
+        p.archiveKB = archiveEdit->text().toInt();
+        p.encoding = encodingFromName(charsetBox->currentData().toString().toLatin1());
+        p.triggers = triggers;
+        for (const QString &line : aliasesEdit->toPlainText().split('\n')) {
+            const int eq = line.indexOf('=');
+            const QString name = line.left(eq).trimmed();
+            if (eq <= 0 || name.isEmpty()) continue;
+            p.aliases.append(Alias{name, line.mid(eq + 1).trimmed()});
+        }
+        return p;
+    }
 
 private:
+    void updateTriggersButton() {
+        triggersButton->setText(QString("Triggers for this connection only (%1)...").arg(triggers.size()));
+    }
+
     QLineEdit *nameEdit;
     QLineEdit *ipEdit;
     QLineEdit *portEdit;
+    QLineEdit *linesEdit;
+    QLineEdit *archiveEdit;
+    QComboBox *charsetBox;
+    QPushButton *triggersButton;
+    QPlainTextEdit *aliasesEdit;
+    QVector<Trigger> triggers;
 };
 
-static QStringList parseEntry(const QString &entry) {
-    return entry.split('|');
+static bool validProfile(QWidget *parent, const Profile &p) {
+    if (!p.name.isEmpty() && !p.host.isEmpty() && p.port > 0) return true;
+    QMessageBox::warning(parent, "Invalid", "Please provide a name, hostname and valid port.");
+    return false;
 }
 
-ManageConnectionsDialog::ManageConnectionsDialog(const QStringList &connections, QWidget *parent)
-    : QDialog(parent), connList(connections) {
+ManageConnectionsDialog::ManageConnectionsDialog(ProfileStore *store, QWidget *parent)
+    : QDialog(parent), store(store) {
     setWindowTitle("Manage Connections");
     resize(480, 360);
 
     auto *mainLay = new QVBoxLayout(this);
     listWidget = new QListWidget(this);
-    for (const QString &e : connList) {
-        auto parts = parseEntry(e);
-        QString name = parts.value(0, e);
-        QListWidgetItem *it = new QListWidgetItem(name, listWidget);
-        it->setData(Qt::UserRole, e);
+    for (int i = 0; i < store->count(); ++i) {
+        new QListWidgetItem(listWidget);
+        refreshItem(i);
     }
     mainLay->addWidget(listWidget);
 
@@ -93,70 +163,56 @@ ManageConnectionsDialog::ManageConnectionsDialog(const QStringList &connections,
     mainLay->addLayout(btnLay);
 
     auto *box = new QDialogButtonBox(QDialogButtonBox::Close, this);
-    connect(box, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    connect(box, &QDialogButtonBox::rejected, this, &QDialog::accept);
     mainLay->addWidget(box);
 
     connect(addBtn, &QPushButton::clicked, this, [this]() {
         ConnectionEditor ed(this);
-        if (ed.exec() == QDialog::Accepted) {
-            if (ed.name().isEmpty() || ed.ip().isEmpty() || ed.port() <= 0) {
-                QMessageBox::warning(this, "Invalid", "Please provide a name, hostname and valid port.");
-                return;
-            }
-            QString entry = ed.name() + "|" + ed.ip() + "|" + QString::number(ed.port());
-            QListWidgetItem *it = new QListWidgetItem(ed.name(), listWidget);
-            it->setData(Qt::UserRole, entry);
-            connList.append(entry);
-        }
+        if (ed.exec() != QDialog::Accepted) return;
+        const Profile p = ed.profile();
+        if (!validProfile(this, p)) return;
+        new QListWidgetItem(listWidget);
+        refreshItem(this->store->add(p));
+        this->store->save();
     });
 
-    connect(editBtn, &QPushButton::clicked, this, [this]() {
-        QListWidgetItem *it = listWidget->currentItem();
-        if (!it) return;
-        QString e = it->data(Qt::UserRole).toString();
-        auto parts = parseEntry(e);
+    auto edit = [this]() {
+        const int row = listWidget->currentRow();
+        if (row < 0) return;
         ConnectionEditor ed(this);
-        ed.setValues(parts.value(0), parts.value(1), parts.value(2).toInt());
-        if (ed.exec() == QDialog::Accepted) {
-            if (ed.name().isEmpty() || ed.ip().isEmpty() || ed.port() <= 0) {
-                QMessageBox::warning(this, "Invalid", "Please provide a name, hostname and valid port.");
-                return;
-            }
-            QString entry = ed.name() + "|" + ed.ip() + "|" + QString::number(ed.port());
-            it->setText(ed.name());
-            it->setData(Qt::UserRole, entry);
-            int idx = listWidget->row(it);
-            if (idx >= 0 && idx < connList.size()) connList[idx] = entry;
-        }
-    });
+        ed.setProfile(this->store->profile(row));
+        if (ed.exec() != QDialog::Accepted) return;
+        const Profile p = ed.profile();
+        if (!validProfile(this, p)) return;
+        this->store->update(row, p);
+        this->store->save();
+        refreshItem(row);
+    };
+    connect(editBtn, &QPushButton::clicked, this, edit);
+    connect(listWidget, &QListWidget::itemDoubleClicked, this, edit);
 
     connect(removeBtn, &QPushButton::clicked, this, [this]() {
-        QListWidgetItem *it = listWidget->currentItem();
-        if (!it) return;
-        int row = listWidget->row(it);
+        const int row = listWidget->currentRow();
+        if (row < 0) return;
         if (QMessageBox::question(this, "Confirm", "Delete selected connection?") == QMessageBox::Yes) {
-            connList.removeAt(row);
             delete listWidget->takeItem(row);
+            this->store->remove(row);
+            this->store->save();
         }
     });
 
-    connect(upBtn, &QPushButton::clicked, this, [this]() {
-        int row = listWidget->currentRow();
-        if (row <= 0) return;
-        QListWidgetItem *it = listWidget->takeItem(row);
-        listWidget->insertItem(row - 1, it);
-        listWidget->setCurrentRow(row - 1);
-        connList.move(row, row - 1);
-    });
-
-    connect(downBtn, &QPushButton::clicked, this, [this]() {
-        int row = listWidget->currentRow();
-        if (row < 0 || row >= listWidget->count() - 1) return;
+    auto move = [this](int delta) {
+        const int row = listWidget->currentRow();
+        const int to = row + delta;
+        if (row < 0 || to < 0 || to >= listWidget->count()) return;
         QListWidgetItem *it = listWidget->takeItem(row);
-        listWidget->insertItem(row + 1, it);
-        listWidget->setCurrentRow(row + 1);
-        connList.move(row, row + 1);
-    });
+        listWidget->insertItem(to, it);
+        listWidget->setCurrentRow(to);
+        this->store->move(row, to);
+        this->store->save();
+    };
+    connect(upBtn, &QPushButton::clicked, this, [move]() { move(-1); });
+    connect(downBtn, &QPushButton::clicked, this, [move]() { move(1); });
 
     connect(importBtn, &QPushButton::clicked, this, [this]() {
         QString path = QFileDialog::getOpenFileName(this, "Import connections", QString(), "JSON Files (*.json);;All Files (*)");
@@ -171,29 +227,52 @@ ManageConnectionsDialog::ManageConnectionsDialog(const QStringList &connections,
         for (const QJsonValue &v : arr) {
             if (!v.isObject()) continue;
             QJsonObject o = v.toObject();
-            QString name = o.value("name").toString();
-            QString ip = o.value("ip").toString();
-            int port = o.value("port").toInt();
-            if (name.isEmpty() || ip.isEmpty() || port <= 0) continue;
-            QString entry = name + "|" + ip + "|" + QString::number(port);
-            QListWidgetItem *it = new QListWidgetItem(name, listWidget);
-            it->setData(Qt::UserRole, entry);
-            connList.append(entry);
+            Profile p;
+            p.name = o.value("name").toString();
+            p.host = o.value("ip").toString();
+            p.port = o.value("port").toInt();
+            p.scrollbackLines = o.value("scrollbackLines").toInt(DefaultScrollbackLines);
+            p.archiveKB = o.value("archiveKB").toInt(DefaultArchiveKB);
+            p.encoding = encodingFromName(o.value("charset").toString("UTF-8").toLatin1());
+            for (const QJsonValue &t : o.value("triggers").toArray()) {
+                const QJsonObject to = t.toObject();
+                p.triggers.append(Trigger{to.value("pattern").toString(), to.value("command").toString(),
+                                          to.value("regex").toBool(), to.value("caseSensitive").toBool(),
+                                          to.value("enabled").toBool(true)});
+            }
+            for (const QJsonValue &a : o.value("aliases").toArray()) {
+                const QJsonObject ao = a.toObject();
+                p.aliases.append(Alias{ao.value("name").toString(), ao.value("expansion").toString()});
+            }
+            if (p.name.isEmpty() || p.host.isEmpty() || p.port <= 0) continue;
+            new QListWidgetItem(listWidget);
+            refreshItem(this->store->add(p));
         }
+        // One write for the whole file.
+        this->store->save();
     });
 
     connect(exportBtn, &QPushButton::clicked, this, [this]() {
         QString path = QFileDialog::getSaveFileName(this, "Export connections", QString(), "JSON Files (*.json);;All Files (*)");
         if (path.isEmpty()) return;
         QJsonArray arr;
-        for (int i = 0; i < listWidget->count(); ++i) {
-            QListWidgetItem *it = listWidget->item(i);
-            QString e = it->data(Qt::UserRole).toString();
-            auto parts = parseEntry(e);
+        for (int i = 0; i < this->store->count(); ++i) {
+            const Profile p = this->store->profile(i);
             QJsonObject o;
-            o.insert("name", parts.value(0));
-            o.insert("ip", parts.value(1));
-            o.insert("port", parts.value(2).toInt());
+            o.insert("name", p.name);
+            o.insert("ip", p.host);
+            o.insert("port", p.port);
+            o.insert("scrollbackLines", p.scrollbackLines);
+            o.insert("archiveKB", p.archiveKB);
+            o.insert("charset", QString(encodingName(p.encoding)));
+            QJsonArray triggers;
+            for (const Trigger &t : p.triggers)
+                triggers.append(QJsonObject{{"pattern", t.pattern}, {"command", t.command}, {"regex", t.regex},
+                                            {"caseSensitive", t.caseSensitive}, {"enabled", t.enabled}});
+            if (!triggers.isEmpty()) o.insert("triggers", triggers);
+            QJsonArray aliases;
+            for (const Alias &a : p.aliases) aliases.append(QJsonObject{{"name", a.name}, {"expansion", a.expansion}});
+            if (!aliases.isEmpty()) o.insert("aliases", aliases);
             arr.append(o);
         }
         QJsonDocument doc(arr);
@@ -203,17 +282,13 @@ ManageConnectionsDialog::ManageConnectionsDialog(const QStringList &connections,
         f.close();
         QMessageBox::information(this, "Exported", "Connections exported.");
     });
-
-    connect(this, &QDialog::accepted, [this]() {
-        connList.clear();
-        for (int i = 0; i < listWidget->count(); ++i) connList.append(listWidget->item(i)->data(Qt::UserRole).toString());
-    });
-
-    connect(box, &QDialogButtonBox::rejected, this, &QDialog::accept);
 }
 
-QStringList ManageConnectionsDialog::connections() const {
-    return connList;
+void ManageConnectionsDialog::refreshItem(int row) {
+    QSettings settings("Aether", "amlp-client");
+    QListWidgetItem *it = listWidget->item(row);
+    it->setText(store->name(row));
+    it->setToolTip(loadConnectStats(settings, store->host(row), store->port(row)).summary());
 }
 
 #include "amlp_manage_connections.moc"
@@ -1,17 +1,20 @@
 #pragma once
 
 #include <QDialog>
-#include <QStringList>
 
+class ProfileStore;
 class QListWidget;
 
+// Edits go straight to the store and are saved one at a time, so the
+// Connections menu follows each change as it is made.
 class ManageConnectionsDialog : public QDialog {
     Q_OBJECT
 public:
-    explicit ManageConnectionsDialog(const QStringList &connections, QWidget *parent = nullptr);
-    QStringList connections() const;
+    explicit ManageConnectionsDialog(ProfileStore *store, QWidget *parent = nullptr);
 
 private:
+    void refreshItem(int row);
+
+    ProfileStore *store;
     QListWidget *listWidget;
-    QStringList connList;
 };
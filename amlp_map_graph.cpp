@@ -0,0 +1,401 @@
+#include "amlp_map_graph.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <numeric>
+
+namespace {
+const char Magic[8] = {'A', 'M', 'L', 'P', 'M', 'A', 'P', '1'};
+const quint32 Version = 1;
+}
+
+static_assert(sizeof(MapGraph::Room) == 32, "room records are stored as-is");
+static_assert(sizeof(MapGraph::Exit) == 8, "exit records are stored as-is");
+
+bool MapGraph::open(const QString &fileName) {
+    close();
+    path = fileName;
+    // A save cut off before the new file replaced the old one. The new file
+    // is whole, since it is only there once it was committed.
+    if (QFile::exists(savingPath())) {
+        QFile::remove(path);
+        QFile::rename(savingPath(), path);
+    }
+    mapped.setFileName(path);
+    if (!mapped.exists() || mapFile()) return true;
+    // Keep the damaged file for inspection and start an empty map.
+    MappedFile::setAside(path);
+    return false;
+}
+
+void MapGraph::close() {
+    unmapFile();
+    clearOverlay();
+    saving = false;
+    journal.clear();
+    dirty = false;
+}
+
+void MapGraph::clearOverlay() {
+    layers.added.clear();
+    layers.changed.clear();
+    layers.exitOverlay.clear();
+    layers.addedStrings.clear();
+    addedByKey.clear();
+    addedStringIds.clear();
+}
+
+bool MapGraph::mapFile() {
+    if (mapped.map([this](const uchar *data, qint64 size) { return validate(data, size); })) return true;
+    unmapFile();
+    return false;
+}
+
+void MapGraph::unmapFile() {
+    mapped.unmap();
+    layers.rooms = nullptr;
+    layers.fileExits = nullptr;
+    layers.strings = nullptr;
+    layers.mappedRooms = 0;
+    layers.mappedStrings = 0;
+}
+
+// Checked once on load so lookups can trust every offset and index.
+bool MapGraph::validate(const uchar *data, qint64 size) {
+    if (size < qint64(sizeof(Header)) || !MappedFile::hasPrefix(data, size, Magic, Version)) return false;
+    Header h;
+    std::memcpy(&h, data, sizeof h);
+    const qint64 expected = qint64(sizeof(Header)) + qint64(h.rooms) * qint64(sizeof(Room))
+                            + qint64(h.exits) * qint64(sizeof(Exit)) + h.strings;
+    if (size != expected || (h.strings > 0 && data[size - 1] != 0)) return false;
+
+    const Room *r = reinterpret_cast<const Room *>(data + sizeof(Header));
+    const Exit *e = reinterpret_cast<const Exit *>(r + h.rooms);
+    auto stringOk = [&](quint32 offset) { return offset == None || offset < h.strings; };
+    for (quint32 i = 0; i < h.rooms; ++i) {
+        if (i > 0 && r[i].key <= r[i - 1].key) return false;
+        if (quint64(r[i].firstExit) + r[i].exitCount > h.exits) return false;
+        if (!stringOk(r[i].name) || !stringOk(r[i].area)) return false;
+    }
+    for (quint32 i = 0; i < h.exits; ++i)
+        if (e[i].to >= h.rooms || !stringOk(e[i].name)) return false;
+
+    layers.rooms = r;
+    layers.fileExits = e;
+    layers.strings = reinterpret_cast<const char *>(e + h.exits);
+    layers.mappedRooms = h.rooms;
+    layers.mappedStrings = h.strings;
+    return true;
+}
+
+quint32 MapGraph::find(quint64 key) const {
+    const Room *end = layers.rooms + layers.mappedRooms;
+    const Room *it = std::lower_bound(layers.rooms, end, key, [](const Room &r, quint64 k) { return r.key < k; });
+    if (it != end && it->key == key) return quint32(it - layers.rooms);
+    return addedByKey.value(key, None);
+}
+
+const MapGraph::Room &MapGraph::room(quint32 index) const {
+    return layers.room(index);
+}
+
+const MapGraph::Room &MapGraph::Layers::room(quint32 index) const {
+    if (index >= mappedRooms) return added[index - mappedRooms];
+    if (!changed.isEmpty()) {
+        auto it = changed.constFind(index);
+        if (it != changed.constEnd()) return *it;
+    }
+    return rooms[index];
+}
+
+const char *MapGraph::Layers::rawString(quint32 offset) const {
+    if (offset == None) return "";
+    if (offset < mappedStrings) return strings + offset;
+    return addedStrings.constData() + (offset - mappedStrings);
+}
+
+QString MapGraph::string(quint32 offset) const {
+    return offset == None ? QString() : QString::fromUtf8(layers.rawString(offset));
+}
+
+int MapGraph::exits(quint32 index, const Exit *&first) const {
+    return layers.exits(index, first);
+}
+
+int MapGraph::Layers::exits(quint32 index, const Exit *&first) const {
+    auto it = exitOverlay.constFind(index);
+    if (it != exitOverlay.constEnd()) {
+        first = it->constData();
+        return it->size();
+    }
+    if (index < mappedRooms) {
+        first = fileExits + rooms[index].firstExit;
+        return rooms[index].exitCount;
+    }
+    first = nullptr;
+    return 0;
+}
+
+// New names only; duplicates of names already in the file go away on save.
+quint32 MapGraph::intern(const QString &text) {
+    if (text.isEmpty()) return None;
+    auto it = addedStringIds.constFind(text);
+    if (it != addedStringIds.constEnd()) return *it;
+    const quint32 offset = layers.mappedStrings + quint32(layers.addedStrings.size());
+    layers.addedStrings.append(text.toUtf8());
+    layers.addedStrings.append('\0');
+    addedStringIds.insert(text, offset);
+    return offset;
+}
+
+MapGraph::Room &MapGraph::editable(quint32 index) {
+    dirty = true;
+    if (index >= layers.mappedRooms) return layers.added[index - layers.mappedRooms];
+    auto it = layers.changed.find(index);
+    if (it == layers.changed.end()) it = layers.changed.insert(index, layers.rooms[index]);
+    return *it;
+}
+
+QVector<MapGraph::Exit> &MapGraph::editableExits(quint32 index) {
+    dirty = true;
+    auto it = layers.exitOverlay.find(index);
+    if (it == layers.exitOverlay.end()) {
+        QVector<Exit> copy;
+        if (index < layers.mappedRooms) {
+            const Room &r = layers.rooms[index];
+            copy = QVector<Exit>(layers.fileExits + r.firstExit, layers.fileExits + r.firstExit + r.exitCount);
+        }
+        it = layers.exitOverlay.insert(index, copy);
+    }
+    return *it;
+}
+
+quint32 MapGraph::addRoom(quint64 key, const QString &name, const QString &area, int x, int y, int z) {
+    const quint32 existing = find(key);
+    if (existing != None) return existing;
+    if (saving) journal.append(Edit{Edit::AddRoom, None, None, key, name, area, x, y, z});
+    auto clamp = [](int v) { return qint16(qBound(-32768, v, 32767)); };
+    Room r{key, intern(name), intern(area), clamp(x), clamp(y), clamp(z), 0, 0, 0};
+    const quint32 index = layers.roomCount();
+    layers.added.append(r);
+    addedByKey.insert(key, index);
+    dirty = true;
+    return index;
+}
+
+void MapGraph::updateRoom(quint32 index, const QString &name, const QString &area) {
+    if (saving) journal.append(Edit{Edit::UpdateRoom, index, None, 0, name, area, 0, 0, 0});
+    const Room &r = room(index);
+    if (!name.isEmpty() && name != string(r.name)) editable(index).name = intern(name);
+    if (!area.isEmpty() && area != string(room(index).area)) editable(index).area = intern(area);
+}
+
+void MapGraph::setExit(quint32 from, const QString &name, quint32 to) {
+    if (saving) journal.append(Edit{Edit::SetExit, from, to, 0, name, QString(), 0, 0, 0});
+    const Exit *first = nullptr;
+    const int count = exits(from, first);
+    for (int i = 0; i < count; ++i) {
+        if (string(first[i].name) != name) continue;
+        if (first[i].to != to) editableExits(from)[i].to = to;
+        return;
+    }
+    if (count >= 0xFFFF) return;
+    const quint32 id = intern(name);
+    editableExits(from).append(Exit{to, id});
+}
+
+quint32 MapGraph::search(quint32 from, const std::function<bool(quint32)> &test, int maxDepth, QStringList *steps,
+                         QVector<quint32> *visited) const {
+    const int n = roomCount();
+    if (from >= quint32(n)) return None;
+    if (seen.size() < n) {
+        seen.resize(n);
+        cameFrom.resize(n);
+        viaExit.resize(n);
+    }
+    // Stamping rooms with a generation saves clearing 30k flags per search.
+    if (++generation == 0) {
+        seen.fill(0);
+        generation = 1;
+    }
+
+    frontier.clear();
+    frontier.append(from);
+    seen[from] = generation;
+    cameFrom[from] = None;
+    int depth = 0;
+    int levelEnd = 1;
+    for (int head = 0; head < frontier.size(); ++head) {
+        if (head == levelEnd) {
+            ++depth;
+            levelEnd = frontier.size();
+        }
+        const quint32 at = frontier[head];
+        if (visited) visited->append(at);
+        if (test && test(at)) {
+            if (steps) {
+                QStringList reversed;
+                for (quint32 r = at; cameFrom[r] != None; r = cameFrom[r]) reversed.append(string(viaExit[r]));
+                std::reverse(reversed.begin(), reversed.end());
+                *steps = reversed;
+            }
+            return at;
+        }
+        if (depth >= maxDepth) continue;
+        const Exit *e = nullptr;
+        const int count = exits(at, e);
+        for (int k = 0; k < count; ++k) {
+            const quint32 to = e[k].to;
+            if (to >= quint32(n) || seen[to] == generation) continue;
+            seen[to] = generation;
+            cameFrom[to] = at;
+            viaExit[to] = e[k].name;
+            frontier.append(to);
+        }
+    }
+    return None;
+}
+
+bool MapGraph::route(quint32 from, quint32 to, QStringList &steps) const {
+    steps.clear();
+    return search(from, [to](quint32 r) { return r == to; }, INT_MAX, &steps, nullptr) != None;
+}
+
+quint32 MapGraph::nearest(quint32 from, const std::function<bool(quint32)> &test, QStringList *steps) const {
+    return search(from, test, INT_MAX, steps, nullptr);
+}
+
+QVector<quint32> MapGraph::neighbourhood(quint32 from, int radius) const {
+    QVector<quint32> out;
+    search(from, nullptr, radius, nullptr, &out);
+    return out;
+}
+
+struct MapGraph::SaveJob {
+    Layers layers;
+    QString path;
+    // Where each room of the snapshot ends up in the new file.
+    QVector<quint32> newIndex;
+    bool written = false;
+};
+
+bool MapGraph::save() {
+    if (!dirty && mapped.isMapped()) return true;
+    const QSharedPointer<SaveJob> job = startSave();
+    if (!job) return false;
+    writeSave(*job);
+    return finishSave(job);
+}
+
+QSharedPointer<MapGraph::SaveJob> MapGraph::startSave() {
+    if (path.isEmpty() || saving || (!dirty && mapped.isMapped())) return {};
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    const QSharedPointer<SaveJob> job = QSharedPointer<SaveJob>::create();
+    job->layers = layers;
+    job->path = savingPath();
+    saving = true;
+    return job;
+}
+
+// Reads only the snapshot. The old file stays mapped until finishSave(),
+// so the pointers into it stay good.
+void MapGraph::writeSave(SaveJob &job) {
+    const Layers &from = job.layers;
+
+    // Rebuild in key order; names are pooled again, so duplicates collapse.
+    const quint32 n = from.roomCount();
+    QVector<quint32> order(int(n));
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [&from](quint32 a, quint32 b) { return from.room(a).key < from.room(b).key; });
+    QVector<quint32> newIndex(int(n));
+    for (quint32 k = 0; k < n; ++k) newIndex[order[k]] = k;
+
+    QByteArray pool;
+    QHash<QByteArray, quint32> pooled;
+    auto put = [&](quint32 offset) -> quint32 {
+        if (offset == None) return None;
+        const QByteArray text(from.rawString(offset));
+        auto it = pooled.constFind(text);
+        if (it != pooled.constEnd()) return *it;
+        const quint32 at = quint32(pool.size());
+        pool.append(text);
+        pool.append('\0');
+        pooled.insert(text, at);
+        return at;
+    };
+    QVector<Room> outRooms;
+    QVector<Exit> outExits;
+    outRooms.reserve(int(n));
+    for (quint32 k = 0; k < n; ++k) {
+        Room r = from.room(order[k]);
+        r.name = put(r.name);
+        r.area = put(r.area);
+        const Exit *e = nullptr;
+        const int count = from.exits(order[k], e);
+        r.firstExit = quint32(outExits.size());
+        r.exitCount = quint16(count);
+        for (int j = 0; j < count; ++j) outExits.append(Exit{newIndex[e[j].to], put(e[j].name)});
+        outRooms.append(r);
+    }
+
+    Header h{};
+    h.prefix = MappedFile::prefix(Magic, Version);
+    h.rooms = n;
+    h.exits = quint32(outExits.size());
+    h.strings = quint32(pool.size());
+
+    QSaveFile out(job.path);
+    job.written = out.open(QIODevice::WriteOnly)
+                  && out.write(reinterpret_cast<const char *>(&h), sizeof h) == qint64(sizeof h)
+                  && out.write(reinterpret_cast<const char *>(outRooms.constData()), qint64(outRooms.size()) * qint64(sizeof(Room))) >= 0
+                  && out.write(reinterpret_cast<const char *>(outExits.constData()), qint64(outExits.size()) * qint64(sizeof(Exit))) >= 0
+                  && out.write(pool) >= 0 && out.commit();
+    job.newIndex = newIndex;
+}
+
+bool MapGraph::finishSave(const QSharedPointer<SaveJob> &job) {
+    saving = false;
+    const QVector<Edit> edits = journal;
+    journal.clear();
+    // If writing failed, the old file is still mapped and the overlay still
+    // holds everything, edits since the snapshot included.
+    if (!job->written) return false;
+
+    // A mapped file cannot be replaced everywhere, so the swap waits until
+    // nothing points into the old one. If the old file will not go, it is
+    // mapped again and the new one dropped.
+    unmapFile();
+    if (QFile::exists(path) && !QFile::remove(path)) {
+        QFile::remove(job->path);
+        mapFile();
+        return false;
+    }
+    mapped.setFileName(QFile::rename(job->path, path) ? path : job->path);
+    clearOverlay();
+    dirty = false;
+    if (!mapFile()) return false;
+
+    // What changed meanwhile, with snapshot indices moved to where the
+    // rooms are now; rooms added since come after the file's, as before.
+    const quint32 n = quint32(job->newIndex.size());
+    auto moved = [&](quint32 index) { return index < n ? job->newIndex[int(index)] : index; };
+    for (const Edit &e : edits) {
+        switch (e.kind) {
+        case Edit::AddRoom:
+            addRoom(e.key, e.name, e.area, e.x, e.y, e.z);
+            break;
+        case Edit::UpdateRoom:
+            updateRoom(moved(e.room), e.name, e.area);
+            break;
+        case Edit::SetExit:
+            setExit(moved(e.room), e.name, moved(e.to));
+            break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <functional>
+
+#include "amlp_mapped_file.h"
+
+// Rooms and exits of one server's map. The file is mapped read-only and
+// used in place: fixed-size room records sorted by the server's room id
+// (found by binary search), then the exits and a pool of names. Nothing
+// is parsed on load, so a 30k-room map opens in the time it takes to
+// check it. Rooms and exits learned since then live in a small overlay
+// until a save rewrites the file.
+class MapGraph {
+public:
+    static constexpr quint32 None = 0xFFFFFFFF;
+
+    struct Room {
+        quint64 key;        // the server's room id
+        quint32 name;       // string offsets, or None
+        quint32 area;
+        qint16 x, y, z;
+        quint16 exitCount;
+        quint32 firstExit;
+        quint32 reserved;
+    };
+    struct Exit {
+        quint32 to;
+        quint32 name;       // "n", "enter portal"
+    };
+
+    MapGraph() = default;
+    MapGraph(const MapGraph &) = delete;
+    MapGraph &operator=(const MapGraph &) = delete;
+
+    // A missing file is an empty map; a damaged one is set aside.
+    bool open(const QString &path);
+    // Writes everything to the file and maps it again.
+    bool save();
+    // The same in three steps, so the slow one can run on another thread.
+    // startSave() takes a snapshot (null if there is nothing to save);
+    // writeSave() sorts it and writes it next to the file, touching nothing
+    // but the job; finishSave() swaps the new file in. The graph stays in
+    // use meanwhile, and what changes in between is carried over onto the
+    // new file. open() and close() must wait for finishSave().
+    struct SaveJob;
+    QSharedPointer<SaveJob> startSave();
+    static void writeSave(SaveJob &job);
+    bool finishSave(const QSharedPointer<SaveJob> &job);
+    bool isSaving() const { return saving; }
+    void close();
+    bool isDirty() const { return dirty; }
+    QString fileName() const { return path; }
+
+    int roomCount() const { return int(layers.roomCount()); }
+    quint32 find(quint64 key) const;
+    const Room &room(quint32 index) const;
+    QString string(quint32 offset) const;
+    // Exits of a room; the pointer stays valid until the graph changes.
+    int exits(quint32 index, const Exit *&first) const;
+
+    // Returns the room already known by that key, unchanged, if there is
+    // one: keys stay unique, as the file requires.
+    quint32 addRoom(quint64 key, const QString &name, const QString &area, int x, int y, int z);
+    void updateRoom(quint32 index, const QString &name, const QString &area);
+    // Adds the exit, or points an existing exit with that name elsewhere.
+    void setExit(quint32 from, const QString &name, quint32 to);
+
+    // Shortest route by number of moves (every exit costs the same, so the
+    // search is breadth-first Dijkstra). Returns the exit names to take, or
+    // false if `to` cannot be reached.
+    bool route(quint32 from, quint32 to, QStringList &steps) const;
+    // Nearest room, by moves, that satisfies the test; None if there is none.
+    quint32 nearest(quint32 from, const std::function<bool(quint32)> &test, QStringList *steps = nullptr) const;
+    // Rooms within `radius` moves, `from` first.
+    QVector<quint32> neighbourhood(quint32 from, int radius) const;
+
+private:
+    struct Header {
+        MappedFile::Prefix prefix;
+        quint32 rooms;
+        quint32 exits;
+        quint32 strings;
+        quint32 reserved;
+    };
+
+    // What lookups read: the mapped file and the overlay on top of it. A
+    // save copies it whole; the containers are shared until written to.
+    struct Layers {
+        // The mapped file.
+        const Room *rooms = nullptr;
+        const Exit *fileExits = nullptr;
+        const char *strings = nullptr;
+        quint32 mappedRooms = 0;
+        quint32 mappedStrings = 0;
+
+        // Everything since: new rooms, edited rooms, replaced exit lists, new names.
+        QVector<Room> added;
+        QHash<quint32, Room> changed;
+        QHash<quint32, QVector<Exit>> exitOverlay;
+        QByteArray addedStrings;
+
+        quint32 roomCount() const { return mappedRooms + quint32(added.size()); }
+        const Room &room(quint32 index) const;
+        const char *rawString(quint32 offset) const;
+        int exits(quint32 index, const Exit *&first) const;
+    };
+    // A change made while a save was being written.
+    struct Edit {
+        enum Kind { AddRoom, UpdateRoom, SetExit } kind;
+        quint32 room;
+        quint32 to;
+        quint64 key;
+        QString name;
+        QString area;
+        int x, y, z;
+    };
+
+    bool mapFile();
+    void unmapFile();
+    void clearOverlay();
+    bool validate(const uchar *data, qint64 size);
+    QString savingPath() const { return path + ".saving"; }
+    quint32 intern(const QString &text);
+    Room &editable(quint32 index);
+    QVector<Exit> &editableExits(quint32 index);
+    quint32 search(quint32 from, const std::function<bool(quint32)> &test, int maxDepth, QStringList *steps,
+                   QVector<quint32> *visited) const;
+
+    QString path;
+    MappedFile mapped;
+    bool dirty = false;
+
+    Layers layers;
+    QHash<quint64, quint32> addedByKey;
+    QHash<QString, quint32> addedStringIds;
+    bool saving = false;
+    QVector<Edit> journal;
+
+    // Search scratch, reused so a route allocates nothing after the first.
+    mutable QVector<quint32> seen;
+    mutable QVector<quint32> cameFrom;
+    mutable QVector<quint32> viaExit;
+    mutable QVector<quint32> frontier;
+    mutable quint32 generation = 0;
+};
@@ -0,0 +1,129 @@
+#include "amlp_map_view.h"
+
+#include <QHash>
+#include <QHelpEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QSet>
+#include <QToolTip>
+
+#include "amlp_automapper.h"
+
+namespace {
+const int CellSize = 22;
+const int RoomSize = 12;
+const int Radius = 12;
+}
+
+MapView::MapView(Automapper *mapper, QWidget *parent) : QWidget(parent), mapper(mapper) {
+    setMinimumWidth(260);
+    auto changed = [this]() {
+        stale = true;
+        if (isVisible()) rebuild();
+    };
+    connect(mapper, &Automapper::roomChanged, this, changed);
+    connect(mapper, &Automapper::mapChanged, this, changed);
+}
+
+void MapView::showEvent(QShowEvent *event) {
+    QWidget::showEvent(event);
+    if (stale) rebuild();
+}
+
+void MapView::rebuild() {
+    stale = false;
+    cells.clear();
+    links.clear();
+    const MapGraph &map = mapper->graph();
+    const quint32 here = mapper->currentRoom();
+    if (here == MapGraph::None) {
+        caption = map.roomCount() > 0 ? QString("%1 rooms mapped").arg(map.roomCount()) : QString("No map yet");
+        update();
+        return;
+    }
+
+    const MapGraph::Room &origin = map.room(here);
+    caption = map.string(origin.name);
+    if (caption.isEmpty()) caption = QString("Room %1").arg(origin.key);
+    const QString area = map.string(origin.area);
+    if (!area.isEmpty()) caption += " - " + area;
+
+    // Rooms reachable on this level; the first to claim a grid square keeps it.
+    QHash<quint32, QPoint> placed;
+    QSet<quint64> taken;
+    for (quint32 r : map.neighbourhood(here, Radius)) {
+        const MapGraph::Room &room = map.room(r);
+        if (room.z != origin.z) continue;
+        const QPoint grid(room.x - origin.x, room.y - origin.y);
+        const quint64 square = (quint64(quint32(grid.x())) << 32) | quint32(grid.y());
+        if (taken.contains(square)) continue;
+        taken.insert(square);
+        placed.insert(r, grid);
+        cells.append(Cell{r, grid});
+    }
+    for (const Cell &cell : cells) {
+        const MapGraph::Exit *exits = nullptr;
+        const int count = map.exits(cell.room, exits);
+        for (int i = 0; i < count; ++i) {
+            auto to = placed.constFind(exits[i].to);
+            if (to != placed.constEnd() && cell.room < exits[i].to) links.append(qMakePair(cell.grid, *to));
+        }
+    }
+    update();
+}
+
+QPoint MapView::centre(const QPoint &grid) const {
+    return QPoint(width() / 2 + grid.x() * CellSize, height() / 2 + grid.y() * CellSize);
+}
+
+int MapView::cellAt(const QPoint &pos) const {
+    for (int i = 0; i < cells.size(); ++i) {
+        const QPoint c = centre(cells[i].grid);
+        if (qAbs(pos.x() - c.x()) <= RoomSize / 2 + 2 && qAbs(pos.y() - c.y()) <= RoomSize / 2 + 2) return i;
+    }
+    return -1;
+}
+
+void MapView::paintEvent(QPaintEvent *) {
+    QPainter p(this);
+    p.fillRect(rect(), QColor("#000000"));
+    p.setRenderHint(QPainter::Antialiasing);
+
+    p.setPen(QPen(QColor("#3282b8"), 2));
+    for (const auto &link : links) p.drawLine(centre(link.first), centre(link.second));
+
+    const MapGraph &map = mapper->graph();
+    const quint32 here = mapper->currentRoom();
+    for (const Cell &cell : cells) {
+        const QPoint c = centre(cell.grid);
+        const bool unvisited = map.room(cell.room).name == MapGraph::None;
+        const QColor fill = cell.room == here ? QColor("#f0c674") : unvisited ? QColor("#303030") : QColor("#0f4c75");
+        p.setPen(QColor("#e0e0e0"));
+        p.setBrush(fill);
+        p.drawRect(c.x() - RoomSize / 2, c.y() - RoomSize / 2, RoomSize, RoomSize);
+    }
+
+    p.setPen(QColor("#e0e0e0"));
+    p.drawText(rect().adjusted(4, 4, -4, -4), Qt::AlignTop | Qt::AlignLeft | Qt::TextWordWrap, caption);
+}
+
+bool MapView::event(QEvent *event) {
+    if (event->type() == QEvent::ToolTip) {
+        auto *help = static_cast<QHelpEvent *>(event);
+        const int i = cellAt(help->pos());
+        if (i < 0) {
+            QToolTip::hideText();
+        } else {
+            const MapGraph &map = mapper->graph();
+            const QString name = map.string(map.room(cells[i].room).name);
+            QToolTip::showText(help->globalPos(), name.isEmpty() ? QString("Unexplored") : name, this);
+        }
+        return true;
+    }
+    return QWidget::event(event);
+}
+
+void MapView::mouseDoubleClickEvent(QMouseEvent *event) {
+    const int i = cellAt(event->position().toPoint());
+    if (i >= 0 && cells[i].room != mapper->currentRoom()) emit walkRequested(cells[i].room);
+}
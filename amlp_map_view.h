@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QVector>
+#include <QWidget>
+
+class Automapper;
+
+// Side panel drawing the rooms around the current one, on its level, at
+// the automapper's coordinates. Only the neighbourhood is walked, so a
+// move costs the same on a 30k-room map as on a small one. Double-click a
+// room to speedwalk there.
+class MapView : public QWidget {
+    Q_OBJECT
+public:
+    explicit MapView(Automapper *mapper, QWidget *parent = nullptr);
+
+signals:
+    void walkRequested(quint32 room);
+
+protected:
+    bool event(QEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;
+    void showEvent(QShowEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+
+private:
+    struct Cell {
+        quint32 room;
+        QPoint grid;
+    };
+
+    void rebuild();
+    QPoint centre(const QPoint &grid) const;
+    int cellAt(const QPoint &pos) const;
+
+    Automapper *mapper;
+    QVector<Cell> cells;
+    QVector<QPair<QPoint, QPoint>> links;
+    QString caption;
+    bool stale = true;
+};
@@ -0,0 +1,45 @@
+#include "amlp_mapped_file.h"
+
+#include <cstring>
+
+namespace {
+const quint32 ByteOrder = 0x01020304;
+}
+
+static_assert(sizeof(MappedFile::Prefix) == 16, "the prefix is stored as-is");
+
+bool MappedFile::map(const std::function<bool(const uchar *, qint64)> &validate) {
+    unmap();
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    const qint64 size = file.size();
+    mapping = size > 0 ? file.map(0, size) : nullptr;
+    if (mapping && validate(mapping, size)) return true;
+    unmap();
+    return false;
+}
+
+void MappedFile::unmap() {
+    if (mapping) file.unmap(mapping);
+    file.close();
+    mapping = nullptr;
+}
+
+MappedFile::Prefix MappedFile::prefix(const char (&magic)[8], quint32 version) {
+    Prefix p{};
+    std::memcpy(p.magic, magic, sizeof p.magic);
+    p.version = version;
+    p.byteOrder = ByteOrder;
+    return p;
+}
+
+bool MappedFile::hasPrefix(const uchar *data, qint64 size, const char (&magic)[8], quint32 version) {
+    if (size < qint64(sizeof(Prefix))) return false;
+    Prefix p;
+    std::memcpy(&p, data, sizeof p);
+    return std::memcmp(p.magic, magic, sizeof p.magic) == 0 && p.version == version && p.byteOrder == ByteOrder;
+}
+
+void MappedFile::setAside(const QString &path) {
+    QFile::remove(path + ".bad");
+    QFile::rename(path, path + ".bad");
+}
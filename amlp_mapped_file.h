@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QFile>
+#include <QString>
+
+#include <functional>
+
+// A store file mapped read-only and used in place, as MapGraph and
+// ProfileStore keep theirs. Files are written in native order behind a
+// magic, a version and a byte-order mark, so one from a machine of the
+// other order is rejected instead of misread.
+class MappedFile {
+public:
+    // The start of every store header; the store's own fields follow.
+    struct Prefix {
+        char magic[8];
+        quint32 version;
+        quint32 byteOrder;
+    };
+
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() { unmap(); }
+
+    void setFileName(const QString &path) { file.setFileName(path); }
+    bool exists() const { return file.exists(); }
+    bool isMapped() const { return mapping != nullptr; }
+
+    // Maps the whole file and hands it to validate, which checks every
+    // offset once so reads can trust them. Unmapped again if that fails.
+    bool map(const std::function<bool(const uchar *data, qint64 size)> &validate);
+    void unmap();
+
+    // The prefix a new file is written with.
+    static Prefix prefix(const char (&magic)[8], quint32 version);
+    // True when the data starts with that prefix.
+    static bool hasPrefix(const uchar *data, qint64 size, const char (&magic)[8], quint32 version);
+    // Keeps a damaged file for inspection as <path>.bad.
+    static void setAside(const QString &path);
+
+private:
+    QFile file;
+    uchar *mapping = nullptr;
+};
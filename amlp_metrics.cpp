@@ -0,0 +1,66 @@
+#include "amlp_metrics.h"
+
+#include <QtCore/qalgorithms.h>
+
+#include <chrono>
+
+LatencyHistogram::LatencyHistogram() {
+    for (std::atomic<quint64> &c : counts) c.store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::bucketFor(qint64 ns) {
+    const quint64 us = quint64(qMax<qint64>(0, ns)) / 1000;
+    if (us < SubBuckets) return int(us);
+    // Position of the top bit picks the octave, the next three bits the sub-bucket.
+    const int msb = 63 - qCountLeadingZeroBits(us);
+    const int sub = int((us >> (msb - 3)) & (SubBuckets - 1));
+    return qMin(Buckets - 1, (msb - 2) * SubBuckets + sub);
+}
+
+qint64 LatencyHistogram::bucketUpperNs(int bucket) {
+    if (bucket < SubBuckets) return qint64(bucket + 1) * 1000;
+    const int msb = bucket / SubBuckets + 2;
+    const int sub = bucket % SubBuckets;
+    const quint64 lower = quint64(SubBuckets + sub) << (msb - 3);
+    return qint64(lower + (quint64(1) << (msb - 3))) * 1000;
+}
+
+void LatencyHistogram::record(qint64 ns) {
+    counts[bucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    Snapshot s;
+    s.counts.resize(Buckets);
+    for (int i = 0; i < Buckets; ++i) {
+        s.counts[i] = counts[i].load(std::memory_order_relaxed);
+        s.total += s.counts[i];
+    }
+    return s;
+}
+
+qint64 LatencyHistogram::Snapshot::percentile(double p) const {
+    if (total == 0) return 0;
+    const quint64 rank = quint64(p * double(total - 1)) + 1;
+    quint64 seen = 0;
+    for (int i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) return bucketUpperNs(i);
+    }
+    return bucketUpperNs(counts.size() - 1);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::Snapshot::since(const Snapshot &earlier) const {
+    Snapshot d;
+    d.counts.resize(counts.size());
+    for (int i = 0; i < counts.size(); ++i) {
+        d.counts[i] = counts[i] - earlier.counts.value(i);
+        d.total += d.counts[i];
+    }
+    return d;
+}
+
+qint64 ClientMetrics::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QVector>
+#include <QtGlobal>
+
+#include <atomic>
+
+// Latency histogram that any thread can record into without locks: one
+// relaxed atomic increment per sample. Buckets are log-linear, eight per
+// power of two of microseconds, so percentiles are within 12.5% anywhere
+// from 1 us to over a minute.
+class LatencyHistogram {
+public:
+    static constexpr int SubBuckets = 8;
+    static constexpr int Buckets = SubBuckets * 30;
+
+    struct Snapshot {
+        QVector<quint64> counts;
+        quint64 total = 0;
+
+        // Upper bound of the bucket holding the p-quantile, in nanoseconds.
+        qint64 percentile(double p) const;
+        // Samples recorded between `earlier` and this snapshot.
+        Snapshot since(const Snapshot &earlier) const;
+    };
+
+    LatencyHistogram();
+
+    void record(qint64 ns);
+    Snapshot snapshot() const;
+
+    static int bucketFor(qint64 ns);
+    static qint64 bucketUpperNs(int bucket);
+
+private:
+    std::atomic<quint64> counts[Buckets];
+};
+
+// Hot-path instrumentation shared by the network worker (writer) and the
+// UI (writer and reader). Counters are cumulative; readers take deltas.
+struct ClientMetrics {
+    // Socket read returned -> bytes parsed and assembled into lines.
+    LatencyHistogram readToParsed;
+    // Batch parsed on the worker -> painted by the terminal view.
+    LatencyHistogram parsedToPainted;
+    // One TerminalView paint.
+    LatencyHistogram paint;
+    // Command written -> first byte of the server's answer.
+    LatencyHistogram roundTrip;
+    // Timer wheel: how long after its due time a ticker or #delay ran.
+    LatencyHistogram timerLateness;
+    // Connect started -> TCP connected, name lookup included.
+    LatencyHistogram connectTime;
+
+    std::atomic<quint64> bytesIn{0};
+    std::atomic<quint64> linesIn{0};
+    // Lines a line rule gagged or moved to a capture pane.
+    std::atomic<quint64> linesFiltered{0};
+    std::atomic<quint64> commandsOut{0};
+    std::atomic<quint64> timersFired{0};
+    std::atomic<quint64> reconnects{0};
+
+    // Monotonic nanoseconds, comparable across threads.
+    static qint64 now();
+};
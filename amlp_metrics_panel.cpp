@@ -0,0 +1,204 @@
+#include "amlp_metrics_panel.h"
+
+#include <QBoxLayout>
+#include <QFile>
+#include <QFileDialog>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLabel>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QTextStream>
+
+#include "amlp_line_store.h"
+#include "amlp_style_table.h"
+
+namespace {
+const int SampleIntervalMs = 1000;
+// One hour at one sample per second.
+const int MaxSamples = 3600;
+
+QString formatNs(qint64 ns) {
+    if (ns <= 0) return "-";
+    if (ns < 1000000) return QString::number(ns / 1000) + "us";
+    return QString::number(double(ns) / 1e6, 'f', 1) + "ms";
+}
+
+QString formatBytes(double bytes) {
+    if (bytes < 1024) return QString::number(qint64(bytes)) + " B";
+    if (bytes < 1024 * 1024) return QString::number(bytes / 1024, 'f', 1) + " KB";
+    return QString::number(bytes / (1024 * 1024), 'f', 1) + " MB";
+}
+}
+
+MetricsPanel::MetricsPanel(ClientMetrics *metrics, LineStore *store, QWidget *parent)
+    : QWidget(parent), metrics(metrics), store(store) {
+    auto *lay = new QVBoxLayout(this);
+    lay->setContentsMargins(0, 0, 0, 0);
+    text = new QLabel(this);
+    text->setAlignment(Qt::AlignTop | Qt::AlignLeft);
+    text->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    lay->addWidget(text, 1);
+
+    auto *btnLay = new QHBoxLayout();
+    QPushButton *csvBtn = new QPushButton("Export CSV", this);
+    QPushButton *jsonBtn = new QPushButton("Export JSON", this);
+    btnLay->addWidget(csvBtn);
+    btnLay->addWidget(jsonBtn);
+    lay->addLayout(btnLay);
+    connect(csvBtn, &QPushButton::clicked, this, &MetricsPanel::exportCsv);
+    connect(jsonBtn, &QPushButton::clicked, this, &MetricsPanel::exportJson);
+
+    setMinimumWidth(260);
+    clock.start();
+    for (int i = 0; i < 5; ++i) last[i].counts.resize(LatencyHistogram::Buckets);
+    connect(&timer, &QTimer::timeout, this, &MetricsPanel::takeSample);
+    timer.start(SampleIntervalMs);
+}
+
+void MetricsPanel::showEvent(QShowEvent *event) {
+    QWidget::showEvent(event);
+    refresh();
+}
+
+void MetricsPanel::takeSample() {
+    Sample s;
+    s.msecs = clock.elapsed();
+    const double secs = qMax<double>(0.001, double(s.msecs - lastMsecs) / 1000.0);
+    lastMsecs = s.msecs;
+
+    const quint64 bytes = metrics->bytesIn.load(std::memory_order_relaxed);
+    const quint64 lines = metrics->linesIn.load(std::memory_order_relaxed);
+    const quint64 commands = metrics->commandsOut.load(std::memory_order_relaxed);
+    s.bytesPerSec = double(bytes - lastBytes) / secs;
+    s.linesPerSec = double(lines - lastLines) / secs;
+    s.commands = commands - lastCommands;
+    lastBytes = bytes;
+    lastLines = lines;
+    const quint64 filtered = metrics->linesFiltered.load(std::memory_order_relaxed);
+    s.filteredPerSec = double(filtered - lastFiltered) / secs;
+    lastFiltered = filtered;
+    lastCommands = commands;
+    const quint64 timers = metrics->timersFired.load(std::memory_order_relaxed);
+    s.timersFired = timers - lastTimers;
+    lastTimers = timers;
+
+    const LatencyHistogram *histograms[5] = {&metrics->readToParsed, &metrics->parsedToPainted,
+                                             &metrics->paint, &metrics->roundTrip, &metrics->timerLateness};
+    qint64 *targets[5] = {s.readParsed, s.parsedPainted, s.paint, s.roundTrip, s.timerLate};
+    for (int i = 0; i < 5; ++i) {
+        const LatencyHistogram::Snapshot now = histograms[i]->snapshot();
+        const LatencyHistogram::Snapshot interval = now.since(last[i]);
+        targets[i][0] = interval.percentile(0.50);
+        targets[i][1] = interval.percentile(0.99);
+        last[i] = now;
+    }
+
+    const LatencyHistogram::Snapshot connects = metrics->connectTime.snapshot();
+    s.connect[0] = connects.percentile(0.50);
+    s.connect[1] = connects.percentile(0.99);
+    s.reconnects = metrics->reconnects.load(std::memory_order_relaxed);
+
+    s.storedLines = store->count();
+    s.textBytes = store->textBytes();
+    s.archivedLines = store->archive().lineCount();
+    s.archiveBytes = store->archive().compressedBytes();
+    s.styles = StyleTable::instance().size();
+    s.stylesApproximated = StyleTable::instance().approximated();
+
+    if (history.size() == MaxSamples) history.removeFirst();
+    history.append(s);
+    if (isVisible()) refresh();
+}
+
+void MetricsPanel::refresh() {
+    if (history.isEmpty()) {
+        text->setText("Collecting...");
+        return;
+    }
+    const Sample &s = history.last();
+    auto row = [](const char *name, const qint64 *p) {
+        return QString("%1 p50 %2  p99 %3\n").arg(name, -14).arg(formatNs(p[0]), 7).arg(formatNs(p[1]), 7);
+    };
+    QString out;
+    out += QString("%1 %2/s  %3 lines/s\n").arg("Throughput", -14).arg(formatBytes(s.bytesPerSec))
+               .arg(qint64(s.linesPerSec));
+    out += QString("%1 %2 lines/s\n").arg("Filtered", -14).arg(qint64(s.filteredPerSec));
+    out += row("Read->parsed", s.readParsed);
+    out += row("Parsed->paint", s.parsedPainted);
+    out += row("Paint", s.paint);
+    out += row("Round trip", s.roundTrip);
+    out += QString("%1 %2\n").arg("Commands/s", -14).arg(s.commands);
+    out += QString("%1 %2/s  late p50 %3  p99 %4\n").arg("Timers", -14).arg(s.timersFired)
+               .arg(formatNs(s.timerLate[0])).arg(formatNs(s.timerLate[1]));
+    out += QString("%1 p50 %2  p99 %3  %4 reconnects\n").arg("Connect", -14).arg(formatNs(s.connect[0]), 7)
+               .arg(formatNs(s.connect[1]), 7).arg(s.reconnects);
+    out += QString("%1 %2 lines, %3\n").arg("Stored", -14).arg(s.storedLines).arg(formatBytes(double(s.textBytes)));
+    out += QString("%1 %2 lines, %3\n").arg("Archived", -14).arg(s.archivedLines)
+               .arg(formatBytes(double(s.archiveBytes)));
+    out += QString("%1 %2, %3 approximated\n").arg("Styles", -14).arg(s.styles).arg(s.stylesApproximated);
+    text->setText(out);
+}
+
+void MetricsPanel::exportCsv() {
+    QString path = QFileDialog::getSaveFileName(this, "Export metrics", "metrics.csv", "CSV Files (*.csv)");
+    if (path.isEmpty()) return;
+    QFile f(path);
+    if (!f.open(QFile::WriteOnly | QFile::Truncate | QFile::Text)) {
+        QMessageBox::warning(this, "Error", "Unable to write file.");
+        return;
+    }
+    QTextStream out(&f);
+    out << "time_ms,bytes_per_s,lines_per_s,filtered_per_s,commands,"
+           "read_parsed_p50_ns,read_parsed_p99_ns,parsed_painted_p50_ns,parsed_painted_p99_ns,"
+           "paint_p50_ns,paint_p99_ns,round_trip_p50_ns,round_trip_p99_ns,"
+           "timers_fired,timer_late_p50_ns,timer_late_p99_ns,connect_p50_ns,connect_p99_ns,reconnects,"
+           "stored_lines,text_bytes,archived_lines,archive_bytes,styles,styles_approximated\n";
+    for (const Sample &s : history) {
+        out << s.msecs << ',' << qint64(s.bytesPerSec) << ',' << qint64(s.linesPerSec) << ','
+            << qint64(s.filteredPerSec) << ',' << s.commands << ','
+            << s.readParsed[0] << ',' << s.readParsed[1] << ',' << s.parsedPainted[0] << ',' << s.parsedPainted[1] << ','
+            << s.paint[0] << ',' << s.paint[1] << ',' << s.roundTrip[0] << ',' << s.roundTrip[1] << ','
+            << s.timersFired << ',' << s.timerLate[0] << ',' << s.timerLate[1] << ','
+            << s.connect[0] << ',' << s.connect[1] << ',' << s.reconnects << ','
+            << s.storedLines << ',' << s.textBytes << ',' << s.archivedLines << ',' << s.archiveBytes << ','
+            << s.styles << ',' << s.stylesApproximated << '\n';
+    }
+}
+
+void MetricsPanel::exportJson() {
+    QString path = QFileDialog::getSaveFileName(this, "Export metrics", "metrics.json", "JSON Files (*.json)");
+    if (path.isEmpty()) return;
+    QJsonArray arr;
+    auto pair = [](const qint64 *p) { return QJsonObject{{"p50_ns", p[0]}, {"p99_ns", p[1]}}; };
+    for (const Sample &s : history) {
+        QJsonObject o;
+        o["time_ms"] = s.msecs;
+        o["bytes_per_s"] = s.bytesPerSec;
+        o["lines_per_s"] = s.linesPerSec;
+        o["filtered_per_s"] = s.filteredPerSec;
+        o["commands"] = qint64(s.commands);
+        o["read_parsed"] = pair(s.readParsed);
+        o["parsed_painted"] = pair(s.parsedPainted);
+        o["paint"] = pair(s.paint);
+        o["round_trip"] = pair(s.roundTrip);
+        o["timers_fired"] = qint64(s.timersFired);
+        o["timer_late"] = pair(s.timerLate);
+        o["connect"] = pair(s.connect);
+        o["reconnects"] = qint64(s.reconnects);
+        o["stored_lines"] = s.storedLines;
+        o["text_bytes"] = s.textBytes;
+        o["archived_lines"] = s.archivedLines;
+        o["archive_bytes"] = s.archiveBytes;
+        o["styles"] = s.styles;
+        o["styles_approximated"] = qint64(s.stylesApproximated);
+        arr.append(o);
+    }
+    QFile f(path);
+    if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
+        QMessageBox::warning(this, "Error", "Unable to write file.");
+        return;
+    }
+    f.write(QJsonDocument(arr).toJson());
+}
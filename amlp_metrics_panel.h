@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QVector>
+#include <QWidget>
+
+#include "amlp_metrics.h"
+
+class LineStore;
+class QLabel;
+
+// Side panel showing the client's hot-path metrics, sampled once a second.
+// Sampling continues while the panel is hidden, so the last hour can be
+// exported as CSV or JSON after the lag has already happened.
+class MetricsPanel : public QWidget {
+    Q_OBJECT
+public:
+    MetricsPanel(ClientMetrics *metrics, LineStore *store, QWidget *parent = nullptr);
+
+public slots:
+    void exportCsv();
+    void exportJson();
+
+protected:
+    void showEvent(QShowEvent *event) override;
+
+private:
+    struct Sample {
+        qint64 msecs = 0;
+        double bytesPerSec = 0;
+        double linesPerSec = 0;
+        double filteredPerSec = 0;
+        quint64 commands = 0;
+        // p50/p99 in nanoseconds over the last interval; 0 when no samples.
+        qint64 readParsed[2] = {0, 0};
+        qint64 parsedPainted[2] = {0, 0};
+        qint64 paint[2] = {0, 0};
+        qint64 roundTrip[2] = {0, 0};
+        qint64 timerLate[2] = {0, 0};
+        quint64 timersFired = 0;
+        // Over the whole session: connects are too rare for a per-second view.
+        qint64 connect[2] = {0, 0};
+        quint64 reconnects = 0;
+        int storedLines = 0;
+        qint64 textBytes = 0;
+        qint64 archivedLines = 0;
+        qint64 archiveBytes = 0;
+        // Process-wide: the style table is shared by every session.
+        int styles = 0;
+        quint64 stylesApproximated = 0;
+    };
+
+    void takeSample();
+    void refresh();
+
+    ClientMetrics *metrics;
+    LineStore *store;
+    QLabel *text;
+    QTimer timer;
+    QElapsedTimer clock;
+    QVector<Sample> history;
+    LatencyHistogram::Snapshot last[5];
+    quint64 lastBytes = 0;
+    quint64 lastLines = 0;
+    quint64 lastFiltered = 0;
+    quint64 lastCommands = 0;
+    quint64 lastTimers = 0;
+    qint64 lastMsecs = 0;
+};
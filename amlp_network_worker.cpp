@@ -0,0 +1,771 @@
+#include "amlp_network_worker.h"
+
+#include <QDir>
+#include <QRandomGenerator>
+#include <QStandardPaths>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <cmath>
+#include <utility>
+
+#include <zlib.h>
+
+#include "amlp_connector.h"
+#include "amlp_telnet.h"
+
+namespace {
+const int RingBatches = 1024;
+const int RingCommands = 256;
+// How soon to retry publishing when the UI has let the ring fill up.
+const int RetryMs = 16;
+// Client messages (#alias and friends) use the same colour as the UI's own.
+const QRgb NoticeColor = qRgb(0xe0, 0xe0, 0xe0);
+// Script sends may reach script aliases that send again; a loop stops here.
+const int MaxScriptRounds = 8;
+
+QString scriptDir() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/scripts";
+}
+}
+
+NetworkWorker::NetworkWorker(QObject *parent)
+    : QObject(parent), toUi(RingBatches), fromUi(RingCommands) {
+    readBuffer.resize(16 * 1024);
+    zlibBuffer.resize(64 * 1024);
+    setQuitPattern(DefaultQuitPattern);
+    // A child, so it follows the worker to its thread.
+    negotiator = new TelnetNegotiator(this);
+    timers = new TimerWheel(this);
+    timers->setPaused(true);
+    parser.setTelnetHandler(negotiator);
+    connect(negotiator, &TelnetNegotiator::send, this, &NetworkWorker::queueBytes);
+    connect(negotiator, &TelnetNegotiator::outgoingCompressionStarted, this, &NetworkWorker::startDeflate);
+    connect(negotiator, &TelnetNegotiator::outOfBand, this, &NetworkWorker::receiveOutOfBand);
+    // Emitted mid-feed, so the bytes after the agreement already decode in the new charset.
+    connect(negotiator, &TelnetNegotiator::charsetSelected, this, [this](const QByteArray &name) {
+        sendEncoding = encodingFromName(name);
+        parser.setEncoding(sendEncoding);
+    });
+    // GA/EOR ends a prompt that has no newline. A newline in the decoded
+    // stream completes it as a line, so triggers, the log and the line rules
+    // see it like any other line.
+    connect(negotiator, &TelnetNegotiator::promptMarked, this, [this] {
+        if (assembler.endPrompt(parsed)) promptEnded = true;
+    });
+    connect(negotiator, &TelnetNegotiator::remoteEchoChanged, this, [this](bool serverEchoes) {
+        // The server stops echoing while a password is typed.
+        if (serverEchoes) emit passwordPrompt();
+    });
+}
+
+NetworkWorker::~NetworkWorker() {
+    recorder.close();
+    endCompression();
+    delete current;
+    RenderBatch *batch = nullptr;
+    while (toUi.pop(batch)) delete batch;
+}
+
+bool NetworkWorker::takeBatch(RenderBatch *&batch) {
+    return toUi.pop(batch);
+}
+
+void NetworkWorker::sendLine(const QString &line, bool verbatim) {
+    if (!fromUi.push(OutgoingLine{line, verbatim})) {
+        // Ring full means the worker is badly behind; fall back to a queued call.
+        QMetaObject::invokeMethod(this, [this, line, verbatim]() {
+            if (verbatim)
+                queueCommand(line);
+            else
+                submit(line);
+            publish();
+        }, Qt::QueuedConnection);
+        return;
+    }
+    if (!drainQueued.exchange(true))
+        QMetaObject::invokeMethod(this, &NetworkWorker::drainOutgoing, Qt::QueuedConnection);
+}
+
+void NetworkWorker::ensureConnector() {
+    if (connector) return;
+    // Created lazily so the timers and sockets belong to the worker's thread.
+    connector = new Connector(this);
+    connect(connector, &Connector::connected, this, &NetworkWorker::adoptSocket);
+    connect(connector, &Connector::failed, this, &NetworkWorker::connectFailed);
+    retryTimer = new QTimer(this);
+    retryTimer->setSingleShot(true);
+    connect(retryTimer, &QTimer::timeout, this, &NetworkWorker::publish);
+    paceTimer = new QTimer(this);
+    paceTimer->setSingleShot(true);
+    connect(paceTimer, &QTimer::timeout, this, &NetworkWorker::flushOutgoing);
+    reconnectTimer = new QTimer(this);
+    reconnectTimer->setSingleShot(true);
+    connect(reconnectTimer, &QTimer::timeout, this, &NetworkWorker::startConnection);
+}
+
+void NetworkWorker::connectToHost(const QString &host, int port) {
+    ensureConnector();
+    hostName = host;
+    hostPort = port;
+    wantConnected = true;
+    reconnecting = false;
+    reconnectAttempt = 0;
+    reconnectTimer->stop();
+#ifdef AMLP_HAVE_LUA
+    // Scripts in the scripts directory start with the first connection.
+    if (!scripts && !QDir(scriptDir()).entryList({"*.lua"}, QDir::Files).isEmpty()) {
+        ensureScripts();
+        publish();
+    }
+#endif
+    startConnection();
+}
+
+// Fresh telnet and decoder state, then the address race; reconnects start here too.
+void NetworkWorker::startConnection() {
+    dropSocket();
+    endCompression();
+    negotiator->reset();
+    negotiator->setPreferredEncoding(profileEncoding);
+    parser.reset();
+    parser.setEncoding(profileEncoding);
+    sendEncoding = profileEncoding;
+    assembler.reset();
+    promptEnded = false;
+    outBuffer.clear();
+    paced.clear();
+    commandsPending = 0;
+    commandSentAt = 0;
+    paceTimer->stop();
+    tokens = paceBurst;
+    logout.reset();
+    connector->start(hostName, hostPort, reconnecting ? Connector::ReconnectTimeoutMs : Connector::ConnectTimeoutMs);
+}
+
+void NetworkWorker::adoptSocket(QTcpSocket *connectedSocket, const QString &address, qint64 resolveNs,
+                                qint64 connectNs) {
+    socket = connectedSocket;
+    socket->setParent(this);
+    connect(socket, &QTcpSocket::readyRead, this, &NetworkWorker::readSocket);
+    connect(socket, &QTcpSocket::disconnected, this, &NetworkWorker::socketClosed);
+    connect(socket, &QAbstractSocket::errorOccurred, this, [this](QAbstractSocket::SocketError) {
+        emit errorOccurred(socket->errorString());
+    });
+    // Commands are already coalesced per tick; Nagle would only add latency.
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    timers->setPaused(false);
+    if (metrics) {
+        metrics->connectTime.record(resolveNs + connectNs);
+        if (reconnecting) metrics->reconnects.fetch_add(1, std::memory_order_relaxed);
+    }
+    reconnecting = false;
+    reconnectAttempt = 0;
+    // One log file per connection, not per attempt: a server that is down
+    // for a while would otherwise leave an empty file behind each retry.
+    if (sessionLog) sessionLog->open(hostName);
+    emit connected();
+    emit connectTimed(address, int(resolveNs / 1000000), int(connectNs / 1000000));
+    negotiator->start();
+    if (socket->bytesAvailable() > 0) readSocket();
+}
+
+void NetworkWorker::socketClosed() {
+    endCompression();
+    if (sessionLog) sessionLog->close();
+    // Tickers would only queue commands for nobody; they pick up on reconnect.
+    timers->setPaused(true);
+    emit disconnected();
+    // After a quit the server was told to close; anything else is a drop,
+    // however recently the player typed.
+    if (wantConnected && autoReconnect && !logout.loggedOut()) scheduleReconnect();
+}
+
+void NetworkWorker::connectFailed(const QString &error) {
+    if (sessionLog) sessionLog->close();
+    emit errorOccurred(error);
+    // Only a dropped connection is retried; a first connect that fails is reported.
+    if (wantConnected && autoReconnect && reconnecting) {
+        scheduleReconnect();
+        return;
+    }
+    wantConnected = false;
+    emit disconnected();
+}
+
+void NetworkWorker::scheduleReconnect() {
+    reconnecting = true;
+    const int delay = reconnectDelayMs(reconnectAttempt, *QRandomGenerator::global());
+    ++reconnectAttempt;
+    reconnectTimer->start(delay);
+    emit reconnectScheduled(reconnectAttempt, delay);
+}
+
+void NetworkWorker::dropSocket() {
+    if (!socket) return;
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+    socket = nullptr;
+}
+
+void NetworkWorker::reconnectNow() {
+    if (hostName.isEmpty() || (socket && socket->state() == QAbstractSocket::ConnectedState)) return;
+    ensureConnector();
+    wantConnected = true;
+    reconnecting = true;
+    reconnectTimer->stop();
+    startConnection();
+}
+
+void NetworkWorker::cancelReconnect() {
+    if (!connector || (socket && socket->state() == QAbstractSocket::ConnectedState)) return;
+    const bool trying = reconnectTimer->isActive() || connector->isActive();
+    wantConnected = false;
+    reconnecting = false;
+    reconnectTimer->stop();
+    connector->cancel();
+    if (trying) emit disconnected();
+}
+
+void NetworkWorker::disconnectFromHost() {
+    wantConnected = false;
+    reconnecting = false;
+    if (connector) connector->cancel();
+    if (reconnectTimer) reconnectTimer->stop();
+    if (socket) socket->disconnectFromHost();
+}
+
+void NetworkWorker::readSocket() {
+    for (;;) {
+        const qint64 n = socket->read(readBuffer.data(), readBuffer.size());
+        if (n <= 0) break;
+        const qint64 readAt = metrics ? ClientMetrics::now() : 0;
+        if (metrics) metrics->bytesIn.fetch_add(quint64(n), std::memory_order_relaxed);
+        if (metrics && commandSentAt) {
+            metrics->roundTrip.record(readAt - commandSentAt);
+            commandSentAt = 0;
+        }
+        parsed.clear();
+        receive(readBuffer.constData(), int(n));
+        if (parsed.isEmpty()) continue;
+
+        RenderBatch &out = batch();
+        const int firstNew = out.lines.size();
+        assembler.feed(parsed, out.lines);
+        out.partial = assembler.partial();
+        out.partialChanged = true;
+        if (metrics) {
+            metrics->readToParsed.record(ClientMetrics::now() - readAt);
+            metrics->linesIn.fetch_add(quint64(out.lines.size() - firstNew), std::memory_order_relaxed);
+        }
+
+        if (sessionLog) sessionLog->append(out.lines.constData() + firstNew, out.lines.size() - firstNew);
+        // Each completed line is matched exactly once, against all triggers.
+        for (int i = firstNew; i < out.lines.size(); ++i) {
+            triggers.matchLine(out.lines[i].text, firedCommands);
+#ifdef AMLP_HAVE_LUA
+            if (scripts) scripts->line(out.lines[i]);
+#endif
+        }
+        // Prompts arrive without a newline, so the password check looks at the
+        // partial, or at the last line when GA/EOR ended the prompt.
+        if (triggers.isPasswordPrompt(out.partial.text)
+            || (promptEnded && out.lines.size() > firstNew && triggers.isPasswordPrompt(out.lines.last().text)))
+            emit passwordPrompt();
+        promptEnded = false;
+        // Triggers, scripts and the log saw every line; the display only gets
+        // what the line rules leave, compacted in place.
+        if (!router.isEmpty()) {
+            int kept = firstNew;
+            for (int i = firstNew; i < out.lines.size(); ++i) {
+                if (!router.route(out.lines[i], out.captured)) continue;
+                if (kept != i) out.lines[kept] = std::move(out.lines[i]);
+                ++kept;
+            }
+            if (metrics && kept < out.lines.size())
+                metrics->linesFiltered.fetch_add(quint64(out.lines.size() - kept), std::memory_order_relaxed);
+            out.lines.resize(kept);
+        }
+    }
+
+    // Trigger commands take the same path as typed ones, aliases included.
+    for (const QString &command : firedCommands) submit(command);
+    firedCommands.clear();
+    publish();
+}
+
+// Runs raw socket bytes through MCCP2 decompression (when active) and the parser.
+void NetworkWorker::receive(const char *data, int len) {
+    while (len > 0) {
+        if (!inflater) {
+            const int used = parser.feed(data, len, parsed);
+            recorder.append(data, used);
+            data += used;
+            len -= used;
+            if (negotiator->takeCompressionStart() && !startInflate()) return;
+            continue;
+        }
+
+        inflater->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        inflater->avail_in = uInt(len);
+        bool ended = false;
+        for (;;) {
+            inflater->next_out = reinterpret_cast<Bytef *>(zlibBuffer.data());
+            inflater->avail_out = uInt(zlibBuffer.size());
+            const int rc = inflate(inflater, Z_NO_FLUSH);
+            const int produced = zlibBuffer.size() - int(inflater->avail_out);
+            if (produced > 0) {
+                recorder.append(zlibBuffer.constData(), produced);
+                // The parser pauses at an MCCP2 start even here, where the
+                // stream is compressed already: drop the start and feed the
+                // rest, so no decompressed byte is lost.
+                for (int fed = 0; fed < produced;) {
+                    fed += parser.feed(zlibBuffer.constData() + fed, produced - fed, parsed);
+                    negotiator->takeCompressionStart();
+                }
+            }
+            if (rc == Z_STREAM_END) {
+                ended = true;
+                break;
+            }
+            if (rc != Z_OK && rc != Z_BUF_ERROR) {
+                emit errorOccurred(QStringLiteral("MCCP decompression failed"));
+                socket->abort();
+                return;
+            }
+            if (inflater->avail_in == 0 && inflater->avail_out != 0) break;
+            if (rc == Z_BUF_ERROR) break;
+        }
+        const int consumed = len - int(inflater->avail_in);
+        data += consumed;
+        len -= consumed;
+        // The server ended compression; whatever follows is plain telnet again.
+        if (ended) {
+            inflateEnd(inflater);
+            delete inflater;
+            inflater = nullptr;
+        }
+    }
+}
+
+bool NetworkWorker::startInflate() {
+    inflater = new z_stream_s();
+    if (inflateInit(inflater) != Z_OK) {
+        delete inflater;
+        inflater = nullptr;
+        emit errorOccurred(QStringLiteral("Unable to start MCCP decompression"));
+        socket->abort();
+        return false;
+    }
+    return true;
+}
+
+void NetworkWorker::startDeflate() {
+    if (deflater) return;
+    // Bytes queued so far, the MCCP3 subnegotiation included, go out plain.
+    writeNow(outBuffer);
+    outBuffer.clear();
+    deflater = new z_stream_s();
+    if (deflateInit(deflater, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        delete deflater;
+        deflater = nullptr;
+    }
+}
+
+void NetworkWorker::endCompression() {
+    if (inflater) {
+        inflateEnd(inflater);
+        delete inflater;
+        inflater = nullptr;
+    }
+    if (deflater) {
+        deflateEnd(deflater);
+        delete deflater;
+        deflater = nullptr;
+    }
+}
+
+RenderBatch &NetworkWorker::batch() {
+    if (!current) {
+        current = new RenderBatch;
+        if (metrics) current->parsedAt = ClientMetrics::now();
+    }
+    return *current;
+}
+
+void NetworkWorker::publish() {
+    runScriptOutput();
+    if (!current) return;
+    // A full ring means the UI is stalled: keep reading and growing this
+    // batch instead of leaving data in the kernel buffer.
+    if (!toUi.push(std::move(current))) {
+        if (!retryTimer->isActive()) retryTimer->start(RetryMs);
+        return;
+    }
+    current = nullptr;
+    if (notifyArmed.exchange(false)) emit batchesReady();
+}
+
+void NetworkWorker::drainOutgoing() {
+    drainQueued.store(false);
+    OutgoingLine line;
+    while (fromUi.pop(line)) {
+        if (line.verbatim)
+            queueCommand(line.text);
+        else
+            submit(line.text);
+    }
+    // Client commands may have printed something.
+    publish();
+}
+
+void NetworkWorker::submit(const QString &line) {
+    QStringList commands;
+    pipeline.expand(line, commands);
+    QStringList sent;
+    for (const QString &command : commands) {
+#ifdef AMLP_HAVE_LUA
+        if (scripts && scripts->alias(command)) continue;
+#endif
+        if (command.startsWith('#')) {
+            runClientCommand(command);
+        } else {
+            queueCommand(command);
+            sent.append(command);
+        }
+    }
+    if (!sent.isEmpty()) emit commandsSent(sent);
+}
+
+void NetworkWorker::runClientCommand(const QString &line) {
+    const QStringList words = line.split(' ', Qt::SkipEmptyParts);
+    const QString name = words.value(0).toLower();
+    if (name == "#alias") {
+        if (words.size() == 1) {
+            const QVector<Alias> list = pipeline.aliases();
+            if (list.isEmpty()) notice("No aliases defined.");
+            for (const Alias &a : list) notice(a.name + " = " + a.expansion);
+            return;
+        }
+        const QString expansion = line.section(' ', 2, -1, QString::SectionSkipEmpty);
+        if (expansion.isEmpty()) {
+            notice("Usage: #alias <name> <expansion>");
+            return;
+        }
+        pipeline.defineAlias(words[1], expansion);
+        notice("Alias " + words[1] + " = " + expansion);
+        emit aliasesChanged(pipeline.aliases());
+    } else if (name == "#unalias") {
+        if (words.size() < 2 || !pipeline.removeAlias(words[1])) {
+            notice("No such alias.");
+            return;
+        }
+        notice("Removed alias " + words[1]);
+        emit aliasesChanged(pipeline.aliases());
+    } else if (name == "#pace") {
+        if (words.size() == 1) {
+            notice(paceRate > 0 ? QString("Pacing: %1 commands/s, burst %2").arg(paceRate).arg(paceBurst)
+                                : QString("Pacing is off."));
+            return;
+        }
+        const int rate = words[1].toInt();
+        setPacing(rate, words.value(2, QString::number(qMax(1, rate))).toInt());
+        notice(paceRate > 0 ? QString("Pacing set to %1 commands/s, burst %2").arg(paceRate).arg(paceBurst)
+                            : QString("Pacing is off."));
+    } else if (name == "#delay" || name == "#ticker" || name == "#untick" || name == "#tickers" || name == "#timers") {
+        runTimerCommand(name, words, line);
+    } else if (name == "#reconnect") {
+        if (hostName.isEmpty())
+            notice("No connection to go back to.");
+        else if (socket && socket->state() == QAbstractSocket::ConnectedState)
+            notice("Already connected.");
+        else
+            reconnectNow();
+    } else if (name == "#lua") {
+        runScriptCommand(words, line);
+    } else {
+        notice("Unknown command " + words.value(0));
+    }
+}
+
+// Fired commands run like typed ones: aliases, stacking and client commands.
+void NetworkWorker::runTimerCommand(const QString &name, const QStringList &words, const QString &line) {
+    auto fire = [this](const QString &command) {
+        submit(command);
+        publish();
+    };
+    if (name == "#delay") {
+        bool ok = false;
+        const qint64 ms = words.value(1).toLongLong(&ok);
+        const QString command = line.section(' ', 2, -1, QString::SectionSkipEmpty);
+        if (!ok || ms < 0 || command.isEmpty()) {
+            notice("Usage: #delay <milliseconds> <command>");
+            return;
+        }
+        timers->start(ms, [fire, command]() { fire(command); });
+    } else if (name == "#ticker") {
+        bool ok = false;
+        const double seconds = words.value(2).toDouble(&ok);
+        const QString command = line.section(' ', 3, -1, QString::SectionSkipEmpty);
+        if (!ok || seconds < 0.001 || command.isEmpty()) {
+            notice("Usage: #ticker <name> <seconds> <command>");
+            return;
+        }
+        Ticker &t = tickers[words[1]];
+        timers->cancel(t.handle);
+        t.intervalMs = qint64(seconds * 1000);
+        t.command = command;
+        t.handle = timers->start(t.intervalMs, [fire, command]() { fire(command); }, t.intervalMs);
+        notice(QString("Ticker %1 every %2 s: %3").arg(words[1]).arg(seconds).arg(command));
+    } else if (name == "#untick") {
+        auto it = tickers.find(words.value(1));
+        if (it == tickers.end()) {
+            notice("No such ticker.");
+            return;
+        }
+        timers->cancel(it->handle);
+        tickers.erase(it);
+        notice("Removed ticker " + words[1]);
+    } else if (name == "#tickers") {
+        if (tickers.isEmpty()) notice("No tickers.");
+        for (auto it = tickers.cbegin(); it != tickers.cend(); ++it) {
+            notice(QString("%1: every %2 s, fired %3 times, next in %4 ms: %5")
+                       .arg(it.key()).arg(double(it->intervalMs) / 1000).arg(timers->fireCount(it->handle))
+                       .arg(timers->remaining(it->handle)).arg(it->command));
+        }
+    } else {
+        const QString action = words.value(1).toLower();
+        if (action == "pause" || action == "resume") timers->setPaused(action == "pause");
+        notice(QString("%1 timers, %2.").arg(timers->count()).arg(timers->isPaused() ? "paused" : "running"));
+    }
+}
+
+void NetworkWorker::runScriptCommand(const QStringList &words, const QString &line) {
+#ifdef AMLP_HAVE_LUA
+    ScriptHost *host = ensureScripts();
+    const QString action = words.value(1).toLower();
+    QString error;
+    if (words.size() == 1 || action == "stats") {
+        for (const QString &text : host->stats()) notice(text);
+    } else if (action == "load" && words.size() > 2) {
+        const QString file = QDir(scriptDir()).absoluteFilePath(line.section(' ', 2, -1, QString::SectionSkipEmpty));
+        if (!host->load(file, error)) {
+            notice("[lua] " + error);
+            return;
+        }
+        if (!scriptFiles.contains(file)) scriptFiles.append(file);
+        notice("Loaded " + file);
+    } else if (action == "reload") {
+        host->reset();
+        loadScripts();
+        notice("Scripts reloaded.");
+    } else if (action == "budget") {
+        if (words.size() > 2) host->setBudget(words[2].toInt());
+        notice(QString("Script budget: %1 instructions per call").arg(host->budget()));
+    } else if (!host->run(line.section(' ', 1, -1, QString::SectionSkipEmpty).toUtf8(), "#lua", error)) {
+        notice("[lua] " + error);
+    }
+#else
+    Q_UNUSED(words);
+    Q_UNUSED(line);
+    notice("Lua scripting is not available in this build.");
+#endif
+}
+
+#ifdef AMLP_HAVE_LUA
+// Created on first use, so sessions without scripts never start a Lua state.
+ScriptHost *NetworkWorker::ensureScripts() {
+    if (scripts) return scripts.get();
+    ScriptHooks hooks;
+    hooks.send = [this](const QString &command) { scriptCommands.append(command); };
+    hooks.echo = [this](const QString &text) { scriptNotices.append(text); };
+    hooks.sendGmcp = [this](const QByteArray &package, const QByteArray &json) { sendGmcp(package, json); };
+    hooks.idle = [this]() { publish(); };
+    scripts = std::make_unique<ScriptHost>(timers, &oobDispatcher, std::move(hooks));
+    loadScripts();
+    return scripts.get();
+}
+
+// Everything in the scripts directory, then whatever #lua load added.
+void NetworkWorker::loadScripts() {
+    const QDir dir(scriptDir());
+    QStringList files;
+    for (const QString &name : dir.entryList({"*.lua"}, QDir::Files, QDir::Name)) files.append(dir.filePath(name));
+    for (const QString &file : scriptFiles)
+        if (!files.contains(file)) files.append(file);
+    for (const QString &file : files) {
+        QString error;
+        if (!scripts->load(file, error)) notice("[lua] " + error);
+    }
+}
+#endif
+
+// Script sends take the typed-command path, aliases and client commands
+// included; echoes become notices.
+void NetworkWorker::runScriptOutput() {
+    for (int round = 0; round < MaxScriptRounds && !scriptCommands.isEmpty(); ++round) {
+        const QStringList commands = std::exchange(scriptCommands, QStringList());
+        for (const QString &command : commands) submit(command);
+    }
+    if (!scriptCommands.isEmpty()) {
+        scriptNotices.append(QString("[lua] dropped %1 commands: scripts kept sending from aliases").arg(scriptCommands.size()));
+        scriptCommands.clear();
+    }
+    const QStringList notices = std::exchange(scriptNotices, QStringList());
+    for (const QString &text : notices) notice(text);
+}
+
+// A client message in the output, between server lines.
+void NetworkWorker::notice(const QString &text) {
+    RenderBatch &out = batch();
+    TextStyle style;
+    style.fg = NoticeColor;
+    const QString line = text + '\n';
+    noticeAssembler.feed(line.constData(), line.size(), style, out.lines);
+}
+
+void NetworkWorker::queueCommand(const QString &command) {
+    ++commandsPending;
+    logout.commandSent(command);
+    if (paceRate > 0)
+        paced.enqueue(CommandPipeline::encode(command, sendEncoding));
+    else
+        outBuffer.append(CommandPipeline::encode(command, sendEncoding));
+    if (!flushQueued) {
+        flushQueued = true;
+        QMetaObject::invokeMethod(this, &NetworkWorker::flushOutgoing, Qt::QueuedConnection);
+    }
+}
+
+void NetworkWorker::queueBytes(const QByteArray &bytes) {
+    outBuffer.append(bytes);
+    if (!flushQueued) {
+        flushQueued = true;
+        QMetaObject::invokeMethod(this, &NetworkWorker::flushOutgoing, Qt::QueuedConnection);
+    }
+}
+
+void NetworkWorker::flushOutgoing() {
+    flushQueued = false;
+    if (!socket || socket->state() != QTcpSocket::ConnectedState) {
+        outBuffer.clear();
+        paced.clear();
+        commandsPending = 0;
+        return;
+    }
+    if (!paced.isEmpty()) {
+        if (paceRate > 0) {
+            tokens = qMin<double>(paceBurst, tokens + paceClock.restart() * paceRate / 1000.0);
+            while (!paced.isEmpty() && tokens >= 1) {
+                outBuffer.append(paced.dequeue());
+                tokens -= 1;
+            }
+            // A long speedwalk leaves in as few writes as the rate allows.
+            if (!paced.isEmpty() && !paceTimer->isActive())
+                paceTimer->start(int(std::ceil((1 - tokens) * 1000 / paceRate)));
+        } else {
+            while (!paced.isEmpty()) outBuffer.append(paced.dequeue());
+        }
+    }
+    if (outBuffer.isEmpty()) return;
+    writeNow(outBuffer);
+    outBuffer.clear();
+    // Round trip is measured from the first command that went out unanswered.
+    const int sent = commandsPending - paced.size();
+    if (sent > 0) {
+        commandsPending -= sent;
+        if (metrics) {
+            metrics->commandsOut.fetch_add(quint64(sent), std::memory_order_relaxed);
+            if (!commandSentAt) commandSentAt = ClientMetrics::now();
+        }
+    }
+}
+
+void NetworkWorker::setPacing(int perSecond, int burst) {
+    paceRate = qMax(0, perSecond);
+    paceBurst = qMax(1, burst);
+    tokens = paceBurst;
+    paceClock.restart();
+    // Anything already waiting goes out under the new limits.
+    if (paceTimer) paceTimer->stop();
+    if (!paced.isEmpty()) flushOutgoing();
+}
+
+void NetworkWorker::writeNow(const QByteArray &bytes) {
+    if (bytes.isEmpty() || !socket || socket->state() != QTcpSocket::ConnectedState) return;
+    if (!deflater) {
+        socket->write(bytes);
+        return;
+    }
+    // MCCP3: one sync flush per write so the server can act on it immediately.
+    deflater->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(bytes.constData()));
+    deflater->avail_in = uInt(bytes.size());
+    QByteArray out;
+    do {
+        deflater->next_out = reinterpret_cast<Bytef *>(zlibBuffer.data());
+        deflater->avail_out = uInt(zlibBuffer.size());
+        deflate(deflater, Z_SYNC_FLUSH);
+        out.append(zlibBuffer.constData(), zlibBuffer.size() - int(deflater->avail_out));
+    } while (deflater->avail_out == 0);
+    socket->write(out);
+}
+
+void NetworkWorker::setQuitPattern(const QString &pattern) {
+    logout.setPattern(pattern);
+}
+
+void NetworkWorker::setWindowSize(int cols, int rows) {
+    negotiator->setWindowSize(cols, rows);
+}
+
+void NetworkWorker::setTriggers(const QVector<Trigger> &list) {
+    triggers.setTriggers(list);
+}
+
+void NetworkWorker::setLineRules(const QVector<LineRule> &rules) {
+    router.setRules(rules);
+}
+
+void NetworkWorker::startRecording(const QString &path) {
+    if (!recorder.open(path)) {
+        emit errorOccurred(QStringLiteral("Unable to open %1 for recording").arg(path));
+        return;
+    }
+    notice("Recording to " + path);
+    publish();
+}
+
+void NetworkWorker::stopRecording() {
+    if (!recorder.isOpen()) return;
+    const qint64 bytes = recorder.bytesWritten();
+    recorder.close();
+    notice(QString("Recording stopped (%1 KB)").arg(bytes / 1024));
+    publish();
+}
+
+void NetworkWorker::setLogging(const LogOptions &options) {
+    sessionLog.reset();
+    if (!options.enabled) return;
+    sessionLog = std::make_unique<SessionLog>(options);
+    if (socket && socket->state() != QAbstractSocket::UnconnectedState) sessionLog->open(hostName);
+}
+
+void NetworkWorker::setAliases(const QVector<Alias> &aliases) {
+    pipeline.setAliases(aliases);
+}
+
+void NetworkWorker::sendGmcp(const QByteArray &package, const QByteArray &json) {
+    if (!negotiator->remoteEnabled(Telnet::Gmcp)) return;
+    queueBytes(TelnetNegotiator::subnegotiation(Telnet::Gmcp, json.isEmpty() ? package : package + ' ' + json));
+}
+
+// Decodes on this thread so the UI only ever sees flattened fields, and
+// never through the text path.
+void NetworkWorker::receiveOutOfBand(quint8 option, const QByteArray &payload) {
+    OobUpdate update;
+    const bool ok = option == Telnet::Gmcp ? decodeGmcp(payload, update) : decodeMsdp(payload, update);
+    if (!ok) return;
+    oobDispatcher.dispatch(update);
+    batch().oob.append(std::move(update));
+}
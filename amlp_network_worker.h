@@ -0,0 +1,233 @@
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QObject>
+#include <QQueue>
+#include <QString>
+
+#include <atomic>
+#include <memory>
+
+#include "amlp_ansi_parser.h"
+#include "amlp_command_pipeline.h"
+#include "amlp_connector.h"
+#include "amlp_gmcp.h"
+#include "amlp_line_router.h"
+#include "amlp_line_store.h"
+#include "amlp_metrics.h"
+#include "amlp_recording.h"
+#include "amlp_script_host.h"
+#include "amlp_session_log.h"
+#include "amlp_spsc_ring.h"
+#include "amlp_timer_wheel.h"
+#include "amlp_triggers.h"
+
+class QTcpSocket;
+class QTimer;
+class TelnetNegotiator;
+struct z_stream_s;
+
+// Lines decoded from one or more socket reads, ready to append to a LineStore.
+struct RenderBatch {
+    QVector<TerminalLine> lines;
+    TerminalLine partial;
+    bool partialChanged = false;
+    // GMCP/MSDP messages decoded alongside the text, in arrival order.
+    QVector<OobUpdate> oob;
+    // Lines line rules routed to capture panes; see LineRouter.
+    QVector<CapturedLine> captured;
+    // ClientMetrics::now() when the batch was started; 0 without metrics.
+    qint64 parsedAt = 0;
+};
+
+// Owns the socket and the decode pipeline on a dedicated thread. Decoded
+// batches reach the UI through a lock-free ring, and outgoing commands come
+// back through another, so a stalled GUI never stops the connection from
+// being read. Create it, move it to its thread, then drive it with queued
+// calls; the ring accessors are the only thread-safe members.
+class NetworkWorker : public QObject {
+    Q_OBJECT
+public:
+    explicit NetworkWorker(QObject *parent = nullptr);
+    ~NetworkWorker() override;
+
+    // UI thread: takes the next decoded batch, which the caller then owns.
+    bool takeBatch(RenderBatch *&batch);
+    // UI thread: call before draining so the next push raises batchesReady again.
+    void rearmNotify() { notifyArmed.store(true, std::memory_order_release); }
+    // UI thread: queues one typed line, without the trailing CRLF. Verbatim
+    // lines (passwords) skip alias expansion, stacking and speedwalks.
+    void sendLine(const QString &line, bool verbatim = false);
+    // Set before the worker's thread starts; may be null.
+    void setMetrics(ClientMetrics *m) {
+        metrics = m;
+        timers->setMetrics(m);
+    }
+
+    // Worker thread only: subscribers see GMCP/MSDP updates as they are
+    // decoded, before they are batched for the UI.
+    OobDispatcher &outOfBand() { return oobDispatcher; }
+
+public slots:
+    // Races the host's addresses; a connection that drops later is retried
+    // with backoff until it is back or disconnectFromHost() is called.
+    void connectToHost(const QString &host, int port);
+    // The profile's character set, used from the next connection on. A
+    // telnet CHARSET agreement overrides it for that connection.
+    void setEncoding(TextEncoding encoding) { profileEncoding = encoding; }
+    void disconnectFromHost();
+    // Skips the rest of the backoff (or retries after a logout).
+    void reconnectNow();
+    // Stops retrying; a live connection is left alone.
+    void cancelReconnect();
+    void setAutoReconnect(bool enabled) { autoReconnect = enabled; }
+    // Matched against each command sent, case-insensitively; empty never matches.
+    void setQuitPattern(const QString &pattern);
+    // Reported to the server over NAWS whenever it changes.
+    void setWindowSize(int cols, int rows);
+    // Sends a GMCP message if the server agreed to GMCP; json may be empty.
+    void sendGmcp(const QByteArray &package, const QByteArray &json);
+    // Recompiles the trigger set; matching happens here, on completed lines.
+    void setTriggers(const QVector<Trigger> &triggers);
+    // Recompiles the gag/highlight/substitute/capture rules.
+    void setLineRules(const QVector<LineRule> &rules);
+    void setAliases(const QVector<Alias> &aliases);
+    // At most `perSecond` commands, with bursts up to `burst`; 0 turns pacing off.
+    void setPacing(int perSecond, int burst);
+    // Captures the inbound stream for amlp_replay until stopped.
+    void startRecording(const QString &path);
+    void stopRecording();
+    // Replaces the session log; a disabled options set turns logging off.
+    void setLogging(const LogOptions &options);
+
+signals:
+    void batchesReady();
+    void connected();
+    void disconnected();
+    void errorOccurred(const QString &message);
+    // A dropped connection will be retried in delayMs; attempt counts from 1.
+    void reconnectScheduled(int attempt, int delayMs);
+    // Right after connected(): the winning address and what the lookup and the race took.
+    void connectTimed(const QString &address, int resolveMs, int connectMs);
+    void passwordPrompt();
+    // #alias / #unalias changed the set; the UI persists it.
+    void aliasesChanged(const QVector<Alias> &aliases);
+    // Typed commands after expansion, as queued for the server (for the automapper).
+    void commandsSent(const QStringList &commands);
+
+private slots:
+    void readSocket();
+    void drainOutgoing();
+    void flushOutgoing();
+    void publish();
+
+private:
+    void ensureConnector();
+    void startConnection();
+    void adoptSocket(QTcpSocket *connectedSocket, const QString &address, qint64 resolveNs, qint64 connectNs);
+    void socketClosed();
+    void connectFailed(const QString &error);
+    void scheduleReconnect();
+    void dropSocket();
+    void receive(const char *data, int len);
+    bool startInflate();
+    void startDeflate();
+    void endCompression();
+    RenderBatch &batch();
+    void submit(const QString &line);
+    void runClientCommand(const QString &line);
+    void runTimerCommand(const QString &name, const QStringList &words, const QString &line);
+    void runScriptCommand(const QStringList &words, const QString &line);
+    void runScriptOutput();
+#ifdef AMLP_HAVE_LUA
+    ScriptHost *ensureScripts();
+    void loadScripts();
+#endif
+    void notice(const QString &text);
+    void queueCommand(const QString &command);
+    void queueBytes(const QByteArray &bytes);
+    void writeNow(const QByteArray &bytes);
+    void receiveOutOfBand(quint8 option, const QByteArray &payload);
+
+    QTcpSocket *socket = nullptr;
+    Connector *connector = nullptr;
+    QTimer *reconnectTimer = nullptr;
+    QTimer *retryTimer = nullptr;
+    QTimer *paceTimer = nullptr;
+    TelnetNegotiator *negotiator;
+    // MCCP2 inbound and MCCP3 outbound zlib streams, while active.
+    z_stream_s *inflater = nullptr;
+    z_stream_s *deflater = nullptr;
+    QByteArray zlibBuffer;
+    AnsiParser parser;
+    LineAssembler assembler;
+    StyledText parsed;
+    // Set when GA/EOR completed a prompt during the current read.
+    bool promptEnded = false;
+    QByteArray readBuffer;
+    OobDispatcher oobDispatcher;
+    TriggerEngine triggers;
+    LineRouter router;
+    QVector<QString> firedCommands;
+    CommandPipeline pipeline;
+    // #delay and #ticker; paused while disconnected.
+    TimerWheel *timers;
+    struct Ticker {
+        TimerWheel::Handle handle;
+        qint64 intervalMs = 0;
+        QString command;
+    };
+    QMap<QString, Ticker> tickers;
+#ifdef AMLP_HAVE_LUA
+    // #lua; after the timers and dispatcher it registers with, so it goes first.
+    std::unique_ptr<ScriptHost> scripts;
+    // Loaded with #lua load, and loaded again on #lua reload.
+    QStringList scriptFiles;
+#endif
+    // What scripts sent and echoed, run once the worker is between lines.
+    QStringList scriptCommands;
+    QStringList scriptNotices;
+    LineAssembler noticeAssembler;
+    RecordingWriter recorder;
+    std::unique_ptr<SessionLog> sessionLog;
+    QString hostName;
+    int hostPort = 0;
+    // Set by connectToHost, cleared by disconnectFromHost: drops are retried in between.
+    bool wantConnected = false;
+    bool autoReconnect = true;
+    // A dropped connection is being re-established.
+    bool reconnecting = false;
+    int reconnectAttempt = 0;
+    // Whether a logout command went out on this connection.
+    LogoutWatch logout;
+    TextEncoding profileEncoding = TextEncoding::Utf8;
+    // What typed commands are encoded as; follows the parser's encoding.
+    TextEncoding sendEncoding = TextEncoding::Utf8;
+
+    // Everything queued during one event-loop pass goes out as one write.
+    QByteArray outBuffer;
+    bool flushQueued = false;
+    // Token bucket for paced commands, which wait here for a token.
+    QQueue<QByteArray> paced;
+    int paceRate = 0;
+    int paceBurst = 1;
+    double tokens = 0;
+    QElapsedTimer paceClock;
+    int commandsPending = 0;
+
+    ClientMetrics *metrics = nullptr;
+    qint64 commandSentAt = 0;
+
+    // Batch being filled; published when the ring has room.
+    RenderBatch *current = nullptr;
+    SpscRing<RenderBatch *> toUi;
+    struct OutgoingLine {
+        QString text;
+        bool verbatim = false;
+    };
+    SpscRing<OutgoingLine> fromUi;
+    std::atomic<bool> notifyArmed{true};
+    std::atomic<bool> drainQueued{false};
+};
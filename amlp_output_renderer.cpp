@@ -0,0 +1,159 @@
+#include "amlp_output_renderer.h"
+
+#include "amlp_automapper.h"
+#include "amlp_capture_panes.h"
+#include "amlp_completion.h"
+#include "amlp_network_worker.h"
+#include "amlp_search.h"
+#include "amlp_terminal_view.h"
+
+namespace {
+const int FrameIntervalMs = 16;
+// Nobody is looking at a background session; batches just need draining.
+const int BackgroundIntervalMs = 250;
+}
+
+OutputRenderer::OutputRenderer(LineStore *store, TerminalView *view, QObject *parent)
+    : QObject(parent), store(store), view(view) {
+    frameTimer.setSingleShot(true);
+    frameTimer.setTimerType(Qt::PreciseTimer);
+    connect(&frameTimer, &QTimer::timeout, this, &OutputRenderer::flush);
+    connect(view, &TerminalView::olderRequested, this, &OutputRenderer::pageIn);
+    connect(view, &TerminalView::painted, this, &OutputRenderer::viewPainted);
+    sinceFlush.start();
+}
+
+void OutputRenderer::setScrollbackLimits(int maxLines, int archiveKB) {
+    if (search) store->setArchiveReserve(search->indexedBytes());
+    store->setLimits(maxLines, archiveKB);
+    store->trim(true);
+    // A smaller archive cap may have dropped lines without a trim.
+    if (search) search->dropBefore(store->firstSeq() - store->archive().lineCount());
+    refreshViews();
+}
+
+void OutputRenderer::setTail(TerminalView *v) {
+    tail = v;
+    connect(tail, &TerminalView::painted, this, &OutputRenderer::viewPainted);
+}
+
+void OutputRenderer::refreshViews() {
+    view->storeChanged();
+    if (tail && !tail->isHidden()) tail->storeChanged();
+}
+
+void OutputRenderer::attach(NetworkWorker *worker) {
+    source = worker;
+    connect(worker, &NetworkWorker::batchesReady, this, &OutputRenderer::schedule);
+}
+
+void OutputRenderer::appendText(const QString &text, const TextStyle &style) {
+    localAssembler.feed(text.constData(), text.size(), style, localLines);
+    schedule();
+}
+
+void OutputRenderer::setActive(bool on) {
+    if (active == on) return;
+    active = on;
+    if (active) {
+        refreshViews();
+        schedule();
+    }
+}
+
+void OutputRenderer::schedule() {
+    if (frameTimer.isActive()) return;
+    // Sparse output goes out immediately; a flood is held to one flush per frame.
+    const qint64 wait = (active ? FrameIntervalMs : BackgroundIntervalMs) - sinceFlush.elapsed();
+    frameTimer.start(wait > 0 ? int(wait) : 0);
+}
+
+void OutputRenderer::flush() {
+    QElapsedTimer budget;
+    budget.start();
+
+    bool textChanged = !localLines.isEmpty();
+    for (TerminalLine &line : localLines) {
+        if (search) search->append(line);
+        store->append(std::move(line));
+    }
+    localLines.clear();
+
+    bool overBudget = false;
+    bool remoteText = false;
+    bool captured = false;
+    if (source) {
+        // Re-arm first so a batch pushed while we drain still raises a signal.
+        source->rearmNotify();
+        RenderBatch *batch = nullptr;
+        while (source->takeBatch(batch)) {
+            if (!batch->lines.isEmpty() || batch->partialChanged) {
+                textChanged = remoteText = true;
+                if (batch->parsedAt) unpainted.append(batch->parsedAt);
+            }
+            for (TerminalLine &line : batch->lines) {
+                if (search) search->append(line);
+                if (mapper && mapper->wantsLines()) mapper->lineReceived(line);
+                if (completion) completion->addSeen(line.text);
+                store->append(std::move(line));
+            }
+            if (batch->partialChanged) store->setPartial(batch->partial);
+            for (CapturedLine &c : batch->captured) {
+                if (completion) completion->addSeen(c.line.text);
+                if (captures) captures->append(c.pane, std::move(c.line));
+                captured = true;
+            }
+            for (OobUpdate &update : batch->oob) pendingOob.append(std::move(update));
+            delete batch;
+            if (budget.elapsed() >= budgetMs) {
+                overBudget = true;
+                break;
+            }
+        }
+    }
+
+    // A frame carrying only GMCP/MSDP leaves the text view alone.
+    if (textChanged) {
+        const bool following = view->isFollowing();
+        // The search index's bitsets come out of the archive's share of the cap.
+        if (search) store->setArchiveReserve(search->indexedBytes());
+        // Lines being read stay put, wherever the reader scrolled or jumped
+        // to, until the store reaches its hard ceiling.
+        if (store->trim(following, following ? -1 : view->firstVisibleSeq()) > 0 && search)
+            search->dropBefore(store->firstSeq() - store->archive().lineCount());
+        if (active) {
+            refreshViews();
+        } else if (remoteText) {
+            emit backgroundOutput();
+        }
+        // Scrolled back with no tail pane, or hidden: new text is not painted.
+        const bool live = view->isFollowing() || (tail && !tail->isHidden());
+        if (!active || !live) unpainted.clear();
+    }
+    if (captured && captures) captures->refresh();
+    if (captured && !active && !remoteText) emit backgroundOutput();
+    pendingOob.dispatchTo(oobDispatcher);
+    sinceFlush.restart();
+
+    // Over budget: leave the rest in the ring and pick it up next frame.
+    if (overBudget) frameTimer.start(active ? FrameIntervalMs : BackgroundIntervalMs);
+}
+
+void OutputRenderer::viewPainted(qint64 ns) {
+    if (!metrics) return;
+    metrics->paint.record(ns);
+    const qint64 now = ClientMetrics::now();
+    for (qint64 parsedAt : unpainted) metrics->parsedToPainted.record(now - parsedAt);
+    unpainted.clear();
+}
+
+void OutputRenderer::pageIn() {
+    if (store->pageIn() > 0) view->storeChanged();
+}
+
+void OutputRenderer::reveal(qint64 seq) {
+    bool paged = false;
+    while (seq < store->firstSeq() && store->pageIn() > 0) paged = true;
+    if (paged) view->storeChanged();
+    if (seq >= store->firstSeq()) view->scrollToLine(seq);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+#include "amlp_ansi_parser.h"
+#include "amlp_gmcp.h"
+#include "amlp_line_store.h"
+#include "amlp_metrics.h"
+
+class Automapper;
+class CapturePanes;
+class CompletionIndex;
+class NetworkWorker;
+class ScrollbackSearch;
+class TerminalView;
+
+// Drains decoded batches from the network worker into the line store at
+// most once per display frame, within a fixed time budget, followed by a
+// single view update. Also applies the scrollback cap and pages archived lines back in
+// when the view asks for older history. GMCP/MSDP updates in the same batches
+// are queued per frame (see OobFrameQueue) and handed to the UI-side dispatcher.
+class OutputRenderer : public QObject {
+    Q_OBJECT
+public:
+    OutputRenderer(LineStore *store, TerminalView *view, QObject *parent = nullptr);
+
+    void attach(NetworkWorker *worker);
+    // Client-side messages; only complete lines are shown.
+    void appendText(const QString &text, const TextStyle &style);
+
+    // Milliseconds of GUI time a single flush may spend storing text.
+    void setFrameBudget(int ms) { budgetMs = ms; }
+
+    void setScrollbackLimits(int maxLines, int archiveKB);
+    OobDispatcher &outOfBand() { return oobDispatcher; }
+    void setMetrics(ClientMetrics *m) { metrics = m; }
+    // Every stored line is also handed to the search index.
+    void setSearch(ScrollbackSearch *s) { search = s; }
+    // Server lines are offered to the automapper while it waits for a room title.
+    void setMapper(Automapper *m) { mapper = m; }
+    // Words in server lines feed the input line's tab completion.
+    void setCompletion(CompletionIndex *c) { completion = c; }
+    // Lines the worker's line rules routed away from the main output.
+    void setCaptures(CapturePanes *c) { captures = c; }
+    // Live pane of a split view. It reads the same store; only it is
+    // refreshed for appends while the main view is scrolled back.
+    void setTail(TerminalView *v);
+    // A session in a background tab keeps storing (and trimming) output but
+    // skips layout and paint, and drains its worker less often.
+    void setActive(bool active);
+
+signals:
+    // Output from the server arrived while inactive.
+    void backgroundOutput();
+
+public slots:
+    // Pages archived lines back in as needed and scrolls the view to seq.
+    void reveal(qint64 seq);
+
+private slots:
+    void flush();
+    void pageIn();
+    void viewPainted(qint64 ns);
+
+private:
+    void schedule();
+    void refreshViews();
+
+    LineStore *store;
+    TerminalView *view;
+    TerminalView *tail = nullptr;
+    NetworkWorker *source = nullptr;
+    LineAssembler localAssembler;
+    QVector<TerminalLine> localLines;
+    OobDispatcher oobDispatcher;
+    OobFrameQueue pendingOob;
+    QTimer frameTimer;
+    QElapsedTimer sinceFlush;
+    int budgetMs = 8;
+    ClientMetrics *metrics = nullptr;
+    ScrollbackSearch *search = nullptr;
+    Automapper *mapper = nullptr;
+    CompletionIndex *completion = nullptr;
+    CapturePanes *captures = nullptr;
+    bool active = true;
+    // parsedAt of batches stored but not yet on screen.
+    QVector<qint64> unpainted;
+};
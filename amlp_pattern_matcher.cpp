@@ -0,0 +1,309 @@
+#include "amlp_pattern_matcher.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// Index of the last character of the escape whose letter is at i, so an
+// operand such as \x41, \101, \k<name> or \cA is not read as literal text.
+int escapeEnd(const QString &regex, int i) {
+    const int n = int(regex.size());
+    auto isDigit = [&](int at, int base) {
+        if (at >= n) return false;
+        const char16_t c = regex.at(at).unicode();
+        if (base == 16) return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+        return c >= '0' && c < '0' + base;
+    };
+    // A bracketed operand: {...}, <...> or '...'.
+    auto bracketed = [&](int at) {
+        if (at >= n) return -1;
+        const QChar open = regex.at(at);
+        const QChar close = open == QLatin1Char('{') ? QLatin1Char('}')
+                            : open == QLatin1Char('<') ? QLatin1Char('>')
+                            : open == QLatin1Char('\'') ? QLatin1Char('\'')
+                                                         : QChar();
+        if (close.isNull()) return -1;
+        const int end = int(regex.indexOf(close, at + 1));
+        return end < 0 ? n - 1 : end;
+    };
+
+    int end = i;
+    switch (regex.at(i).unicode()) {
+    case 'x':
+        if ((end = bracketed(i + 1)) >= 0) return end;
+        for (end = i; end < i + 2 && isDigit(end + 1, 16); ++end) {}
+        return end;
+    case '0':
+        for (; end < i + 2 && isDigit(end + 1, 8); ++end) {}
+        return end;
+    case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
+        while (isDigit(end + 1, 10)) ++end;
+        return end;
+    case 'c':
+        return qMin(i + 1, n - 1);
+    case 'g':
+        if ((end = bracketed(i + 1)) >= 0) return end;
+        end = i;
+        if (end + 1 < n && (regex.at(end + 1) == QLatin1Char('-') || regex.at(end + 1) == QLatin1Char('+'))) ++end;
+        while (isDigit(end + 1, 10)) ++end;
+        return end;
+    case 'k':
+    case 'o':
+    case 'N':
+        return qMax(i, bracketed(i + 1));
+    case 'p':
+    case 'P':
+        if ((end = bracketed(i + 1)) >= 0) return end;
+        return qMin(i + 1, n - 1);
+    case 'Q': {
+        // Quoted text up to \E; skipped rather than taken as a literal.
+        const int quoteEnd = int(regex.indexOf(QLatin1String("\\E"), i + 1));
+        return quoteEnd < 0 ? n - 1 : quoteEnd + 1;
+    }
+    default:
+        return i;
+    }
+}
+}
+
+int PatternMatcher::add(const QString &pattern, int flags) {
+    Pattern p;
+    p.isRegex = flags & Regex;
+    p.caseSensitive = flags & CaseSensitive;
+    p.text = pattern;
+    if (p.isRegex) {
+        p.regex.setPattern(pattern);
+        p.regex.setPatternOptions(p.caseSensitive ? QRegularExpression::NoPatternOption
+                                                  : QRegularExpression::CaseInsensitiveOption);
+        if (p.regex.isValid()) p.literal = requiredLiteral(pattern);
+    } else {
+        p.literal = pattern.toUtf8();
+    }
+    patterns.append(p);
+    return patterns.size() - 1;
+}
+
+void PatternMatcher::clear() {
+    patterns.clear();
+    unfiltered.clear();
+    next.clear();
+    outputStart.clear();
+    outputs.clear();
+    stamp.clear();
+    classCount = 1;
+}
+
+void PatternMatcher::compile() {
+    // Byte classes: every byte that occurs (case-folded) in some literal gets
+    // its own class, everything else shares class 0. Keeps the table narrow.
+    int classOf[256];
+    std::fill(classOf, classOf + 256, 0);
+    classCount = 1;
+    for (const Pattern &p : patterns)
+        for (char c : p.literal) {
+            const quint8 f = fold(quint8(c));
+            if (!classOf[f]) classOf[f] = classCount++;
+        }
+    for (int b = 0; b < 256; ++b) byteClass[b] = quint8(classOf[fold(quint8(b))]);
+
+    // Trie
+    next = QVector<qint32>(classCount, -1);
+    QVector<QVector<qint32>> found(1);
+    unfiltered.clear();
+    for (int i = 0; i < patterns.size(); ++i) {
+        const Pattern &p = patterns[i];
+        if (p.literal.isEmpty()) {
+            if (p.isRegex && p.regex.isValid()) unfiltered.append(i);
+            continue;
+        }
+        qint32 s = 0;
+        for (char c : p.literal) {
+            const int slot = s * classCount + byteClass[quint8(c)];
+            if (next[slot] < 0) {
+                next[slot] = found.size();
+                found.append(QVector<qint32>());
+                next.resize(next.size() + classCount);
+                std::fill(next.end() - classCount, next.end(), -1);
+            }
+            s = next[slot];
+        }
+        found[s].append(i);
+    }
+
+    // Failure links, breadth first, folded into a complete transition table.
+    const int states = found.size();
+    QVector<qint32> fail(states, 0);
+    QVector<qint32> queue;
+    queue.reserve(states);
+    for (int c = 0; c < classCount; ++c) {
+        qint32 &t = next[c];
+        if (t < 0) {
+            t = 0;
+        } else {
+            fail[t] = 0;
+            queue.append(t);
+        }
+    }
+    for (int head = 0; head < queue.size(); ++head) {
+        const qint32 u = queue[head];
+        for (int c = 0; c < classCount; ++c) {
+            qint32 &t = next[u * classCount + c];
+            const qint32 viaFail = next[fail[u] * classCount + c];
+            if (t < 0) {
+                t = viaFail;
+            } else {
+                fail[t] = viaFail;
+                found[t] += found[viaFail];
+                queue.append(t);
+            }
+        }
+    }
+
+    outputStart.resize(states + 1);
+    outputs.clear();
+    for (int s = 0; s < states; ++s) {
+        outputStart[s] = outputs.size();
+        outputs += found[s];
+    }
+    outputStart[states] = outputs.size();
+
+    stamp.fill(0, patterns.size());
+    generation = 0;
+}
+
+void PatternMatcher::match(const QByteArray &utf8, QVector<int> &hits) const {
+    if (patterns.isEmpty() || outputStart.isEmpty()) return;
+    if (++generation == 0) {
+        stamp.fill(0);
+        generation = 1;
+    }
+
+    const int first = hits.size();
+    candidates.clear();
+    const quint8 *data = reinterpret_cast<const quint8 *>(utf8.constData());
+    const int n = utf8.size();
+    qint32 s = 0;
+    for (int i = 0; i < n; ++i) {
+        s = next[s * classCount + byteClass[data[i]]];
+        for (int k = outputStart[s], e = outputStart[s + 1]; k < e; ++k) {
+            const int idx = outputs[k];
+            if (stamp[idx] == generation) continue;
+            const Pattern &p = patterns[idx];
+            // The automaton is case-folded; exact-case literals are confirmed here.
+            if (p.caseSensitive && !p.isRegex
+                && std::memcmp(data + i + 1 - p.literal.size(), p.literal.constData(), size_t(p.literal.size())) != 0)
+                continue;
+            stamp[idx] = generation;
+            if (p.isRegex)
+                candidates.append(idx);
+            else
+                hits.append(idx);
+        }
+    }
+
+    if (!candidates.isEmpty() || !unfiltered.isEmpty()) {
+        const QString line = QString::fromUtf8(utf8);
+        for (int idx : candidates)
+            if (patterns[idx].regex.match(line).hasMatch()) hits.append(idx);
+        for (int idx : unfiltered)
+            if (patterns[idx].regex.match(line).hasMatch()) hits.append(idx);
+    }
+    std::sort(hits.begin() + first, hits.end());
+}
+
+bool PatternMatcher::locate(int index, const QString &line, int from, int &start, int &length) const {
+    const Pattern &p = patterns.at(index);
+    if (p.isRegex) {
+        if (!p.regex.isValid()) return false;
+        const QRegularExpressionMatch m = p.regex.match(line, from);
+        if (!m.hasMatch() || m.capturedLength() == 0) return false;
+        start = int(m.capturedStart());
+        length = int(m.capturedLength());
+        return true;
+    }
+    if (p.text.isEmpty()) return false;
+    start = int(line.indexOf(p.text, from, p.caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive));
+    length = int(p.text.size());
+    return start >= 0;
+}
+
+// Conservative: only literal runs outside groups count, alternation and
+// inline options give up entirely, escapes are skipped with their operands,
+// and a character made optional by ?, * or {} ends the run without itself
+// being included.
+QByteArray PatternMatcher::requiredLiteral(const QString &regex) {
+    QByteArray best;
+    QByteArray run;
+    int depth = 0;
+    auto flush = [&]() {
+        if (run.size() > best.size()) best = run;
+        run.clear();
+    };
+
+    for (int i = 0; i < regex.size(); ++i) {
+        const QChar c = regex.at(i);
+        switch (c.unicode()) {
+        case '|':
+            return QByteArray();
+        case '\\':
+            if (++i >= regex.size()) break;
+            // \d, \w, \b, back-references and the like are not literals.
+            if (regex.at(i).isLetterOrNumber() || regex.at(i).unicode() > 0x7F) {
+                flush();
+                i = escapeEnd(regex, i);
+            } else if (depth == 0) {
+                run.append(char(fold(quint8(regex.at(i).unicode()))));
+            }
+            continue;
+        case '[':
+            flush();
+            // Skip the class, allowing "[]...]" and escaped brackets.
+            ++i;
+            if (i < regex.size() && regex.at(i) == QLatin1Char('^')) ++i;
+            if (i < regex.size() && regex.at(i) == QLatin1Char(']')) ++i;
+            while (i < regex.size() && regex.at(i) != QLatin1Char(']')) {
+                if (regex.at(i) == QLatin1Char('\\')) ++i;
+                ++i;
+            }
+            continue;
+        case '(':
+            // Inline options such as (?i) or (?x) change how the rest reads.
+            if (i + 2 < regex.size() && regex.at(i + 1) == QLatin1Char('?')
+                && QLatin1String("imnsxJU^-").contains(regex.at(i + 2)))
+                return QByteArray();
+            flush();
+            ++depth;
+            continue;
+        case ')':
+            flush();
+            if (depth > 0) --depth;
+            continue;
+        case '?':
+        case '*':
+            if (!run.isEmpty()) run.chop(1);
+            flush();
+            continue;
+        case '{':
+            if (!run.isEmpty()) run.chop(1);
+            flush();
+            while (i < regex.size() && regex.at(i) != QLatin1Char('}')) ++i;
+            continue;
+        case '+':
+        case '.':
+        case '^':
+        case '$':
+            flush();
+            continue;
+        default:
+            break;
+        }
+        if (c.unicode() < 0x20 || c.unicode() > 0x7E) {
+            flush();
+            continue;
+        }
+        if (depth == 0) run.append(char(fold(quint8(c.unicode()))));
+    }
+    flush();
+    // A single character filters almost nothing; just run the regex.
+    return best.size() >= 2 ? best : QByteArray();
+}
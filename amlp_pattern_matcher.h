@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QByteArray>
+#include <QRegularExpression>
+#include <QString>
+#include <QVector>
+
+// Matches one UTF-8 line against many patterns in a single pass. Literals
+// are compiled into one Aho-Corasick automaton over byte classes; each regex
+// contributes its longest required literal to the same automaton and is only
+// run when that literal was seen. Regexes without a usable literal run on
+// every line. Not thread-safe: one matcher per thread.
+class PatternMatcher {
+public:
+    enum Flag { Literal = 0, Regex = 1, CaseSensitive = 2 };
+
+    // Returns the pattern's index, which is what match() reports. An invalid
+    // regex keeps its index but never matches.
+    int add(const QString &pattern, int flags);
+    void clear();
+    // Call after the last add() and before match().
+    void compile();
+
+    // Appends the indices of all matching patterns, in ascending order.
+    void match(const QByteArray &utf8, QVector<int> &hits) const;
+    // First match of one pattern as a UTF-16 range of the decoded line.
+    bool locate(int index, const QString &line, int from, int &start, int &length) const;
+
+    int count() const { return patterns.size(); }
+    bool isEmpty() const { return patterns.isEmpty(); }
+
+    // The longest run of ASCII that every match of the regex must contain,
+    // case-folded; empty when there is none of at least two characters.
+    static QByteArray requiredLiteral(const QString &regex);
+
+private:
+    struct Pattern {
+        QString text;
+        QByteArray literal;     // UTF-8 literal, or the regex's required literal
+        QRegularExpression regex;
+        bool isRegex = false;
+        bool caseSensitive = false;
+    };
+
+    static quint8 fold(quint8 c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; }
+
+    QVector<Pattern> patterns;
+    // Regexes that must be tried on every line.
+    QVector<int> unfiltered;
+
+    // Automaton: next[state * classCount + byteClass[b]]
+    quint8 byteClass[256];
+    int classCount = 1;
+    QVector<qint32> next;
+    // Patterns ending at each state, including those inherited through
+    // failure links: outputs[outputStart[s] .. outputStart[s + 1]).
+    QVector<qint32> outputStart;
+    QVector<qint32> outputs;
+
+    // Per-pattern "already hit on this line" stamp, so no clearing per line.
+    mutable QVector<quint32> stamp;
+    mutable quint32 generation = 0;
+    // Regexes whose literal the current line contains. Cleared per line but
+    // kept, so match() does not allocate once it has grown.
+    mutable QVector<int> candidates;
+};
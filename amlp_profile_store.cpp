@@ -0,0 +1,284 @@
+#include "amlp_profile_store.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+
+#include <cstring>
+
+namespace {
+const char Magic[8] = {'A', 'M', 'L', 'P', 'P', 'R', 'F', '1'};
+const quint32 Version = 1;
+
+enum TriggerFlag : quint8 { TriggerRegex = 1, TriggerCaseSensitive = 2, TriggerEnabled = 4 };
+}
+
+ProfileStore::ProfileStore(QObject *parent) : QObject(parent) {
+}
+
+ProfileStore::~ProfileStore() {
+    unmapFile();
+}
+
+bool ProfileStore::open(const QString &fileName) {
+    unmapFile();
+    entries.clear();
+    dirty = false;
+    path = fileName;
+    mapped.setFileName(path);
+    if (!mapped.exists()) return true;
+    if (mapFile()) {
+        entries.resize(int(mappedRecords));
+        for (int i = 0; i < entries.size(); ++i) entries[i].record = i;
+        return true;
+    }
+    // Keep the damaged file for inspection and start empty.
+    MappedFile::setAside(path);
+    return false;
+}
+
+bool ProfileStore::mapFile() {
+    if (mapped.map([this](const uchar *data, qint64 size) { return validate(data, size); })) return true;
+    unmapFile();
+    return false;
+}
+
+void ProfileStore::unmapFile() {
+    mapped.unmap();
+    records = nullptr;
+    strings = nullptr;
+    details = nullptr;
+    mappedRecords = 0;
+    mappedStrings = 0;
+    mappedDetails = 0;
+}
+
+// Checked once on open so reads can trust every offset.
+bool ProfileStore::validate(const uchar *data, qint64 size) {
+    static_assert(sizeof(Header) == 32, "the header is stored as-is");
+    static_assert(sizeof(Record) == 32, "profile records are stored as-is");
+    if (size < qint64(sizeof(Header)) || !MappedFile::hasPrefix(data, size, Magic, Version)) return false;
+    Header h;
+    std::memcpy(&h, data, sizeof h);
+    const qint64 expected = qint64(sizeof(Header)) + qint64(h.profiles) * qint64(sizeof(Record)) + h.strings
+                            + h.details;
+    if (size != expected) return false;
+
+    const Record *r = reinterpret_cast<const Record *>(data + sizeof(Header));
+    const char *pool = reinterpret_cast<const char *>(r + h.profiles);
+    if (h.strings > 0 && pool[h.strings - 1] != 0) return false;
+    for (quint32 i = 0; i < h.profiles; ++i) {
+        if (r[i].name >= h.strings || r[i].host >= h.strings) return false;
+        if (quint64(r[i].detail) + r[i].detailSize > h.details) return false;
+        if (r[i].encoding > quint8(TextEncoding::Cp437)) return false;
+    }
+
+    records = r;
+    strings = pool;
+    details = pool + h.strings;
+    mappedRecords = h.profiles;
+    mappedStrings = h.strings;
+    mappedDetails = h.details;
+    return true;
+}
+
+QString ProfileStore::string(quint32 offset) const {
+    return QString::fromUtf8(strings + offset);
+}
+
+QString ProfileStore::name(int index) const {
+    const Slot &slot = entries.at(index);
+    return slot.edited ? slot.edited->name : string(record(slot).name);
+}
+
+QString ProfileStore::host(int index) const {
+    const Slot &slot = entries.at(index);
+    return slot.edited ? slot.edited->host : string(record(slot).host);
+}
+
+int ProfileStore::port(int index) const {
+    const Slot &slot = entries.at(index);
+    return slot.edited ? slot.edited->port : int(record(slot).port);
+}
+
+Profile ProfileStore::profile(int index) const {
+    const Slot &slot = entries.at(index);
+    if (slot.edited) return *slot.edited;
+    return decode(record(slot), strings, details);
+}
+
+Profile ProfileStore::decode(const Record &r, const char *pool, const char *detailArea) {
+    Profile p;
+    p.name = QString::fromUtf8(pool + r.name);
+    p.host = QString::fromUtf8(pool + r.host);
+    p.port = r.port;
+    p.scrollbackLines = int(r.scrollbackLines);
+    p.archiveKB = int(r.archiveKB);
+    p.encoding = TextEncoding(r.encoding);
+    if (r.detailSize > 0) decodeDetail(QByteArray::fromRawData(detailArea + r.detail, int(r.detailSize)), p);
+    return p;
+}
+
+int ProfileStore::add(const Profile &profile) {
+    Slot slot;
+    slot.edited = QSharedPointer<Profile>::create(profile);
+    entries.append(slot);
+    dirty = true;
+    emit added(entries.size() - 1);
+    return entries.size() - 1;
+}
+
+void ProfileStore::update(int index, const Profile &profile) {
+    entries[index].edited = QSharedPointer<Profile>::create(profile);
+    dirty = true;
+    emit changed(index);
+}
+
+void ProfileStore::remove(int index) {
+    entries.removeAt(index);
+    dirty = true;
+    emit removed(index);
+}
+
+void ProfileStore::move(int from, int to) {
+    if (from == to) return;
+    entries.move(from, to);
+    dirty = true;
+    emit moved(from, to);
+}
+
+QByteArray ProfileStore::encodeDetail(const Profile &profile) {
+    if (profile.triggers.isEmpty() && profile.aliases.isEmpty()) return QByteArray();
+    QByteArray raw;
+    QDataStream out(&raw, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << quint32(profile.triggers.size());
+    for (const Trigger &t : profile.triggers) {
+        quint8 flags = 0;
+        if (t.regex) flags |= TriggerRegex;
+        if (t.caseSensitive) flags |= TriggerCaseSensitive;
+        if (t.enabled) flags |= TriggerEnabled;
+        out << t.pattern << t.command << flags;
+    }
+    out << quint32(profile.aliases.size());
+    for (const Alias &a : profile.aliases) out << a.name << a.expansion;
+    return raw;
+}
+
+void ProfileStore::decodeDetail(const QByteArray &detail, Profile &profile) {
+    QDataStream in(detail);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint32 n = 0;
+    in >> n;
+    for (quint32 i = 0; i < n && in.status() == QDataStream::Ok; ++i) {
+        Trigger t;
+        quint8 flags = 0;
+        in >> t.pattern >> t.command >> flags;
+        t.regex = flags & TriggerRegex;
+        t.caseSensitive = flags & TriggerCaseSensitive;
+        t.enabled = flags & TriggerEnabled;
+        profile.triggers.append(t);
+    }
+    n = 0;
+    in >> n;
+    for (quint32 i = 0; i < n && in.status() == QDataStream::Ok; ++i) {
+        Alias a;
+        in >> a.name >> a.expansion;
+        profile.aliases.append(a);
+    }
+}
+
+bool ProfileStore::save() {
+    QVector<Record> outRecords;
+    outRecords.reserve(entries.size());
+    QByteArray pool;
+    QByteArray blobs;
+    auto put = [&pool](const QByteArray &utf8) {
+        const quint32 offset = quint32(pool.size());
+        pool.append(utf8);
+        pool.append('\0');
+        return offset;
+    };
+    for (const Slot &slot : entries) {
+        Record r{};
+        QByteArray detail;
+        if (slot.edited) {
+            const Profile &p = *slot.edited;
+            r.name = put(p.name.toUtf8());
+            r.host = put(p.host.toUtf8());
+            r.scrollbackLines = quint32(qMax(0, p.scrollbackLines));
+            r.archiveKB = quint32(qMax(0, p.archiveKB));
+            r.port = quint16(p.port);
+            r.encoding = quint8(p.encoding);
+            detail = encodeDetail(p);
+        } else {
+            // Untouched profiles are copied across without being decoded.
+            const Record &old = record(slot);
+            r = old;
+            r.name = put(QByteArray(strings + old.name));
+            r.host = put(QByteArray(strings + old.host));
+            detail = QByteArray(details + old.detail, int(old.detailSize));
+        }
+        r.detail = quint32(blobs.size());
+        r.detailSize = quint32(detail.size());
+        blobs.append(detail);
+        outRecords.append(r);
+    }
+
+    Header h{};
+    h.prefix = MappedFile::prefix(Magic, Version);
+    h.profiles = quint32(outRecords.size());
+    h.strings = quint32(pool.size());
+    h.details = quint32(blobs.size());
+
+    // Everything is copied out of the mapping by now; if writing fails, the
+    // old file is mapped again and the overlay still refers into it.
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    unmapFile();
+    QSaveFile out(path);
+    const bool ok = out.open(QIODevice::WriteOnly)
+                    && out.write(reinterpret_cast<const char *>(&h), sizeof h) == qint64(sizeof h)
+                    && out.write(reinterpret_cast<const char *>(outRecords.constData()),
+                                 qint64(outRecords.size()) * qint64(sizeof(Record))) >= 0
+                    && out.write(pool) >= 0 && out.write(blobs) >= 0 && out.commit();
+    if (ok && mapFile()) {
+        for (int i = 0; i < entries.size(); ++i) entries[i] = Slot{i, {}};
+        dirty = false;
+        return true;
+    }
+    if (!ok && mapFile()) return false;
+    // Nothing is mapped now, so no slot may refer into a file: each one
+    // becomes an edited copy of what was to be written.
+    for (int i = 0; i < entries.size(); ++i)
+        entries[i] = Slot{-1, QSharedPointer<Profile>::create(decode(outRecords[i], pool.constData(), blobs.constData()))};
+    dirty = true;
+    return false;
+}
+
+int ProfileStore::migrate(QSettings &settings) {
+    if (!entries.isEmpty()) return 0;
+    const QStringList old = settings.value("connections").toStringList();
+    for (const QString &entry : old) {
+        const QStringList parts = entry.split('|');
+        if (parts.size() < 3) continue;
+        Profile p;
+        p.name = parts[0];
+        p.host = parts[1];
+        p.port = parts[2].toInt();
+        p.scrollbackLines = parts.value(3, QString::number(DefaultScrollbackLines)).toInt();
+        p.archiveKB = parts.value(4, QString::number(DefaultArchiveKB)).toInt();
+        p.encoding = encodingFromName(parts.value(5, "UTF-8").toLatin1());
+        add(p);
+    }
+    if (entries.isEmpty() || !save()) return 0;
+    settings.remove("connections");
+    return entries.size();
+}
+
+QString ProfileStore::defaultPath() {
+    const QDir dir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+    return dir.filePath("profiles.amlpprof");
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <QByteArray>
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "amlp_command_pipeline.h"
+#include "amlp_mapped_file.h"
+#include "amlp_scrollback.h"
+#include "amlp_text_codec.h"
+#include "amlp_triggers.h"
+
+class QSettings;
+
+// A saved connection and everything that applies only to it. Its triggers
+// and aliases run alongside the shared ones while it is connected.
+struct Profile {
+    QString name;
+    QString host;
+    int port = 0;
+    int scrollbackLines = DefaultScrollbackLines;
+    int archiveKB = DefaultArchiveKB;
+    TextEncoding encoding = TextEncoding::Utf8;
+    QVector<Trigger> triggers;
+    QVector<Alias> aliases;
+};
+
+// The saved connections, in one file mapped read-only like a MapGraph:
+// fixed-size records holding the menu fields, a pool of names, and each
+// profile's triggers and aliases as a blob that is only decoded when the
+// profile is used or edited. Opening checks offsets and decodes nothing,
+// so hundreds of profiles cost nothing at startup. Edits live in an
+// overlay until save() rewrites the file; each one is signalled, so the
+// menu and dialogs update the one entry instead of rebuilding.
+class ProfileStore : public QObject {
+    Q_OBJECT
+public:
+    explicit ProfileStore(QObject *parent = nullptr);
+    ~ProfileStore() override;
+
+    // A missing file is an empty store; a damaged one is set aside.
+    bool open(const QString &path);
+    // Writes every profile to the file and maps it again.
+    bool save();
+    bool isDirty() const { return dirty; }
+    QString fileName() const { return path; }
+
+    // Fills an empty store from the "name|ip|port|lines|archiveKB|charset"
+    // list kept in QSettings before this store existed, saves it, and drops
+    // the old key. Returns the number of profiles moved over.
+    int migrate(QSettings &settings);
+
+    int count() const { return entries.size(); }
+    QString name(int index) const;
+    QString host(int index) const;
+    int port(int index) const;
+    // Decodes the profile's triggers and aliases too.
+    Profile profile(int index) const;
+
+    int add(const Profile &profile);
+    void update(int index, const Profile &profile);
+    void remove(int index);
+    void move(int from, int to);
+
+    // The default file, in the app data directory.
+    static QString defaultPath();
+
+signals:
+    void added(int index);
+    void changed(int index);
+    void removed(int index);
+    void moved(int from, int to);
+
+private:
+    struct Header {
+        MappedFile::Prefix prefix;
+        quint32 profiles;
+        quint32 strings;
+        quint32 details;
+        quint32 reserved;
+    };
+    struct Record {
+        quint32 name;       // offsets into the string pool
+        quint32 host;
+        quint32 detail;     // offset and size in the detail area
+        quint32 detailSize;
+        quint32 scrollbackLines;
+        quint32 archiveKB;
+        quint16 port;
+        quint8 encoding;
+        quint8 flags;
+        quint32 reserved;
+    };
+    // A profile is either a record of the mapped file or an edited copy.
+    struct Slot {
+        int record = -1;
+        QSharedPointer<Profile> edited;
+    };
+
+    bool mapFile();
+    void unmapFile();
+    bool validate(const uchar *data, qint64 size);
+    QString string(quint32 offset) const;
+    const Record &record(const Slot &slot) const { return records[slot.record]; }
+    // The profile a record holds, read from the given string pool and details.
+    static Profile decode(const Record &r, const char *pool, const char *detailArea);
+    static QByteArray encodeDetail(const Profile &profile);
+    static void decodeDetail(const QByteArray &detail, Profile &profile);
+
+    QString path;
+    MappedFile mapped;
+    bool dirty = false;
+
+    const Record *records = nullptr;
+    const char *strings = nullptr;
+    const char *details = nullptr;
+    quint32 mappedRecords = 0;
+    quint32 mappedStrings = 0;
+    quint32 mappedDetails = 0;
+
+    QVector<Slot> entries;
+};
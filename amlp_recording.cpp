@@ -0,0 +1,89 @@
+#include "amlp_recording.h"
+
+namespace {
+const char Magic[] = "AMLPREC1";
+const int MagicLength = 8;
+
+void putVarint(QByteArray &out, quint64 v) {
+    while (v >= 0x80) {
+        out.append(char(v | 0x80));
+        v >>= 7;
+    }
+    out.append(char(v));
+}
+
+bool getVarint(const QByteArray &in, int &pos, quint64 &v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+        const quint8 b = quint8(in.at(pos++));
+        v |= quint64(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+}
+
+bool RecordingWriter::open(const QString &path) {
+    close();
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+    file.write(Magic, MagicLength);
+    written = MagicLength;
+    lastMicros = 0;
+    clock.start();
+    return true;
+}
+
+void RecordingWriter::append(const char *data, int length) {
+    if (!file.isOpen() || length <= 0) return;
+    const qint64 now = clock.nsecsElapsed() / 1000;
+    QByteArray header;
+    putVarint(header, quint64(now - lastMicros));
+    putVarint(header, quint64(length));
+    lastMicros = now;
+    file.write(header);
+    file.write(data, length);
+    written += header.size() + length;
+}
+
+void RecordingWriter::close() {
+    if (file.isOpen()) file.close();
+}
+
+bool RecordingReader::open(const QString &path) {
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) return false;
+    return openData(f.readAll());
+}
+
+bool RecordingReader::openData(const QByteArray &capture) {
+    if (!capture.startsWith(QByteArray(Magic, MagicLength))) return false;
+    bytes = capture;
+    pos = MagicLength;
+    micros = 0;
+    return true;
+}
+
+bool RecordingReader::next(RecordedChunk &chunk) {
+    quint64 delta = 0;
+    quint64 length = 0;
+    if (!getVarint(bytes, pos, delta) || !getVarint(bytes, pos, length)) return false;
+    if (length > quint64(bytes.size() - pos)) return false;
+    micros += qint64(delta);
+    chunk.micros = micros;
+    chunk.data = bytes.mid(pos, int(length));
+    pos += int(length);
+    return true;
+}
+
+QByteArray encodeRecording(const QVector<RecordedChunk> &chunks) {
+    QByteArray out(Magic, MagicLength);
+    qint64 last = 0;
+    for (const RecordedChunk &c : chunks) {
+        putVarint(out, quint64(qMax<qint64>(0, c.micros - last)));
+        putVarint(out, quint64(c.data.size()));
+        out.append(c.data);
+        last = c.micros;
+    }
+    return out;
+}
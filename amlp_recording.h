@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+// Capture format: the magic "AMLPREC1", then one record per socket read:
+// varint microseconds since the previous record, varint length, bytes.
+// Records hold the stream as the parser sees it, i.e. after MCCP
+// decompression, so a capture replays without the server's zlib state.
+struct RecordedChunk {
+    qint64 micros = 0;      // since the start of the capture
+    QByteArray data;
+};
+
+class RecordingWriter {
+public:
+    bool open(const QString &path);
+    void append(const char *data, int length);
+    void close();
+    bool isOpen() const { return file.isOpen(); }
+    qint64 bytesWritten() const { return written; }
+
+private:
+    QFile file;
+    QElapsedTimer clock;
+    qint64 lastMicros = 0;
+    qint64 written = 0;
+};
+
+class RecordingReader {
+public:
+    bool open(const QString &path);
+    // Reads a capture held in memory, e.g. a synthetic one.
+    bool openData(const QByteArray &capture);
+    bool next(RecordedChunk &chunk);
+
+private:
+    QByteArray bytes;
+    int pos = 0;
+    qint64 micros = 0;
+};
+
+// Encodes chunks into the capture format; used by tools building captures.
+QByteArray encodeRecording(const QVector<RecordedChunk> &chunks);
@@ -0,0 +1,525 @@
+// Headless replay and throughput benchmark for the receive path.
+//
+//   amlp_replay [--realtime] [--synthetic LINES] [capture.amlprec]
+//       Pushes a capture through parser, line assembler, line store and
+//       TerminalView painting in-process and reports per-stage latency.
+//   amlp_replay --loopback [--min-mbps MB] [...]
+//       Serves the capture on localhost and receives it with the real
+//       NetworkWorker/OutputRenderer pair, end to end. Exits non-zero when
+//       the bytes or lines received differ from the capture, or throughput
+//       is under the floor; ctest runs it as replay_loopback.
+//   amlp_replay --serve PORT [...]
+//       Fake MUD server: streams the capture to every client that connects,
+//       without the MCCP negotiation it recorded (the data is plain text).
+//
+// Captures come from Tools > Record Session in the client.
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QPixmap>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QTimer>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+
+#include "amlp_ansi_parser.h"
+#include "amlp_line_store.h"
+#include "amlp_network_worker.h"
+#include "amlp_output_renderer.h"
+#include "amlp_recording.h"
+#include "amlp_telnet.h"
+#include "amlp_terminal_view.h"
+#include "amlp_text_codec.h"
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+const int FrameIntervalMs = 16;
+
+// Peak resident set size in KB, or -1 where unknown.
+qint64 peakMemoryKB() {
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return qint64(pmc.PeakWorkingSetSize / 1024);
+    return -1;
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+#if defined(Q_OS_MACOS)
+    return qint64(usage.ru_maxrss / 1024); // bytes on macOS
+#else
+    return qint64(usage.ru_maxrss);
+#endif
+#else
+    return -1;
+#endif
+}
+
+// Mixed MUD-like traffic: colours, UTF-8, prompts ending in IAC GA, sent in
+// MTU-sized chunks two milliseconds apart. A compressed capture starts the
+// way one recorded from an MCCP server does: the offers, then the MCCP2
+// start with the plain text that was inflated after it.
+QVector<RecordedChunk> syntheticCapture(int lines, bool compressed) {
+    static const char *const words[] = {"the", "orc", "swings", "at", "you", "and", "misses", "a", "cloaked",
+                                        "figure", "arrives", "from", "north", "café", "─", "gold"};
+    QVector<RecordedChunk> chunks;
+    QByteArray pending;
+    quint32 seed = 12345;
+    auto rnd = [&seed](int n) {
+        seed = seed * 1103515245 + 12345;
+        return int((seed >> 16) % quint32(n));
+    };
+    qint64 micros = 0;
+    if (compressed) pending = "Welcome!\r\n\xff\xfb\x56\xff\xfb\x57\xff\xfa\x56\xff\xf0";
+    for (int i = 0; i < lines; ++i) {
+        if (rnd(4) == 0) pending += "\x1b[1;3" + QByteArray::number(1 + rnd(7)) + "m";
+        const int n = 4 + rnd(12);
+        for (int w = 0; w < n; ++w) {
+            pending += words[rnd(16)];
+            pending += ' ';
+        }
+        pending += "\x1b[0m\r\n";
+        if (rnd(20) == 0) pending += "<100hp 80sp 120mv> \xff\xf9";
+        while (pending.size() >= 1400) {
+            chunks.append(RecordedChunk{micros, pending.left(1400)});
+            pending.remove(0, 1400);
+            micros += 2000;
+        }
+    }
+    if (!pending.isEmpty()) chunks.append(RecordedChunk{micros, pending});
+    return chunks;
+}
+
+bool loadCapture(const QCommandLineParser &args, QVector<RecordedChunk> &chunks) {
+    RecordingReader reader;
+    if (!args.positionalArguments().isEmpty()) {
+        if (!reader.open(args.positionalArguments().first())) {
+            std::fprintf(stderr, "Cannot read capture %s\n", qPrintable(args.positionalArguments().first()));
+            return false;
+        }
+    } else {
+        reader.openData(encodeRecording(syntheticCapture(args.value("synthetic").toInt(), args.isSet("mccp"))));
+    }
+    RecordedChunk c;
+    while (reader.next(c)) chunks.append(c);
+    return true;
+}
+
+struct Samples {
+    QVector<qint64> ns;
+
+    void report(const char *name) {
+        if (ns.isEmpty()) return;
+        std::sort(ns.begin(), ns.end());
+        auto pct = [this](double p) { return double(ns[qMin(ns.size() - 1, int(p * ns.size()))]) / 1000.0; };
+        std::printf("  %-10s n=%-8d p50=%8.1fus p90=%8.1fus p99=%8.1fus max=%8.1fus\n", name, int(ns.size()),
+                    pct(0.50), pct(0.90), pct(0.99), double(ns.last()) / 1000.0);
+    }
+};
+
+void reportThroughput(qint64 bytes, qint64 lines, qint64 elapsedNs) {
+    const double secs = qMax<double>(1e-9, double(elapsedNs) / 1e9);
+    std::printf("  bytes      %lld (%.1f MB/s)\n", static_cast<long long>(bytes), double(bytes) / secs / (1024 * 1024));
+    std::printf("  lines      %lld (%.0f lines/s)\n", static_cast<long long>(lines), double(lines) / secs);
+    std::printf("  elapsed    %.3f s\n", secs);
+    std::printf("  peak RSS   %lld KB\n", static_cast<long long>(peakMemoryKB()));
+}
+
+// Same stages the client runs, in one thread, each timed separately.
+int runDirect(const QVector<RecordedChunk> &chunks, bool realtime) {
+    LineStore store(DefaultScrollbackLines, DefaultArchiveKB);
+    TerminalView view(&store);
+    view.resize(900, 600);
+    view.show();
+
+    AnsiParser parser;
+    TelnetNegotiator negotiator;
+    parser.setTelnetHandler(&negotiator);
+    LineAssembler assembler;
+    StyledText parsed;
+    QVector<TerminalLine> lines;
+
+    // GA/EOR ends prompts as lines, as on the network worker.
+    QObject::connect(&negotiator, &TelnetNegotiator::promptMarked, [&]() { assembler.endPrompt(parsed); });
+
+    Samples parse, assemble, storeStage, paint;
+    qint64 bytes = 0;
+    QElapsedTimer total;
+    QElapsedTimer stage;
+    QElapsedTimer sinceFrame;
+    total.start();
+    sinceFrame.start();
+
+    auto frame = [&]() {
+        stage.start();
+        store.trim(true);
+        view.storeChanged();
+        view.viewport()->grab();
+        paint.ns.append(stage.nsecsElapsed());
+        sinceFrame.restart();
+    };
+
+    for (const RecordedChunk &c : chunks) {
+        if (realtime) {
+            const qint64 wait = c.micros - total.nsecsElapsed() / 1000;
+            if (wait > 0) QThread::usleep(quint64(wait));
+        }
+        bytes += c.data.size();
+
+        stage.start();
+        parsed.clear();
+        int offset = 0;
+        // Feed pauses at MCCP starts; captures are already decompressed.
+        while (offset < c.data.size())
+            offset += qMax(1, parser.feed(c.data.constData() + offset, c.data.size() - offset, parsed));
+        negotiator.takeCompressionStart();
+        parse.ns.append(stage.nsecsElapsed());
+
+        stage.start();
+        lines.clear();
+        assembler.feed(parsed, lines);
+        assemble.ns.append(stage.nsecsElapsed());
+
+        stage.start();
+        for (TerminalLine &l : lines) store.append(std::move(l));
+        store.setPartial(assembler.partial());
+        storeStage.ns.append(stage.nsecsElapsed());
+
+        if (sinceFrame.elapsed() >= FrameIntervalMs) frame();
+    }
+    frame();
+    const qint64 elapsed = total.nsecsElapsed();
+
+    std::printf("direct replay (%s), %d chunks\n", realtime ? "real time" : "max speed", int(chunks.size()));
+    reportThroughput(bytes, store.endSeq(), elapsed);
+    parse.report("parse");
+    assemble.report("assemble");
+    storeStage.report("store");
+    paint.report("paint");
+    return 0;
+}
+
+// Repeats one line of the given kind until the buffer holds `bytes`.
+QByteArray decodeCorpus(const char *kind, int bytes) {
+    QByteArray line;
+    if (qstrcmp(kind, "ascii") == 0) {
+        line = "A cloaked figure arrives from the north and swings at the orc, missing it.\r\n";
+    } else if (qstrcmp(kind, "ansi") == 0) {
+        line = "\x1b[1;31mA cloaked\x1b[0m figure \x1b[33marrives\x1b[0m from the \x1b[36mnorth\x1b[0m.\r\n";
+    } else if (qstrcmp(kind, "utf8") == 0) {
+        line = "Le caf\xc3\xa9 est ferm\xc3\xa9 \xe2\x94\x80\xe2\x94\x80 \xe6\x97\xa5\xe6\x9c\xac gold coins.\r\n";
+    } else {
+        line = "\xc9\xcd\xcd\xcd\xbb Gold: 120 \xb3 Caf\x82 \xb0\xb1\xb2\xdb \xc8\xcd\xcd\xbc\r\n";
+    }
+    QByteArray out;
+    out.reserve(bytes + line.size());
+    while (out.size() < bytes) out += line;
+    return out;
+}
+
+// Parser cost per byte for each input kind at each scan implementation the
+// CPU supports, fed in socket-sized reads. Best of three passes.
+int runDecodeBench(int megabytes) {
+    static const char *const kinds[] = {"ascii", "ansi", "utf8", "cp437"};
+    const int bytes = qMax(1, megabytes) * 1024 * 1024;
+    const int ReadSize = 16 * 1024;
+    const ScanLevel best = bestScanLevel();
+    std::printf("decode benchmark, %d MB per input, best of 3\n", qMax(1, megabytes));
+    for (const char *kind : kinds) {
+        const QByteArray input = decodeCorpus(kind, bytes);
+        for (int level = int(ScanLevel::Scalar); level <= int(best); ++level) {
+            setScanLevel(ScanLevel(level));
+            AnsiParser parser;
+            parser.setEncoding(qstrcmp(kind, "cp437") == 0 ? TextEncoding::Cp437 : TextEncoding::Utf8);
+            StyledText parsed;
+            qint64 fastest = -1;
+            for (int pass = 0; pass < 3; ++pass) {
+                QElapsedTimer clock;
+                clock.start();
+                for (int offset = 0; offset < input.size(); offset += ReadSize) {
+                    parsed.clear();
+                    parser.feed(input.constData() + offset, qMin(ReadSize, int(input.size()) - offset), parsed);
+                }
+                const qint64 ns = clock.nsecsElapsed();
+                if (fastest < 0 || ns < fastest) fastest = ns;
+            }
+            std::printf("  %-6s %-7s %6.2f ns/byte %8.1f MB/s\n", kind, scanLevelName(ScanLevel(level)),
+                        double(fastest) / input.size(),
+                        double(input.size()) / qMax<double>(1e-9, double(fastest) / 1e9) / (1024 * 1024));
+        }
+    }
+    setScanLevel(best);
+    return 0;
+}
+
+// Lines the client should end up with: the capture through the parser and
+// line assembler alone, with prompts ended the way the network worker does.
+qint64 expectedLines(const QVector<RecordedChunk> &chunks) {
+    AnsiParser parser;
+    TelnetNegotiator negotiator;
+    parser.setTelnetHandler(&negotiator);
+    LineAssembler assembler;
+    StyledText parsed;
+    QVector<TerminalLine> lines;
+    QObject::connect(&negotiator, &TelnetNegotiator::promptMarked, [&]() { assembler.endPrompt(parsed); });
+    qint64 count = 0;
+    for (const RecordedChunk &c : chunks) {
+        parsed.clear();
+        int offset = 0;
+        while (offset < c.data.size())
+            offset += qMax(1, parser.feed(c.data.constData() + offset, c.data.size() - offset, parsed));
+        negotiator.takeCompressionStart();
+        lines.clear();
+        assembler.feed(parsed, lines);
+        count += lines.size();
+    }
+    return count;
+}
+
+bool isCompression(quint8 option) {
+    return option == Telnet::Mccp2 || option == Telnet::Mccp3;
+}
+
+// The capture without its MCCP2/MCCP3 offers and starts. Captures hold the
+// stream after decompression, so a client that agreed to compression would
+// try to inflate the plain text that follows. Sequences may span chunks.
+QVector<RecordedChunk> withoutCompression(const QVector<RecordedChunk> &chunks) {
+    using namespace Telnet;
+    enum { Data, Iac, Option, SbOption, Sb, SbIac } state = Data;
+    QByteArray held;  // the telnet sequence read so far
+    bool dropSb = false;
+    QVector<RecordedChunk> out;
+    for (const RecordedChunk &c : chunks) {
+        QByteArray data;
+        for (const char ch : c.data) {
+            const quint8 b = quint8(ch);
+            if (state != Data) held += ch;
+            switch (state) {
+            case Data:
+                if (b == IAC) {
+                    held = QByteArray(1, ch);
+                    state = Iac;
+                } else {
+                    data += ch;
+                }
+                break;
+            case Iac:
+                if (b >= WILL && b <= DONT) {
+                    state = Option;
+                } else if (b == SB) {
+                    state = SbOption;
+                } else {
+                    data += held;
+                    state = Data;
+                }
+                break;
+            case Option:
+                if (!isCompression(b)) data += held;
+                state = Data;
+                break;
+            case SbOption:
+                dropSb = isCompression(b);
+                state = Sb;
+                break;
+            case Sb:
+                if (b == IAC) state = SbIac;
+                break;
+            case SbIac:
+                if (b != SE) {
+                    state = Sb;
+                    break;
+                }
+                if (!dropSb) data += held;
+                state = Data;
+                break;
+            }
+        }
+        if (!data.isEmpty()) out.append(RecordedChunk{c.micros, data});
+    }
+    return out;
+}
+
+// Streams the capture, less its MCCP negotiation, to each client and turns
+// down any compression a client asks for; other input is discarded.
+class FakeServer : public QObject {
+public:
+    FakeServer(const QVector<RecordedChunk> &capture, bool realtime, QObject *parent = nullptr)
+        : QObject(parent), chunks(withoutCompression(capture)), realtime(realtime) {
+        QObject::connect(&server, &QTcpServer::newConnection, this, [this]() {
+            while (QTcpSocket *s = server.nextPendingConnection()) stream(s);
+        });
+    }
+
+    bool listen(quint16 port) { return server.listen(QHostAddress::LocalHost, port); }
+    quint16 port() const { return server.serverPort(); }
+    // What each client is sent.
+    const QVector<RecordedChunk> &served() const { return chunks; }
+
+private:
+    void stream(QTcpSocket *socket) {
+        QObject::connect(socket, &QTcpSocket::readyRead, socket, [socket]() {
+            const QByteArray input = socket->readAll();
+            for (int i = 0; i + 2 < input.size(); ++i) {
+                if (quint8(input[i]) != Telnet::IAC || quint8(input[i + 1]) != Telnet::DO) continue;
+                if (!isCompression(quint8(input[i + 2]))) continue;
+                const char wont[3] = {char(Telnet::IAC), char(Telnet::WONT), input[i + 2]};
+                socket->write(wont, 3);
+            }
+        });
+        QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        struct Progress {
+            QElapsedTimer clock;
+            int index = 0;
+        };
+        auto progress = std::make_shared<Progress>();
+        progress->clock.start();
+        auto *timer = new QTimer(socket);
+        timer->setSingleShot(true);
+        timer->setTimerType(Qt::PreciseTimer);
+        QObject::connect(timer, &QTimer::timeout, socket, [this, socket, timer, progress]() {
+            const qint64 now = progress->clock.nsecsElapsed() / 1000;
+            // Write everything that is due, then sleep until the next chunk.
+            while (progress->index < chunks.size() && (!realtime || chunks[progress->index].micros <= now))
+                socket->write(chunks[progress->index++].data);
+            if (progress->index >= chunks.size()) {
+                socket->disconnectFromHost();
+                return;
+            }
+            timer->start(int(qMax<qint64>(0, (chunks[progress->index].micros - now) / 1000)));
+        });
+        timer->start(0);
+    }
+
+    QTcpServer server;
+    QVector<RecordedChunk> chunks;
+    bool realtime;
+};
+
+// The real client pipeline against the fake server over loopback TCP,
+// checked against what the capture holds.
+int runLoopback(const QVector<RecordedChunk> &chunks, bool realtime, double minMBps) {
+    FakeServer server(chunks, realtime);
+    if (!server.listen(0)) {
+        std::fprintf(stderr, "Cannot listen on localhost\n");
+        return 1;
+    }
+    qint64 bytes = 0;
+    for (const RecordedChunk &c : server.served()) bytes += c.data.size();
+    const qint64 lines = expectedLines(chunks);
+
+    LineStore store(DefaultScrollbackLines, DefaultArchiveKB);
+    TerminalView view(&store);
+    view.resize(900, 600);
+    view.show();
+    OutputRenderer renderer(&store, &view);
+    ClientMetrics metrics;
+    QThread thread;
+    auto *worker = new NetworkWorker;
+    worker->setMetrics(&metrics);
+    worker->moveToThread(&thread);
+    QObject::connect(&thread, &QThread::finished, worker, &QObject::deleteLater);
+    renderer.attach(worker);
+    thread.start();
+
+    QElapsedTimer total;
+    QTimer drain;
+    drain.setInterval(FrameIntervalMs);
+    int drainFrames = 0;
+    QObject::connect(worker, &NetworkWorker::disconnected, qApp, [&]() { drain.start(); });
+    QObject::connect(&drain, &QTimer::timeout, qApp, [&]() {
+        // The renderer drains the ring once a frame; wait up to a second for the last lines.
+        if (store.endSeq() < lines && ++drainFrames < 1000 / FrameIntervalMs) return;
+        drain.stop();
+        qApp->quit();
+    });
+    QObject::connect(worker, &NetworkWorker::errorOccurred, qApp, [](const QString &message) {
+        if (message.contains("closed")) return;
+        std::fprintf(stderr, "%s\n", qPrintable(message));
+    });
+
+    total.start();
+    const quint16 port = server.port();
+    QMetaObject::invokeMethod(worker, [worker, port]() {
+        // The server hangs up at the end of the capture; that is not a drop.
+        worker->setAutoReconnect(false);
+        worker->connectToHost("127.0.0.1", port);
+    });
+    qApp->exec();
+    const qint64 elapsed = total.nsecsElapsed();
+    thread.quit();
+    thread.wait();
+
+    std::printf("loopback replay (%s), %d chunks\n", realtime ? "real time" : "max speed", int(chunks.size()));
+    reportThroughput(bytes, store.endSeq(), elapsed);
+    int failures = 0;
+    const qint64 received = qint64(metrics.bytesIn.load());
+    if (received != bytes) {
+        std::fprintf(stderr, "FAIL: received %lld of %lld bytes\n", static_cast<long long>(received),
+                     static_cast<long long>(bytes));
+        ++failures;
+    }
+    if (store.endSeq() != lines) {
+        std::fprintf(stderr, "FAIL: stored %lld lines, the capture holds %lld\n",
+                     static_cast<long long>(store.endSeq()), static_cast<long long>(lines));
+        ++failures;
+    }
+    const double mbps = double(bytes) / qMax<double>(1e-9, double(elapsed) / 1e9) / (1024 * 1024);
+    if (minMBps > 0 && mbps < minMBps) {
+        std::fprintf(stderr, "FAIL: %.1f MB/s is under the %.1f MB/s floor\n", mbps, minMBps);
+        ++failures;
+    }
+    return failures ? 1 : 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    // Headless by default; set QT_QPA_PLATFORM to watch the view.
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    QApplication::setApplicationName("amlp_replay");
+
+    QCommandLineParser args;
+    args.setApplicationDescription("Replays AMLP captures through the client's receive path.");
+    args.addHelpOption();
+    args.addPositionalArgument("capture", "Capture recorded by the client (.amlprec).");
+    args.addOption({"realtime", "Honour capture timestamps instead of running flat out."});
+    args.addOption({"synthetic", "Generate a synthetic capture of N lines when no file is given.", "lines", "200000"});
+    args.addOption({"mccp", "Start the synthetic capture with an MCCP2/MCCP3 negotiation, as from a compressed session."});
+    args.addOption({"loopback", "Receive over loopback TCP with the real network worker."});
+    args.addOption({"min-mbps", "With --loopback, fail below MB megabytes per second.", "MB", "0"});
+    args.addOption({"serve", "Act as a fake MUD server on PORT.", "port"});
+    args.addOption({"bench-decode", "Time the parser alone on MB megabytes of each kind of input.", "MB"});
+    args.process(app);
+
+    if (args.isSet("bench-decode")) return runDecodeBench(args.value("bench-decode").toInt());
+
+    QVector<RecordedChunk> chunks;
+    if (!loadCapture(args, chunks)) return 1;
+
+    const bool realtime = args.isSet("realtime");
+    if (args.isSet("serve")) {
+        FakeServer server(chunks, realtime);
+        if (!server.listen(quint16(args.value("serve").toUInt()))) {
+            std::fprintf(stderr, "Cannot listen on port %s\n", qPrintable(args.value("serve")));
+            return 1;
+        }
+        std::printf("Serving %d chunks on 127.0.0.1:%u\n", int(chunks.size()), unsigned(server.port()));
+        std::fflush(stdout);
+        return app.exec();
+    }
+    if (args.isSet("loopback")) return runLoopback(chunks, realtime, args.value("min-mbps").toDouble());
+    return runDirect(chunks, realtime);
+}
@@ -0,0 +1,514 @@
+#include "amlp_script_host.h"
+
+#ifdef AMLP_HAVE_LUA
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+
+#include <cmath>
+
+extern "C" {
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+}
+
+#include "amlp_style_table.h"
+
+namespace {
+const char *const LineType = "amlp.Line";
+// The budget hook runs every this many VM instructions.
+const int HookInterval = 1000;
+// Loading a script may set up tables and the like; it gets far more room.
+const int LoadTicks = 100000;
+// Consecutive failures before a handler is switched off.
+const int MaxErrors = 5;
+// Longest timer a script may ask for; a longer one is cut to this.
+const double MaxTimerSeconds = 7 * 24 * 3600;
+// Only what cannot reach outside the state: no os or io (os.exit and
+// io.popen would end or block the worker thread), no package loading.
+const luaL_Reg SafeLibraries[] = {
+    {"_G", luaopen_base},           {LUA_STRLIBNAME, luaopen_string}, {LUA_TABLIBNAME, luaopen_table},
+    {LUA_MATHLIBNAME, luaopen_math}, {LUA_UTF8LIBNAME, luaopen_utf8},  {nullptr, nullptr},
+};
+}
+
+ScriptHost::ScriptHost(TimerWheel *timers, OobDispatcher *oob, ScriptHooks hooks)
+    : timers(timers), oob(oob), hooks(std::move(hooks)) {
+    setBudget(budgetInstructions);
+    open();
+}
+
+ScriptHost::~ScriptHost() {
+    close();
+}
+
+ScriptHost *ScriptHost::self(lua_State *L) {
+    return *static_cast<ScriptHost **>(lua_getextraspace(L));
+}
+
+QString ScriptHost::errorText(lua_State *L) {
+    const char *text = lua_tostring(L, -1);
+    const QString message = text ? QString::fromUtf8(text) : QStringLiteral("error object is not a string");
+    lua_pop(L, 1);
+    return message;
+}
+
+void ScriptHost::open() {
+    L = luaL_newstate();
+    *static_cast<ScriptHost **>(lua_getextraspace(L)) = this;
+    for (const luaL_Reg *lib = SafeLibraries; lib->func; ++lib) {
+        luaL_requiref(L, lib->name, lib->func, 1);
+        lua_pop(L, 1);
+    }
+    // The base library's file loaders read stdin when given no name.
+    for (const char *name : {"dofile", "loadfile"}) {
+        lua_pushnil(L);
+        lua_setglobal(L, name);
+    }
+
+    static const luaL_Reg api[] = {
+        {"trigger", luaTrigger}, {"line", luaLine},   {"alias", luaAlias}, {"timer", luaTimer},
+        {"cancel", luaCancel},   {"gmcp", luaGmcp},   {"send", luaSend},   {"echo", luaEcho},
+        {"gmcpsend", luaGmcpSend}, {nullptr, nullptr},
+    };
+    luaL_newlib(L, api);
+    lua_setglobal(L, "amlp");
+
+    static const luaL_Reg lineMethods[] = {
+        {"text", lineText}, {"len", lineLen}, {"sub", lineSub}, {"find", lineFind},
+        {"runs", lineRuns}, {"run", lineRun}, {nullptr, nullptr},
+    };
+    luaL_newmetatable(L, LineType);
+    luaL_newlib(L, lineMethods);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
+    lineSlot = static_cast<const TerminalLine **>(lua_newuserdata(L, sizeof(const TerminalLine *)));
+    *lineSlot = nullptr;
+    luaL_setmetatable(L, LineType);
+    lineRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    lua_sethook(L, budgetHook, LUA_MASKCOUNT, HookInterval);
+    delayHandler = addHandler(DelayHandler, LUA_NOREF, QStringLiteral("one-shot timers"));
+}
+
+void ScriptHost::close() {
+    for (const Handler &h : handlers)
+        if (h.kind == GmcpHandler) oob->unsubscribe(h.subscription);
+    for (const ScriptTimer &t : scriptTimers) timers->cancel(t.handle);
+    scriptTimers.clear();
+    handlers.clear();
+    matcher.clear();
+    triggerHandlers.clear();
+    matcherDirty = false;
+    lineHandlers.clear();
+    aliases.clear();
+    delayHandler = -1;
+    if (L) lua_close(L);
+    L = nullptr;
+    lineSlot = nullptr;
+}
+
+void ScriptHost::reset() {
+    close();
+    open();
+}
+
+void ScriptHost::setBudget(int instructions) {
+    budgetInstructions = qMax(HookInterval, instructions);
+    budgetTicks = budgetInstructions / HookInterval;
+}
+
+void ScriptHost::budgetHook(lua_State *L, lua_Debug *) {
+    ScriptHost *host = self(L);
+    if (++host->ticks > host->limit) luaL_error(L, "instruction budget exceeded");
+}
+
+bool ScriptHost::load(const QString &path, QString &error) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = QFileInfo(path).fileName() + ": " + file.errorString();
+        return false;
+    }
+    return run(file.readAll(), QFileInfo(path).fileName(), error);
+}
+
+bool ScriptHost::run(const QByteArray &chunk, const QString &name, QString &error) {
+    const QByteArray chunkName = "=" + name.toUtf8();
+    if (luaL_loadbuffer(L, chunk.constData(), size_t(chunk.size()), chunkName.constData()) != LUA_OK) {
+        error = errorText(L);
+        return false;
+    }
+    ticks = 0;
+    limit = LoadTicks;
+    if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+        error = errorText(L);
+        return false;
+    }
+    return true;
+}
+
+int ScriptHost::addHandler(Kind kind, int ref, const QString &label) {
+    Handler h;
+    h.kind = kind;
+    h.ref = ref;
+    h.label = label;
+    handlers.append(h);
+    return handlers.size() - 1;
+}
+
+// Pushes the handler's function; false if it has been switched off.
+bool ScriptHost::push(int handler) {
+    if (handlers[handler].disabled) return false;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, handlers[handler].ref);
+    return true;
+}
+
+// Runs the function and arguments on the stack, charging the handler.
+void ScriptHost::call(int handler, int nargs) {
+    ticks = 0;
+    limit = budgetTicks;
+    QElapsedTimer clock;
+    clock.start();
+    const int status = lua_pcall(L, nargs, 0, 0);
+    // The callback may have added handlers; look this one up again.
+    Handler &h = handlers[handler];
+    ++h.calls;
+    h.ns += clock.nsecsElapsed();
+    if (status == LUA_OK) {
+        h.errors = 0;
+        return;
+    }
+    const QString message = errorText(L);
+    if (++h.errors >= MaxErrors && h.kind != DelayHandler) {
+        h.disabled = true;
+        hooks.echo(QString("[lua] %1 switched off after %2 errors: %3").arg(h.label).arg(h.errors).arg(message));
+    } else {
+        hooks.echo(QString("[lua] %1: %2").arg(h.label, message));
+    }
+}
+
+void ScriptHost::line(const TerminalLine &line) {
+    if (lineHandlers.isEmpty() && triggerHandlers.isEmpty()) return;
+    if (matcherDirty) {
+        matcher.compile();
+        matcherDirty = false;
+    }
+    *lineSlot = &line;
+    // By index: a handler may register more handlers.
+    const int lineCount = lineHandlers.size();
+    for (int i = 0; i < lineCount; ++i) {
+        if (!push(lineHandlers[i])) continue;
+        lua_rawgeti(L, LUA_REGISTRYINDEX, lineRef);
+        call(lineHandlers[i], 1);
+    }
+    if (!triggerHandlers.isEmpty()) {
+        hits.clear();
+        matcher.match(line.text, hits);
+        for (int index : hits) {
+            const int h = triggerHandlers[index];
+            if (!push(h)) continue;
+            lua_rawgeti(L, LUA_REGISTRYINDEX, lineRef);
+            int nargs = 1;
+            const QRegularExpression &regex = handlers[h].regex;
+            if (regex.isValid() && regex.captureCount() > 0) {
+                const QRegularExpressionMatch m = regex.match(QString::fromUtf8(line.text));
+                lua_checkstack(L, regex.captureCount());
+                for (int c = 1; c <= regex.captureCount(); ++c, ++nargs) {
+                    const QByteArray captured = m.captured(c).toUtf8();
+                    lua_pushlstring(L, captured.constData(), size_t(captured.size()));
+                }
+            }
+            call(h, nargs);
+        }
+    }
+    *lineSlot = nullptr;
+}
+
+bool ScriptHost::alias(const QString &command) {
+    if (aliases.isEmpty()) return false;
+    auto it = aliases.constFind(command.section(' ', 0, 0));
+    // A switched-off alias lets the command through to the server.
+    if (it == aliases.constEnd() || !push(*it)) return false;
+    const int h = *it;
+    const QString args = command.section(' ', 1, -1, QString::SectionSkipEmpty);
+    const QStringList words = args.split(' ', Qt::SkipEmptyParts);
+    lua_checkstack(L, words.size() + 1);
+    const QByteArray utf8 = args.toUtf8();
+    lua_pushlstring(L, utf8.constData(), size_t(utf8.size()));
+    for (const QString &word : words) {
+        const QByteArray w = word.toUtf8();
+        lua_pushlstring(L, w.constData(), size_t(w.size()));
+    }
+    call(h, 1 + words.size());
+    return true;
+}
+
+void ScriptHost::fireTimer(int id) {
+    auto it = scriptTimers.find(id);
+    if (it == scriptTimers.end()) return;
+    const ScriptTimer t = *it;
+    if (!t.repeat) scriptTimers.erase(it);
+    if (!handlers[t.handler].disabled) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, t.ref);
+        call(t.handler, 0);
+    }
+    if (!t.repeat) {
+        luaL_unref(L, LUA_REGISTRYINDEX, t.ref);
+    } else if (handlers[t.handler].disabled && scriptTimers.contains(id)) {
+        timers->cancel(t.handle);
+        scriptTimers.remove(id);
+    }
+    if (hooks.idle) hooks.idle();
+}
+
+void ScriptHost::gmcpReceived(int handler, const OobUpdate &update) {
+    if (!push(handler)) return;
+    lua_pushlstring(L, update.package.constData(), size_t(update.package.size()));
+    lua_createtable(L, 0, update.fields.size());
+    for (const OobField &f : update.fields) {
+        if (f.isNumber)
+            lua_pushnumber(L, f.number);
+        else
+            lua_pushlstring(L, f.text.constData(), size_t(f.text.size()));
+        lua_setfield(L, -2, f.key.constData());
+    }
+    call(handler, 2);
+}
+
+QStringList ScriptHost::stats() const {
+    QStringList out;
+    out.append(QString("%1 handlers, budget %2 instructions per call").arg(handlers.size() - 1).arg(budgetInstructions));
+    for (const Handler &h : handlers) {
+        if (h.kind == DelayHandler && h.calls == 0) continue;
+        const qint64 avg = h.calls ? h.ns / qint64(h.calls) : 0;
+        out.append(QString("%1: %2 calls, %3 us avg%4").arg(h.label).arg(h.calls).arg(double(avg) / 1000, 0, 'f', 1)
+                       .arg(h.disabled ? QStringLiteral(", off") : QString()));
+    }
+    return out;
+}
+
+// Script API. Arguments are checked before any Qt object is built: a Lua
+// error unwinds with longjmp, which must not skip a destructor.
+
+int ScriptHost::luaTrigger(lua_State *L) {
+    size_t length = 0;
+    const char *pattern = luaL_checklstring(L, 1, &length);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    int flags = PatternMatcher::Literal;
+    if (lua_istable(L, 3)) {
+        lua_getfield(L, 3, "regex");
+        if (lua_toboolean(L, -1)) flags |= PatternMatcher::Regex;
+        lua_getfield(L, 3, "case");
+        if (lua_toboolean(L, -1)) flags |= PatternMatcher::CaseSensitive;
+        lua_pop(L, 2);
+    }
+    lua_pushvalue(L, 2);
+    const int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    ScriptHost *host = self(L);
+    const QString text = QString::fromUtf8(pattern, int(length));
+    const int h = host->addHandler(TriggerHandler, ref, "trigger " + text);
+    if (flags & PatternMatcher::Regex) {
+        QRegularExpression regex(text, flags & PatternMatcher::CaseSensitive ? QRegularExpression::NoPatternOption
+                                                                             : QRegularExpression::CaseInsensitiveOption);
+        if (!regex.isValid())
+            host->hooks.echo(QString("[lua] invalid trigger regex %1: %2").arg(text, regex.errorString()));
+        else if (regex.captureCount() > 0)
+            host->handlers[h].regex = regex;
+    }
+    host->triggerHandlers.append(h);
+    host->matcher.add(text, flags);
+    host->matcherDirty = true;
+    return 0;
+}
+
+int ScriptHost::luaLine(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    lua_pushvalue(L, 1);
+    const int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    ScriptHost *host = self(L);
+    host->lineHandlers.append(host->addHandler(LineHandler, ref, QStringLiteral("line handler")));
+    return 0;
+}
+
+int ScriptHost::luaAlias(lua_State *L) {
+    size_t length = 0;
+    const char *name = luaL_checklstring(L, 1, &length);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    lua_pushvalue(L, 2);
+    const int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    ScriptHost *host = self(L);
+    const QString word = QString::fromUtf8(name, int(length));
+    // Redefining an alias switches the old handler off; its stats stay.
+    auto it = host->aliases.constFind(word);
+    if (it != host->aliases.constEnd()) host->handlers[*it].disabled = true;
+    host->aliases.insert(word, host->addHandler(AliasHandler, ref, "alias " + word));
+    return 0;
+}
+
+int ScriptHost::luaTimer(lua_State *L) {
+    // Bounded before it becomes an integer: NaN or infinity would not convert.
+    const double given = luaL_checknumber(L, 1);
+    luaL_argcheck(L, std::isfinite(given), 1, "seconds must be a finite number");
+    const double seconds = qBound(0.0, given, MaxTimerSeconds);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    const bool repeat = lua_toboolean(L, 3);
+    lua_pushvalue(L, 2);
+    const int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    ScriptHost *host = self(L);
+    const qint64 ms = qMax<qint64>(1, qint64(seconds * 1000));
+    const int id = host->nextTimerId++;
+    const int handler = repeat ? host->addHandler(TickerHandler, LUA_NOREF, QString("timer every %1 s").arg(seconds))
+                               : host->delayHandler;
+    const TimerWheel::Handle handle = host->timers->start(ms, [host, id]() { host->fireTimer(id); }, repeat ? ms : 0);
+    host->scriptTimers.insert(id, ScriptTimer{handle, ref, handler, repeat});
+    lua_pushinteger(L, id);
+    return 1;
+}
+
+int ScriptHost::luaCancel(lua_State *L) {
+    const int id = int(luaL_checkinteger(L, 1));
+    ScriptHost *host = self(L);
+    auto it = host->scriptTimers.find(id);
+    if (it == host->scriptTimers.end()) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    host->timers->cancel(it->handle);
+    luaL_unref(L, LUA_REGISTRYINDEX, it->ref);
+    if (it->repeat) host->handlers[it->handler].disabled = true;
+    host->scriptTimers.erase(it);
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+int ScriptHost::luaGmcp(lua_State *L) {
+    size_t length = 0;
+    const char *package = luaL_checklstring(L, 1, &length);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    lua_pushvalue(L, 2);
+    const int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    ScriptHost *host = self(L);
+    const QByteArray name(package, int(length));
+    const int h = host->addHandler(GmcpHandler, ref, "gmcp " + QString::fromUtf8(name));
+    host->handlers[h].subscription =
+        host->oob->subscribe(name, [host, h](const OobUpdate &update) { host->gmcpReceived(h, update); });
+    return 0;
+}
+
+int ScriptHost::luaSend(lua_State *L) {
+    size_t length = 0;
+    const char *command = luaL_checklstring(L, 1, &length);
+    self(L)->hooks.send(QString::fromUtf8(command, int(length)));
+    return 0;
+}
+
+int ScriptHost::luaEcho(lua_State *L) {
+    size_t length = 0;
+    const char *text = luaL_checklstring(L, 1, &length);
+    self(L)->hooks.echo(QString::fromUtf8(text, int(length)));
+    return 0;
+}
+
+int ScriptHost::luaGmcpSend(lua_State *L) {
+    size_t packageLength = 0, jsonLength = 0;
+    const char *package = luaL_checklstring(L, 1, &packageLength);
+    const char *json = luaL_optlstring(L, 2, "", &jsonLength);
+    self(L)->hooks.sendGmcp(QByteArray(package, int(packageLength)), QByteArray(json, int(jsonLength)));
+    return 0;
+}
+
+// Line methods. Offsets are 1-based byte positions into the UTF-8 text, as
+// with Lua's own string functions.
+
+const TerminalLine &ScriptHost::checkLine(lua_State *L) {
+    auto **slot = static_cast<const TerminalLine **>(luaL_checkudata(L, 1, LineType));
+    if (!*slot) luaL_error(L, "line used after its callback returned");
+    return **slot;
+}
+
+int ScriptHost::lineText(lua_State *L) {
+    const TerminalLine &line = checkLine(L);
+    lua_pushlstring(L, line.text.constData(), size_t(line.text.size()));
+    return 1;
+}
+
+int ScriptHost::lineLen(lua_State *L) {
+    lua_pushinteger(L, checkLine(L).text.size());
+    return 1;
+}
+
+int ScriptHost::lineSub(lua_State *L) {
+    const TerminalLine &line = checkLine(L);
+    const lua_Integer n = line.text.size();
+    lua_Integer i = luaL_optinteger(L, 2, 1);
+    lua_Integer j = luaL_optinteger(L, 3, -1);
+    if (i < 0) i = qMax<lua_Integer>(n + i + 1, 1);
+    else if (i == 0) i = 1;
+    if (j < 0) j = n + j + 1;
+    else if (j > n) j = n;
+    if (i > j)
+        lua_pushliteral(L, "");
+    else
+        lua_pushlstring(L, line.text.constData() + i - 1, size_t(j - i + 1));
+    return 1;
+}
+
+int ScriptHost::lineFind(lua_State *L) {
+    const TerminalLine &line = checkLine(L);
+    size_t length = 0;
+    const char *needle = luaL_checklstring(L, 2, &length);
+    const lua_Integer init = qMax<lua_Integer>(1, luaL_optinteger(L, 3, 1));
+    if (init > line.text.size() + 1) {
+        lua_pushnil(L);
+        return 1;
+    }
+    const qsizetype at = line.text.indexOf(QByteArray::fromRawData(needle, qsizetype(length)), qsizetype(init - 1));
+    if (at < 0) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_pushinteger(L, at + 1);
+    lua_pushinteger(L, at + lua_Integer(length));
+    return 2;
+}
+
+// A line without style runs is one run in the default style.
+int ScriptHost::lineRuns(lua_State *L) {
+    const TerminalLine &line = checkLine(L);
+    lua_pushinteger(L, line.runs.isEmpty() ? (line.text.isEmpty() ? 0 : 1) : line.runs.size());
+    return 1;
+}
+
+// start, length, fg (0xRRGGBB), bg (nil for none) and TextStyle flags of run k.
+int ScriptHost::lineRun(lua_State *L) {
+    const TerminalLine &line = checkLine(L);
+    const lua_Integer k = luaL_checkinteger(L, 2);
+    lua_Integer start = 0;
+    lua_Integer length = line.text.size();
+    StyleId style = 0;
+    if (!line.runs.isEmpty()) {
+        if (k < 1 || k > line.runs.size()) return 0;
+        for (int r = 0; r < k - 1; ++r) start += line.runs[r].length;
+        length = line.runs[int(k - 1)].length;
+        style = line.runs[int(k - 1)].style;
+    } else if (k != 1 || line.text.isEmpty()) {
+        return 0;
+    }
+    const TextStyle &s = StyleTable::instance().style(style);
+    lua_pushinteger(L, start + 1);
+    lua_pushinteger(L, length);
+    lua_pushinteger(L, s.fg & 0xFFFFFF);
+    if (s.hasBackground())
+        lua_pushinteger(L, s.bg & 0xFFFFFF);
+    else
+        lua_pushnil(L);
+    lua_pushinteger(L, s.flags);
+    return 5;
+}
+
+#endif // AMLP_HAVE_LUA
@@ -0,0 +1,147 @@
+#pragma once
+
+#ifdef AMLP_HAVE_LUA
+
+#include <QHash>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <functional>
+
+#include "amlp_gmcp.h"
+#include "amlp_line_store.h"
+#include "amlp_pattern_matcher.h"
+#include "amlp_timer_wheel.h"
+
+struct lua_State;
+struct lua_Debug;
+
+// What scripts can do to the session. The worker holds sends and echoes
+// back until it is between lines, so a script never changes the batch it
+// is reading from.
+struct ScriptHooks {
+    std::function<void(const QString &)> send;
+    std::function<void(const QString &)> echo;
+    std::function<void(const QByteArray &, const QByteArray &)> sendGmcp;
+    // After a callback the worker did not start itself (timers).
+    std::function<void()> idle;
+};
+
+// One Lua state per session, on the session's network thread. Scripts are
+// compiled once when loaded and register handlers through the `amlp` table:
+//
+//   amlp.trigger(pattern, fn [, {regex = true, case = true}])  fn(line, captures...)
+//   amlp.line(fn)                       every completed line
+//   amlp.alias(name, fn)                fn(args, words...) instead of sending
+//   amlp.timer(seconds, fn [, repeat])  up to a week; returns an id for amlp.cancel(id)
+//   amlp.gmcp(package, fn)              fn(package, fields)
+//   amlp.send(cmd), amlp.echo(text), amlp.gmcpsend(package [, json])
+//
+// Trigger patterns share one PatternMatcher, so a line no script cares
+// about costs one scan. A line is handed over as a single reused userdata
+// over the stored bytes (line:text(), line:sub(i, j), line:find(s),
+// line:run(k)); nothing is copied unless the script asks, and the line is
+// only valid during its callback. Every callback runs under an instruction
+// budget, and a handler that keeps failing is switched off.
+class ScriptHost {
+public:
+    ScriptHost(TimerWheel *timers, OobDispatcher *oob, ScriptHooks hooks);
+    ~ScriptHost();
+
+    ScriptHost(const ScriptHost &) = delete;
+    ScriptHost &operator=(const ScriptHost &) = delete;
+
+    bool load(const QString &path, QString &error);
+    bool run(const QByteArray &chunk, const QString &name, QString &error);
+    // Drops every handler and starts again with a fresh state.
+    void reset();
+
+    void line(const TerminalLine &line);
+    // True if a script alias took the command.
+    bool alias(const QString &command);
+
+    // Per-callback budget in VM instructions.
+    void setBudget(int instructions);
+    int budget() const { return budgetInstructions; }
+    QStringList stats() const;
+
+private:
+    enum Kind { TriggerHandler, LineHandler, AliasHandler, TickerHandler, DelayHandler, GmcpHandler };
+    struct Handler {
+        Kind kind;
+        int ref;
+        QString label;
+        // Regex triggers with capture groups, which are passed to the handler.
+        QRegularExpression regex;
+        int subscription = 0;
+        quint64 calls = 0;
+        qint64 ns = 0;
+        int errors = 0;
+        bool disabled = false;
+    };
+    struct ScriptTimer {
+        TimerWheel::Handle handle;
+        int ref;
+        int handler;
+        bool repeat;
+    };
+
+    void open();
+    void close();
+    int addHandler(Kind kind, int ref, const QString &label);
+    bool push(int handler);
+    void call(int handler, int nargs);
+    void fireTimer(int id);
+    void gmcpReceived(int handler, const OobUpdate &update);
+
+    static ScriptHost *self(lua_State *L);
+    static QString errorText(lua_State *L);
+    static void budgetHook(lua_State *L, lua_Debug *ar);
+    static int luaTrigger(lua_State *L);
+    static int luaLine(lua_State *L);
+    static int luaAlias(lua_State *L);
+    static int luaTimer(lua_State *L);
+    static int luaCancel(lua_State *L);
+    static int luaGmcp(lua_State *L);
+    static int luaSend(lua_State *L);
+    static int luaEcho(lua_State *L);
+    static int luaGmcpSend(lua_State *L);
+    static const TerminalLine &checkLine(lua_State *L);
+    static int lineText(lua_State *L);
+    static int lineLen(lua_State *L);
+    static int lineSub(lua_State *L);
+    static int lineFind(lua_State *L);
+    static int lineRuns(lua_State *L);
+    static int lineRun(lua_State *L);
+
+    lua_State *L = nullptr;
+    TimerWheel *timers;
+    OobDispatcher *oob;
+    ScriptHooks hooks;
+
+    QVector<Handler> handlers;
+    PatternMatcher matcher;
+    QVector<int> triggerHandlers;   // handler for each matcher index
+    bool matcherDirty = false;
+    QVector<int> hits;
+    QVector<int> lineHandlers;
+    QHash<QString, int> aliases;
+    QHash<int, ScriptTimer> scriptTimers;
+    int nextTimerId = 1;
+    // One-shot timers share a handler, so their stats don't grow per call.
+    int delayHandler = -1;
+
+    // The userdata every line callback gets, pointed at the current line.
+    int lineRef = 0;
+    const TerminalLine **lineSlot = nullptr;
+
+    int budgetInstructions = 200000;
+    int budgetTicks = 0;
+    // Hook ticks used by the running callback, and how many it may use.
+    int ticks = 0;
+    int limit = 0;
+};
+
+#endif // AMLP_HAVE_LUA
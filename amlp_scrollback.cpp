@@ -0,0 +1,45 @@
+#include "amlp_scrollback.h"
+
+ScrollbackArchive::ScrollbackArchive(int maxKB)
+    : capBytes(qint64(maxKB) * 1024) {
+}
+
+void ScrollbackArchive::setMaxKB(int kb) {
+    capBytes = qint64(qMax(0, kb)) * 1024;
+    enforceCap();
+}
+
+void ScrollbackArchive::push(const QByteArray &lines, int lineCount) {
+    if (capBytes <= 0 || lineCount <= 0) return;
+    Chunk c{qCompress(lines, 6), lineCount};
+    totalBytes += c.data.size();
+    totalLines += lineCount;
+    chunks.append(std::move(c));
+    enforceCap();
+}
+
+bool ScrollbackArchive::takeNewest(QByteArray &lines, int &lineCount) {
+    if (chunks.isEmpty()) return false;
+    Chunk c = chunks.takeLast();
+    totalBytes -= c.data.size();
+    totalLines -= c.lines;
+    lines = qUncompress(c.data);
+    lineCount = c.lines;
+    return true;
+}
+
+void ScrollbackArchive::clear() {
+    chunks.clear();
+    totalBytes = 0;
+    totalLines = 0;
+}
+
+void ScrollbackArchive::enforceCap() {
+    // QList keeps free space at the front, so dropping the oldest chunk is O(1).
+    while (totalBytes + reserved > capBytes && !chunks.isEmpty()) {
+        const Chunk &c = chunks.first();
+        totalBytes -= c.data.size();
+        totalLines -= c.lines;
+        chunks.removeFirst();
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+
+// Defaults used when a saved connection does not set its own limits.
+const int DefaultScrollbackLines = 20000;
+const int DefaultArchiveKB = 8 * 1024;
+
+// Compressed tier for lines evicted from the live view. Chunks are kept
+// oldest-first; the oldest are dropped once the byte cap is reached.
+class ScrollbackArchive {
+public:
+    struct Chunk {
+        QByteArray data;
+        int lines;
+    };
+
+    explicit ScrollbackArchive(int maxKB = DefaultArchiveKB);
+
+    void setMaxKB(int kb);
+    int maxKB() const { return int(capBytes / 1024); }
+
+    // Compresses one serialized chunk of evicted lines.
+    void push(const QByteArray &lines, int lineCount);
+    // Removes and returns the most recently evicted chunk, for paging back in.
+    bool takeNewest(QByteArray &lines, int &lineCount);
+    // The chunks, oldest first. Implicitly shared, so the copy can be read
+    // on another thread while the archive changes.
+    QList<Chunk> chunkList() const { return chunks; }
+    // Bytes held elsewhere on the archive's behalf (the search index) that
+    // count against the cap; applied from the next push.
+    void setReservedBytes(qint64 bytes) { reserved = bytes; }
+    // False when a push would be dropped at once: no cap, or the reserve
+    // takes all of it.
+    bool hasRoom() const { return capBytes > reserved; }
+
+    bool isEmpty() const { return chunks.isEmpty(); }
+    qint64 lineCount() const { return totalLines; }
+    qint64 compressedBytes() const { return totalBytes; }
+    void clear();
+
+private:
+    void enforceCap();
+
+    QList<Chunk> chunks;
+    qint64 capBytes;
+    qint64 totalBytes = 0;
+    qint64 totalLines = 0;
+    qint64 reserved = 0;
+};
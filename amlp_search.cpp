@@ -0,0 +1,255 @@
+#include "amlp_search.h"
+
+#include <algorithm>
+
+#include "amlp_pattern_matcher.h"
+
+namespace {
+
+struct FoldTables {
+    quint8 identity[256];
+    quint8 lower[256];
+    FoldTables() {
+        for (int b = 0; b < 256; ++b) {
+            identity[b] = quint8(b);
+            lower[b] = quint8(b >= 'A' && b <= 'Z' ? b + 32 : b);
+        }
+    }
+};
+
+const FoldTables &folds() {
+    static const FoldTables tables;
+    return tables;
+}
+
+bool isAscii(const QString &s) {
+    for (QChar c : s)
+        if (c.unicode() > 0x7F) return false;
+    return true;
+}
+
+} // namespace
+
+bool SearchSegment::mayContain(const QVector<quint16> &required) const {
+    const quint64 *bits = trigrams.constData();
+    for (quint16 t : required)
+        if (!((bits[t >> 6] >> (t & 63)) & 1)) return false;
+    return true;
+}
+
+void SearchSource::capture(const LineStore &store) {
+    live = store.snapshot();
+    liveFirst = store.firstSeq();
+    chunks = store.archive().chunkList();
+    // The archive ends where the store's lines begin.
+    chunkFirst.resize(chunks.size());
+    qint64 first = liveFirst;
+    for (int i = chunks.size() - 1; i >= 0; --i) {
+        first -= chunks.at(i).lines;
+        chunkFirst[i] = first;
+    }
+}
+
+const QByteArray *SearchReader::line(qint64 seq) {
+    if (seq >= source.liveFirst) {
+        const qint64 i = seq - source.liveFirst;
+        return i < source.live.size() ? &source.live.at(int(i)).text : nullptr;
+    }
+    if (chunk < 0 || seq < source.chunkFirst.at(chunk) || seq >= source.chunkFirst.at(chunk) + unpacked.size()) {
+        const auto it = std::upper_bound(source.chunkFirst.constBegin(), source.chunkFirst.constEnd(), seq);
+        if (it == source.chunkFirst.constBegin()) return nullptr;
+        chunk = int(it - source.chunkFirst.constBegin()) - 1;
+        unpacked = LineStore::unpack(source.chunks.at(chunk).data);
+    }
+    const qint64 i = seq - source.chunkFirst.at(chunk);
+    return i < unpacked.size() ? &unpacked.at(int(i)).text : nullptr;
+}
+
+quint16 SearchPattern::trigram(quint8 a, quint8 b, quint8 c) {
+    return quint16((((quint32(a) << 16) | (quint32(b) << 8) | c) * 2654435761u) >> 16);
+}
+
+SearchPattern::SearchPattern(const QString &query, bool regexMode, bool matchCase)
+    : text(query), useRegex(regexMode), caseSensitive(matchCase) {
+    // Stored lines never contain a newline, so a match cannot either.
+    text.remove(QLatin1Char('\n'));
+    // The byte scanner only folds ASCII; other scripts go through the regex engine.
+    if (!useRegex && !caseSensitive && !isAscii(text)) {
+        useRegex = true;
+        text = QRegularExpression::escape(text);
+    }
+
+    if (useRegex) {
+        regex.setPattern(text);
+        regex.setPatternOptions(caseSensitive ? QRegularExpression::NoPatternOption
+                                              : QRegularExpression::CaseInsensitiveOption);
+        valid = !text.isEmpty() && regex.isValid();
+        if (valid) needle = PatternMatcher::requiredLiteral(text);
+        // The required literal comes back folded, so it is always compared folded.
+        fold = folds().lower;
+    } else {
+        needle = text.toUtf8();
+        valid = !needle.isEmpty();
+        fold = caseSensitive ? folds().identity : folds().lower;
+        for (char &c : needle) c = char(fold[quint8(c)]);
+    }
+
+    const int m = needle.size();
+    std::fill(skip, skip + 256, qMax(1, m));
+    for (int k = 0; k + 1 < m; ++k) skip[quint8(needle[k])] = m - 1 - k;
+
+    // The index is built from folded text whatever the query's case mode.
+    const quint8 *lower = folds().lower;
+    for (int i = 0; i + 2 < m; ++i)
+        required.append(trigram(lower[quint8(needle[i])], lower[quint8(needle[i + 1])], lower[quint8(needle[i + 2])]));
+    std::sort(required.begin(), required.end());
+    required.erase(std::unique(required.begin(), required.end()), required.end());
+}
+
+int SearchPattern::find(const char *hay, int length, int from) const {
+    const int m = needle.size();
+    const quint8 *h = reinterpret_cast<const quint8 *>(hay);
+    const quint8 *n = reinterpret_cast<const quint8 *>(needle.constData());
+    const quint8 last = n[m - 1];
+    for (int i = from; i + m <= length;) {
+        const quint8 c = fold[h[i + m - 1]];
+        if (c == last) {
+            int k = m - 2;
+            while (k >= 0 && fold[h[i + k]] == n[k]) --k;
+            if (k < 0) return i;
+        }
+        i += skip[c];
+    }
+    return -1;
+}
+
+bool SearchPattern::lineMatches(const char *utf8, int length) const {
+    if (!needle.isEmpty() && find(utf8, length, 0) < 0) return false;
+    return !useRegex || regex.match(QString::fromUtf8(utf8, length)).hasMatch();
+}
+
+bool SearchPattern::matches(const QByteArray &utf8) const {
+    return valid && lineMatches(utf8.constData(), utf8.size());
+}
+
+void SearchPattern::search(const SearchSegment &segment, SearchReader &lines, QVector<qint64> &hits) const {
+    if (!valid || !segment.mayContain(required)) return;
+    for (qint64 seq = segment.firstSeq, end = seq + segment.lineCount(); seq < end; ++seq) {
+        const QByteArray *line = lines.line(seq);
+        if (line && lineMatches(line->constData(), int(line->size()))) hits.append(seq);
+    }
+}
+
+void SearchPattern::ranges(const QString &line, QVector<QPair<int, int>> &out) const {
+    if (!valid) return;
+    if (useRegex) {
+        QRegularExpressionMatchIterator it = regex.globalMatch(line);
+        while (it.hasNext()) {
+            const QRegularExpressionMatch m = it.next();
+            if (m.capturedLength() > 0) out.append(qMakePair(int(m.capturedStart()), int(m.capturedLength())));
+        }
+        return;
+    }
+    const Qt::CaseSensitivity cs = caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    for (int from = 0; (from = int(line.indexOf(text, from, cs))) >= 0; from += int(text.size()))
+        out.append(qMakePair(from, int(text.size())));
+}
+
+ScrollbackSearch::ScrollbackSearch(const LineStore *store, QObject *parent) : QObject(parent), store(store) {}
+
+ScrollbackSearch::~ScrollbackSearch() {
+    cancel();
+    pool.waitForDone();
+}
+
+void ScrollbackSearch::append(const TerminalLine &line) {
+    const qint64 seq = endSeq++;
+    if (segments.isEmpty() || segments.last().lineCount() >= SearchSegment::Lines) {
+        SearchSegment fresh;
+        fresh.firstSeq = seq;
+        fresh.trigrams.fill(0, SearchSegment::TrigramBits / 64);
+        segments.append(fresh);
+        bytes += SearchSegment::TrigramBits / 8;
+    }
+    SearchSegment &segment = segments.last();
+    ++segment.lines;
+
+    const quint8 *lower = folds().lower;
+    const quint8 *p = reinterpret_cast<const quint8 *>(line.text.constData());
+    quint64 *bits = segment.trigrams.data();
+    for (int i = 0, n = line.text.size(); i + 2 < n; ++i) {
+        const quint16 t = SearchPattern::trigram(lower[p[i]], lower[p[i + 1]], lower[p[i + 2]]);
+        bits[t >> 6] |= quint64(1) << (t & 63);
+    }
+
+    if (active && active->matches(line.text)) {
+        if (job) {
+            liveHits.append(seq);
+        } else {
+            hits.append(seq);
+            emit resultsExtended();
+        }
+    }
+}
+
+void ScrollbackSearch::dropBefore(qint64 seq) {
+    int n = 0;
+    while (n + 1 < segments.size() && segments[n].firstSeq + segments[n].lineCount() <= seq) {
+        bytes -= SearchSegment::TrigramBits / 8;
+        ++n;
+    }
+    if (n > 0) segments.remove(0, n);
+    hits.erase(hits.begin(), std::lower_bound(hits.begin(), hits.end(), seq));
+}
+
+void ScrollbackSearch::start(std::shared_ptr<const SearchPattern> pattern) {
+    cancel();
+    active = std::move(pattern);
+    hits.clear();
+    liveHits.clear();
+    if (!active || !active->isValid()) {
+        active.reset();
+        emit finished(0, 0);
+        return;
+    }
+
+    auto next = std::make_shared<Job>();
+    next->pattern = active;
+    next->segments = segments;
+    next->source.capture(*store);
+    next->timer.start();
+    const int count = next->segments.size();
+    const int slices = qBound(1, pool.maxThreadCount(), qMax(1, count));
+    next->slices.resize(slices);
+    next->remaining.store(slices);
+    job = next;
+
+    for (int s = 0; s < slices; ++s) {
+        const int begin = int(qint64(count) * s / slices);
+        const int end = int(qint64(count) * (s + 1) / slices);
+        QVector<qint64> *out = next->slices.data() + s;
+        pool.start([this, next, out, begin, end]() {
+            SearchReader lines(next->source);
+            for (int i = begin; i < end && !next->cancelled.load(std::memory_order_relaxed); ++i)
+                next->pattern->search(next->segments.at(i), lines, *out);
+            if (next->remaining.fetch_sub(1) == 1 && !next->cancelled.load())
+                QMetaObject::invokeMethod(this, [this, next]() { finish(next); }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void ScrollbackSearch::cancel() {
+    if (!job) return;
+    job->cancelled.store(true);
+    job.reset();
+}
+
+void ScrollbackSearch::finish(const std::shared_ptr<Job> &done) {
+    if (done != job) return;
+    job.reset();
+    // Slices cover consecutive segments, so concatenating keeps the order.
+    for (const QVector<qint64> &slice : done->slices) hits += slice;
+    hits += liveHits;
+    liveHits.clear();
+    emit finished(hits.size(), done->timer.nsecsElapsed());
+}
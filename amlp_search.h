@@ -0,0 +1,149 @@
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPair>
+#include <QRegularExpression>
+#include <QThreadPool>
+#include <QVector>
+
+#include <atomic>
+#include <memory>
+
+#include "amlp_line_store.h"
+
+// A bitset of the case-folded trigrams in a run of consecutive stored
+// lines. The text itself stays in the store and its archive; segments are
+// implicitly shared, so a query works on a snapshot while the UI appends.
+struct SearchSegment {
+    static constexpr int Lines = 2048;
+    static constexpr int TrigramBits = 1 << 16;
+
+    qint64 firstSeq = 0;
+    int lines = 0;
+    QVector<quint64> trigrams;  // TrigramBits bits
+
+    int lineCount() const { return lines; }
+    bool mayContain(const QVector<quint16> &required) const;
+};
+
+// The lines a query reads, taken from the store on the GUI thread: its
+// complete lines and its archive chunks, both implicitly shared, so the
+// pool reads them while the store moves on.
+struct SearchSource {
+    void capture(const LineStore &store);
+
+    QList<TerminalLine> live;
+    qint64 liveFirst = 0;
+    QList<ScrollbackArchive::Chunk> chunks;
+    QVector<qint64> chunkFirst;  // sequence number of each chunk's first line
+};
+
+// Reads a SearchSource by sequence number, decompressing one archive chunk
+// at a time as a scan walks through them. One per pool thread.
+class SearchReader {
+public:
+    explicit SearchReader(const SearchSource &source) : source(source) {}
+    // The line's text, or null when it is no longer kept.
+    const QByteArray *line(qint64 seq);
+
+private:
+    const SearchSource &source;
+    int chunk = -1;
+    QList<TerminalLine> unpacked;
+};
+
+// One compiled query. Immutable once built, so background scans and the
+// view's highlighter can share it.
+class SearchPattern {
+public:
+    SearchPattern(const QString &text, bool regex, bool caseSensitive);
+
+    bool isValid() const { return valid; }
+    QString errorString() const { return regex.errorString(); }
+
+    // Appends the sequence numbers of matching lines in the segment, in order.
+    void search(const SearchSegment &segment, SearchReader &lines, QVector<qint64> &hits) const;
+    bool matches(const QByteArray &utf8) const;
+    // Every match in a decoded line, as (start, length) UTF-16 ranges.
+    void ranges(const QString &line, QVector<QPair<int, int>> &out) const;
+
+    static quint16 trigram(quint8 a, quint8 b, quint8 c);
+
+private:
+    // Horspool search for `needle` (folded when case-insensitive).
+    int find(const char *hay, int length, int from) const;
+    bool lineMatches(const char *utf8, int length) const;
+
+    QString text;
+    bool useRegex;
+    bool caseSensitive;
+    bool valid = true;
+    QRegularExpression regex;
+    // Bytes every match contains; for a regex, its required literal.
+    QByteArray needle;
+    const quint8 *fold;
+    int skip[256];
+    // Folded trigrams of needle, for skipping whole segments.
+    QVector<quint16> required;
+};
+
+// Scrollback search. Every stored line is added to a trigram-filtered
+// segment index as it is appended; queries snapshot the index and the store
+// and scan them on a thread pool, one slice of segments per thread, so the
+// GUI thread never waits. Only segments whose trigrams fit are read, and
+// archived lines are decompressed just for those. Starting a new query
+// cancels the one in flight. While a query is active, new lines are
+// matched as they arrive.
+class ScrollbackSearch : public QObject {
+    Q_OBJECT
+public:
+    explicit ScrollbackSearch(const LineStore *store, QObject *parent = nullptr);
+    ~ScrollbackSearch() override;
+
+    // Lines must arrive in store order, starting at sequence number 0.
+    void append(const TerminalLine &line);
+    // Forgets whole segments older than seq, once the store can no longer reach them.
+    void dropBefore(qint64 seq);
+
+    void start(std::shared_ptr<const SearchPattern> pattern);
+    void cancel();
+
+    std::shared_ptr<const SearchPattern> pattern() const { return active; }
+    bool isRunning() const { return job != nullptr; }
+    // Matching line sequence numbers, ascending.
+    const QVector<qint64> &results() const { return hits; }
+    // Bytes of trigram bitsets; the renderer counts them against the archive cap.
+    qint64 indexedBytes() const { return bytes; }
+
+signals:
+    void finished(int count, qint64 nanoseconds);
+    // A newly appended line matched the active query.
+    void resultsExtended();
+
+private:
+    struct Job {
+        std::shared_ptr<const SearchPattern> pattern;
+        QVector<SearchSegment> segments;
+        SearchSource source;
+        QVector<QVector<qint64>> slices;
+        std::atomic<bool> cancelled{false};
+        std::atomic<int> remaining{0};
+        QElapsedTimer timer;
+    };
+
+    void finish(const std::shared_ptr<Job> &done);
+
+    const LineStore *store;
+    QVector<SearchSegment> segments;
+    qint64 endSeq = 0;
+    qint64 bytes = 0;
+
+    QThreadPool pool;
+    std::shared_ptr<Job> job;
+    std::shared_ptr<const SearchPattern> active;
+    QVector<qint64> hits;
+    // Matches among lines appended while a query was scanning its snapshot.
+    QVector<qint64> liveHits;
+};
@@ -0,0 +1,163 @@
+#include "amlp_search_bar.h"
+
+#include <QApplication>
+#include <QBoxLayout>
+#include <QKeyEvent>
+#include <QLabel>
+#include <QLineEdit>
+#include <QToolButton>
+
+#include "amlp_output_renderer.h"
+#include "amlp_search.h"
+#include "amlp_terminal_view.h"
+
+namespace {
+// Pause after the last keystroke before a query starts.
+const int DebounceMs = 150;
+}
+
+SearchBar::SearchBar(ScrollbackSearch *search, OutputRenderer *renderer, TerminalView *view, QWidget *parent)
+    : QWidget(parent), search(search), renderer(renderer), view(view) {
+    auto *lay = new QHBoxLayout(this);
+    lay->setContentsMargins(0, 0, 0, 0);
+    query = new QLineEdit(this);
+    query->setPlaceholderText("Search scrollback");
+    caseButton = new QToolButton(this);
+    caseButton->setText("Aa");
+    caseButton->setToolTip("Match case");
+    caseButton->setCheckable(true);
+    regexButton = new QToolButton(this);
+    regexButton->setText(".*");
+    regexButton->setToolTip("Regular expression");
+    regexButton->setCheckable(true);
+    auto *prevBtn = new QToolButton(this);
+    prevBtn->setArrowType(Qt::UpArrow);
+    prevBtn->setToolTip("Previous match (Enter)");
+    auto *nextBtn = new QToolButton(this);
+    nextBtn->setArrowType(Qt::DownArrow);
+    nextBtn->setToolTip("Next match (Shift+Enter)");
+    status = new QLabel(this);
+    status->setMinimumWidth(140);
+    auto *closeBtn = new QToolButton(this);
+    closeBtn->setText("x");
+    closeBtn->setToolTip("Close (Esc)");
+
+    lay->addWidget(query, 1);
+    lay->addWidget(caseButton);
+    lay->addWidget(regexButton);
+    lay->addWidget(prevBtn);
+    lay->addWidget(nextBtn);
+    lay->addWidget(status);
+    lay->addWidget(closeBtn);
+
+    debounce.setSingleShot(true);
+    debounce.setInterval(DebounceMs);
+    connect(&debounce, &QTimer::timeout, this, &SearchBar::restart);
+    connect(query, &QLineEdit::textChanged, &debounce, qOverload<>(&QTimer::start));
+    connect(caseButton, &QToolButton::toggled, this, &SearchBar::restart);
+    connect(regexButton, &QToolButton::toggled, this, &SearchBar::restart);
+    connect(query, &QLineEdit::returnPressed, this, [this]() {
+        // Enter straight after typing runs the query now instead of stepping.
+        if (debounce.isActive()) {
+            debounce.stop();
+            restart();
+        } else if (QApplication::keyboardModifiers() & Qt::ShiftModifier) {
+            next();
+        } else {
+            previous();
+        }
+    });
+    connect(prevBtn, &QToolButton::clicked, this, &SearchBar::previous);
+    connect(nextBtn, &QToolButton::clicked, this, &SearchBar::next);
+    connect(closeBtn, &QToolButton::clicked, this, &SearchBar::dismiss);
+    connect(search, &ScrollbackSearch::finished, this, &SearchBar::searchFinished);
+    connect(search, &ScrollbackSearch::resultsExtended, this, &SearchBar::showStatus);
+    hide();
+}
+
+void SearchBar::activate() {
+    show();
+    query->setFocus();
+    query->selectAll();
+    if (!query->text().isEmpty() && !search->pattern()) restart();
+}
+
+void SearchBar::dismiss() {
+    debounce.stop();
+    hide();
+    current = -1;
+    search->start(nullptr);
+    view->setHighlight(nullptr);
+    emit closed();
+}
+
+void SearchBar::keyPressEvent(QKeyEvent *event) {
+    if (event->key() == Qt::Key_Escape) {
+        dismiss();
+        return;
+    }
+    QWidget::keyPressEvent(event);
+}
+
+void SearchBar::restart() {
+    debounce.stop();
+    current = -1;
+    const QString text = query->text();
+    if (text.isEmpty()) {
+        search->start(nullptr);
+        view->setHighlight(nullptr);
+        status->clear();
+        return;
+    }
+    auto pattern = std::make_shared<const SearchPattern>(text, regexButton->isChecked(), caseButton->isChecked());
+    if (!pattern->isValid()) {
+        search->start(nullptr);
+        view->setHighlight(nullptr);
+        status->setText("Invalid: " + pattern->errorString());
+        return;
+    }
+    view->setHighlight(pattern);
+    status->setText("Searching...");
+    search->start(pattern);
+}
+
+void SearchBar::searchFinished(int count, qint64 nanoseconds) {
+    lastNs = nanoseconds;
+    if (!search->pattern()) return;
+    if (count == 0) {
+        showStatus();
+        return;
+    }
+    // Start from the newest match, as if searching up from the prompt.
+    jump(count - 1);
+}
+
+// With no current match, previous wraps to the newest and next to the oldest.
+void SearchBar::previous() {
+    jump(current < 0 ? -1 : current - 1);
+}
+
+void SearchBar::next() {
+    jump(current + 1);
+}
+
+void SearchBar::jump(int index) {
+    const QVector<qint64> &hits = search->results();
+    if (hits.isEmpty()) return;
+    current = (index % hits.size() + hits.size()) % hits.size();
+    const qint64 seq = hits.at(current);
+    renderer->reveal(seq);
+    view->setCurrentMatch(seq);
+    showStatus();
+}
+
+void SearchBar::showStatus() {
+    if (!search->pattern() || search->isRunning()) return;
+    const int count = search->results().size();
+    QString text;
+    if (count == 0) text = "No matches";
+    else if (current < 0) text = QString("%1 matches").arg(count);
+    else text = QString("%1 of %2").arg(current + 1).arg(count);
+    if (lastNs > 0) text += QString(" (%1 ms)").arg(double(lastNs) / 1e6, 0, 'f', 1);
+    status->setText(text);
+}
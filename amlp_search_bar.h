@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QTimer>
+#include <QWidget>
+
+class OutputRenderer;
+class QLabel;
+class QLineEdit;
+class QToolButton;
+class ScrollbackSearch;
+class TerminalView;
+
+// Find bar under the output (Ctrl+F). Queries run as the user types, after
+// a short pause; every match on screen is highlighted and Enter / Shift+Enter
+// step to the previous (older) / next (newer) matching line. Esc closes it.
+class SearchBar : public QWidget {
+    Q_OBJECT
+public:
+    SearchBar(ScrollbackSearch *search, OutputRenderer *renderer, TerminalView *view, QWidget *parent = nullptr);
+
+public slots:
+    void activate();
+    void previous();
+    void next();
+    void dismiss();
+
+signals:
+    void closed();
+
+protected:
+    void keyPressEvent(QKeyEvent *event) override;
+
+private:
+    void restart();
+    void searchFinished(int count, qint64 nanoseconds);
+    void jump(int index);
+    void showStatus();
+
+    ScrollbackSearch *search;
+    OutputRenderer *renderer;
+    TerminalView *view;
+    QLineEdit *query;
+    QToolButton *caseButton;
+    QToolButton *regexButton;
+    QLabel *status;
+    QTimer debounce;
+    int current = -1;
+    qint64 lastNs = 0;
+};
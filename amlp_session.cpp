@@ -0,0 +1,357 @@
+#include "amlp_session.h"
+
+#include <QBoxLayout>
+#include <QCoreApplication>
+#include <QLineEdit>
+#include <QSettings>
+#include <QSplitter>
+#include <QThread>
+#include <QTimer>
+#include <QWheelEvent>
+
+#include <algorithm>
+
+#include "amlp_automapper.h"
+#include "amlp_capture_panes.h"
+#include "amlp_command_input.h"
+#include "amlp_connection_bar.h"
+#include "amlp_connector.h"
+#include "amlp_map_view.h"
+#include "amlp_metrics_panel.h"
+#include "amlp_network_worker.h"
+#include "amlp_output_renderer.h"
+#include "amlp_search.h"
+#include "amlp_search_bar.h"
+#include "amlp_status_gauges.h"
+#include "amlp_terminal_view.h"
+
+IoPool::IoPool(int threadCount, QObject *parent) : QObject(parent) {
+    for (int i = 0; i < qMax(1, threadCount); ++i) {
+        auto *thread = new QThread(this);
+        thread->setObjectName(QString("amlp-io-%1").arg(i));
+        thread->start();
+        threads.append(thread);
+        load.append(0);
+    }
+}
+
+IoPool::~IoPool() {
+    for (QThread *thread : threads) thread->quit();
+    for (QThread *thread : threads) thread->wait();
+}
+
+QThread *IoPool::acquire() {
+    int best = 0;
+    for (int i = 1; i < threads.size(); ++i)
+        if (load[i] < load[best]) best = i;
+    ++load[best];
+    return threads[best];
+}
+
+void IoPool::release(QThread *thread) {
+    const int i = threads.indexOf(thread);
+    if (i >= 0) --load[i];
+}
+
+Session::Session(IoPool *pool, QWidget *parent)
+    : QWidget(parent), pool(pool), name("New session") {
+    auto *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    // Both panes paint from the same store; each lays out only its own rows.
+    splitter = new QSplitter(Qt::Vertical, this);
+    splitter->setChildrenCollapsible(false);
+    output = new TerminalView(&lines, splitter);
+    tail = new TerminalView(&lines, splitter);
+    tail->setLiveTail(true);
+    tail->hide();
+    splitter->addWidget(output);
+    splitter->addWidget(tail);
+    renderer = new OutputRenderer(&lines, output, this);
+    renderer->setTail(tail);
+    // Capture panes sit above the output, hidden until a rule names one.
+    paneSplitter = new QSplitter(Qt::Vertical, this);
+    paneSplitter->setChildrenCollapsible(false);
+    captures = new CapturePanes(paneSplitter);
+    paneSplitter->addWidget(captures);
+    paneSplitter->addWidget(splitter);
+    paneSplitter->setStretchFactor(1, 1);
+    renderer->setCaptures(captures);
+    connect(output, &TerminalView::followingChanged, this, &Session::updateSplit);
+    // The tail never scrolls; the wheel over it scrolls the history instead.
+    connect(tail, &TerminalView::tailScrolled, output,
+            [this](QWheelEvent *event) { QCoreApplication::sendEvent(output->viewport(), event); });
+    gauges = new StatusGauges(&renderer->outOfBand(), this);
+    input = new CommandInput(this);
+    setFocusProxy(input);
+    renderer->setCompletion(&input->completion());
+
+    metricsPanel = new MetricsPanel(&metrics, &lines, this);
+    metricsPanel->hide();
+    renderer->setMetrics(&metrics);
+    search = new ScrollbackSearch(&lines, this);
+    renderer->setSearch(search);
+    searchBar = new SearchBar(search, renderer, output, this);
+    connect(searchBar, &SearchBar::closed, input, qOverload<>(&QWidget::setFocus));
+    mapper = new Automapper(&renderer->outOfBand(), this);
+    renderer->setMapper(mapper);
+    mapView = new MapView(mapper, this);
+    mapView->hide();
+    connect(mapView, &MapView::walkRequested, this, &Session::walkTo);
+    connectionBar = new ConnectionBar(this);
+
+    auto *outputRow = new QHBoxLayout();
+    outputRow->addWidget(paneSplitter, 1);
+    outputRow->addWidget(mapView);
+    outputRow->addWidget(metricsPanel);
+    layout->addLayout(outputRow, 1);
+    layout->addWidget(searchBar);
+    layout->addWidget(connectionBar);
+    layout->addWidget(gauges);
+    layout->addWidget(input);
+
+    // The worker lives on a shared I/O thread; it is deleted there, see ~Session.
+    ioThread = pool->acquire();
+    net = new NetworkWorker;
+    net->setMetrics(&metrics);
+    net->moveToThread(ioThread);
+    renderer->attach(net);
+
+    connect(input, &QLineEdit::returnPressed, this, &Session::sendCommand);
+    connect(net, &NetworkWorker::connected, this, [this]() {
+        appendNotice("Connected!\n");
+        gauges->clear();
+        reportWindowSize();
+    });
+    connect(net, &NetworkWorker::disconnected, this, [this]() { connectedNow = false; });
+    // NAWS follows the viewport; a drag-resize is reported once it settles
+    nawsTimer = new QTimer(this);
+    nawsTimer->setSingleShot(true);
+    nawsTimer->setInterval(150);
+    connect(nawsTimer, &QTimer::timeout, this, &Session::reportWindowSize);
+    connect(output, &TerminalView::viewportResized, nawsTimer, qOverload<>(&QTimer::start));
+    connect(tail, &TerminalView::viewportResized, nawsTimer, qOverload<>(&QTimer::start));
+    connect(net, &NetworkWorker::errorOccurred, connectionBar, &ConnectionBar::showError);
+    connect(net, &NetworkWorker::reconnectScheduled, this, [this](int attempt, int delayMs) {
+        connectedNow = true; // the tab is still in use
+        connectionBar->showReconnect(attempt, delayMs);
+    });
+    connect(net, &NetworkWorker::connectTimed, this, [this](const QString &address, int resolveMs, int connectMs) {
+        connectionBar->showConnected(address, resolveMs, connectMs);
+        QSettings settings("Aether", "amlp-client");
+        recordConnect(settings, hostName, hostPort, resolveMs + connectMs);
+    });
+    connect(connectionBar, &ConnectionBar::reconnectRequested, this, [this]() {
+        connectedNow = true;
+        QMetaObject::invokeMethod(net, [w = net]() { w->reconnectNow(); });
+    });
+    connect(connectionBar, &ConnectionBar::stopRequested, this, [this]() {
+        QMetaObject::invokeMethod(net, [w = net]() { w->cancelReconnect(); });
+    });
+    connect(net, &NetworkWorker::passwordPrompt, this, [this]() {
+        passwordMode = true;
+        input->setEchoMode(QLineEdit::PasswordEchoOnEdit);
+    });
+    connect(net, &NetworkWorker::aliasesChanged, this, &Session::workerAliasesChanged);
+    connect(net, &NetworkWorker::commandsSent, mapper, &Automapper::commandsSent);
+    connect(renderer, &OutputRenderer::backgroundOutput, this, &Session::activity);
+}
+
+Session::~Session() {
+    // The worker records into this session's metrics, so it has to be gone
+    // before they are. The I/O thread never waits on the GUI, so this is quick.
+    QMetaObject::invokeMethod(net, [w = net]() { delete w; }, Qt::BlockingQueuedConnection);
+    pool->release(ioThread);
+}
+
+void Session::connectTo(const QString &title, const QString &host, int port, int scrollbackLines, int archiveKB,
+                        TextEncoding encoding) {
+    name = title;
+    hostName = host;
+    hostPort = port;
+    connectedNow = true;
+    emit titleChanged(name);
+    renderer->setScrollbackLimits(scrollbackLines, archiveKB);
+    mapper->openServer(host, port);
+    input->openHistory(host, port);
+    connectionBar->dismiss();
+    appendNotice(QString("Connecting to %1:%2...\n").arg(host).arg(port));
+    QMetaObject::invokeMethod(net, [w = net, host, port, encoding]() {
+        w->setEncoding(encoding);
+        w->connectToHost(host, port);
+    });
+}
+
+void Session::appendNotice(const QString &text, const QColor &color) {
+    TextStyle style;
+    style.fg = color.rgb();
+    renderer->appendText(text, style);
+}
+
+void Session::setActive(bool active) {
+    renderer->setActive(active);
+}
+
+void Session::setTriggers(const QVector<Trigger> &triggers) {
+    sharedTriggers = triggers;
+    pushTriggers();
+}
+
+void Session::setProfileRules(const QVector<Trigger> &triggers, const QVector<Alias> &aliases) {
+    const bool hadAny = !profileTriggers.isEmpty() || !profileAliases.isEmpty();
+    profileTriggers = triggers;
+    profileAliases = aliases;
+    if (!hadAny && triggers.isEmpty() && aliases.isEmpty()) return;
+    pushTriggers();
+    pushAliases();
+}
+
+void Session::pushTriggers() {
+    const QVector<Trigger> triggers = sharedTriggers + profileTriggers;
+    QMetaObject::invokeMethod(net, [w = net, triggers]() { w->setTriggers(triggers); });
+}
+
+void Session::pushAliases() {
+    // Later definitions win, so a profile alias overrides a shared one of the same name.
+    const QVector<Alias> aliases = sharedAliases + profileAliases;
+    QMetaObject::invokeMethod(net, [w = net, aliases]() { w->setAliases(aliases); });
+}
+
+// #alias and #unalias edit the worker's merged list. Only the shared part is
+// handed on to be saved: a profile alias still as the profile defines it is
+// left out, or put back to the shared definition it was hiding.
+void Session::workerAliasesChanged(const QVector<Alias> &aliases) {
+    QVector<Alias> shared;
+    for (const Alias &a : aliases) {
+        auto fromProfile = std::find_if(profileAliases.cbegin(), profileAliases.cend(),
+                                        [&](const Alias &p) { return p.name == a.name; });
+        if (fromProfile == profileAliases.cend() || fromProfile->expansion != a.expansion) {
+            shared.append(a);
+            continue;
+        }
+        auto hidden = std::find_if(sharedAliases.cbegin(), sharedAliases.cend(),
+                                   [&](const Alias &s) { return s.name == a.name; });
+        if (hidden != sharedAliases.cend()) shared.append(*hidden);
+    }
+    sharedAliases = shared;
+    emit aliasesChanged(shared);
+}
+
+void Session::setLineRules(const QVector<LineRule> &rules) {
+    captures->setPanes(LineRouter::paneNames(rules));
+    QMetaObject::invokeMethod(net, [w = net, rules]() { w->setLineRules(rules); });
+}
+
+void Session::setAliases(const QVector<Alias> &aliases) {
+    sharedAliases = aliases;
+    pushAliases();
+}
+
+void Session::setLogging(const LogOptions &options) {
+    QMetaObject::invokeMethod(net, [w = net, options]() { w->setLogging(options); });
+}
+
+void Session::setMetricsVisible(bool visible) {
+    metricsPanel->setVisible(visible);
+}
+
+void Session::setMapVisible(bool visible) {
+    mapView->setVisible(visible);
+}
+
+void Session::setMapTitlePattern(const QString &pattern) {
+    mapper->setTitlePattern(pattern);
+}
+
+void Session::setAutoReconnect(bool enabled) {
+    QMetaObject::invokeMethod(net, [w = net, enabled]() { w->setAutoReconnect(enabled); });
+}
+
+void Session::setQuitPattern(const QString &pattern) {
+    QMetaObject::invokeMethod(net, [w = net, pattern]() { w->setQuitPattern(pattern); });
+}
+
+void Session::setSplitOnScroll(bool enabled) {
+    splitOnScroll = enabled;
+    updateSplit();
+}
+
+void Session::updateSplit() {
+    const bool split = splitOnScroll && !output->isFollowing();
+    if (split == !tail->isHidden()) return;
+    tail->setVisible(split);
+    if (!split) return;
+    // First split takes a third for the tail; after that the user's sizes stick.
+    if (!splitSized) {
+        const int height = splitter->height();
+        splitter->setSizes({height - height / 3, height / 3});
+        splitSized = true;
+    }
+    tail->scrollToBottom();
+}
+
+void Session::findInScrollback() {
+    searchBar->activate();
+}
+
+void Session::sendCommand() {
+    if (!passwordMode) input->remember(input->text());
+    if (!passwordMode && runMapCommand(input->text())) {
+        input->clear();
+        return;
+    }
+    // Passwords go out exactly as typed: no aliases, ';' or speedwalks.
+    net->sendLine(input->text(), passwordMode);
+    // If we just sent password, reset echo mode
+    if (passwordMode) {
+        passwordMode = false;
+        QTimer::singleShot(100, this, [this]() {
+            input->setEchoMode(QLineEdit::Normal);
+        });
+    }
+    input->clear();
+}
+
+bool Session::runMapCommand(const QString &line) {
+    const QString word = line.section(' ', 0, 0).toLower();
+    const QString args = line.section(' ', 1).trimmed();
+    if (word == "#map") {
+        const MapGraph &map = mapper->graph();
+        const quint32 here = mapper->currentRoom();
+        QString where = "Location unknown.";
+        if (here != MapGraph::None)
+            where = QString("In %1 (%2).").arg(map.string(map.room(here).name)).arg(map.room(here).key);
+        appendNotice(QString("%1 rooms mapped. %2\n").arg(map.roomCount()).arg(where));
+        return true;
+    }
+    if (word == "#walk") {
+        if (args.isEmpty()) {
+            appendNotice("Usage: #walk <room id or part of its name>\n");
+            return true;
+        }
+        const quint32 room = mapper->findRoom(args);
+        if (room == MapGraph::None)
+            appendNotice("No such room on the map.\n");
+        else
+            walkTo(room);
+        return true;
+    }
+    return false;
+}
+
+void Session::walkTo(quint32 room) {
+    const QString route = mapper->routeTo(room);
+    if (route.isEmpty()) {
+        appendNotice("No known route.\n");
+        return;
+    }
+    appendNotice("Walking " + route + "\n");
+    net->sendLine(route);
+}
+
+void Session::reportWindowSize() {
+    int cols = output->columns();
+    // A split divides the screen, it does not change how much the server may send.
+    int rows = output->visibleRows() + (!tail->isHidden() ? tail->visibleRows() : 0);
+    if (cols < 60) cols = 40; // fallback for mobile
+    QMetaObject::invokeMethod(net, [w = net, cols, rows]() { w->setWindowSize(cols, rows); });
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <QColor>
+#include <QObject>
+#include <QVector>
+#include <QWidget>
+
+#include "amlp_command_pipeline.h"
+#include "amlp_line_router.h"
+#include "amlp_line_store.h"
+#include "amlp_metrics.h"
+#include "amlp_session_log.h"
+#include "amlp_triggers.h"
+
+class Automapper;
+class CapturePanes;
+class CommandInput;
+class ConnectionBar;
+class MapView;
+class MetricsPanel;
+class NetworkWorker;
+class OutputRenderer;
+class QSplitter;
+class QThread;
+class QTimer;
+class ScrollbackSearch;
+class SearchBar;
+class StatusGauges;
+class TerminalView;
+
+// The threads that run the sessions' network workers. Sessions share a few
+// threads instead of taking one each: decoding is a short burst per socket
+// read, so a handful of threads keeps up with many connections.
+class IoPool : public QObject {
+    Q_OBJECT
+public:
+    explicit IoPool(int threadCount, QObject *parent = nullptr);
+    // Stops the threads; workers still on them are deleted as they finish.
+    ~IoPool() override;
+
+    // The thread with the fewest sessions.
+    QThread *acquire();
+    void release(QThread *thread);
+
+private:
+    QVector<QThread *> threads;
+    QVector<int> load;
+};
+
+// One connection and everything that belongs to it: socket, telnet and
+// parser state (in its NetworkWorker), scrollback, search, triggers,
+// gauges and the input line. A session in a background tab keeps storing
+// output but does not lay it out or paint until it is shown again.
+class Session : public QWidget {
+    Q_OBJECT
+public:
+    explicit Session(IoPool *pool, QWidget *parent = nullptr);
+    ~Session() override;
+
+    NetworkWorker *worker() const { return net; }
+    QString title() const { return name; }
+    // Connected, or a connection attempt is under way.
+    bool isConnected() const { return connectedNow; }
+
+    void connectTo(const QString &title, const QString &host, int port, int scrollbackLines, int archiveKB,
+                   TextEncoding encoding = TextEncoding::Utf8);
+    void appendNotice(const QString &text, const QColor &color = QColor("#e0e0e0"));
+    // Shown in the current tab or not.
+    void setActive(bool active);
+
+    // The shared triggers and aliases; the connected profile's own run alongside.
+    void setTriggers(const QVector<Trigger> &triggers);
+    // Gags, highlights, substitutions and the capture panes they fill.
+    void setLineRules(const QVector<LineRule> &rules);
+    void setAliases(const QVector<Alias> &aliases);
+    // Triggers and aliases of the profile being connected; empty for a quick connect.
+    void setProfileRules(const QVector<Trigger> &triggers, const QVector<Alias> &aliases);
+    void setLogging(const LogOptions &options);
+    void setMetricsVisible(bool visible);
+    void setMapVisible(bool visible);
+    void setMapTitlePattern(const QString &pattern);
+    // Retry dropped connections with backoff; on by default.
+    void setAutoReconnect(bool enabled);
+    // Commands after which the server closing is a logout, not a drop.
+    void setQuitPattern(const QString &pattern);
+    // Scrolling back splits the output: history above, the live tail below.
+    void setSplitOnScroll(bool enabled);
+    void findInScrollback();
+
+signals:
+    void titleChanged(const QString &title);
+    // Output arrived while the session was in the background.
+    void activity();
+    void aliasesChanged(const QVector<Alias> &aliases);
+
+private:
+    void sendCommand();
+    void reportWindowSize();
+    void updateSplit();
+    // #map and #walk work on the UI-side automapper, so they stop here.
+    bool runMapCommand(const QString &line);
+    void walkTo(quint32 room);
+    void pushTriggers();
+    void pushAliases();
+    void workerAliasesChanged(const QVector<Alias> &aliases);
+
+    IoPool *pool;
+    QThread *ioThread;
+    ClientMetrics metrics;
+    LineStore lines;
+    QSplitter *splitter;
+    TerminalView *output;
+    TerminalView *tail;
+    // Capture panes above, the output/tail splitter below.
+    QSplitter *paneSplitter;
+    CapturePanes *captures;
+    OutputRenderer *renderer;
+    StatusGauges *gauges;
+    MetricsPanel *metricsPanel;
+    Automapper *mapper;
+    MapView *mapView;
+    ScrollbackSearch *search;
+    SearchBar *searchBar;
+    ConnectionBar *connectionBar;
+    CommandInput *input;
+    NetworkWorker *net;
+    QTimer *nawsTimer;
+    QString name;
+    QString hostName;
+    QVector<Trigger> sharedTriggers;
+    QVector<Trigger> profileTriggers;
+    QVector<Alias> sharedAliases;
+    QVector<Alias> profileAliases;
+    int hostPort = 0;
+    bool passwordMode = false;
+    bool connectedNow = false;
+    bool splitOnScroll = true;
+    bool splitSized = false;
+};
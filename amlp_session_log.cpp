@@ -0,0 +1,481 @@
+#include "amlp_session_log.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QMutex>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QThread>
+#include <QWaitCondition>
+#include <QtDebug>
+
+#include <zlib.h>
+
+#include <algorithm>
+
+#include "amlp_spsc_ring.h"
+
+namespace {
+
+const int RingRecords = 4096;
+// A block closes at this many uncompressed bytes, or after FlushMs so the
+// file on disk never trails the session by more than a few seconds.
+const int BlockBytes = 256 * 1024;
+const qint64 FlushMs = 5000;
+// How often the writer wakes on its own when nobody asks it to.
+const int TickMs = 500;
+const char IndexMagic[] = "AMLPLIX1";
+const int IndexMagicLength = 8;
+const int IndexEntryBytes = 32;
+
+enum RecordKind { Lines, Open, Close };
+
+struct LogRecord {
+    int kind = Lines;
+    qint64 msecs = 0;
+    QVector<TerminalLine> lines;
+    QString name;
+};
+
+void appendColor(QByteArray &out, QRgb c) {
+    out += QByteArray::number(qRed(c)) + ';' + QByteArray::number(qGreen(c)) + ';' + QByteArray::number(qBlue(c));
+}
+
+QByteArray sgr(const TextStyle &s) {
+    QByteArray out("\x1b[0");
+    if (s.has(TextStyle::Bold)) out += ";1";
+    if (s.has(TextStyle::Dim)) out += ";2";
+    if (s.has(TextStyle::Italic)) out += ";3";
+    if (s.has(TextStyle::Underline)) out += ";4";
+    if (s.has(TextStyle::Inverse)) out += ";7";
+    if (s.fg != TextStyle().fg) {
+        out += ";38;2;";
+        appendColor(out, s.fg);
+    }
+    if (s.hasBackground()) {
+        out += ";48;2;";
+        appendColor(out, s.bg);
+    }
+    return out + 'm';
+}
+
+QByteArray cssColor(QRgb c) {
+    return '#' + QByteArray::number(c & 0xffffff, 16).rightJustified(6, '0');
+}
+
+// Same resolution as the view: inverse swaps, dim fades toward the background.
+QByteArray cssStyle(const TextStyle &s) {
+    QRgb fg = s.fg;
+    QRgb bg = s.hasBackground() ? s.bg : qRgb(0, 0, 0);
+    if (s.has(TextStyle::Inverse)) std::swap(fg, bg);
+    QByteArray css = "color:" + cssColor(fg);
+    if (s.hasBackground() || s.has(TextStyle::Inverse)) css += ";background:" + cssColor(bg);
+    if (s.has(TextStyle::Bold)) css += ";font-weight:bold";
+    if (s.has(TextStyle::Dim)) css += ";opacity:0.6";
+    if (s.has(TextStyle::Italic)) css += ";font-style:italic";
+    if (s.has(TextStyle::Underline)) css += ";text-decoration:underline";
+    return css;
+}
+
+void appendEscaped(QByteArray &out, const char *text, int length) {
+    for (int i = 0; i < length; ++i) {
+        switch (text[i]) {
+        case '&': out += "&amp;"; break;
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        default: out += text[i]; break;
+        }
+    }
+}
+
+QString safeName(const QString &name) {
+    QString out;
+    for (QChar c : name) out += (c.isLetterOrNumber() || c == '.' || c == '-') ? c : QChar('_');
+    return out.isEmpty() ? QStringLiteral("session") : out;
+}
+
+} // namespace
+
+LogFile::~LogFile() {
+    close();
+}
+
+void LogFile::open(const LogOptions &opts, const QString &name, qint64 msecs) {
+    close();
+    options = opts;
+    session = safeName(name);
+    start(msecs);
+}
+
+void LogFile::write(const QVector<TerminalLine> &lines, qint64 msecs) {
+    if (!file.isOpen()) return;
+    if (block.isEmpty()) {
+        blockFirstLine = lineNumber;
+        blockStartMsecs = msecs;
+    }
+    for (const TerminalLine &line : lines) format(line);
+    lineNumber += lines.size();
+    if (block.size() >= BlockBytes) flushBlock();
+    if (rotateDue(msecs)) start(msecs);
+}
+
+void LogFile::note(const QString &text, qint64 msecs) {
+    TerminalLine line;
+    line.text = text.toUtf8();
+    write(QVector<TerminalLine>{line}, msecs);
+}
+
+void LogFile::noteDropped(quint64 lines, qint64 msecs) {
+    note(QString("[%1 lines not logged: the log writer fell behind]").arg(lines), msecs);
+}
+
+void LogFile::tick(qint64 msecs) {
+    if (!file.isOpen()) return;
+    if (!block.isEmpty() && msecs - blockStartMsecs >= FlushMs) flushBlock();
+    if (rotateDue(msecs)) start(msecs);
+}
+
+void LogFile::close() {
+    if (!file.isOpen()) return;
+    if (options.format == LogOptions::Html) block += "</pre></body></html>\n";
+    flushBlock();
+    file.close();
+    index.close();
+    if (deflater) {
+        deflateEnd(deflater);
+        delete deflater;
+        deflater = nullptr;
+    }
+}
+
+void LogFile::start(qint64 msecs) {
+    close();
+    const char *ext = options.format == LogOptions::Html ? ".html"
+                      : options.format == LogOptions::Ansi ? ".ansi" : ".txt";
+    const QString base = QDir(options.directory).filePath(
+        session + '_' + QDateTime::fromMSecsSinceEpoch(msecs).toString("yyyyMMdd-HHmmss"));
+    const QString suffix = QString::fromLatin1(ext) + QLatin1String(options.compress ? ".gz" : "");
+    // Size rotation can come round twice in one second.
+    QString path = base + suffix;
+    for (int n = 2; QFile::exists(path); ++n) path = base + '-' + QString::number(n) + suffix;
+    file.setFileName(path);
+    index.setFileName(path + ".idx");
+    if (!file.open(QIODevice::WriteOnly) || !index.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning("Session log: cannot write %s", qPrintable(path));
+        file.close();
+        return;
+    }
+    index.write(IndexMagic, IndexMagicLength);
+    if (options.compress) {
+        deflater = new z_stream_s();
+        // 16 + window bits: a gzip header and trailer around every block.
+        if (deflateInit2(deflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            delete deflater;
+            deflater = nullptr;
+        }
+    }
+    openedMsecs = msecs;
+    fileBytes = 0;
+    lineNumber = 0;
+    blockFirstLine = 0;
+    blockStartMsecs = msecs;
+    lastStyle = 0;
+    if (options.format == LogOptions::Html)
+        block += "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>" + session.toUtf8()
+                 + "</title></head>\n<body style=\"background:#000000;color:#ffffff\"><pre>\n";
+}
+
+bool LogFile::rotateDue(qint64 msecs) const {
+    if (!file.isOpen()) return false;
+    if (options.rotateMB > 0 && fileBytes + block.size() >= qint64(options.rotateMB) * 1024 * 1024) return true;
+    return options.rotateHours > 0 && msecs - openedMsecs >= qint64(options.rotateHours) * 3600 * 1000;
+}
+
+void LogFile::format(const TerminalLine &line) {
+    const char *text = line.text.constData();
+    if (options.format == LogOptions::Plain || line.runs.isEmpty()) {
+        if (options.format == LogOptions::Html)
+            appendEscaped(block, text, line.text.size());
+        else
+            block += line.text;
+        block += '\n';
+        return;
+    }
+
+    const StyleTable &styles = StyleTable::instance();
+    int byte = 0;
+    for (const StyleRun &run : line.runs) {
+        const int length = int(run.length);
+        if (options.format == LogOptions::Ansi) {
+            if (run.style != lastStyle) block += sgr(styles.style(run.style));
+            lastStyle = run.style;
+            block.append(text + byte, length);
+        } else if (run.style == 0) {
+            appendEscaped(block, text + byte, length);
+        } else {
+            block += "<span style=\"" + cssStyle(styles.style(run.style)) + "\">";
+            appendEscaped(block, text + byte, length);
+            block += "</span>";
+        }
+        byte += length;
+    }
+    // Every ANSI line ends in the default style so any one of them reads alone.
+    if (options.format == LogOptions::Ansi && lastStyle != 0) {
+        block += "\x1b[0m";
+        lastStyle = 0;
+    }
+    block += '\n';
+}
+
+void LogFile::flushBlock() {
+    if (block.isEmpty() || !file.isOpen()) return;
+    const qint64 compressedAt = file.pos();
+    if (deflater) {
+        QByteArray out(64 * 1024, Qt::Uninitialized);
+        deflateReset(deflater);
+        deflater->next_in = reinterpret_cast<Bytef *>(block.data());
+        deflater->avail_in = uInt(block.size());
+        int rc;
+        do {
+            deflater->next_out = reinterpret_cast<Bytef *>(out.data());
+            deflater->avail_out = uInt(out.size());
+            rc = deflate(deflater, Z_FINISH);
+            file.write(out.constData(), out.size() - int(deflater->avail_out));
+        } while (rc == Z_OK);
+    } else {
+        file.write(block);
+    }
+    QDataStream entry(&index);
+    entry << quint64(fileBytes) << quint64(compressedAt) << quint64(blockFirstLine) << qint64(blockStartMsecs);
+    file.flush();
+    index.flush();
+    fileBytes += block.size();
+    block.truncate(0);
+}
+
+struct SessionLog::Channel {
+    explicit Channel(const LogOptions &o) : options(o), ring(RingRecords) {}
+
+    const LogOptions options;
+    SpscRing<LogRecord> ring;
+    // Lines dropped since the writer last looked.
+    std::atomic<quint64> lost{0};
+    std::atomic<bool> wakeRequested{false};
+    std::atomic<bool> detached{false};
+    // Writer thread only.
+    LogFile file;
+};
+
+namespace {
+
+// The one thread that does all log I/O. It drains every session's ring
+// each tick, or sooner when a ring is filling up.
+class LogWriter : public QThread {
+public:
+    static LogWriter &instance() {
+        static LogWriter writer;
+        return writer;
+    }
+
+    void add(const std::shared_ptr<SessionLog::Channel> &channel) {
+        QMutexLocker lock(&mutex);
+        channels.append(channel);
+        if (!isRunning()) start(QThread::LowPriority);
+    }
+
+    void wake() {
+        QMutexLocker lock(&mutex);
+        woken = true;
+        wakeup.wakeOne();
+    }
+
+protected:
+    void run() override {
+        QMutexLocker lock(&mutex);
+        for (;;) {
+            if (!stopping && !woken) wakeup.wait(&mutex, TickMs);
+            woken = false;
+            const bool last = stopping;
+            const QVector<std::shared_ptr<SessionLog::Channel>> list = channels;
+            lock.unlock();
+            QVector<SessionLog::Channel *> done;
+            for (const auto &channel : list)
+                if (service(*channel, last)) done.append(channel.get());
+            lock.relock();
+            channels.erase(std::remove_if(channels.begin(), channels.end(),
+                                          [&](const std::shared_ptr<SessionLog::Channel> &c) { return done.contains(c.get()); }),
+                           channels.end());
+            if (last) return;
+        }
+    }
+
+private:
+    LogWriter() = default;
+    ~LogWriter() override {
+        {
+            QMutexLocker lock(&mutex);
+            stopping = true;
+            wakeup.wakeOne();
+        }
+        wait();
+    }
+
+    // Returns true once the channel is finished with.
+    static bool service(SessionLog::Channel &c, bool last) {
+        // Read before draining: everything pushed before detaching is then in the ring.
+        const bool detached = c.detached.load(std::memory_order_acquire);
+        c.wakeRequested.store(false, std::memory_order_relaxed);
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+        LogRecord record;
+        while (c.ring.pop(record)) {
+            switch (record.kind) {
+            case Open:
+                c.file.open(c.options, record.name, record.msecs);
+                break;
+            case Close:
+                c.file.close();
+                break;
+            default:
+                if (!c.file.isOpen()) c.file.open(c.options, QString(), record.msecs);
+                c.file.write(record.lines, record.msecs);
+                break;
+            }
+        }
+        if (const quint64 lost = c.lost.exchange(0)) c.file.noteDropped(lost, now);
+
+        if (detached || last) {
+            c.file.close();
+            return true;
+        }
+        c.file.tick(now);
+        return false;
+    }
+
+    QMutex mutex;
+    QWaitCondition wakeup;
+    QVector<std::shared_ptr<SessionLog::Channel>> channels;
+    bool woken = false;
+    bool stopping = false;
+};
+
+} // namespace
+
+LogOptions loadLogOptions(QSettings &settings) {
+    LogOptions o;
+    settings.beginGroup("logging");
+    o.enabled = settings.value("enabled", false).toBool();
+    o.directory = settings.value("directory",
+        QDir(QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)).filePath("amlp-logs")).toString();
+    o.format = LogOptions::Format(qBound(0, settings.value("format", int(LogOptions::Plain)).toInt(), int(LogOptions::Html)));
+    o.compress = settings.value("compress", true).toBool();
+    o.rotateMB = settings.value("rotateMB", o.rotateMB).toInt();
+    o.rotateHours = settings.value("rotateHours", o.rotateHours).toInt();
+    settings.endGroup();
+    return o;
+}
+
+void saveLogOptions(QSettings &settings, const LogOptions &o) {
+    settings.beginGroup("logging");
+    settings.setValue("enabled", o.enabled);
+    settings.setValue("directory", o.directory);
+    settings.setValue("format", int(o.format));
+    settings.setValue("compress", o.compress);
+    settings.setValue("rotateMB", o.rotateMB);
+    settings.setValue("rotateHours", o.rotateHours);
+    settings.endGroup();
+}
+
+SessionLog::SessionLog(const LogOptions &options) : channel(std::make_shared<Channel>(options)) {
+    QDir().mkpath(options.directory);
+    LogWriter::instance().add(channel);
+}
+
+SessionLog::~SessionLog() {
+    channel->detached.store(true, std::memory_order_release);
+    LogWriter::instance().wake();
+}
+
+void SessionLog::open(const QString &sessionName) {
+    push(Open, QVector<TerminalLine>(), sessionName);
+}
+
+void SessionLog::close() {
+    push(Close, QVector<TerminalLine>(), QString());
+}
+
+void SessionLog::append(const TerminalLine *lines, int count) {
+    if (count > 0) push(Lines, QVector<TerminalLine>(lines, lines + count), QString());
+}
+
+// The hot path: one allocation for the line list (the lines themselves are
+// implicitly shared) and a ring push. The writer is only poked directly
+// when the ring is half full; otherwise it picks the lines up on its tick.
+void SessionLog::push(int kind, QVector<TerminalLine> &&lines, const QString &name) {
+    const int count = lines.size();
+    LogRecord record{kind, QDateTime::currentMSecsSinceEpoch(), std::move(lines), name};
+    const bool pushed = channel->ring.push(std::move(record));
+    if (!pushed) channel->lost.fetch_add(quint64(count), std::memory_order_relaxed);
+    if ((!pushed || channel->ring.size() * 2 > channel->ring.capacity())
+        && !channel->wakeRequested.exchange(true, std::memory_order_relaxed))
+        LogWriter::instance().wake();
+}
+
+bool LogReader::open(const QString &path) {
+    entries.clear();
+    file.close();
+    QFile idx(path + ".idx");
+    if (!idx.open(QIODevice::ReadOnly) || idx.read(IndexMagicLength) != QByteArray(IndexMagic, IndexMagicLength))
+        return false;
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    compressed = path.endsWith(".gz");
+    // A crash can leave a partial entry at the end; only whole ones count.
+    const qint64 count = (idx.size() - IndexMagicLength) / IndexEntryBytes;
+    QDataStream in(&idx);
+    for (qint64 i = 0; i < count; ++i) {
+        Entry e;
+        in >> e.offset >> e.compressedOffset >> e.firstLine >> e.msecs;
+        entries.append(e);
+    }
+    return true;
+}
+
+int LogReader::blockForLine(qint64 line) const {
+    auto it = std::upper_bound(entries.begin(), entries.end(), quint64(qMax<qint64>(0, line)),
+                               [](quint64 l, const Entry &e) { return l < e.firstLine; });
+    return it == entries.begin() ? -1 : int(it - entries.begin()) - 1;
+}
+
+int LogReader::blockForTime(const QDateTime &time) const {
+    const qint64 msecs = time.toMSecsSinceEpoch();
+    auto it = std::lower_bound(entries.begin(), entries.end(), msecs,
+                               [](const Entry &e, qint64 t) { return e.msecs < t; });
+    return it == entries.end() ? -1 : int(it - entries.begin());
+}
+
+QByteArray LogReader::readBlock(int block) {
+    if (block < 0 || block >= entries.size()) return QByteArray();
+    const qint64 start = qint64(entries.at(block).compressedOffset);
+    const qint64 end = block + 1 < entries.size() ? qint64(entries.at(block + 1).compressedOffset) : file.size();
+    if (!file.seek(start)) return QByteArray();
+    QByteArray raw = file.read(end - start);
+    if (!compressed) return raw;
+
+    z_stream_s zs{};
+    // 32 + window bits: accept the gzip header.
+    if (inflateInit2(&zs, 15 + 32) != Z_OK) return QByteArray();
+    QByteArray text;
+    QByteArray out(64 * 1024, Qt::Uninitialized);
+    zs.next_in = reinterpret_cast<Bytef *>(raw.data());
+    zs.avail_in = uInt(raw.size());
+    int rc;
+    do {
+        zs.next_out = reinterpret_cast<Bytef *>(out.data());
+        zs.avail_out = uInt(out.size());
+        rc = inflate(&zs, Z_NO_FLUSH);
+        text.append(out.constData(), out.size() - int(zs.avail_out));
+    } while (rc == Z_OK);
+    inflateEnd(&zs);
+    return text;
+}
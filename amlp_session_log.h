@@ -0,0 +1,137 @@
+#pragma once
+
+#include <QDateTime>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+#include <memory>
+
+#include "amlp_line_store.h"
+
+class QSettings;
+struct z_stream_s;
+
+// What to log and where. Persisted under "logging/" in the settings.
+struct LogOptions {
+    enum Format { Plain, Ansi, Html };
+
+    bool enabled = false;
+    QString directory;
+    Format format = Plain;
+    // Each block becomes its own gzip member, so the file still reads with zcat.
+    bool compress = true;
+    // A new file starts once either limit is reached; 0 turns that limit off.
+    int rotateMB = 64;
+    int rotateHours = 24;
+};
+
+LogOptions loadLogOptions(QSettings &settings);
+void saveLogOptions(QSettings &settings, const LogOptions &options);
+
+// One open log: formatting, block compression, the index and rotation. The
+// text goes out in blocks of about 256 KB, each its own gzip member when
+// compressed, and every block gets an entry in <log>.idx that LogReader
+// seeks by. Times are passed in, in ms since the epoch. Used by the log
+// writer thread only.
+class LogFile {
+public:
+    LogFile() = default;
+    ~LogFile();
+
+    LogFile(const LogFile &) = delete;
+    LogFile &operator=(const LogFile &) = delete;
+
+    // Closes the current file and starts a new one named after the session
+    // and the time.
+    void open(const LogOptions &options, const QString &name, qint64 msecs);
+    bool isOpen() const { return file.isOpen(); }
+    // The file being written; rotation moves it on.
+    QString fileName() const { return file.fileName(); }
+
+    void write(const QVector<TerminalLine> &lines, qint64 msecs);
+    // A client line in the log.
+    void note(const QString &text, qint64 msecs);
+    // Says in the log how many lines the writer dropped.
+    void noteDropped(quint64 lines, qint64 msecs);
+    // Closes a block that has waited long enough, and rotates on time.
+    void tick(qint64 msecs);
+    void close();
+
+private:
+    void start(qint64 msecs);
+    bool rotateDue(qint64 msecs) const;
+    void format(const TerminalLine &line);
+    void flushBlock();
+
+    LogOptions options;
+    QString session;
+    QFile file;
+    QFile index;
+    z_stream_s *deflater = nullptr;
+    QByteArray block;
+    qint64 openedMsecs = 0;
+    qint64 fileBytes = 0;       // uncompressed bytes written to this file
+    qint64 lineNumber = 0;
+    qint64 blockFirstLine = 0;
+    qint64 blockStartMsecs = 0;
+    StyleId lastStyle = 0;
+};
+
+// One session's log. The owning thread hands it completed lines, which
+// costs one ring push; a single writer thread shared by all sessions
+// formats, compresses, indexes and rotates the files. A writer that falls
+// behind never stalls the connection: once the ring is full, lines are
+// dropped and a note saying how many goes into the log. Not thread-safe:
+// one producer thread per SessionLog.
+class SessionLog {
+public:
+    explicit SessionLog(const LogOptions &options);
+    // Queued lines are still written; the writer closes the file afterwards.
+    ~SessionLog();
+
+    SessionLog(const SessionLog &) = delete;
+    SessionLog &operator=(const SessionLog &) = delete;
+
+    // Starts a new file named after the session, e.g. on connect.
+    void open(const QString &sessionName);
+    void append(const TerminalLine *lines, int count);
+    void close();
+
+    struct Channel;
+
+private:
+    void push(int kind, QVector<TerminalLine> &&lines, const QString &name);
+
+    std::shared_ptr<Channel> channel;
+};
+
+// Random access to a log through the block index written next to it
+// (<log>.idx): locating a line or a moment reads and decompresses only
+// the block that holds it, however large the file.
+class LogReader {
+public:
+    bool open(const QString &path);
+
+    int blockCount() const { return entries.size(); }
+    // Block holding the line (0-based within the file), or -1.
+    int blockForLine(qint64 line) const;
+    // First block with output at or after the time, or -1.
+    int blockForTime(const QDateTime &time) const;
+    qint64 firstLine(int block) const { return qint64(entries.at(block).firstLine); }
+    QDateTime startTime(int block) const { return QDateTime::fromMSecsSinceEpoch(entries.at(block).msecs); }
+    // The block's text, whole lines only.
+    QByteArray readBlock(int block);
+
+private:
+    struct Entry {
+        quint64 offset;            // uncompressed
+        quint64 compressedOffset;  // in the file
+        quint64 firstLine;
+        qint64 msecs;
+    };
+
+    QFile file;
+    bool compressed = false;
+    QVector<Entry> entries;
+};
@@ -0,0 +1,65 @@
+#include "amlp_status_gauges.h"
+
+#include <QHBoxLayout>
+#include <QProgressBar>
+
+namespace {
+const OobField *findAny(const OobUpdate &update, const QList<QByteArray> &keys) {
+    for (const QByteArray &key : keys)
+        if (const OobField *f = update.field(key)) return f;
+    return nullptr;
+}
+}
+
+StatusGauges::StatusGauges(OobDispatcher *dispatcher, QWidget *parent)
+    : QWidget(parent) {
+    auto *layout = new QHBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+
+    auto addGauge = [&](const char *name, QList<QByteArray> valueKeys, QList<QByteArray> maxKeys) {
+        auto *bar = new QProgressBar(this);
+        bar->setObjectName(name);
+        bar->setTextVisible(true);
+        bar->setFormat("%v / %m");
+        bar->setRange(0, 1);
+        bar->setValue(0);
+        layout->addWidget(bar);
+        gauges.append(Gauge{bar, valueKeys, maxKeys});
+    };
+    addGauge("hp", {"hp", "health", "HEALTH"}, {"maxhp", "hpmax", "maxhealth", "HEALTH_MAX"});
+    addGauge("sp", {"sp", "mana", "mp", "MANA"}, {"maxsp", "maxmana", "maxmp", "MANA_MAX"});
+    addGauge("mv", {"mv", "moves", "movement", "MOVEMENT"}, {"maxmv", "maxmoves", "maxmovement", "MOVEMENT_MAX"});
+    hide();
+
+    dispatcher->subscribe("Char.Vitals", [this](const OobUpdate &u) { apply(u); });
+    dispatcher->subscribe("Char.Status", [this](const OobUpdate &u) { apply(u); });
+    dispatcher->subscribe("MSDP", [this](const OobUpdate &u) { apply(u); });
+}
+
+void StatusGauges::clear() {
+    for (Gauge &g : gauges) {
+        g.value = -1;
+        g.max = -1;
+        g.bar->setRange(0, 1);
+        g.bar->setValue(0);
+    }
+    hide();
+}
+
+void StatusGauges::apply(const OobUpdate &update) {
+    bool any = false;
+    for (Gauge &g : gauges) {
+        const OobField *value = findAny(update, g.valueKeys);
+        const OobField *max = findAny(update, g.maxKeys);
+        if (max && max->isNumber && int(max->number) != g.max) {
+            g.max = int(max->number);
+            g.bar->setMaximum(qMax(1, g.max));
+        }
+        if (value && value->isNumber && int(value->number) != g.value) {
+            g.value = int(value->number);
+            g.bar->setValue(qBound(0, g.value, g.bar->maximum()));
+        }
+        any = any || value || max;
+    }
+    if (any && isHidden()) show();
+}
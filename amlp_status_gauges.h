@@ -0,0 +1,34 @@
+#pragma once
+
+#include <QVector>
+#include <QWidget>
+
+#include "amlp_gmcp.h"
+
+class QProgressBar;
+
+// HP / SP / MV bars fed from GMCP Char.Vitals or MSDP. Hidden until the
+// server sends something it recognizes. Bars only change when a value does,
+// so a server repeating the same vitals costs no repaint.
+class StatusGauges : public QWidget {
+    Q_OBJECT
+public:
+    explicit StatusGauges(OobDispatcher *dispatcher, QWidget *parent = nullptr);
+
+    // Forget the last values, e.g. when a new connection starts.
+    void clear();
+
+private:
+    struct Gauge {
+        QProgressBar *bar;
+        // Field names different servers use for the current and maximum value.
+        QList<QByteArray> valueKeys;
+        QList<QByteArray> maxKeys;
+        int value = -1;
+        int max = -1;
+    };
+
+    void apply(const OobUpdate &update);
+
+    QVector<Gauge> gauges;
+};
@@ -0,0 +1,83 @@
+#include "amlp_style_table.h"
+
+#include <QMutexLocker>
+#include <QtAlgorithms>
+
+#include <limits>
+
+namespace {
+// Largest colorDistance(): black against white.
+const int MaxColorDistance = 3 * 255 * 255;
+
+int colorDistance(QRgb a, QRgb b) {
+    const int r = qRed(a) - qRed(b);
+    const int g = qGreen(a) - qGreen(b);
+    const int bl = qBlue(a) - qBlue(b);
+    return r * r + g * g + bl * bl;
+}
+}
+
+StyleTable &StyleTable::instance() {
+    static StyleTable table;
+    return table;
+}
+
+StyleTable::StyleTable(int capacity)
+    : capacity(qBound(1, capacity, MaxStyles)) {
+    for (auto &chunk : chunks) chunk.store(nullptr, std::memory_order_relaxed);
+    intern(TextStyle());
+}
+
+StyleTable::~StyleTable() {
+    for (auto &chunk : chunks) delete[] chunk.load(std::memory_order_relaxed);
+}
+
+StyleId StyleTable::intern(const TextStyle &style) {
+    QMutexLocker lock(&mutex);
+    auto it = ids.constFind(style);
+    if (it != ids.constEnd()) return it.value();
+
+    const int n = count.load(std::memory_order_relaxed);
+    if (n >= capacity) {
+        overflow.fetch_add(1, std::memory_order_relaxed);
+        auto hit = fallbacks.constFind(style);
+        if (hit != fallbacks.constEnd()) return hit.value();
+        if (fallbacks.size() >= MaxFallbacks) fallbacks.clear();
+        const StyleId id = nearest(style);
+        fallbacks.insert(style, id);
+        return id;
+    }
+    TextStyle *chunk = chunks[n >> ChunkBits].load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new TextStyle[ChunkSize];
+        chunks[n >> ChunkBits].store(chunk, std::memory_order_release);
+    }
+    chunk[n & (ChunkSize - 1)] = style;
+    // Publishing the count releases the entry to lock-free readers.
+    count.store(n + 1, std::memory_order_release);
+    ids.insert(style, StyleId(n));
+    return StyleId(n);
+}
+
+// A linear scan, under the mutex; the callers' caches keep it to once per
+// distinct style. Attributes outweigh any colour difference, and a missing
+// background outweighs any background colour.
+StyleId StyleTable::nearest(const TextStyle &style) const {
+    const int n = count.load(std::memory_order_relaxed);
+    StyleId best = 0;
+    qint64 bestDistance = std::numeric_limits<qint64>::max();
+    for (int id = 0; id < n && bestDistance > 0; ++id) {
+        const TextStyle &s = this->style(StyleId(id));
+        qint64 d = qint64(qPopulationCount(quint32(s.flags ^ style.flags))) * 4 * MaxColorDistance;
+        d += colorDistance(s.fg, style.fg);
+        if (s.hasBackground() != style.hasBackground())
+            d += 2 * MaxColorDistance;
+        else if (style.hasBackground())
+            d += colorDistance(s.bg, style.bg);
+        if (d < bestDistance) {
+            bestDistance = d;
+            best = StyleId(id);
+        }
+    }
+    return best;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <QColor>
+#include <QHash>
+#include <QMutex>
+
+#include <atomic>
+
+// Attributes applied to a run of output text. A zero bg (alpha 0) means the
+// view's own background shows through.
+struct TextStyle {
+    enum Flag : quint8 { Bold = 1, Dim = 2, Italic = 4, Underline = 8, Inverse = 16 };
+
+    QRgb fg = qRgb(0xff, 0xff, 0xff);
+    QRgb bg = 0;
+    quint8 flags = 0;
+
+    bool has(Flag f) const { return flags & f; }
+    void set(Flag f, bool on) { flags = on ? quint8(flags | f) : quint8(flags & ~f); }
+    bool hasBackground() const { return qAlpha(bg) != 0; }
+
+    bool operator==(const TextStyle &o) const { return fg == o.fg && bg == o.bg && flags == o.flags; }
+    bool operator!=(const TextStyle &o) const { return !(*this == o); }
+};
+
+inline size_t qHash(const TextStyle &s, size_t seed = 0) {
+    return qHashMulti(seed, s.fg, s.bg, s.flags);
+}
+
+// Small integer handle for an interned TextStyle. Id 0 is the default style.
+using StyleId = quint16;
+
+// Process-wide, append-only table of every distinct style seen so far, so
+// lines store a 16-bit id per run instead of a full style. Lookups by id are
+// lock-free from any thread; interning a new style takes a mutex, which is
+// why callers keep a StyleCache in front of it. Ids are never reused: stored
+// lines, logs and archives hold them with no count of who still does. Once
+// the table is full, a new style gets the id of the nearest existing one
+// (same attributes first, then the closest colours), so a session that keeps
+// inventing truecolor gradients shifts a shade instead of losing colour.
+class StyleTable {
+public:
+    static constexpr int MaxStyles = 65536;
+
+    // Sessions share instance(); tests make their own, smaller ones.
+    explicit StyleTable(int capacity = MaxStyles);
+    ~StyleTable();
+    static StyleTable &instance();
+
+    StyleId intern(const TextStyle &style);
+    // Only valid for ids returned by intern().
+    const TextStyle &style(StyleId id) const {
+        return chunks[id >> ChunkBits].load(std::memory_order_acquire)[id & (ChunkSize - 1)];
+    }
+    int size() const { return count.load(std::memory_order_acquire); }
+    // intern() calls answered with the nearest style because the table was full.
+    quint64 approximated() const { return overflow.load(std::memory_order_relaxed); }
+
+private:
+    StyleId nearest(const TextStyle &style) const;
+
+    static constexpr int ChunkBits = 10;
+    static constexpr int ChunkSize = 1 << ChunkBits;
+    static constexpr int MaxChunks = MaxStyles / ChunkSize;
+    // Approximations remembered; cleared when full, since each one is a scan.
+    static constexpr int MaxFallbacks = 4096;
+
+    const int capacity;
+    std::atomic<TextStyle *> chunks[MaxChunks];
+    std::atomic<int> count{0};
+    std::atomic<quint64> overflow{0};
+    QMutex mutex;
+    QHash<TextStyle, StyleId> ids;
+    QHash<TextStyle, StyleId> fallbacks;
+};
+
+// Per-thread front for StyleTable::intern(): repeated styles resolve without
+// touching the shared mutex. Not thread-safe; one per parser or worker.
+// Starts over once it holds MaxEntries styles, so a stream of one-off
+// gradient colours does not grow it for the whole session.
+class StyleCache {
+public:
+    static constexpr int MaxEntries = 4096;
+
+    StyleId intern(const TextStyle &style) {
+        if (style == last) return lastId;
+        auto it = ids.constFind(style);
+        if (it != ids.constEnd()) {
+            lastId = it.value();
+        } else {
+            if (ids.size() >= MaxEntries) ids.clear();
+            lastId = *ids.insert(style, StyleTable::instance().intern(style));
+        }
+        last = style;
+        return lastId;
+    }
+    int size() const { return ids.size(); }
+
+private:
+    QHash<TextStyle, StyleId> ids;
+    TextStyle last;
+    StyleId lastId = 0;
+};
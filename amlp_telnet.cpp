@@ -0,0 +1,361 @@
+#include "amlp_telnet.h"
+
+#include <QList>
+
+#include "amlp_gmcp.h"
+
+using namespace Telnet;
+
+namespace {
+enum : quint8 { TtypeIs = 0, TtypeSend = 1 };
+enum : quint8 { CharsetRequest = 1, CharsetAccepted = 2, CharsetRejected = 3 };
+// MTTS bitvector: ANSI (1) | UTF-8 (4) | 256 colours (8) | truecolour (256)
+const char MttsFlags[] = "MTTS 269";
+const char MttsFlagsLegacy[] = "MTTS 265";
+const char GmcpHello[] = "Core.Hello {\"client\":\"AMLP-Client\",\"version\":\"1.0.0\"}";
+const char GmcpSupports[] = "Core.Supports.Set [\"Char 1\",\"Char.Vitals 1\",\"Char.Status 1\",\"Room 1\",\"Comm 1\"]";
+}
+
+TelnetNegotiator::TelnetNegotiator(QObject *parent)
+    : QObject(parent) {
+}
+
+void TelnetNegotiator::reset() {
+    for (OptionState &o : options) o = OptionState();
+    ttypeCycle = 0;
+    nawsSent = false;
+    compressionPending = false;
+}
+
+void TelnetNegotiator::start() {
+    requestLocal(Naws, true);
+}
+
+bool TelnetNegotiator::acceptLocal(quint8 option) const {
+    switch (option) {
+    case Naws:
+    case TerminalType:
+    case Charset:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool TelnetNegotiator::acceptRemote(quint8 option) const {
+    switch (option) {
+    case Echo:
+    case SuppressGoAhead:
+    case EndOfRecord:
+    case Charset:
+    case Msdp:
+    case Mccp2:
+    case Mccp3:
+    case Gmcp:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool TelnetNegotiator::takeCompressionStart() {
+    const bool pending = compressionPending;
+    compressionPending = false;
+    return pending;
+}
+
+void TelnetNegotiator::sendCommand(quint8 command, quint8 option) {
+    const char bytes[3] = {char(IAC), char(command), char(option)};
+    emit send(QByteArray(bytes, 3));
+}
+
+QByteArray TelnetNegotiator::subnegotiation(quint8 option, const QByteArray &payload) {
+    QByteArray out;
+    out.reserve(payload.size() + 6);
+    out.append(char(IAC));
+    out.append(char(SB));
+    out.append(char(option));
+    for (char c : payload) {
+        out.append(c);
+        if (quint8(c) == IAC) out.append(c);
+    }
+    out.append(char(IAC));
+    out.append(char(SE));
+    return out;
+}
+
+void TelnetNegotiator::telnetCommand(quint8 command, quint8 option) {
+    OptionState &o = options[option];
+    switch (command) {
+    case WILL:
+        switch (o.him) {
+        case No:
+            if (acceptRemote(option)) {
+                o.him = Yes;
+                sendCommand(DO, option);
+                remoteChanged(option, true);
+            } else {
+                sendCommand(DONT, option);
+            }
+            break;
+        case Yes:
+            break;
+        case WantNo:
+            // DONT answered by WILL is a protocol error; settle where the peer is.
+            o.him = o.himOpposite ? Yes : No;
+            o.himOpposite = false;
+            if (o.him == Yes) remoteChanged(option, true);
+            break;
+        case WantYes:
+            if (o.himOpposite) {
+                o.him = WantNo;
+                o.himOpposite = false;
+                sendCommand(DONT, option);
+            } else {
+                o.him = Yes;
+                remoteChanged(option, true);
+            }
+            break;
+        }
+        break;
+
+    case WONT:
+        switch (o.him) {
+        case No:
+            break;
+        case Yes:
+            o.him = No;
+            sendCommand(DONT, option);
+            remoteChanged(option, false);
+            break;
+        case WantNo:
+            if (o.himOpposite) {
+                o.him = WantYes;
+                o.himOpposite = false;
+                sendCommand(DO, option);
+            } else {
+                o.him = No;
+                remoteChanged(option, false);
+            }
+            break;
+        case WantYes:
+            o.him = No;
+            o.himOpposite = false;
+            break;
+        }
+        break;
+
+    case DO:
+        switch (o.us) {
+        case No:
+            if (acceptLocal(option)) {
+                o.us = Yes;
+                sendCommand(WILL, option);
+                localChanged(option, true);
+            } else {
+                sendCommand(WONT, option);
+            }
+            break;
+        case Yes:
+            break;
+        case WantNo:
+            o.us = o.usOpposite ? Yes : No;
+            o.usOpposite = false;
+            if (o.us == Yes) localChanged(option, true);
+            break;
+        case WantYes:
+            if (o.usOpposite) {
+                o.us = WantNo;
+                o.usOpposite = false;
+                sendCommand(WONT, option);
+            } else {
+                o.us = Yes;
+                localChanged(option, true);
+            }
+            break;
+        }
+        break;
+
+    case DONT:
+        switch (o.us) {
+        case No:
+            break;
+        case Yes:
+            o.us = No;
+            sendCommand(WONT, option);
+            localChanged(option, false);
+            break;
+        case WantNo:
+            if (o.usOpposite) {
+                o.us = WantYes;
+                o.usOpposite = false;
+                sendCommand(WILL, option);
+            } else {
+                o.us = No;
+                localChanged(option, false);
+            }
+            break;
+        case WantYes:
+            o.us = No;
+            o.usOpposite = false;
+            break;
+        }
+        break;
+
+    case GA:
+    case EOR:
+        emit promptMarked();
+        break;
+
+    default:
+        break;
+    }
+}
+
+void TelnetNegotiator::requestLocal(quint8 option, bool enable) {
+    OptionState &o = options[option];
+    const QState target = enable ? Yes : No;
+    if (o.us == target) return;
+    if (o.us == (enable ? No : Yes)) {
+        o.us = enable ? WantYes : WantNo;
+        sendCommand(enable ? WILL : WONT, option);
+    } else if (o.us == (enable ? WantNo : WantYes)) {
+        o.usOpposite = true;
+    } else {
+        o.usOpposite = false;
+    }
+}
+
+void TelnetNegotiator::requestRemote(quint8 option, bool enable) {
+    OptionState &o = options[option];
+    const QState target = enable ? Yes : No;
+    if (o.him == target) return;
+    if (o.him == (enable ? No : Yes)) {
+        o.him = enable ? WantYes : WantNo;
+        sendCommand(enable ? DO : DONT, option);
+    } else if (o.him == (enable ? WantNo : WantYes)) {
+        o.himOpposite = true;
+    } else {
+        o.himOpposite = false;
+    }
+}
+
+void TelnetNegotiator::localChanged(quint8 option, bool enabled) {
+    if (option == Naws && enabled) {
+        nawsSent = false;
+        sendNaws();
+    }
+}
+
+void TelnetNegotiator::remoteChanged(quint8 option, bool enabled) {
+    switch (option) {
+    case Echo:
+        emit remoteEchoChanged(enabled);
+        break;
+    case Mccp3:
+        if (enabled) {
+            // Everything after this subnegotiation goes out compressed.
+            emit send(subnegotiation(Mccp3, QByteArray()));
+            emit outgoingCompressionStarted();
+        }
+        break;
+    case Gmcp:
+        if (enabled) {
+            emit send(subnegotiation(Gmcp, GmcpHello));
+            emit send(subnegotiation(Gmcp, GmcpSupports));
+        }
+        break;
+    case Msdp:
+        if (enabled)
+            emit send(subnegotiation(Msdp, msdpReport({"HEALTH", "HEALTH_MAX", "MANA", "MANA_MAX",
+                                                       "MOVEMENT", "MOVEMENT_MAX", "ROOM"})));
+        break;
+    default:
+        break;
+    }
+}
+
+bool TelnetNegotiator::telnetSubnegotiation(quint8 option, const QByteArray &payload) {
+    switch (option) {
+    case TerminalType:
+        handleTerminalType(payload);
+        return true;
+    case Charset:
+        handleCharset(payload);
+        return true;
+    case Mccp2:
+        if (!remoteEnabled(Mccp2)) return true;
+        // The very next byte is zlib data: stop the parser here.
+        compressionPending = true;
+        return false;
+    case Gmcp:
+    case Msdp:
+        if (remoteEnabled(option)) emit outOfBand(option, payload);
+        return true;
+    default:
+        return true;
+    }
+}
+
+void TelnetNegotiator::setWindowSize(int cols, int rows) {
+    cols = qBound(1, cols, 0xFFFF);
+    rows = qBound(1, rows, 0xFFFF);
+    if (nawsSent && cols == nawsCols && rows == nawsRows) return;
+    nawsCols = cols;
+    nawsRows = rows;
+    nawsSent = false;
+    sendNaws();
+}
+
+void TelnetNegotiator::sendNaws() {
+    if (!localEnabled(Naws) || nawsSent) return;
+    QByteArray size;
+    size.append(char((nawsCols >> 8) & 0xFF));
+    size.append(char(nawsCols & 0xFF));
+    size.append(char((nawsRows >> 8) & 0xFF));
+    size.append(char(nawsRows & 0xFF));
+    emit send(subnegotiation(Naws, size));
+    nawsSent = true;
+}
+
+void TelnetNegotiator::handleTerminalType(const QByteArray &payload) {
+    if (payload.isEmpty() || quint8(payload.at(0)) != TtypeSend) return;
+    // MTTS: name, then terminal kind, then the capability bitvector, which
+    // repeats so the server can detect the end of the list.
+    QByteArray name;
+    switch (ttypeCycle) {
+    case 0: name = terminalName; break;
+    case 1: name = "XTERM-256COLOR"; break;
+    default: name = preferred == TextEncoding::Utf8 ? MttsFlags : MttsFlagsLegacy; break;
+    }
+    if (ttypeCycle < 2) ++ttypeCycle;
+    emit send(subnegotiation(TerminalType, char(TtypeIs) + name));
+}
+
+void TelnetNegotiator::handleCharset(const QByteArray &payload) {
+    if (payload.size() < 2 || quint8(payload.at(0)) != CharsetRequest) return;
+    QByteArray list = payload.mid(1);
+    if (list.startsWith("[TTABLE]") && list.size() > 9) list = list.mid(9);
+    if (list.isEmpty()) return;
+    const char sep = list.at(0);
+    const QList<QByteArray> names = list.mid(1).split(sep);
+    // The profile's choice, then UTF-8, then any code page the parser knows.
+    int best = -1;
+    int bestRank = 3;
+    for (int i = 0; i < names.size(); ++i) {
+        bool known = false;
+        const TextEncoding encoding = encodingFromName(names[i], &known);
+        if (!known) continue;
+        const int rank = encoding == preferred ? 0 : encoding == TextEncoding::Utf8 ? 1 : 2;
+        if (rank < bestRank) {
+            best = i;
+            bestRank = rank;
+        }
+    }
+    if (best < 0) {
+        emit send(subnegotiation(Charset, QByteArray(1, char(CharsetRejected))));
+        return;
+    }
+    emit send(subnegotiation(Charset, char(CharsetAccepted) + names[best]));
+    emit charsetSelected(encodingName(encodingFromName(names[best])));
+}
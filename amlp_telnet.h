@@ -0,0 +1,100 @@
+#pragma once
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+
+#include "amlp_ansi_parser.h"
+#include "amlp_text_codec.h"
+
+namespace Telnet {
+enum : quint8 {
+    IAC = 255, DONT = 254, DO = 253, WONT = 252, WILL = 251,
+    SB = 250, GA = 249, NOP = 241, SE = 240, EOR = 239
+};
+enum Option : quint8 {
+    Echo = 1,
+    SuppressGoAhead = 3,
+    TerminalType = 24,
+    // Lets the server end prompts with IAC EOR.
+    EndOfRecord = 25,
+    Naws = 31,
+    Charset = 42,
+    Msdp = 69,
+    Mccp2 = 86,
+    Mccp3 = 87,
+    Gmcp = 201
+};
+}
+
+// Telnet option negotiation following the Q method (RFC 1143), so neither
+// side can be driven into a negotiation loop. Plugs into AnsiParser as its
+// TelnetHandler; replies are emitted through send().
+class TelnetNegotiator : public QObject, public TelnetHandler {
+    Q_OBJECT
+public:
+    explicit TelnetNegotiator(QObject *parent = nullptr);
+
+    // Forget all option state; call when a new connection starts.
+    void reset();
+    // Options the client offers up front once connected.
+    void start();
+    // Sends NAWS immediately when enabled and the size changed.
+    void setWindowSize(int cols, int rows);
+    void setTerminalName(const QString &name) { terminalName = name.toLatin1(); }
+    // The profile's character set: taken first when a CHARSET request offers
+    // it, and MTTS only claims UTF-8 when it is UTF-8.
+    void setPreferredEncoding(TextEncoding encoding) { preferred = encoding; }
+
+    bool localEnabled(quint8 option) const { return options[option].us == Yes; }
+    bool remoteEnabled(quint8 option) const { return options[option].him == Yes; }
+
+    // True once after the server announced that MCCP2 compression starts
+    // right after the subnegotiation that paused the parser.
+    bool takeCompressionStart();
+
+    void telnetCommand(quint8 command, quint8 option) override;
+    bool telnetSubnegotiation(quint8 option, const QByteArray &payload) override;
+
+    static QByteArray subnegotiation(quint8 option, const QByteArray &payload);
+
+signals:
+    void send(const QByteArray &bytes);
+    void remoteEchoChanged(bool serverEchoes);
+    // MCCP3 agreed: every byte written after this signal must be compressed.
+    void outgoingCompressionStarted();
+    void charsetSelected(const QByteArray &name);
+    // GA or EOR: the preceding partial line is a complete prompt.
+    void promptMarked();
+    // A GMCP or MSDP subnegotiation payload, still undecoded.
+    void outOfBand(quint8 option, const QByteArray &payload);
+
+private:
+    enum QState : quint8 { No, Yes, WantNo, WantYes };
+    struct OptionState {
+        QState us = No;
+        QState him = No;
+        bool usOpposite = false;
+        bool himOpposite = false;
+    };
+
+    bool acceptLocal(quint8 option) const;
+    bool acceptRemote(quint8 option) const;
+    void requestLocal(quint8 option, bool enable);
+    void requestRemote(quint8 option, bool enable);
+    void localChanged(quint8 option, bool enabled);
+    void remoteChanged(quint8 option, bool enabled);
+    void sendCommand(quint8 command, quint8 option);
+    void sendNaws();
+    void handleTerminalType(const QByteArray &payload);
+    void handleCharset(const QByteArray &payload);
+
+    OptionState options[256];
+    QByteArray terminalName = "AMLP-CLIENT";
+    TextEncoding preferred = TextEncoding::Utf8;
+    int ttypeCycle = 0;
+    int nawsCols = 80;
+    int nawsRows = 24;
+    bool nawsSent = false;
+    bool compressionPending = false;
+};
@@ -0,0 +1,375 @@
+#include "amlp_terminal_view.h"
+
+#include <QApplication>
+#include <QClipboard>
+#include <QElapsedTimer>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QScrollBar>
+#include <QWheelEvent>
+
+#include "amlp_search.h"
+
+namespace {
+// Inner margin; the stylesheet adds its own padding around the viewport.
+const int Padding = 2;
+const int TabWidth = 8;
+// Laid-out lines kept around; far more than fit on any screen.
+const int CachedLines = 4096;
+}
+
+TerminalView::TerminalView(LineStore *store, QWidget *parent)
+    : QAbstractScrollArea(parent), store(store), cache(CachedLines) {
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
+    setFocusPolicy(Qt::ClickFocus);
+    viewport()->setCursor(Qt::IBeamCursor);
+    updateMetrics();
+    syncScrollBar();
+}
+
+int TerminalView::visibleRows() const {
+    return qMax(1, (viewport()->height() - 2 * Padding) / lineHeight);
+}
+
+void TerminalView::storeChanged() {
+    // The partial line may have grown or been completed since it was laid out.
+    cache.remove(cachedPartialSeq);
+    cachedPartialSeq = store->endSeq();
+
+    const qint64 first = store->firstSeq();
+    const qint64 last = first + qMax(0, store->count() - 1);
+    const bool frontMoved = first != lastFirstSeq;
+    lastFirstSeq = first;
+
+    if (following) bottomSeq = last;
+    bottomSeq = qBound(lowestBottomSeq(), bottomSeq, last);
+    syncScrollBar();
+    // A reader parked in history is unaffected by appends at the tail.
+    if (following || frontMoved) viewport()->update();
+}
+
+void TerminalView::scrollToBottom() {
+    setFollowing(true);
+    storeChanged();
+    viewport()->update();
+}
+
+void TerminalView::setLiveTail(bool on) {
+    liveTail = on;
+    setVerticalScrollBarPolicy(on ? Qt::ScrollBarAlwaysOff : Qt::ScrollBarAlwaysOn);
+    if (on) scrollToBottom();
+}
+
+void TerminalView::setFollowing(bool on) {
+    if (following == on) return;
+    following = on;
+    emit followingChanged(on);
+}
+
+void TerminalView::setHighlight(std::shared_ptr<const SearchPattern> pattern) {
+    highlight = std::move(pattern);
+    if (!highlight) currentMatch = -1;
+    cache.clear();
+    viewport()->update();
+}
+
+void TerminalView::setCurrentMatch(qint64 seq) {
+    currentMatch = seq;
+    viewport()->update();
+}
+
+void TerminalView::scrollToLine(qint64 seq) {
+    const qint64 first = store->firstSeq();
+    const qint64 last = first + qMax(0, store->count() - 1);
+    // Painting is bottom-up, so aim the bottom half a screen below the line.
+    bottomSeq = qBound(lowestBottomSeq(), seq + visibleRows() / 2, last);
+    setFollowing(bottomSeq >= last);
+    syncScrollBar();
+    viewport()->update();
+}
+
+// Lines never take less than a row, so the oldest screenful ends at least
+// visibleRows() - 1 lines after the first.
+qint64 TerminalView::lowestBottomSeq() const {
+    return store->firstSeq() + qMin(visibleRows(), qMax(1, store->count())) - 1;
+}
+
+// The scroll bar's value is the top of a screenful of lines: 0 shows the
+// first visibleRows() lines, the maximum ends at the newest.
+void TerminalView::syncScrollBar() {
+    syncing = true;
+    QScrollBar *bar = verticalScrollBar();
+    const int rows = visibleRows();
+    bar->setRange(0, qMax(0, store->count() - rows));
+    bar->setPageStep(rows);
+    bar->setSingleStep(1);
+    bar->setValue(int(bottomSeq - store->firstSeq()) - (rows - 1));
+    syncing = false;
+}
+
+void TerminalView::scrollContentsBy(int, int) {
+    if (syncing) return;
+    QScrollBar *bar = verticalScrollBar();
+    const qint64 last = store->firstSeq() + qMax(0, store->count() - 1);
+    bottomSeq = qMin(store->firstSeq() + bar->value() + visibleRows() - 1, last);
+    setFollowing(bar->value() >= bar->maximum());
+    viewport()->update();
+}
+
+void TerminalView::updateMetrics() {
+    QFontMetrics fm(font());
+    charWidth = qMax(1, fm.horizontalAdvance(QLatin1Char('W')));
+    lineHeight = qMax(1, fm.lineSpacing());
+    for (int i = 0; i < 8; ++i) {
+        fonts[i] = font();
+        fonts[i].setBold(i & 1);
+        fonts[i].setItalic(i & 2);
+        fonts[i].setUnderline(i & 4);
+    }
+    cols = qMax(1, (viewport()->width() - 2 * Padding) / charWidth);
+    cache.clear();
+}
+
+void TerminalView::resizeEvent(QResizeEvent *event) {
+    QAbstractScrollArea::resizeEvent(event);
+    const int oldCols = cols;
+    cols = qMax(1, (viewport()->width() - 2 * Padding) / charWidth);
+    if (cols != oldCols) cache.clear();
+    // Taller now: near the top of history, keep the screen full.
+    bottomSeq = qMax(bottomSeq, lowestBottomSeq());
+    syncScrollBar();
+    emit viewportResized(cols, visibleRows());
+}
+
+void TerminalView::changeEvent(QEvent *event) {
+    if (event->type() == QEvent::FontChange || event->type() == QEvent::StyleChange) {
+        updateMetrics();
+        viewport()->update();
+    }
+    QAbstractScrollArea::changeEvent(event);
+}
+
+const TerminalView::CachedLine *TerminalView::layoutLine(qint64 seq) const {
+    if (const CachedLine *hit = cache.object(seq)) return hit;
+
+    const TerminalLine &line = store->at(seq);
+    auto *cl = new CachedLine;
+
+    // Decode run by run so style boundaries land on character offsets.
+    struct Span { int start; int length; StyleId style; };
+    QVector<Span> spans;
+    if (line.runs.isEmpty()) {
+        cl->text = QString::fromUtf8(line.text);
+        spans.append(Span{0, int(cl->text.size()), 0});
+    } else {
+        int byte = 0;
+        for (const StyleRun &run : line.runs) {
+            const int start = cl->text.size();
+            cl->text.append(QString::fromUtf8(line.text.constData() + byte, int(run.length)));
+            spans.append(Span{start, int(cl->text.size()) - start, run.style});
+            byte += int(run.length);
+        }
+    }
+
+    // Expand tabs so every character occupies one cell.
+    if (cl->text.contains(QLatin1Char('\t'))) {
+        QString expanded;
+        QVector<Span> shifted = spans;
+        int s = 0;
+        for (int i = 0; i < cl->text.size(); ++i) {
+            while (s < spans.size() && spans[s].start + spans[s].length <= i) ++s;
+            if (cl->text[i] == QLatin1Char('\t')) {
+                const int pad = TabWidth - expanded.size() % TabWidth;
+                expanded.append(QString(pad, QLatin1Char(' ')));
+                for (int k = s; k < shifted.size(); ++k) {
+                    if (k == s) shifted[k].length += pad - 1;
+                    else shifted[k].start += pad - 1;
+                }
+            } else {
+                expanded.append(cl->text[i]);
+            }
+        }
+        cl->text = expanded;
+        spans = shifted;
+    }
+
+    if (highlight) highlight->ranges(cl->text, cl->matches);
+
+    cl->rows = qMax(1, int((cl->text.size() + cols - 1) / cols));
+    const StyleTable &table = StyleTable::instance();
+    for (const Span &span : spans) {
+        const TextStyle &style = table.style(span.style);
+        QRgb fg = style.fg;
+        QRgb bg = style.hasBackground() ? style.bg : background.rgb();
+        if (style.has(TextStyle::Inverse)) std::swap(fg, bg);
+        if (style.has(TextStyle::Dim))
+            fg = qRgb((qRed(fg) + qRed(bg)) / 2, (qGreen(fg) + qGreen(bg)) / 2, (qBlue(fg) + qBlue(bg)) / 2);
+        if (bg == background.rgb()) bg = 0;
+        const int fontIndex = (style.has(TextStyle::Bold) ? 1 : 0) | (style.has(TextStyle::Italic) ? 2 : 0)
+                              | (style.has(TextStyle::Underline) ? 4 : 0);
+
+        int pos = span.start;
+        const int end = span.start + span.length;
+        while (pos < end) {
+            const int row = pos / cols;
+            const int stop = qMin(end, (row + 1) * cols);
+            Piece piece{row, pos % cols, stop - pos, fontIndex, fg, bg, QStaticText(cl->text.mid(pos, stop - pos))};
+            piece.glyphs.setTextFormat(Qt::PlainText);
+            piece.glyphs.prepare(QTransform(), fonts[fontIndex]);
+            cl->pieces.append(piece);
+            pos = stop;
+        }
+    }
+
+    cache.insert(seq, cl);
+    return cl;
+}
+
+void TerminalView::paintEvent(QPaintEvent *) {
+    QElapsedTimer timer;
+    timer.start();
+    QPainter p(viewport());
+    p.fillRect(viewport()->rect(), background);
+    rowHits.clear();
+    if (store->count() == 0) return;
+
+    TextPos selStart = selAnchor, selEnd = selCursor;
+    if (selEnd < selStart) std::swap(selStart, selEnd);
+    const bool hasSelection = selStart.seq >= 0 && !(selStart == selEnd);
+
+    const qint64 first = store->firstSeq();
+    int bottom = viewport()->height() - Padding;
+    for (qint64 seq = bottomSeq; seq >= first && bottom > 0; --seq) {
+        const CachedLine *cl = layoutLine(seq);
+        const int top = bottom - cl->rows * lineHeight;
+        const int length = cl->text.size();
+
+        for (const Piece &piece : cl->pieces) {
+            if (piece.bg)
+                p.fillRect(Padding + piece.column * charWidth, top + piece.row * lineHeight,
+                           piece.length * charWidth, lineHeight, QColor(piece.bg));
+        }
+        for (const QPair<int, int> &match : cl->matches) {
+            const QColor &color = seq == currentMatch ? currentMatchColor : matchColor;
+            for (int pos = match.first, end = match.first + match.second; pos < end;) {
+                const int row = pos / cols;
+                const int stop = qMin(end, (row + 1) * cols);
+                p.fillRect(Padding + (pos % cols) * charWidth, top + row * lineHeight,
+                           (stop - pos) * charWidth, lineHeight, color);
+                pos = stop;
+            }
+        }
+
+        for (int r = 0; r < cl->rows; ++r) {
+            const int rowTop = top + r * lineHeight;
+            const int rowStart = r * cols;
+            const int rowLength = qMin(cols, length - rowStart);
+            rowHits.prepend(RowHit{rowTop, seq, rowStart, qMax(0, rowLength)});
+
+            if (hasSelection && seq >= selStart.seq && seq <= selEnd.seq) {
+                const int from = qMax(rowStart, seq == selStart.seq ? selStart.offset : 0);
+                const int to = qMin(rowStart + cols, seq == selEnd.seq ? selEnd.offset : length + 1);
+                if (to > from)
+                    p.fillRect(Padding + (from - rowStart) * charWidth, rowTop,
+                               (to - from) * charWidth, lineHeight, selectionColor);
+            }
+        }
+
+        for (const Piece &piece : cl->pieces) {
+            const int y = top + piece.row * lineHeight;
+            if (y + lineHeight <= 0) continue;
+            p.setFont(fonts[piece.font]);
+            p.setPen(QColor(piece.fg));
+            p.drawStaticText(Padding + piece.column * charWidth, y, piece.glyphs);
+        }
+        bottom = top;
+    }
+    emit painted(timer.nsecsElapsed());
+}
+
+void TerminalView::wheelEvent(QWheelEvent *event) {
+    if (liveTail) {
+        emit tailScrolled(event);
+        return;
+    }
+    QScrollBar *bar = verticalScrollBar();
+    if (event->angleDelta().y() > 0 && bar->value() <= bar->minimum() && !store->archive().isEmpty()) {
+        emit olderRequested();
+        event->accept();
+        return;
+    }
+    QAbstractScrollArea::wheelEvent(event);
+}
+
+TerminalView::TextPos TerminalView::hitTest(const QPoint &pos) const {
+    TextPos tp;
+    if (rowHits.isEmpty()) return tp;
+    const RowHit *hit = &rowHits.first();
+    if (pos.y() >= rowHits.last().top) {
+        hit = &rowHits.last();
+    } else {
+        for (const RowHit &row : rowHits) {
+            if (pos.y() < row.top + lineHeight) { hit = &row; break; }
+        }
+    }
+    const int col = qBound(0, (pos.x() - Padding + charWidth / 2) / charWidth, hit->length);
+    tp.seq = hit->seq;
+    tp.offset = hit->start + col;
+    return tp;
+}
+
+void TerminalView::mousePressEvent(QMouseEvent *event) {
+    if (event->button() != Qt::LeftButton) {
+        QAbstractScrollArea::mousePressEvent(event);
+        return;
+    }
+    selAnchor = selCursor = hitTest(event->position().toPoint());
+    selecting = true;
+    viewport()->update();
+}
+
+void TerminalView::mouseMoveEvent(QMouseEvent *event) {
+    if (!selecting) return;
+    selCursor = hitTest(event->position().toPoint());
+    viewport()->update();
+}
+
+void TerminalView::mouseReleaseEvent(QMouseEvent *event) {
+    if (event->button() != Qt::LeftButton || !selecting) return;
+    selecting = false;
+    QClipboard *clipboard = QApplication::clipboard();
+    if (clipboard->supportsSelection() && !(selAnchor == selCursor))
+        clipboard->setText(selectedText(), QClipboard::Selection);
+}
+
+void TerminalView::keyPressEvent(QKeyEvent *event) {
+    if (event->matches(QKeySequence::Copy)) {
+        QApplication::clipboard()->setText(selectedText());
+        return;
+    }
+    if (liveTail) {
+        event->ignore();
+        return;
+    }
+    QAbstractScrollArea::keyPressEvent(event);
+}
+
+QString TerminalView::selectedText() const {
+    TextPos from = selAnchor, to = selCursor;
+    if (to < from) std::swap(from, to);
+    if (from.seq < 0 || from == to) return QString();
+
+    QString result;
+    const qint64 first = qMax(from.seq, store->firstSeq());
+    for (qint64 seq = first; seq <= to.seq && seq < store->firstSeq() + store->count(); ++seq) {
+        // Offsets count tab-expanded cells; expand the same way before slicing.
+        const CachedLine *cl = layoutLine(seq);
+        const int start = seq == from.seq ? from.offset : 0;
+        const int end = seq == to.seq ? to.offset : cl->text.size();
+        if (seq != first) result.append(QLatin1Char('\n'));
+        result.append(cl->text.mid(start, qMax(0, end - start)));
+    }
+    return result;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <QAbstractScrollArea>
+#include <QCache>
+#include <QFont>
+#include <QStaticText>
+
+#include <memory>
+
+#include "amlp_line_store.h"
+
+class SearchPattern;
+
+// Read-only output view that paints straight from a LineStore. Only the
+// visible rows are laid out, and laid-out lines are cached by sequence
+// number so repaints reuse their glyphs. Lines wrap at the viewport width
+// and are painted bottom-up from the line the scroll bar points at.
+class TerminalView : public QAbstractScrollArea {
+    Q_OBJECT
+public:
+    explicit TerminalView(LineStore *store, QWidget *parent = nullptr);
+
+    // Call after the store changed. Only repaints when the visible content moved.
+    void storeChanged();
+
+    int columns() const { return cols; }
+    int visibleRows() const;
+    bool isFollowing() const { return following; }
+    void scrollToBottom();
+    // Live tail pane of a split: pinned to the newest line, no scroll bar,
+    // and wheel input is handed on through tailScrolled().
+    void setLiveTail(bool on);
+    QString selectedText() const;
+
+    // Highlights every match of the pattern in the visible lines; null clears.
+    void setHighlight(std::shared_ptr<const SearchPattern> pattern);
+    // Line whose matches are drawn as the current one.
+    void setCurrentMatch(qint64 seq);
+    // Scrolls so the line is on screen, roughly centred. It must be in the store.
+    void scrollToLine(qint64 seq);
+    // No line older than this can be on screen (every line takes a row or more).
+    qint64 firstVisibleSeq() const { return qMax(store->firstSeq(), bottomSeq - visibleRows()); }
+
+signals:
+    // The user scrolled past the oldest stored line.
+    void olderRequested();
+    // Wheel input over a live tail, for the history pane above it to scroll.
+    void tailScrolled(QWheelEvent *event);
+    void viewportResized(int columns, int rows);
+    // Scrolled away from the newest line, or back to it.
+    void followingChanged(bool following);
+    // After each paint, with the time the paint took.
+    void painted(qint64 nanoseconds);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void changeEvent(QEvent *event) override;
+
+private:
+    // Colours are resolved from the interned style at layout time, with
+    // inverse and dim already applied. bg is 0 when nothing needs filling.
+    struct Piece {
+        int row;
+        int column;
+        int length;
+        int font;
+        QRgb fg;
+        QRgb bg;
+        QStaticText glyphs;
+    };
+    struct CachedLine {
+        QString text;
+        int rows = 1;
+        QVector<Piece> pieces;
+        // Search matches as (start, length) in text.
+        QVector<QPair<int, int>> matches;
+    };
+    // Where each visible row landed during the last paint, for hit testing.
+    struct RowHit {
+        int top;
+        qint64 seq;
+        int start;
+        int length;
+    };
+    struct TextPos {
+        qint64 seq = -1;
+        int offset = 0;
+        bool operator<(const TextPos &o) const { return seq < o.seq || (seq == o.seq && offset < o.offset); }
+        bool operator==(const TextPos &o) const { return seq == o.seq && offset == o.offset; }
+    };
+
+    const CachedLine *layoutLine(qint64 seq) const;
+    void updateMetrics();
+    void syncScrollBar();
+    qint64 lowestBottomSeq() const;
+    void setFollowing(bool on);
+    TextPos hitTest(const QPoint &pos) const;
+
+    LineStore *store;
+    mutable QCache<qint64, CachedLine> cache;
+    qint64 cachedPartialSeq = -1;
+    qint64 lastFirstSeq = 0;
+    qint64 bottomSeq = 0;
+    bool following = true;
+    bool syncing = false;
+    bool liveTail = false;
+
+    // Indexed by bold | italic << 1 | underline << 2.
+    QFont fonts[8];
+    int charWidth = 8;
+    int lineHeight = 16;
+    int cols = 80;
+    QColor background = QColor("#000000");
+    QColor selectionColor = QColor("#264f78");
+    QColor matchColor = QColor("#5c4a00");
+    QColor currentMatchColor = QColor("#a66f00");
+
+    std::shared_ptr<const SearchPattern> highlight;
+    qint64 currentMatch = -1;
+
+    QVector<RowHit> rowHits;
+    TextPos selAnchor;
+    TextPos selCursor;
+    bool selecting = false;
+};
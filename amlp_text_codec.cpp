@@ -0,0 +1,187 @@
+#include "amlp_text_codec.h"
+
+#include <QtAlgorithms>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define AMLP_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX2 instructions in functions marked for it;
+// MSVC emits whatever intrinsics it is given.
+#if defined(AMLP_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define AMLP_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define AMLP_TARGET_AVX2
+#endif
+
+namespace {
+
+// CP437's upper half: accents, box drawing, blocks, Greek and maths.
+const char16_t Cp437High[128] = {
+    0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7,
+    0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+    0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9,
+    0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+    0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA,
+    0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+    0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+    0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+    0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F,
+    0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+    0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B,
+    0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+    0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4,
+    0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+    0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248,
+    0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0,
+};
+
+int scanScalar(const char *data, int length) {
+    const quint8 *p = reinterpret_cast<const quint8 *>(data);
+    for (int i = 0; i < length; ++i)
+        if (p[i] < 0x20 || p[i] > 0x7e) return i;
+    return length;
+}
+
+#ifdef AMLP_SIMD_X86
+// A signed compare against 0x20 catches control bytes and, as negative
+// numbers, every byte from 0x80 up (IAC included); DEL is the one left.
+int scanSse2(const char *data, int length) {
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    int i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const __m128i stop = _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del));
+        const int mask = _mm_movemask_epi8(stop);
+        if (mask) return i + qCountTrailingZeroBits(quint32(mask));
+    }
+    return i + scanScalar(data + i, length - i);
+}
+
+AMLP_TARGET_AVX2 int scanAvx2(const char *data, int length) {
+    const __m256i space = _mm256_set1_epi8(0x20);
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    int i = 0;
+    for (; i + 32 <= length; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        const __m256i stop = _mm256_or_si256(_mm256_cmpgt_epi8(space, v), _mm256_cmpeq_epi8(v, del));
+        const quint32 mask = quint32(_mm256_movemask_epi8(stop));
+        if (mask) return i + qCountTrailingZeroBits(mask);
+    }
+    return i + scanSse2(data + i, length - i);
+}
+
+bool cpuHasAvx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    // The OS has to save the YMM registers too (OSXSAVE, then XCR0 bits 1-2).
+    if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+using ScanFunction = int (*)(const char *, int);
+
+ScanFunction scanFunction(ScanLevel level) {
+    switch (level) {
+#ifdef AMLP_SIMD_X86
+    case ScanLevel::Avx2: return scanAvx2;
+    case ScanLevel::Sse2: return scanSse2;
+#endif
+    default: return scanScalar;
+    }
+}
+
+ScanLevel detectScanLevel() {
+#ifdef AMLP_SIMD_X86
+    return cpuHasAvx2() ? ScanLevel::Avx2 : ScanLevel::Sse2;
+#else
+    return ScanLevel::Scalar;
+#endif
+}
+
+const ScanLevel BestLevel = detectScanLevel();
+ScanLevel currentLevel = BestLevel;
+ScanFunction scan = scanFunction(BestLevel);
+
+} // namespace
+
+QByteArray encodingName(TextEncoding encoding) {
+    switch (encoding) {
+    case TextEncoding::Latin1: return "ISO-8859-1";
+    case TextEncoding::Cp437: return "CP437";
+    default: return "UTF-8";
+    }
+}
+
+TextEncoding encodingFromName(const QByteArray &name, bool *ok) {
+    const QByteArray upper = name.trimmed().toUpper();
+    if (ok) *ok = true;
+    if (upper == "UTF-8" || upper == "UTF8") return TextEncoding::Utf8;
+    if (upper == "ISO-8859-1" || upper == "ISO8859-1" || upper == "ISO_8859-1" || upper == "LATIN1"
+        || upper == "LATIN-1" || upper == "CP819")
+        return TextEncoding::Latin1;
+    if (upper == "CP437" || upper == "IBM437" || upper == "437") return TextEncoding::Cp437;
+    if (ok) *ok = false;
+    return TextEncoding::Utf8;
+}
+
+char32_t legacyCodePoint(TextEncoding encoding, quint8 byte) {
+    if (byte < 0x80 || encoding == TextEncoding::Latin1) return byte;
+    if (encoding == TextEncoding::Cp437) return Cp437High[byte - 0x80];
+    return 0xFFFD;
+}
+
+QByteArray encodeText(const QString &text, TextEncoding encoding) {
+    if (encoding == TextEncoding::Utf8) return text.toUtf8();
+    QByteArray out;
+    out.reserve(text.size());
+    for (QChar c : text) {
+        const char16_t u = c.unicode();
+        char byte = '?';
+        if (u < 0x80 || (u < 0x100 && encoding == TextEncoding::Latin1)) {
+            byte = char(u);
+        } else if (encoding == TextEncoding::Cp437) {
+            for (int i = 0; i < 128; ++i)
+                if (Cp437High[i] == u) { byte = char(0x80 + i); break; }
+        }
+        out.append(byte);
+    }
+    return out;
+}
+
+int printableAsciiRun(const char *data, int length) {
+    return scan(data, length);
+}
+
+ScanLevel bestScanLevel() {
+    return BestLevel;
+}
+
+ScanLevel scanLevel() {
+    return currentLevel;
+}
+
+void setScanLevel(ScanLevel level) {
+    currentLevel = qMin(level, BestLevel);
+    scan = scanFunction(currentLevel);
+}
+
+const char *scanLevelName(ScanLevel level) {
+    switch (level) {
+    case ScanLevel::Avx2: return "avx2";
+    case ScanLevel::Sse2: return "sse2";
+    default: return "scalar";
+    }
+}
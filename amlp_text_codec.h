@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+// How the bytes of server text map to characters. UTF-8 unless the
+// connection profile or a telnet CHARSET negotiation picks a code page.
+enum class TextEncoding : quint8 { Utf8, Latin1, Cp437 };
+
+// The name sent in CHARSET negotiation ("UTF-8", "ISO-8859-1", "CP437").
+QByteArray encodingName(TextEncoding encoding);
+// Accepts the usual aliases too; an unknown name gives UTF-8 and ok = false.
+TextEncoding encodingFromName(const QByteArray &name, bool *ok = nullptr);
+// The character a byte 0x80-0xFF stands for in a single-byte encoding.
+char32_t legacyCodePoint(TextEncoding encoding, quint8 byte);
+// Outgoing text. Characters a code page lacks are sent as '?'.
+QByteArray encodeText(const QString &text, TextEncoding encoding);
+
+// Length of the printable ASCII (0x20-0x7E) run at the start of data: bytes
+// that are neither ESC, IAC, CR/LF nor part of a multi-byte character, so
+// they go into the output as they are. Scans 32 or 16 bytes at a time.
+int printableAsciiRun(const char *data, int length);
+
+// The implementations printableAsciiRun picks from. The best one the CPU
+// supports is chosen at startup; benchmarks can force a lower one.
+enum class ScanLevel { Scalar, Sse2, Avx2 };
+ScanLevel bestScanLevel();
+ScanLevel scanLevel();
+// Clamped to bestScanLevel(). Not thread-safe: set it before any decoding starts.
+void setScanLevel(ScanLevel level);
+const char *scanLevelName(ScanLevel level);
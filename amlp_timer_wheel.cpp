@@ -0,0 +1,246 @@
+#include "amlp_timer_wheel.h"
+
+#include <QTimer>
+
+#include <algorithm>
+#include <climits>
+
+#include "amlp_metrics.h"
+
+TimerWheel::TimerWheel(QObject *parent) : QObject(parent) {
+    std::fill(heads, heads + Levels * Slots, -1);
+    clock.start();
+    wake = new QTimer(this);
+    wake->setSingleShot(true);
+    wake->setTimerType(Qt::PreciseTimer);
+    connect(wake, &QTimer::timeout, this, &TimerWheel::poll);
+}
+
+void TimerWheel::poll() {
+    advance();
+    arm();
+}
+
+qint64 TimerWheel::wallNs() const {
+    return source ? source() * 1000000 : clock.nsecsElapsed();
+}
+
+qint64 TimerWheel::now() const {
+    return (paused ? pausedAt : wallNs() / 1000000) - pausedMs;
+}
+
+bool TimerWheel::valid(Handle handle) const {
+    if (handle.index < 0 || handle.index >= nodes.size()) return false;
+    const Node &n = nodes[handle.index];
+    return n.generation == handle.generation && (n.slot >= 0 || handle.index == firing);
+}
+
+TimerWheel::Handle TimerWheel::start(qint64 delayMs, Callback callback, qint64 intervalMs) {
+    // An idle wheel may be far behind the clock; with nothing queued it can jump.
+    if (active == 0) elapsed = now();
+    int index;
+    if (freeNodes.isEmpty()) {
+        index = nodes.size();
+        nodes.append(Node());
+    } else {
+        index = freeNodes.takeLast();
+    }
+    Node &n = nodes[index];
+    n.due = now() + qMax<qint64>(0, delayMs);
+    n.interval = qMax<qint64>(0, intervalMs);
+    n.callback = std::move(callback);
+    n.fires = 0;
+    ++active;
+    place(index, elapsed + 1);
+    arm();
+    return Handle{index, n.generation};
+}
+
+bool TimerWheel::cancel(Handle handle) {
+    if (!valid(handle)) return false;
+    if (handle.index == firing) {
+        firingCancelled = true;
+        return true;
+    }
+    unlink(handle.index);
+    release(handle.index);
+    return true;
+}
+
+void TimerWheel::cancelAll() {
+    for (int i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].slot >= 0) {
+            unlink(i);
+            release(i);
+        }
+    }
+    if (firing >= 0) firingCancelled = true;
+    wake->stop();
+}
+
+bool TimerWheel::isActive(Handle handle) const {
+    return valid(handle) && !(handle.index == firing && firingCancelled);
+}
+
+quint64 TimerWheel::fireCount(Handle handle) const {
+    return valid(handle) ? nodes[handle.index].fires : 0;
+}
+
+qint64 TimerWheel::remaining(Handle handle) const {
+    return isActive(handle) ? qMax<qint64>(0, nodes[handle.index].due - now()) : -1;
+}
+
+void TimerWheel::setPaused(bool on) {
+    if (on == paused) return;
+    if (on) {
+        advance();
+        pausedAt = wallNs() / 1000000;
+        paused = true;
+        wake->stop();
+    } else {
+        pausedMs += wallNs() / 1000000 - pausedAt;
+        paused = false;
+        arm();
+    }
+}
+
+// Level L holds timers due 64^L to 64^(L+1) ms from now, in the slot of
+// their due time's level-L digit. Anything further out waits in the top
+// level and is placed again when it comes round. `earliest` is the first
+// bottom slot still to run: the current one while cascading into it.
+void TimerWheel::place(int index, qint64 earliest) {
+    Node &n = nodes[index];
+    const qint64 horizon = (qint64(1) << (Bits * Levels)) - 1;
+    const qint64 when = qBound(earliest, n.due, elapsed + horizon);
+    const qint64 delta = when - elapsed;
+    int level = 0;
+    while (level < Levels - 1 && delta >= (qint64(1) << (Bits * (level + 1)))) ++level;
+    const int slot = level * Slots + int((when >> (Bits * level)) & (Slots - 1));
+
+    n.slot = slot;
+    n.prev = -1;
+    n.next = heads[slot];
+    if (n.next >= 0) nodes[n.next].prev = index;
+    heads[slot] = index;
+    ++perLevel[level];
+}
+
+void TimerWheel::unlink(int index) {
+    Node &n = nodes[index];
+    if (n.prev >= 0)
+        nodes[n.prev].next = n.next;
+    else
+        heads[n.slot] = n.next;
+    if (n.next >= 0) nodes[n.next].prev = n.prev;
+    --perLevel[n.slot / Slots];
+    n.slot = n.prev = n.next = -1;
+}
+
+void TimerWheel::release(int index) {
+    Node &n = nodes[index];
+    n.callback = nullptr;
+    ++n.generation;
+    freeNodes.append(index);
+    --active;
+}
+
+// Moves the slot for the current level-L digit down a level or more. When
+// that digit has wrapped to 0 too, the level above goes first.
+void TimerWheel::cascade(int level) {
+    const int digit = int((elapsed >> (Bits * level)) & (Slots - 1));
+    if (digit == 0 && level + 1 < Levels) cascade(level + 1);
+    const int slot = level * Slots + digit;
+    while (heads[slot] >= 0) {
+        const int index = heads[slot];
+        unlink(index);
+        place(index, elapsed);
+    }
+}
+
+void TimerWheel::advance() {
+    if (advancing) return;
+    const qint64 target = now();
+    if (active == 0) {
+        elapsed = qMax(elapsed, target);
+        return;
+    }
+    advancing = true;
+    while (elapsed < target) {
+        // With the bottom level empty nothing fires before the next cascade.
+        if (perLevel[0] == 0) {
+            const qint64 boundary = (elapsed | (Slots - 1)) + 1;
+            if (boundary > target) {
+                elapsed = target;
+                break;
+            }
+            elapsed = boundary - 1;
+        }
+        ++elapsed;
+        if ((elapsed & (Slots - 1)) == 0) cascade(1);
+        fireSlot(int(elapsed & (Slots - 1)));
+    }
+    advancing = false;
+}
+
+void TimerWheel::fireSlot(int slot) {
+    while (heads[slot] >= 0) {
+        const int index = heads[slot];
+        unlink(index);
+        if (nodes[index].due > elapsed) {
+            // Beyond the wheel's horizon when started; not due yet.
+            place(index, elapsed + 1);
+            continue;
+        }
+
+        Node &n = nodes[index];
+        ++n.fires;
+        if (metrics) {
+            metrics->timersFired.fetch_add(1, std::memory_order_relaxed);
+            const qint64 firedNs = wallNs() - pausedMs * 1000000;
+            metrics->timerLateness.record(qMax<qint64>(0, firedNs - n.due * 1000000));
+        }
+        // The callback may start or cancel timers, which can move `nodes`.
+        Callback callback = std::move(n.callback);
+        firing = index;
+        firingCancelled = false;
+        callback();
+        firing = -1;
+
+        Node &after = nodes[index];
+        if (after.interval > 0 && !firingCancelled) {
+            after.callback = std::move(callback);
+            after.due += after.interval;
+            // After a stall, skip the missed ticks rather than firing them in a burst.
+            if (after.due <= elapsed) after.due += ((elapsed - after.due) / after.interval + 1) * after.interval;
+            place(index, elapsed + 1);
+        } else {
+            release(index);
+        }
+    }
+}
+
+// Sleeps until the next bottom-level slot with timers in it, or until the
+// lowest non-empty upper level cascades, whichever is sooner.
+void TimerWheel::arm() {
+    if (paused || active == 0) {
+        wake->stop();
+        return;
+    }
+    qint64 next = LLONG_MAX;
+    if (perLevel[0] > 0) {
+        for (int k = 1; k < Slots; ++k) {
+            if (heads[(elapsed + k) & (Slots - 1)] >= 0) {
+                next = elapsed + k;
+                break;
+            }
+        }
+    }
+    for (int level = 1; level < Levels; ++level) {
+        if (perLevel[level] == 0) continue;
+        const qint64 span = qint64(1) << (Bits * level);
+        next = qMin(next, (elapsed / span + 1) * span);
+        break;
+    }
+    const qint64 delay = qMax<qint64>(0, next - now());
+    wake->start(int(qMin<qint64>(delay, INT_MAX)));
+}
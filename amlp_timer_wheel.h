@@ -0,0 +1,107 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QVector>
+
+#include <functional>
+
+class QTimer;
+struct ClientMetrics;
+
+// Hierarchical timing wheel for tickers and delayed commands: four levels
+// of 64 slots at 1 ms resolution, covering about 4.6 hours before an entry
+// has to be re-queued. Starting and cancelling a timer is O(1) whatever
+// the number of timers, and all of them share one QTimer armed for the
+// next slot that has work, so hundreds of tickers cost one wake-up per
+// expiry instead of one timer event source each. Single-threaded: use it
+// on the thread that owns it.
+class TimerWheel : public QObject {
+    Q_OBJECT
+public:
+    using Callback = std::function<void()>;
+
+    struct Handle {
+        int index = -1;
+        quint32 generation = 0;
+        bool isNull() const { return index < 0; }
+    };
+
+    explicit TimerWheel(QObject *parent = nullptr);
+
+    // Runs the callback after delayMs, then every intervalMs if that is above 0.
+    Handle start(qint64 delayMs, Callback callback, qint64 intervalMs = 0);
+    // False if the timer already fired (one-shot) or was cancelled. A
+    // repeating timer may cancel itself from its callback.
+    bool cancel(Handle handle);
+    void cancelAll();
+    bool isActive(Handle handle) const;
+    quint64 fireCount(Handle handle) const;
+    // Milliseconds until the timer next fires; -1 if it is not active.
+    qint64 remaining(Handle handle) const;
+    int count() const { return active; }
+
+    // Stops the clock: timers keep their remaining time until resumed.
+    void setPaused(bool paused);
+    bool isPaused() const { return paused; }
+
+    // Fire counts and lateness (fire time minus due time) go here; may be null.
+    void setMetrics(ClientMetrics *m) { metrics = m; }
+
+    // For tests: a clock in ms to use instead of the wall clock, set before
+    // any timer starts, and a way to run what is due without waiting for
+    // the wheel's own wake-up.
+    void setClock(std::function<qint64()> ms) { source = std::move(ms); }
+    void poll();
+
+private:
+    static constexpr int Bits = 6;
+    static constexpr int Slots = 1 << Bits;
+    static constexpr int Levels = 4;
+
+    struct Node {
+        qint64 due = 0;
+        qint64 interval = 0;
+        Callback callback;
+        quint64 fires = 0;
+        quint32 generation = 0;
+        int slot = -1;
+        int prev = -1;
+        int next = -1;
+    };
+
+    qint64 now() const;
+    qint64 wallNs() const;
+    bool valid(Handle handle) const;
+    void place(int index, qint64 earliest);
+    void unlink(int index);
+    void release(int index);
+    void cascade(int level);
+    void advance();
+    void fireSlot(int slot);
+    void arm();
+
+    QVector<Node> nodes;
+    QVector<int> freeNodes;
+    int heads[Levels * Slots];
+    int perLevel[Levels] = {};
+    int active = 0;
+    // Wheel time in ms: every slot up to and including it has been run.
+    qint64 elapsed = 0;
+
+    QElapsedTimer clock;
+    std::function<qint64()> source;
+    // Wall time spent paused, which the wheel's clock leaves out.
+    qint64 pausedMs = 0;
+    qint64 pausedAt = 0;
+    bool paused = false;
+
+    int firing = -1;
+    bool firingCancelled = false;
+    // A callback can pause the wheel, which advances it; the advance under
+    // way carries on instead.
+    bool advancing = false;
+    // A child, so it follows the wheel to its thread.
+    QTimer *wake;
+    ClientMetrics *metrics = nullptr;
+};
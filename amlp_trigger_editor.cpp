@@ -0,0 +1,147 @@
+#include "amlp_trigger_editor.h"
+
+#include <QBoxLayout>
+#include <QCheckBox>
+#include <QDialogButtonBox>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QRegularExpression>
+
+// Editor for a single trigger
+class TriggerEditor : public QDialog {
+    Q_OBJECT
+public:
+    TriggerEditor(QWidget *parent = nullptr) : QDialog(parent) {
+        setWindowTitle("Trigger");
+        auto *lay = new QVBoxLayout(this);
+        patternEdit = new QLineEdit(this);
+        commandEdit = new QLineEdit(this);
+        regexBox = new QCheckBox("Regular expression", this);
+        caseBox = new QCheckBox("Case sensitive", this);
+        enabledBox = new QCheckBox("Enabled", this);
+        enabledBox->setChecked(true);
+
+        lay->addWidget(new QLabel("Pattern:", this));
+        lay->addWidget(patternEdit);
+        lay->addWidget(new QLabel("Command to send:", this));
+        lay->addWidget(commandEdit);
+        lay->addWidget(regexBox);
+        lay->addWidget(caseBox);
+        lay->addWidget(enabledBox);
+
+        auto *box = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+        connect(box, &QDialogButtonBox::accepted, this, &TriggerEditor::validate);
+        connect(box, &QDialogButtonBox::rejected, this, &QDialog::reject);
+        lay->addWidget(box);
+    }
+
+    void setTrigger(const Trigger &t) {
+        patternEdit->setText(t.pattern);
+        commandEdit->setText(t.command);
+        regexBox->setChecked(t.regex);
+        caseBox->setChecked(t.caseSensitive);
+        enabledBox->setChecked(t.enabled);
+    }
+
+    Trigger trigger() const {
+        Trigger t;
+        t.pattern = patternEdit->text();
+        t.command = commandEdit->text();
+        t.regex = regexBox->isChecked();
+        t.caseSensitive = caseBox->isChecked();
+        t.enabled = enabledBox->isChecked();
+        return t;
+    }
+
+private:
+    void validate() {
+        if (patternEdit->text().isEmpty()) {
+            QMessageBox::warning(this, "Invalid", "Please provide a pattern.");
+            return;
+        }
+        if (regexBox->isChecked()) {
+            QRegularExpression re(patternEdit->text());
+            if (!re.isValid()) {
+                QMessageBox::warning(this, "Invalid", "Invalid regular expression: " + re.errorString());
+                return;
+            }
+        }
+        accept();
+    }
+
+    QLineEdit *patternEdit;
+    QLineEdit *commandEdit;
+    QCheckBox *regexBox;
+    QCheckBox *caseBox;
+    QCheckBox *enabledBox;
+};
+
+TriggerDialog::TriggerDialog(const QVector<Trigger> &triggers, QWidget *parent)
+    : QDialog(parent), list(triggers) {
+    setWindowTitle("Triggers");
+    resize(480, 360);
+
+    auto *mainLay = new QVBoxLayout(this);
+    listWidget = new QListWidget(this);
+    for (int i = 0; i < list.size(); ++i) {
+        new QListWidgetItem(listWidget);
+        refreshItem(i);
+    }
+    mainLay->addWidget(listWidget);
+
+    auto *btnLay = new QHBoxLayout();
+    QPushButton *addBtn = new QPushButton("Add", this);
+    QPushButton *editBtn = new QPushButton("Edit", this);
+    QPushButton *removeBtn = new QPushButton("Remove", this);
+    btnLay->addWidget(addBtn);
+    btnLay->addWidget(editBtn);
+    btnLay->addWidget(removeBtn);
+    btnLay->addStretch();
+    mainLay->addLayout(btnLay);
+
+    auto *box = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    connect(box, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(box, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    mainLay->addWidget(box);
+
+    connect(addBtn, &QPushButton::clicked, this, [this]() {
+        TriggerEditor ed(this);
+        if (ed.exec() != QDialog::Accepted) return;
+        list.append(ed.trigger());
+        new QListWidgetItem(listWidget);
+        refreshItem(list.size() - 1);
+    });
+
+    auto edit = [this]() {
+        int row = listWidget->currentRow();
+        if (row < 0) return;
+        TriggerEditor ed(this);
+        ed.setTrigger(list[row]);
+        if (ed.exec() != QDialog::Accepted) return;
+        list[row] = ed.trigger();
+        refreshItem(row);
+    };
+    connect(editBtn, &QPushButton::clicked, this, edit);
+    connect(listWidget, &QListWidget::itemDoubleClicked, this, edit);
+
+    connect(removeBtn, &QPushButton::clicked, this, [this]() {
+        int row = listWidget->currentRow();
+        if (row < 0) return;
+        if (QMessageBox::question(this, "Confirm", "Delete selected trigger?") == QMessageBox::Yes) {
+            list.removeAt(row);
+            delete listWidget->takeItem(row);
+        }
+    });
+}
+
+void TriggerDialog::refreshItem(int row) {
+    const Trigger &t = list[row];
+    QString label = (t.regex ? "/" + t.pattern + "/" : t.pattern) + "  →  " + t.command;
+    if (!t.enabled) label += "  (disabled)";
+    listWidget->item(row)->setText(label);
+}
+
+#include "amlp_trigger_editor.moc"
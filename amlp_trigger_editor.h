@@ -0,0 +1,21 @@
+#pragma once
+
+#include <QDialog>
+#include <QVector>
+
+#include "amlp_triggers.h"
+
+class QListWidget;
+
+class TriggerDialog : public QDialog {
+    Q_OBJECT
+public:
+    explicit TriggerDialog(const QVector<Trigger> &triggers, QWidget *parent = nullptr);
+    QVector<Trigger> triggers() const { return list; }
+
+private:
+    void refreshItem(int row);
+
+    QListWidget *listWidget;
+    QVector<Trigger> list;
+};
@@ -0,0 +1,67 @@
+#include "amlp_triggers.h"
+
+#include <QSettings>
+
+QVector<Trigger> loadTriggers(QSettings &settings) {
+    QVector<Trigger> triggers;
+    const int n = settings.beginReadArray("triggers");
+    for (int i = 0; i < n; ++i) {
+        settings.setArrayIndex(i);
+        Trigger t;
+        t.pattern = settings.value("pattern").toString();
+        t.command = settings.value("command").toString();
+        t.regex = settings.value("regex", false).toBool();
+        t.caseSensitive = settings.value("caseSensitive", false).toBool();
+        t.enabled = settings.value("enabled", true).toBool();
+        triggers.append(t);
+    }
+    settings.endArray();
+    return triggers;
+}
+
+void saveTriggers(QSettings &settings, const QVector<Trigger> &triggers) {
+    settings.beginWriteArray("triggers", triggers.size());
+    for (int i = 0; i < triggers.size(); ++i) {
+        const Trigger &t = triggers[i];
+        settings.setArrayIndex(i);
+        settings.setValue("pattern", t.pattern);
+        settings.setValue("command", t.command);
+        settings.setValue("regex", t.regex);
+        settings.setValue("caseSensitive", t.caseSensitive);
+        settings.setValue("enabled", t.enabled);
+    }
+    settings.endArray();
+}
+
+TriggerEngine::TriggerEngine() {
+    passwordMatcher.add("password:", PatternMatcher::Literal);
+    passwordMatcher.add("pass:", PatternMatcher::Literal);
+    passwordMatcher.compile();
+}
+
+void TriggerEngine::setTriggers(const QVector<Trigger> &triggers) {
+    matcher.clear();
+    actions.clear();
+    for (const Trigger &t : triggers) {
+        if (!t.enabled || t.pattern.isEmpty()) continue;
+        int flags = t.regex ? PatternMatcher::Regex : PatternMatcher::Literal;
+        if (t.caseSensitive) flags |= PatternMatcher::CaseSensitive;
+        matcher.add(t.pattern, flags);
+        actions.append(t.command);
+    }
+    matcher.compile();
+}
+
+void TriggerEngine::matchLine(const QByteArray &utf8, QVector<QString> &commands) const {
+    if (matcher.isEmpty()) return;
+    hits.clear();
+    matcher.match(utf8, hits);
+    for (int idx : hits)
+        if (!actions[idx].isEmpty()) commands.append(actions[idx]);
+}
+
+bool TriggerEngine::isPasswordPrompt(const QByteArray &utf8) const {
+    hits.clear();
+    passwordMatcher.match(utf8, hits);
+    return !hits.isEmpty();
+}
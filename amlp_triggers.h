@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include "amlp_pattern_matcher.h"
+
+class QSettings;
+
+// A user trigger: when a completed line matches, its command is sent.
+struct Trigger {
+    QString pattern;
+    QString command;
+    bool regex = false;
+    bool caseSensitive = false;
+    bool enabled = true;
+};
+
+QVector<Trigger> loadTriggers(QSettings &settings);
+void saveTriggers(QSettings &settings, const QVector<Trigger> &triggers);
+
+// All enabled triggers compiled into one PatternMatcher, so each line is
+// scanned once however many triggers there are. Lives on the network worker.
+class TriggerEngine {
+public:
+    TriggerEngine();
+
+    void setTriggers(const QVector<Trigger> &triggers);
+    // Appends the commands of every trigger the line fires, in trigger order.
+    void matchLine(const QByteArray &utf8, QVector<QString> &commands) const;
+    // Built-in trigger, checked against the unterminated prompt line.
+    bool isPasswordPrompt(const QByteArray &utf8) const;
+
+private:
+    PatternMatcher matcher;
+    // Command for each matcher index.
+    QVector<QString> actions;
+    PatternMatcher passwordMatcher;
+    mutable QVector<int> hits;
+};
@@ -2,16 +2,12 @@
 #include <QWidget>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
-#include <QPlainTextEdit>
 #include <QLineEdit>
 #include <QPushButton>
-#include <QTcpSocket>
+#include <QThread>
 #include <QMessageBox>
 #include <QDialog>
 #include <QLabel>
-#include <QTextCursor>
-#include <QTextCharFormat>
-#include <QRegularExpression>
 #include <QTimer>
 #include <QMenuBar>
 #include <QMenu>
@@ -20,31 +16,94 @@
 #include <QInputDialog>
 #include <QListWidget>
 #include <QDialogButtonBox>
+#include <QFileDialog>
+#include <QTabBar>
+#include <QTabWidget>
+#include <QRegularExpression>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+
+#include <cstdio>
+
+#include "amlp_automapper.h"
+#include "amlp_connector.h"
+#include "amlp_line_rule_editor.h"
+#include "amlp_log_settings.h"
 #include "amlp_manage_connections.h"
+#include "amlp_network_worker.h"
+#include "amlp_profile_store.h"
+#include "amlp_session.h"
+#include "amlp_trigger_editor.h"
 
-// Simple ANSI to QColor mapping (16 colors)
-static QColor ansiColor(int code, bool bright=false) {
-    switch(code) {
-        case 30: return QColor("#000000"); // black
-        case 31: return QColor("#b21818"); // red
-        case 32: return QColor("#1fb839"); // green
-        case 33: return QColor("#d0a800"); // yellow
-        case 34: return QColor("#1f4fb8"); // blue
-        case 35: return QColor("#b030b0"); // magenta
-        case 36: return QColor("#18b0b8"); // cyan
-        case 37: return QColor("#e0e0e0"); // white
-        // bright variants fallback to lighter colors
-        case 90: return QColor("#555555");
-        case 91: return QColor("#ff6e6e");
-        case 92: return QColor("#6efc6e");
-        case 93: return QColor("#ffd86e");
-        case 94: return QColor("#6ea6ff");
-        case 95: return QColor("#ff6eff");
-        case 96: return QColor("#6ef6ff");
-        case 97: return QColor("#ffffff");
-        default: return QColor();
-    }
+// Set before the first widget is created, so each widget is polished once
+// when shown instead of the whole window being polished again.
+static const char *const DarkStyleSheet = R"(
+QWidget {
+    background-color: #1a1a2e;
+    color: #e0e0e0;
+    font-family: 'Consolas', 'Monaco', monospace;
+    font-size: 11pt;
+}
+TerminalView {
+    background-color: #000000;
+    color: #ffffff;
+    border: 1px solid #3282b8;
+    padding: 5px;
+}
+QLineEdit {
+    background-color: #0a0a0a;
+    color: #ffffff;
+    border: 1px solid #3282b8;
+    padding: 5px;
+}
+QTabBar::tab {
+    background-color: #0a0a0a;
+    color: #e0e0e0;
+    border: 1px solid #3282b8;
+    padding: 4px 12px;
 }
+QTabBar::tab:selected {
+    background-color: #0f4c75;
+}
+QProgressBar {
+    background-color: #0a0a0a;
+    border: 1px solid #3282b8;
+    text-align: center;
+    max-height: 16px;
+}
+QProgressBar#hp::chunk {
+    background-color: #a31515;
+}
+QProgressBar#sp::chunk {
+    background-color: #1f4fb8;
+}
+QProgressBar#mv::chunk {
+    background-color: #2e8b57;
+}
+QPushButton {
+    background-color: #0f4c75;
+    color: #ffffff;
+    border: none;
+    padding: 8px 15px;
+    border-radius: 4px;
+}
+QPushButton:hover {
+    background-color: #3282b8;
+}
+QDialog {
+    background-color: #0a0a0a;
+}
+QLabel {
+    color: #ffffff;
+}
+QWidget {
+    background-color: #0a0a0a;
+    color: #ffffff;
+    font-family: 'Consolas', 'Monaco', monospace;
+    font-size: 11pt;
+}
+)";
 
 class ConnectionDialog : public QDialog {
     Q_OBJECT
@@ -79,94 +138,102 @@ private:
 class MudClient : public QWidget {
     Q_OBJECT
 public:
-    MudClient(QWidget *parent = nullptr) : QWidget(parent), passwordMode(false) {
+    explicit MudClient(const QString &profilePath, QWidget *parent = nullptr)
+        : QWidget(parent), profilePath(profilePath) {
         // UI setup
         auto *layout = new QVBoxLayout(this);
-        output = new QPlainTextEdit(this);
-        output->setReadOnly(true);
-        input = new QLineEdit(this);
+        tabs = new QTabWidget(this);
+        tabs->setTabsClosable(true);
+        tabs->setMovable(true);
+        tabs->setDocumentMode(true);
         auto *connectBtn = new QPushButton("Connect", this);
-
-        layout->addWidget(output);
-        layout->addWidget(input);
+        layout->addWidget(tabs, 1);
         layout->addWidget(connectBtn);
 
-        // Socket setup
-        socket = new QTcpSocket(this);
+        // Network workers: every session's socket and decoding runs on one of
+        // a few shared threads
+        pool = new IoPool(qBound(1, QThread::idealThreadCount() / 2, 4), this);
+        splitOnScroll = QSettings("Aether", "amlp-client").value("splitOnScroll", true).toBool();
+        autoReconnect = QSettings("Aether", "amlp-client").value("autoReconnect", true).toBool();
+        quitPattern = QSettings("Aether", "amlp-client").value("quitPattern", DefaultQuitPattern).toString();
 
         // Menu bar + connections
         auto *menuBar = new QMenuBar(this);
         layout->setMenuBar(menuBar);
         connectionsMenu = menuBar->addMenu("Connections");
-        // build initial menu
-        loadSavedConnections();
-        // Connections
-        connect(connectBtn, &QPushButton::clicked, this, &MudClient::connectToServer);
-        connect(input, &QLineEdit::returnPressed, this, &MudClient::sendCommand);
-        connect(socket, &QTcpSocket::readyRead, this, &MudClient::receiveData);
-        connect(socket, &QTcpSocket::connected, [this]() {
-            appendPlainTextColored("Connected!\n", QColor("#e0e0e0"));
-            // Send NAWS (window size) after connecting
-            QFontMetrics fm = output->fontMetrics();
-            int charW = fm.horizontalAdvance('W');
-            if (charW <= 0) charW = 8;
-            int cols = output->viewport()->width() / charW;
-            int rows = output->viewport()->height() / fm.lineSpacing();
-            if (cols < 60) cols = 40; // fallback for mobile
-            sendNaws(socket, cols, rows);
+        // The saved connections are added after the first paint; see finishStartup().
+        buildConnectionsMenu();
+        profiles = new ProfileStore(this);
+        QMenu *triggersMenu = menuBar->addMenu("Triggers");
+        QAction *editTriggersAct = triggersMenu->addAction("Edit Triggers...");
+        connect(editTriggersAct, &QAction::triggered, this, &MudClient::openTriggerDialog);
+        QAction *editRulesAct = triggersMenu->addAction("Edit Line Rules...");
+        connect(editRulesAct, &QAction::triggered, this, &MudClient::openLineRuleDialog);
+        QMenu *toolsMenu = menuBar->addMenu("Tools");
+        QAction *findAct = toolsMenu->addAction("Find in Scrollback...");
+        findAct->setShortcut(QKeySequence::Find);
+        connect(findAct, &QAction::triggered, this, [this]() {
+            if (Session *s = currentSession()) s->findInScrollback();
+        });
+        QAction *recordAct = toolsMenu->addAction("Record Session...");
+        recordAct->setCheckable(true);
+        connect(recordAct, &QAction::toggled, this, &MudClient::toggleRecording);
+        QAction *loggingAct = toolsMenu->addAction("Session Logging...");
+        connect(loggingAct, &QAction::triggered, this, &MudClient::openLoggingDialog);
+        QAction *splitAct = toolsMenu->addAction("Split on Scroll Back");
+        splitAct->setCheckable(true);
+        splitAct->setChecked(splitOnScroll);
+        connect(splitAct, &QAction::toggled, this, [this](bool on) {
+            splitOnScroll = on;
+            QSettings settings("Aether", "amlp-client");
+            settings.setValue("splitOnScroll", on);
+            for (Session *s : sessions()) s->setSplitOnScroll(on);
         });
-        connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
-                [this](QAbstractSocket::SocketError) {
-            QMessageBox::critical(this, "Error", socket->errorString());
+        QAction *reconnectAct = toolsMenu->addAction("Reconnect Automatically");
+        reconnectAct->setCheckable(true);
+        reconnectAct->setChecked(autoReconnect);
+        connect(reconnectAct, &QAction::toggled, this, [this](bool on) {
+            autoReconnect = on;
+            QSettings settings("Aether", "amlp-client");
+            settings.setValue("autoReconnect", on);
+            for (Session *s : sessions()) s->setAutoReconnect(on);
         });
+        QAction *quitAct = toolsMenu->addAction("Logout Command Pattern...");
+        connect(quitAct, &QAction::triggered, this, &MudClient::editQuitPattern);
+        QAction *mapAct = toolsMenu->addAction("Show Map");
+        mapAct->setCheckable(true);
+        connect(mapAct, &QAction::toggled, this, [this](bool on) {
+            mapVisible = on;
+            for (Session *s : sessions()) s->setMapVisible(on);
+        });
+        QAction *titleAct = toolsMenu->addAction("Map Room Title Pattern...");
+        connect(titleAct, &QAction::triggered, this, &MudClient::editMapTitlePattern);
+        QAction *metricsAct = toolsMenu->addAction("Show Metrics");
+        metricsAct->setCheckable(true);
+        connect(metricsAct, &QAction::toggled, this, [this](bool on) {
+            metricsVisible = on;
+            for (Session *s : sessions()) s->setMetricsVisible(on);
+        });
+        restoreTriggers();
+        restoreLineRules();
+        restoreAliases();
+        restoreLogging();
+        restoreMapTitlePattern();
+        // Connections
+        connect(connectBtn, &QPushButton::clicked, this, &MudClient::connectToServer);
+        connect(tabs, &QTabWidget::currentChanged, this, &MudClient::currentTabChanged);
+        connect(tabs, &QTabWidget::tabCloseRequested, this, &MudClient::closeTab);
+        newSession();
 
         setWindowTitle("AMLP-Client");
         resize(900, 650);
+    }
 
-        // Apply dark stylesheet
-        QString style = R"(
-QWidget {
-    background-color: #1a1a2e;
-    color: #e0e0e0;
-    font-family: 'Consolas', 'Monaco', monospace;
-    font-size: 11pt;
-}
-QPlainTextEdit {
-    background-color: #000000;
-    color: #ffffff;
-    border: 1px solid #3282b8;
-    padding: 5px;
-}
-QLineEdit {
-    background-color: #0a0a0a;
-    color: #ffffff;
-    border: 1px solid #3282b8;
-    padding: 5px;
-}
-QPushButton {
-    background-color: #0f4c75;
-    color: #ffffff;
-    border: none;
-    padding: 8px 15px;
-    border-radius: 4px;
-}
-QPushButton:hover {
-    background-color: #3282b8;
-}
-QDialog {
-    background-color: #0a0a0a;
-}
-QLabel {
-    color: #ffffff;
-}
-QWidget {
-    background-color: #0a0a0a;
-    color: #ffffff;
-    font-family: 'Consolas', 'Monaco', monospace;
-    font-size: 11pt;
-}
-)";
-        qApp->setStyleSheet(style);
+    ~MudClient() override {
+        // Sessions hand their workers back to the pool's threads to delete,
+        // so they go first.
+        tabs->disconnect(this);
+        for (Session *s : sessions()) delete s;
     }
 
 private slots:
@@ -175,207 +242,414 @@ private slots:
         if (dialog.exec() == QDialog::Accepted) {
             QString ip = dialog.getIP();
             int port = dialog.getPort();
-            appendPlainTextColored(QString("Connecting to %1:%2...\n").arg(ip).arg(port), QColor("#e0e0e0"));
-            socket->connectToHost(ip, port);
+            Profile p;
+            p.name = QString("%1:%2").arg(ip).arg(port);
+            p.host = ip;
+            p.port = port;
+            connectTo(p);
         }
     }
 
-    void sendCommand() {
-        QString cmd = input->text() + "\r\n";
-        socket->write(cmd.toUtf8());
-        // If we just sent password, reset echo mode
-        if (passwordMode) {
-            passwordMode = false;
-            QTimer::singleShot(100, this, [this]() {
-                input->setEchoMode(QLineEdit::Normal);
-            });
-        }
-        input->clear();
+    void addSavedConnection() {
+        bool ok;
+        Profile p;
+        p.name = QInputDialog::getText(this, "Connection name", "Name:", QLineEdit::Normal, QString(), &ok);
+        if (!ok || p.name.isEmpty()) return;
+        p.host = QInputDialog::getText(this, "Connection IP", "IP:", QLineEdit::Normal, "127.0.0.1", &ok);
+        if (!ok || p.host.isEmpty()) return;
+        p.port = QInputDialog::getInt(this, "Connection Port", "Port:", 3000, 1, 65535, 1, &ok);
+        if (!ok) return;
+        profiles->add(p);
+        profiles->save();
+    }
+
+    void connectSavedTriggered() {
+        const int index = profileActions.indexOf(qobject_cast<QAction*>(sender()));
+        if (index < 0) return;
+        connectTo(profiles->profile(index));
     }
 
-    // Basic ANSI parsing: split on ESC sequences and apply color formats
-    void receiveData() {
-        QByteArray data = socket->readAll();
-        QString text = QString::fromUtf8(data);
+    void openManageDialog() {
+        ManageConnectionsDialog dlg(profiles, this);
+        dlg.exec();
+    }
+
+    void buildConnectionsMenu() {
+        QAction *newTabAct = new QAction("New Tab", this);
+        newTabAct->setShortcut(QKeySequence::AddTab);
+        connect(newTabAct, &QAction::triggered, this, &MudClient::newSession);
+        connectionsMenu->addAction(newTabAct);
+        connectionsMenu->addSeparator();
+        QAction *addConnAct = new QAction("Add Connection...", this);
+        connect(addConnAct, &QAction::triggered, this, &MudClient::addSavedConnection);
+        connectionsMenu->addAction(addConnAct);
+        QAction *manageAct = new QAction("Manage Connections...", this);
+        connect(manageAct, &QAction::triggered, this, &MudClient::openManageDialog);
+        connectionsMenu->addAction(manageAct);
+        // The store is only opened in finishStartup(); an entry added before
+        // that would be saved to no file and dropped by the open.
+        addConnAct->setEnabled(false);
+        manageAct->setEnabled(false);
+        connect(this, &MudClient::startupFinished, this, [addConnAct, manageAct]() {
+            addConnAct->setEnabled(true);
+            manageAct->setEnabled(true);
+        });
+        connectionsMenu->addSeparator();
+        connectionsMenu->setToolTipsVisible(true);
+        // Connect times are looked up when an entry is pointed at, not for every entry up front.
+        connect(connectionsMenu, &QMenu::hovered, this, [this](QAction *act) {
+            const int index = profileActions.indexOf(act);
+            if (index < 0) return;
+            QSettings settings("Aether", "amlp-client");
+            act->setToolTip(loadConnectStats(settings, profiles->host(index), profiles->port(index)).summary());
+        });
+    }
 
-        // Detect password prompts
-        QString low = text.toLower();
-        if (low.contains("password:") || low.contains("pass:")) {
-            passwordMode = true;
-            input->setEchoMode(QLineEdit::PasswordEchoOnEdit);
+    // Everything the first frame does not need: the saved connections (and
+    // moving them over from QSettings on first run), their menu entries and
+    // the DNS prefetch. Runs once the window has painted.
+    void finishStartup() {
+        emit firstPainted();
+        if (!profiles->open(profilePath)) {
+            if (Session *s = currentSession())
+                s->appendNotice("Saved connections were damaged; the file was renamed to " + profilePath + ".bad\n",
+                                QColor("#ff6e6e"));
+        }
+        QSettings settings("Aether", "amlp-client");
+        if (profiles->count() == 0) profiles->migrate(settings);
+        QStringList hosts;
+        for (int i = 0; i < profiles->count(); ++i) {
+            profileAdded(i);
+            hosts.append(profiles->host(i));
         }
+        // Resolved in the background, so picking one doesn't wait on DNS.
+        HostCache::instance().prefetch(hosts);
+        connect(profiles, &ProfileStore::added, this, [this](int index) {
+            profileAdded(index);
+            HostCache::instance().prefetch({profiles->host(index)});
+        });
+        connect(profiles, &ProfileStore::changed, this, [this](int index) {
+            profileActions[index]->setText(profiles->name(index));
+            HostCache::instance().prefetch({profiles->host(index)});
+        });
+        connect(profiles, &ProfileStore::removed, this, [this](int index) { delete profileActions.takeAt(index); });
+        connect(profiles, &ProfileStore::moved, this, [this](int from, int to) {
+            QAction *act = profileActions.takeAt(from);
+            connectionsMenu->removeAction(act);
+            connectionsMenu->insertAction(profileActions.value(to, nullptr), act);
+            profileActions.insert(to, act);
+        });
+        emit startupFinished();
+    }
+
+    // One menu entry, inserted where the profile now is.
+    void profileAdded(int index) {
+        QAction *act = new QAction(profiles->name(index), this);
+        connect(act, &QAction::triggered, this, &MudClient::connectSavedTriggered);
+        connectionsMenu->insertAction(profileActions.value(index, nullptr), act);
+        profileActions.insert(index, act);
+    }
 
-        // Regex to find ANSI CSI sequences like \x1b[31m
-        QRegularExpression re("(\\x1b\\[([0-9;]+)m)");
-        int lastPos = 0;
-        QRegularExpressionMatchIterator i = re.globalMatch(text);
-        QTextCursor cur = output->textCursor();
-        cur.movePosition(QTextCursor::End);
-        QTextCharFormat fmt;
-        fmt.setForeground(QBrush(QColor("#ffffff")));
-        fmt.setFontWeight(QFont::Normal);
-        while (i.hasNext()) {
-            QRegularExpressionMatch m = i.next();
-            int idx = m.capturedStart(1);
-            QString chunk = text.mid(lastPos, idx - lastPos);
-            if (!chunk.isEmpty()) {
-                cur.insertText(chunk, fmt);
+    void toggleRecording(bool on) {
+        if (!on) {
+            // Stop the session that was recorded, even if another tab is shown now.
+            if (recording) {
+                NetworkWorker *worker = recording->worker();
+                QMetaObject::invokeMethod(worker, [w = worker]() { w->stopRecording(); });
             }
-            QString codeStr = m.captured(2);
-            QStringList parts = codeStr.split(';');
-            for (const QString &part : parts) {
-                int code = part.toInt();
-                if (code == 0) { // reset
-                    fmt.setForeground(QBrush(QColor("#ffffff")));
-                    fmt.setFontWeight(QFont::Normal);
-                } else if (code == 1) { // bold
-                    fmt.setFontWeight(QFont::Bold);
-                } else if ((code >= 30 && code <= 37) || (code >= 90 && code <= 97)) {
-                    QColor c = ansiColor(code);
-                    if (c.isValid()) fmt.setForeground(QBrush(c));
-                }
+            recording = nullptr;
+            return;
+        }
+        Session *session = currentSession();
+        QString path = session ? QFileDialog::getSaveFileName(this, "Record session", "session.amlprec",
+                                                              "AMLP captures (*.amlprec);;All Files (*)")
+                               : QString();
+        if (path.isEmpty()) {
+            QAction *a = qobject_cast<QAction*>(sender());
+            if (a) {
+                QSignalBlocker block(a);
+                a->setChecked(false);
             }
-            lastPos = m.capturedEnd(1);
+            return;
         }
-        QString tail = text.mid(lastPos);
-        if (!tail.isEmpty()) cur.insertText(tail, fmt);
-        output->setTextCursor(cur);
-        output->ensureCursorVisible();
+        recording = session;
+        NetworkWorker *worker = session->worker();
+        QMetaObject::invokeMethod(worker, [w = worker, path]() { w->startRecording(path); });
     }
 
-    void addSavedConnection() {
-        bool ok;
-        QString name = QInputDialog::getText(this, "Connection name", "Name:", QLineEdit::Normal, QString(), &ok);
-        if (!ok || name.isEmpty()) return;
-        QString ip = QInputDialog::getText(this, "Connection IP", "IP:", QLineEdit::Normal, "127.0.0.1", &ok);
-        if (!ok || ip.isEmpty()) return;
-        int port = QInputDialog::getInt(this, "Connection Port", "Port:", 3000, 1, 65535, 1, &ok);
-        if (!ok) return;
-        QString entry = name + "|" + ip + "|" + QString::number(port);
-        savedConnections.append(entry);
-        QAction *act = new QAction(name, this);
-        act->setData(entry);
-        connect(act, &QAction::triggered, this, &MudClient::connectSavedTriggered);
-        connectionsMenu->addAction(act);
-        saveSavedConnections();
-        rebuildConnectionsMenu();
+    void openTriggerDialog() {
+        TriggerDialog dlg(triggers, this);
+        if (dlg.exec() == QDialog::Accepted) {
+            triggers = dlg.triggers();
+            QSettings settings("Aether", "amlp-client");
+            saveTriggers(settings, triggers);
+            for (Session *s : sessions()) s->setTriggers(triggers);
+        }
     }
 
-    void connectSavedTriggered() {
-        QAction *a = qobject_cast<QAction*>(sender());
-        if (!a) return;
-        QString entry = a->data().toString();
-        QStringList parts = entry.split('|');
-        if (parts.size() < 3) return;
-        QString ip = parts[1];
-        int port = parts[2].toInt();
-        appendPlainTextColored(QString("Connecting to %1:%2...\n").arg(ip).arg(port), QColor("#e0e0e0"));
-        socket->connectToHost(ip, port);
+    void restoreTriggers() {
+        QSettings settings("Aether", "amlp-client");
+        triggers = loadTriggers(settings);
     }
 
-    void appendPlainTextColored(const QString &text, const QColor &color) {
-        QTextCursor cur = output->textCursor();
-        cur.movePosition(QTextCursor::End);
-        QTextCharFormat fmt;
-        fmt.setForeground(QBrush(color));
-        cur.insertText(text, fmt);
-        output->setTextCursor(cur);
-        output->ensureCursorVisible();
+    void openLineRuleDialog() {
+        LineRuleDialog dlg(lineRules, this);
+        if (dlg.exec() == QDialog::Accepted) {
+            lineRules = dlg.rules();
+            QSettings settings("Aether", "amlp-client");
+            saveLineRules(settings, lineRules);
+            for (Session *s : sessions()) s->setLineRules(lineRules);
+        }
     }
 
-    void openManageDialog() {
-        ManageConnectionsDialog dlg(savedConnections, this);
+    void restoreLineRules() {
+        QSettings settings("Aether", "amlp-client");
+        lineRules = loadLineRules(settings);
+    }
+
+    void restoreAliases() {
+        QSettings settings("Aether", "amlp-client");
+        aliases = loadAliases(settings);
+    }
+
+    void openLoggingDialog() {
+        QSettings settings("Aether", "amlp-client");
+        LogSettingsDialog dlg(logOptions, this);
         if (dlg.exec() == QDialog::Accepted) {
-            savedConnections = dlg.connections();
-            saveSavedConnections();
-            rebuildConnectionsMenu();
+            logOptions = dlg.options();
+            saveLogOptions(settings, logOptions);
+            for (Session *s : sessions()) s->setLogging(logOptions);
         }
     }
 
-    void rebuildConnectionsMenu() {
-        connectionsMenu->clear();
-        QAction *addConnAct = new QAction("Add Connection...", this);
-        connect(addConnAct, &QAction::triggered, this, &MudClient::addSavedConnection);
-        connectionsMenu->addAction(addConnAct);
-        QAction *manageAct = new QAction("Manage Connections...", this);
-        connect(manageAct, &QAction::triggered, this, &MudClient::openManageDialog);
-        connectionsMenu->addAction(manageAct);
-        connectionsMenu->addSeparator();
-        for (const QString &entry : savedConnections) {
-            QStringList parts = entry.split('|');
-            QString name = parts.value(0, entry);
-            QAction *act = new QAction(name, this);
-            act->setData(entry);
-            connect(act, &QAction::triggered, this, &MudClient::connectSavedTriggered);
-            connectionsMenu->addAction(act);
+    void restoreLogging() {
+        QSettings settings("Aether", "amlp-client");
+        logOptions = loadLogOptions(settings);
+    }
+
+    void restoreMapTitlePattern() {
+        QSettings settings("Aether", "amlp-client");
+        mapTitlePattern = loadMapTitlePattern(settings);
+    }
+
+    void editMapTitlePattern() {
+        bool ok;
+        const QString pattern = QInputDialog::getText(this, "Map Room Title Pattern",
+                                                      "Regular expression matching room titles (for servers without GMCP rooms).\n"
+                                                      "Capture group 1, if present, is the room name:",
+                                                      QLineEdit::Normal, mapTitlePattern, &ok);
+        if (!ok) return;
+        if (!pattern.isEmpty() && !QRegularExpression(pattern).isValid()) {
+            QMessageBox::warning(this, "Map Room Title Pattern", "That is not a valid regular expression.");
+            return;
         }
+        mapTitlePattern = pattern;
+        QSettings settings("Aether", "amlp-client");
+        saveMapTitlePattern(settings, mapTitlePattern);
+        for (Session *s : sessions()) s->setMapTitlePattern(mapTitlePattern);
     }
 
-    void loadSavedConnections() {
+    void editQuitPattern() {
+        bool ok;
+        const QString pattern = QInputDialog::getText(this, "Logout Command Pattern",
+                                                      "Regular expression matching commands that log out.\n"
+                                                      "When the server closes after one, the session is not reconnected:",
+                                                      QLineEdit::Normal, quitPattern, &ok);
+        if (!ok) return;
+        if (!pattern.isEmpty() && !QRegularExpression(pattern).isValid()) {
+            QMessageBox::warning(this, "Logout Command Pattern", "That is not a valid regular expression.");
+            return;
+        }
+        quitPattern = pattern;
         QSettings settings("Aether", "amlp-client");
-        savedConnections = settings.value("connections").toStringList();
-        rebuildConnectionsMenu();
+        settings.setValue("quitPattern", quitPattern);
+        for (Session *s : sessions()) s->setQuitPattern(quitPattern);
     }
 
-    void saveSavedConnections() {
+    // #alias in one session applies to all of them, and is saved.
+    void aliasesEdited(const QVector<Alias> &list) {
+        aliases = list;
         QSettings settings("Aether", "amlp-client");
-        settings.setValue("connections", savedConnections);
+        saveAliases(settings, aliases);
+        Session *origin = qobject_cast<Session*>(sender());
+        for (Session *s : sessions())
+            if (s != origin) s->setAliases(aliases);
     }
 
-    void sendNaws(QTcpSocket *socket, int cols, int rows) {
-        if (!socket || socket->state() != QTcpSocket::ConnectedState) return;
-        const char IAC = (char)255;
-        const char WILL = (char)251;
-        const char SB = (char)250;
-        const char SE = (char)240;
-        const char NAWS = (char)31;
-
-        QByteArray will;
-        will.append(IAC);
-        will.append(WILL);
-        will.append(NAWS);
-        socket->write(will);
-
-        quint16 w = static_cast<quint16>(cols);
-        quint16 h = static_cast<quint16>(rows);
-        char w_hi = (char)((w >> 8) & 0xFF);
-        char w_lo = (char)(w & 0xFF);
-        char h_hi = (char)((h >> 8) & 0xFF);
-        char h_lo = (char)(h & 0xFF);
-
-        QByteArray sb;
-        sb.append(IAC);
-        sb.append(SB);
-        sb.append(NAWS);
-        sb.append(w_hi);
-        sb.append(w_lo);
-        sb.append(h_hi);
-        sb.append(h_lo);
-        sb.append(IAC);
-        sb.append(SE);
-
-        QByteArray escaped;
-        for (char c : sb) {
-            escaped.append(c);
-            if ((unsigned char)c == 255) escaped.append((char)255);
+    Session *newSession() {
+        auto *session = new Session(pool, tabs);
+        session->setTriggers(triggers);
+        session->setLineRules(lineRules);
+        session->setAliases(aliases);
+        if (logOptions.enabled) session->setLogging(logOptions);
+        session->setMetricsVisible(metricsVisible);
+        session->setSplitOnScroll(splitOnScroll);
+        session->setAutoReconnect(autoReconnect);
+        session->setQuitPattern(quitPattern);
+        session->setMapVisible(mapVisible);
+        session->setMapTitlePattern(mapTitlePattern);
+        connect(session, &Session::aliasesChanged, this, &MudClient::aliasesEdited);
+        connect(session, &Session::titleChanged, this, [this, session](const QString &title) {
+            const int i = tabs->indexOf(session);
+            if (i >= 0) tabs->setTabText(i, title);
+            if (session == currentSession()) setWindowTitle("AMLP-Client - " + title);
+        });
+        connect(session, &Session::activity, this, [this, session]() {
+            const int i = tabs->indexOf(session);
+            if (i >= 0) tabs->tabBar()->setTabTextColor(i, QColor("#f0c674"));
+        });
+        const int index = tabs->addTab(session, session->title());
+        tabs->setCurrentIndex(index);
+        session->setFocus();
+        return session;
+    }
+
+    void closeTab(int index) {
+        auto *session = qobject_cast<Session*>(tabs->widget(index));
+        if (!session) return;
+        if (session == recording) recording = nullptr;
+        tabs->removeTab(index);
+        delete session;
+        if (tabs->count() == 0) newSession();
+    }
+
+    void currentTabChanged(int index) {
+        for (Session *s : sessions()) s->setActive(tabs->indexOf(s) == index);
+        Session *session = currentSession();
+        if (!session) return;
+        tabs->tabBar()->setTabTextColor(index, QColor());
+        setWindowTitle("AMLP-Client - " + session->title());
+        session->setFocus();
+    }
+
+    // An idle tab is reused; otherwise the connection gets a tab of its own.
+    void connectTo(const Profile &p) {
+        Session *session = currentSession();
+        if (!session || session->isConnected()) session = newSession();
+        session->setProfileRules(p.triggers, p.aliases);
+        session->connectTo(p.name, p.host, p.port, p.scrollbackLines, p.archiveKB, p.encoding);
+    }
+
+signals:
+    // The first frame is on screen.
+    void firstPainted();
+    // finishStartup() is done: the saved connections are in the menu.
+    void startupFinished();
+
+protected:
+    bool event(QEvent *e) override {
+        if (e->type() == QEvent::Paint && !startupQueued) {
+            startupQueued = true;
+            QTimer::singleShot(0, this, &MudClient::finishStartup);
         }
-        socket->write(escaped);
+        return QWidget::event(e);
     }
 
 private:
-    QPlainTextEdit *output;
-    QLineEdit *input;
-    QTcpSocket *socket;
-    bool passwordMode;
+    Session *currentSession() const { return qobject_cast<Session*>(tabs->currentWidget()); }
+
+    QVector<Session*> sessions() const {
+        QVector<Session*> all;
+        for (int i = 0; i < tabs->count(); ++i)
+            if (auto *s = qobject_cast<Session*>(tabs->widget(i))) all.append(s);
+        return all;
+    }
+
+    QTabWidget *tabs;
+    IoPool *pool;
     QMenu *connectionsMenu;
-    QStringList savedConnections;
+    QString profilePath;
+    ProfileStore *profiles;
+    // The menu entries of the saved connections, in store order.
+    QVector<QAction*> profileActions;
+    bool startupQueued = false;
+    QVector<Trigger> triggers;
+    QVector<LineRule> lineRules;
+    QVector<Alias> aliases;
+    LogOptions logOptions;
+    bool metricsVisible = false;
+    bool splitOnScroll = true;
+    bool autoReconnect = true;
+    QString quitPattern;
+    bool mapVisible = false;
+    QString mapTitlePattern;
+    Session *recording = nullptr;
 };
 
 #include "main.moc"
 
+// Cold start with `count` generated saved connections in a scratch store:
+// QApplication, building the window, the first frame and the deferred rest.
+static int runStartupBench(QApplication &app, const QElapsedTimer &sinceStart, int count) {
+    const qint64 appReady = sinceStart.nsecsElapsed();
+    QTemporaryDir dir;
+    const QString path = dir.filePath("profiles.amlpprof");
+    {
+        ProfileStore store;
+        store.open(path);
+        for (int i = 0; i < count; ++i) {
+            Profile p;
+            p.name = QString("Generated MUD %1").arg(i + 1);
+            // Literal addresses, so the prefetch never touches DNS.
+            p.host = QString("10.%1.%2.%3").arg(i >> 16 & 255).arg(i >> 8 & 255).arg(i & 255);
+            p.port = 4000 + i % 1000;
+            if (i % 4 == 0) {
+                p.triggers.append(Trigger{"You are hungry", "eat bread"});
+                p.aliases.append(Alias{"k", "kill $1"});
+            }
+            store.add(p);
+        }
+        if (!store.save()) {
+            std::fprintf(stderr, "cannot write %s\n", qPrintable(path));
+            return 1;
+        }
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+    qint64 built = 0;
+    qint64 painted = 0;
+    qint64 finished = 0;
+    MudClient client(path);
+    built = clock.nsecsElapsed();
+    QObject::connect(&client, &MudClient::firstPainted, [&]() { painted = clock.nsecsElapsed(); });
+    QObject::connect(&client, &MudClient::startupFinished, [&]() {
+        finished = clock.nsecsElapsed();
+        QTimer::singleShot(0, &app, &QCoreApplication::quit);
+    });
+    QTimer::singleShot(10000, &app, &QCoreApplication::quit);
+    client.show();
+    app.exec();
+    if (!finished) {
+        std::fprintf(stderr, "the window never finished starting\n");
+        return 1;
+    }
+
+    auto ms = [](qint64 ns) { return double(ns) / 1e6; };
+    std::printf("startup benchmark, %d saved connections\n", count);
+    std::printf("  QApplication        %8.1f ms\n", ms(appReady));
+    std::printf("  window built        %8.1f ms\n", ms(built));
+    std::printf("  first frame         %8.1f ms\n", ms(painted));
+    std::printf("  deferred startup    %8.1f ms\n", ms(finished - painted));
+    std::printf("  usable window       %8.1f ms from process start\n", ms(appReady + painted));
+    std::printf("  menu complete       %8.1f ms from process start\n", ms(appReady + finished));
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
+    QElapsedTimer sinceStart;
+    sinceStart.start();
     QApplication app(argc, argv);
-    MudClient client;
+    QCommandLineParser args;
+    args.setApplicationDescription("AMLP MUD client");
+    args.addHelpOption();
+    args.addOption({"startup-bench", "Start with N generated saved connections, print how long the window took to "
+                                     "appear and to finish starting, then exit.", "N"});
+    args.process(app);
+    app.setStyleSheet(DarkStyleSheet);
+    if (args.isSet("startup-bench")) return runStartupBench(app, sinceStart, qMax(1, args.value("startup-bench").toInt()));
+
+    MudClient client(ProfileStore::defaultPath());
     client.show();
     return app.exec();
 }
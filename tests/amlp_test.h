@@ -0,0 +1,12 @@
+#pragma once
+
+#include <QObject>
+#include <QTest>
+
+// Test classes register themselves with AMLP_TEST(Class); amlp_tests runs
+// every class, or only the ones named on its command line.
+using TestFactory = QObject *(*)();
+bool registerTest(const char *name, TestFactory create);
+
+#define AMLP_TEST(Class) \
+    static const bool Class##Registered = registerTest(#Class, []() -> QObject * { return new Class; });
@@ -0,0 +1,43 @@
+// Runs the registered QtTest classes: all of them, or those named as
+// arguments (CTest runs one class per test).
+
+#include <QCoreApplication>
+#include <QMap>
+
+#include <cstdio>
+#include <memory>
+
+#include "amlp_test.h"
+
+namespace {
+QMap<QByteArray, TestFactory> &registry() {
+    static QMap<QByteArray, TestFactory> tests;
+    return tests;
+}
+}
+
+bool registerTest(const char *name, TestFactory create) {
+    registry().insert(name, create);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    QCoreApplication app(argc, argv);
+    QList<QByteArray> names;
+    for (int i = 1; i < argc; ++i) names.append(argv[i]);
+    if (names.isEmpty()) names = registry().keys();
+
+    int failed = 0;
+    for (const QByteArray &name : names) {
+        const TestFactory create = registry().value(name);
+        if (!create) {
+            std::fprintf(stderr, "No test class %s\n", name.constData());
+            ++failed;
+            continue;
+        }
+        std::unique_ptr<QObject> test(create());
+        char *args[] = {argv[0]};
+        failed += QTest::qExec(test.get(), 1, args);
+    }
+    return failed ? 1 : 0;
+}
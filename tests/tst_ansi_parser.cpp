@@ -0,0 +1,217 @@
+// Escape sequences, SGR colours in every form servers send them, and
+// input split across reads at any byte.
+
+#include "amlp_ansi_parser.h"
+#include "amlp_test.h"
+
+namespace {
+// Style of the last character decoded from the bytes.
+TextStyle lastStyle(AnsiParser &parser, const QByteArray &bytes) {
+    StyledText out;
+    parser.feed(bytes.constData(), bytes.size(), out);
+    if (out.spans.isEmpty()) return TextStyle();
+    return StyleTable::instance().style(out.spans.last().style);
+}
+
+// Text with the style id in front of every span, so two decodes compare whole.
+QString render(const StyledText &out) {
+    QString r;
+    for (const StyleSpan &span : out.spans)
+        r += QString("[%1]").arg(span.style) + out.text.mid(span.start, span.length);
+    return r;
+}
+
+QString decode(const QByteArray &bytes) {
+    AnsiParser parser;
+    StyledText out;
+    parser.feed(bytes.constData(), bytes.size(), out);
+    return out.text;
+}
+
+// SGR, truecolour, OSC, a charset select, a telnet command and UTF-8 of
+// every length, each of which a read can end in the middle of.
+const char Mixed[] = "plain \x1b[1;31mbold red\x1b[0m \x1b]0;a title\x07" "caf\xc3\xa9 "
+                     "\x1b(B\x1b[38;2;10;20;30m\xe2\x82\xac 5\xff\xf9\x1b[48:5:21m\xf0\x9d\x84\x9e"
+                     "\x1b]2;other\x1b\\\x1b[m end\n";
+}
+
+class TestAnsiParser : public QObject {
+    Q_OBJECT
+private slots:
+    void sgrColors_data();
+    void sgrColors();
+    void sgrInternsOnce();
+    void escapes_data();
+    void escapes();
+    void invalidUtf8_data();
+    void invalidUtf8();
+    void splitAnywhere();
+    void byteAtATime();
+    void controlEndsSequence();
+};
+
+void TestAnsiParser::sgrColors_data() {
+    QTest::addColumn<QByteArray>("sgr");
+    QTest::addColumn<uint>("fg");
+    QTest::addColumn<uint>("bg");
+    QTest::addColumn<int>("flags");
+
+    const uint white = TextStyle().fg;
+    QTest::newRow("base") << QByteArray("31;42") << AnsiParser::paletteColor(1) << AnsiParser::paletteColor(2) << 0;
+    QTest::newRow("bright") << QByteArray("91;102") << AnsiParser::paletteColor(9) << AnsiParser::paletteColor(10)
+                            << 0;
+    QTest::newRow("256 cube") << QByteArray("38;5;196") << qRgb(0xff, 0, 0) << 0u << 0;
+    QTest::newRow("256 grey") << QByteArray("38;5;244") << qRgb(128, 128, 128) << 0u << 0;
+    QTest::newRow("256 clamped") << QByteArray("38;5;300") << qRgb(238, 238, 238) << 0u << 0;
+    QTest::newRow("256 colon") << QByteArray("38:5:196") << qRgb(0xff, 0, 0) << 0u << 0;
+    QTest::newRow("256 bg") << QByteArray("48;5;21") << white << qRgb(0, 0, 0xff) << 0;
+    QTest::newRow("256 bg colon") << QByteArray("48:5:21") << white << qRgb(0, 0, 0xff) << 0;
+    QTest::newRow("truecolor") << QByteArray("38;2;10;20;30") << qRgb(10, 20, 30) << 0u << 0;
+    QTest::newRow("truecolor clamped") << QByteArray("38;2;300;20;30") << qRgb(255, 20, 30) << 0u << 0;
+    QTest::newRow("truecolor colon") << QByteArray("38:2:10:20:30") << qRgb(10, 20, 30) << 0u << 0;
+    QTest::newRow("truecolor colour space") << QByteArray("38:2:0:10:20:30") << qRgb(10, 20, 30) << 0u << 0;
+    QTest::newRow("truecolor empty space") << QByteArray("38:2::10:20:30") << qRgb(10, 20, 30) << 0u << 0;
+    QTest::newRow("truecolor bg") << QByteArray("48;2;1;2;3") << white << qRgb(1, 2, 3) << 0;
+    QTest::newRow("truecolor bg colon") << QByteArray("48:2:0:1:2:3") << white << qRgb(1, 2, 3) << 0;
+    // Attributes on either side of an extended colour still apply.
+    QTest::newRow("between attributes") << QByteArray("1;38;2;255;0;0;4;48;5;16") << qRgb(255, 0, 0)
+                                        << qRgb(0, 0, 0) << int(TextStyle::Bold | TextStyle::Underline);
+    QTest::newRow("colon then semicolon") << QByteArray("38:2::1:2:3;1") << qRgb(1, 2, 3) << 0u
+                                          << int(TextStyle::Bold);
+    // Truncated: the colour is left alone and the rest is swallowed.
+    QTest::newRow("truncated truecolor") << QByteArray("38;2;1;2") << white << 0u << 0;
+    QTest::newRow("truncated 256") << QByteArray("48;5") << white << 0u << 0;
+    QTest::newRow("reset") << QByteArray("38;5;196;48;2;1;2;3;1;0") << white << 0u << 0;
+    QTest::newRow("default colours") << QByteArray("38;5;196;48;5;21;39;49") << white << 0u << 0;
+}
+
+void TestAnsiParser::sgrColors() {
+    QFETCH(QByteArray, sgr);
+    QFETCH(uint, fg);
+    QFETCH(uint, bg);
+    QFETCH(int, flags);
+
+    AnsiParser parser;
+    const TextStyle style = lastStyle(parser, "\x1b[" + sgr + "mx");
+    QCOMPARE(uint(style.fg), fg);
+    QCOMPARE(uint(style.bg), bg);
+    QCOMPARE(int(style.flags), flags);
+    QVERIFY(style == parser.currentStyle());
+}
+
+// The same colour from two parsers, and in both notations, is one entry
+// in the table.
+void TestAnsiParser::sgrInternsOnce() {
+    AnsiParser a;
+    AnsiParser b;
+    StyledText outA;
+    StyledText outB;
+    const QByteArray semicolons("\x1b[38;2;12;34;56mx");
+    const QByteArray colons("\x1b[38:2::12:34:56mx");
+    a.feed(semicolons.constData(), semicolons.size(), outA);
+    const int size = StyleTable::instance().size();
+    b.feed(colons.constData(), colons.size(), outB);
+    QCOMPARE(StyleTable::instance().size(), size);
+    QCOMPARE(outA.spans.last().style, outB.spans.last().style);
+    QVERIFY(StyleTable::instance().style(outA.spans.last().style) == a.currentStyle());
+}
+
+void TestAnsiParser::escapes_data() {
+    QTest::addColumn<QByteArray>("in");
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("charset select") << QByteArray("a\x1b(Bb") << "ab";
+    QTest::newRow("G1 charset") << QByteArray("a\x1b)0b") << "ab";
+    QTest::newRow("two intermediates") << QByteArray("a\x1b$(Bb") << "ab";
+    QTest::newRow("line attributes") << QByteArray("\x1b#8x") << "x";
+    QTest::newRow("two-byte") << QByteArray("a\x1b=b\x1b>c") << "abc";
+    QTest::newRow("private CSI") << QByteArray("\x1b[?25lv\x1b[?25h") << "v";
+    QTest::newRow("cursor CSI") << QByteArray("\x1b[2J\x1b[1;1Hhome") << "home";
+    QTest::newRow("OSC BEL") << QByteArray("\x1b]0;title\x07t") << "t";
+    QTest::newRow("OSC ST") << QByteArray("\x1b]0;title\x1b\\t") << "t";
+    QTest::newRow("malformed CSI") << QByteArray("\x1b[1\nx") << "\nx";
+    QTest::newRow("lone ESC") << QByteArray("a\x1b\nb") << "a\nb";
+    QTest::newRow("cut intermediate") << QByteArray("a\x1b(\tb") << "a\tb";
+    QTest::newRow("ESC restarts CSI") << QByteArray("a\x1b[3\x1b[1mb") << "ab";
+    QTest::newRow("ESC restarts escape") << QByteArray("a\x1b\x1b[mb") << "ab";
+    QTest::newRow("controls") << QByteArray("a\rb\x07" "c\td\n") << "abc\td\n";
+}
+
+void TestAnsiParser::escapes() {
+    QFETCH(QByteArray, in);
+    QFETCH(QString, text);
+    QCOMPARE(decode(in), text);
+}
+
+void TestAnsiParser::invalidUtf8_data() {
+    QTest::addColumn<QByteArray>("in");
+    QTest::addColumn<QString>("text");
+
+    const QString bad(QChar(0xFFFD));
+    QTest::newRow("truncated") << QByteArray("a\xe2\x82" "b") << "a" + bad + "b";
+    QTest::newRow("overlong") << QByteArray("\xc0\xaf") << bad;
+    QTest::newRow("surrogate") << QByteArray("\xed\xa0\x80") << bad;
+    QTest::newRow("past U+10FFFF") << QByteArray("\xf4\x90\x80\x80") << bad;
+    QTest::newRow("lone continuation") << QByteArray("a\x80" "b") << "a" + bad + "b";
+    QTest::newRow("cut by an escape") << QByteArray("\xc3\x1b[1mx") << bad + "x";
+    QTest::newRow("astral") << QByteArray("\xf0\x9d\x84\x9e") << QString::fromUtf8("\xf0\x9d\x84\x9e");
+}
+
+void TestAnsiParser::invalidUtf8() {
+    QFETCH(QByteArray, in);
+    QFETCH(QString, text);
+    QCOMPARE(decode(in), text);
+}
+
+// Two reads, split at every byte: the same text in the same styles as one.
+void TestAnsiParser::splitAnywhere() {
+    const QByteArray bytes(Mixed);
+    AnsiParser whole;
+    StyledText expected;
+    whole.feed(bytes.constData(), bytes.size(), expected);
+    QCOMPARE(expected.text, QString::fromUtf8("plain bold red caf\xc3\xa9 \xe2\x82\xac 5\xf0\x9d\x84\x9e end\n"));
+    QCOMPARE(expected.spans.size(), 6);
+
+    for (int at = 1; at < bytes.size(); ++at) {
+        AnsiParser parser;
+        StyledText out;
+        QCOMPARE(parser.feed(bytes.constData(), at, out), at);
+        parser.feed(bytes.constData() + at, bytes.size() - at, out);
+        QVERIFY2(render(out) == render(expected), qPrintable(QString("split at %1").arg(at)));
+    }
+}
+
+void TestAnsiParser::byteAtATime() {
+    const QByteArray bytes(Mixed);
+    AnsiParser whole;
+    StyledText expected;
+    whole.feed(bytes.constData(), bytes.size(), expected);
+
+    AnsiParser parser;
+    StyledText out;
+    for (int i = 0; i < bytes.size(); ++i) parser.feed(bytes.constData() + i, 1, out);
+    QCOMPARE(render(out), render(expected));
+    QVERIFY(parser.currentStyle() == whole.currentStyle());
+}
+
+// A truncated SGR does not swallow the line end after it, wherever the read
+// boundary falls, and the colour it never finished is not applied.
+void TestAnsiParser::controlEndsSequence() {
+    const QByteArray bytes("one\x1b[31\nnext\n");
+    for (int at = 1; at < bytes.size(); ++at) {
+        AnsiParser parser;
+        StyledText out;
+        parser.feed(bytes.constData(), at, out);
+        parser.feed(bytes.constData() + at, bytes.size() - at, out);
+        QVERIFY2(out.text == "one\nnext\n", qPrintable(QString("split at %1").arg(at)));
+        QCOMPARE(out.spans.size(), 1);
+        QCOMPARE(out.spans.first().style, StyleId(0));
+    }
+
+    // A new ESC inside a CSI starts the next sequence, which applies.
+    AnsiParser parser;
+    QCOMPARE(lastStyle(parser, "\x1b[3\x1b[31mx").fg, AnsiParser::paletteColor(1));
+}
+
+AMLP_TEST(TestAnsiParser)
+#include "tst_ansi_parser.moc"
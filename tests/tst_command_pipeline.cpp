@@ -0,0 +1,221 @@
+// Typed lines to outgoing commands: stacking, aliases, speedwalks and encoding.
+
+#include <QRandomGenerator>
+
+#include "amlp_command_pipeline.h"
+#include "amlp_test.h"
+
+namespace {
+QStringList expanded(const CommandPipeline &pipeline, const QString &line) {
+    QStringList commands;
+    pipeline.expand(line, commands);
+    return commands;
+}
+
+QStringList walk(const QString &path) {
+    QStringList steps;
+    return CommandPipeline::speedwalk(path, steps) ? steps : QStringList({"<rejected>"});
+}
+}
+
+class TestCommandPipeline : public QObject {
+    Q_OBJECT
+private slots:
+    void stacking_data();
+    void stacking();
+    void aliasArguments_data();
+    void aliasArguments();
+    void aliasDepthIsCapped();
+    void speedwalk_data();
+    void speedwalk();
+    void speedwalkFor_data();
+    void speedwalkFor();
+    void speedwalkRoundTrip();
+    void encode_data();
+    void encode();
+};
+
+void TestCommandPipeline::stacking_data() {
+    QTest::addColumn<QString>("line");
+    QTest::addColumn<QStringList>("commands");
+
+    QTest::newRow("single") << "look" << QStringList({"look"});
+    QTest::newRow("stacked") << "n; e ;look" << QStringList({"n", "e", "look"});
+    QTest::newRow("escaped") << "say a\\;b;look" << QStringList({"say a;b", "look"});
+    QTest::newRow("only escaped") << "say \\;\\;" << QStringList({"say ;;"});
+    QTest::newRow("backslash alone") << "say a\\b" << QStringList({"say a\\b"});
+    QTest::newRow("trailing backslash") << "say a\\" << QStringList({"say a\\"});
+    QTest::newRow("empty parts") << "n;;s" << QStringList({"n", "", "s"});
+    QTest::newRow("bare enter") << "" << QStringList({""});
+    QTest::newRow("client command") << "#lua x = 1; y = 2" << QStringList({"#lua x = 1; y = 2"});
+    QTest::newRow("speedwalk") << " .2n(ne) " << QStringList({"n", "n", "ne"});
+    QTest::newRow("dotted text in a stack") << "look;.news;.sun" << QStringList({"look", ".news", ".sun"});
+    QTest::newRow("speedwalk in a stack") << "look;.2n;say hi" << QStringList({"look", ".2n", "say hi"});
+    QTest::newRow("lone dot") << "." << QStringList({"."});
+    QTest::newRow("not a speedwalk") << ".2x" << QStringList({".2x"});
+}
+
+// ';' separates commands, "\;" is a semicolon, and each part is trimmed.
+// Only a whole line is taken for a speedwalk.
+void TestCommandPipeline::stacking() {
+    QFETCH(QString, line);
+    QFETCH(QStringList, commands);
+    CommandPipeline pipeline;
+    QCOMPARE(expanded(pipeline, line), commands);
+}
+
+void TestCommandPipeline::aliasArguments_data() {
+    QTest::addColumn<QString>("expansion");
+    QTest::addColumn<QString>("line");
+    QTest::addColumn<QStringList>("commands");
+
+    QTest::newRow("appended") << "kill" << "k orc" << QStringList({"kill orc"});
+    QTest::newRow("no arguments") << "kill" << "k" << QStringList({"kill"});
+    QTest::newRow("all") << "say $* loudly" << "k hello  there" << QStringList({"say hello  there loudly"});
+    QTest::newRow("words") << "give $2 to $1" << "k bob sword" << QStringList({"give sword to bob"});
+    QTest::newRow("missing word") << "give $2 to $1" << "k bob" << QStringList({"give  to bob"});
+    QTest::newRow("referenced, none given") << "kill $1 now" << "k" << QStringList({"kill  now"});
+    QTest::newRow("dollar kept") << "say $x $" << "k a" << QStringList({"say $x $ a"});
+    QTest::newRow("empty word referenced") << "say $5$" << "k a" << QStringList({"say $"});
+    QTest::newRow("stacked expansion") << "stand;kill $1" << "k orc" << QStringList({"stand", "kill orc"});
+    QTest::newRow("escaped in expansion") << "say a\\;b" << "k" << QStringList({"say a;b"});
+    QTest::newRow("escaped argument") << "say $*" << "k a\\;b" << QStringList({"say a;b"});
+    QTest::newRow("escaped, appended") << "say" << "k a\\;b" << QStringList({"say a;b"});
+    QTest::newRow("client command") << "#lua f('$1')" << "k a\\;b" << QStringList({"#lua f('a;b')"});
+    QTest::newRow("only the first word") << "kill" << "x k orc" << QStringList({"x k orc"});
+    QTest::newRow("speedwalk expansion") << ".2n$1" << "k e" << QStringList({"n", "n", "e"});
+    QTest::newRow("stacked speedwalk alias") << ".2n" << "look;k" << QStringList({"look", "n", "n"});
+    QTest::newRow("speedwalk in a stacked expansion") << "stand;.2n" << "k" << QStringList({"stand", ".2n"});
+}
+
+// $1..$9 are words, $* all the arguments; with neither the arguments are
+// appended. A "\;" in the arguments stays one command.
+void TestCommandPipeline::aliasArguments() {
+    QFETCH(QString, expansion);
+    QFETCH(QString, line);
+    QFETCH(QStringList, commands);
+    CommandPipeline pipeline;
+    pipeline.defineAlias("k", expansion);
+    QCOMPARE(expanded(pipeline, line), commands);
+}
+
+// An alias that expands to itself stops after a fixed depth, sending what it
+// has reached instead of recursing.
+void TestCommandPipeline::aliasDepthIsCapped() {
+    CommandPipeline pipeline;
+    pipeline.defineAlias("loop", "loop x");
+    pipeline.defineAlias("a", "b;a");
+    pipeline.defineAlias("b", "bow");
+    const QStringList loop = expanded(pipeline, "loop");
+    QCOMPARE(loop.size(), 1);
+    QCOMPARE(loop[0], QString("loop") + QString(" x").repeated(8));
+    QCOMPARE(expanded(pipeline, "a"), QStringList(7, "bow") + QStringList({"b", "a"}));
+}
+
+void TestCommandPipeline::speedwalk_data() {
+    QTest::addColumn<QString>("path");
+    QTest::addColumn<QStringList>("steps");
+
+    const QStringList rejected({"<rejected>"});
+    QTest::newRow("single") << "n" << QStringList({"n"});
+    QTest::newRow("counts") << "3n2e" << QStringList({"n", "n", "n", "e", "e"});
+    QTest::newRow("all directions") << "nsewud" << QStringList({"n", "s", "e", "w", "u", "d"});
+    QTest::newRow("exit") << "(ne)" << QStringList({"ne"});
+    QTest::newRow("counted exit") << "2(enter portal)s" << QStringList({"enter portal", "enter portal", "s"});
+    QTest::newRow("exit trimmed") << "( ne )" << QStringList({"ne"});
+    QTest::newRow("zero is one") << "0n" << QStringList({"n"});
+    QTest::newRow("at the cap") << "99n" << QStringList(99, "n");
+    QTest::newRow("past the cap") << "100n" << rejected;
+    QTest::newRow("far past the cap") << "99999999999n" << rejected;
+    QTest::newRow("count at the end") << "n3" << rejected;
+    QTest::newRow("unknown direction") << "3x" << rejected;
+    QTest::newRow("capital") << "N" << rejected;
+    QTest::newRow("unclosed exit") << "2(ne" << rejected;
+    QTest::newRow("empty exit") << "()" << rejected;
+    QTest::newRow("blank exit") << "n(  )" << rejected;
+    QTest::newRow("empty") << "" << rejected;
+}
+
+// A rejected path leaves the steps as they were.
+void TestCommandPipeline::speedwalk() {
+    QFETCH(QString, path);
+    QFETCH(QStringList, steps);
+    QCOMPARE(walk(path), steps);
+    QStringList kept({"look"});
+    CommandPipeline::speedwalk(path, kept);
+    QCOMPARE(kept.first(), QString("look"));
+    if (steps == QStringList({"<rejected>"})) QCOMPARE(kept.size(), 1);
+}
+
+void TestCommandPipeline::speedwalkFor_data() {
+    QTest::addColumn<QStringList>("steps");
+    QTest::addColumn<QString>("path");
+
+    QTest::newRow("none") << QStringList() << QString();
+    QTest::newRow("runs") << QStringList({"n", "n", "n", "e", "n"}) << ".3nen";
+    QTest::newRow("exits") << QStringList({"ne", "ne", "enter portal", "u"}) << ".2(ne)(enter portal)u";
+    QTest::newRow("long run") << QStringList(150, "w") << ".99w51w";
+    QTest::newRow("capital") << QStringList({"N"}) << ".(N)";
+    QTest::newRow("digits") << QStringList({"2nd door", "3"}) << ".(2nd door)(3)";
+    QTest::newRow("parenthesis") << QStringList({"n", "say (hi)"}) << "n;say (hi)";
+    QTest::newRow("semicolon") << QStringList({"say a;b", "s"}) << "say a\\;b;s";
+    QTest::newRow("blank step") << QStringList({"n", " "}) << "n; ";
+}
+
+// Steps a speedwalk cannot carry make a stacked line instead.
+void TestCommandPipeline::speedwalkFor() {
+    QFETCH(QStringList, steps);
+    QFETCH(QString, path);
+    QCOMPARE(CommandPipeline::speedwalkFor(steps), path);
+}
+
+// speedwalk(speedwalkFor(steps)) == steps for any steps a speedwalk can
+// carry, and the stacked fallback expands back to the same steps.
+void TestCommandPipeline::speedwalkRoundTrip() {
+    const QStringList exits({"n", "s", "e", "w", "u", "d", "ne", "sw", "enter portal", "N", "2nd door", "(in"});
+    QRandomGenerator random(9);
+    CommandPipeline pipeline;
+    for (int round = 0; round < 2000; ++round) {
+        QStringList steps;
+        const int length = 1 + random.bounded(40);
+        while (steps.size() < length) {
+            const QString exit = exits[random.bounded(exits.size())];
+            for (int n = random.bounded(1, random.bounded(8) == 0 ? 250 : 5); n > 0; --n) steps.append(exit);
+        }
+        const QString path = CommandPipeline::speedwalkFor(steps);
+        QVERIFY2(path.startsWith('.'), qPrintable(path));
+        QStringList back;
+        QVERIFY2(CommandPipeline::speedwalk(path.mid(1), back), qPrintable(path));
+        QCOMPARE(back, steps);
+        QCOMPARE(expanded(pipeline, path), steps);
+    }
+    const QStringList awkward({"say a;b", "n", "say (hi)", "n"});
+    QCOMPARE(expanded(pipeline, CommandPipeline::speedwalkFor(awkward)), awkward);
+}
+
+void TestCommandPipeline::encode_data() {
+    QTest::addColumn<QString>("command");
+    QTest::addColumn<int>("encoding");
+    QTest::addColumn<QByteArray>("bytes");
+
+    const int utf8 = int(TextEncoding::Utf8);
+    const int latin1 = int(TextEncoding::Latin1);
+    const int cp437 = int(TextEncoding::Cp437);
+    QTest::newRow("plain") << "look" << utf8 << QByteArray("look\r\n");
+    QTest::newRow("empty") << "" << utf8 << QByteArray("\r\n");
+    QTest::newRow("utf-8") << QString::fromUtf8("say ÿ") << utf8 << QByteArray("say \xc3\xbf\r\n");
+    QTest::newRow("latin-1 IAC") << QString::fromUtf8("ÿaÿÿ") << latin1 << QByteArray("\xff\xff" "a\xff\xff\xff\xff\r\n");
+    QTest::newRow("cp437 IAC") << QString(QChar(0xa0)) << cp437 << QByteArray("\xff\xff\r\n");
+    QTest::newRow("cp437 other") << QString::fromUtf8("é€") << cp437 << QByteArray("\x82?\r\n");
+}
+
+// Every 0xFF byte the encoding produces goes out as IAC IAC.
+void TestCommandPipeline::encode() {
+    QFETCH(QString, command);
+    QFETCH(int, encoding);
+    QFETCH(QByteArray, bytes);
+    QCOMPARE(CommandPipeline::encode(command, TextEncoding(encoding)), bytes);
+}
+
+AMLP_TEST(TestCommandPipeline)
+#include "tst_command_pipeline.moc"
@@ -0,0 +1,217 @@
+// Tab completion ranking against brute force over every word's uses.
+
+#include <QHash>
+#include <QRandomGenerator>
+#include <QSet>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "amlp_completion.h"
+#include "amlp_test.h"
+
+namespace {
+// The half-life and the weight of typed words, as in CompletionIndex.
+const double HalfLifeMs = 20 * 60 * 1000;
+const double TypedWeight = 4;
+
+// What the index should rank by: every use of a word, weighted and decayed
+// to a common time, summed. On a clock the test moves.
+struct Model {
+    qint64 ms = 0;
+    QHash<QByteArray, double> scores;
+
+    void seen(CompletionIndex &index, const QByteArray &word) {
+        index.addSeen(word);
+        scores[word] += std::exp2(double(ms) / HalfLifeMs);
+    }
+    void typed(CompletionIndex &index, const QByteArray &word) {
+        index.addTyped(QString::fromUtf8(word));
+        scores[word] += TypedWeight * std::exp2(double(ms) / HalfLifeMs);
+    }
+};
+
+// The completions are the best `max` words under the prefix, compared by
+// score only: words whose scores tie may come in either order.
+void expectTop(const CompletionIndex &index, const Model &model, const QByteArray &prefix, int max) {
+    const QStringList got = index.complete(QString::fromUtf8(prefix), max);
+    QVector<double> want;
+    for (auto it = model.scores.cbegin(); it != model.scores.cend(); ++it)
+        if (it.key().startsWith(prefix) && it.key() != prefix) want.append(it.value());
+    std::sort(want.begin(), want.end(), std::greater<double>());
+    QVERIFY2(got.size() == qMin(max, int(want.size())), prefix.constData());
+    for (int k = 0; k < got.size(); ++k) {
+        const QByteArray word = got[k].toUtf8();
+        QVERIFY2(word.startsWith(prefix) && word != prefix, word.constData());
+        const double score = model.scores.value(word, -1);
+        QVERIFY2(std::abs(score - want[k]) <= want[k] * 1e-9, (prefix + " -> " + word).constData());
+    }
+}
+
+// Every prefix of the words, up to one longer than the cached depth, with
+// the cache's own size, fewer, and more than it holds.
+void expectAllPrefixes(const CompletionIndex &index, const Model &model, const QVector<QByteArray> &words) {
+    QSet<QByteArray> prefixes;
+    for (const QByteArray &w : words)
+        for (int n = 1; n <= qMin(int(w.size()), 5); ++n) prefixes.insert(w.left(n));
+    for (const QByteArray &p : prefixes) {
+        for (int max : {CompletionIndex::CacheSize, 3, 20}) {
+            expectTop(index, model, p, max);
+            if (QTest::currentTestFailed()) return;
+        }
+    }
+}
+
+// Words over a small alphabet, so prefixes are shared by many of them and
+// some words are prefixes of others.
+QVector<QByteArray> vocabulary(QRandomGenerator &random, int count) {
+    QSet<QByteArray> words;
+    while (words.size() < count) {
+        QByteArray w;
+        const int length = 3 + random.bounded(5);
+        for (int k = 0; k < length; ++k) w.append(char('a' + random.bounded(5)));
+        words.insert(w);
+    }
+    QVector<QByteArray> out(words.cbegin(), words.cend());
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+// Uses skewed towards the front of the vocabulary, a fifth of them typed,
+// with the clock moving on by up to `stepMs` between them.
+void feed(CompletionIndex &index, Model &model, QRandomGenerator &random, const QVector<QByteArray> &words,
+          int uses, int stepMs) {
+    for (int i = 0; i < uses; ++i) {
+        model.ms += random.bounded(stepMs + 1);
+        const int pick = qMin(random.bounded(words.size()), random.bounded(words.size()));
+        if (random.bounded(5) == 0)
+            model.typed(index, words[pick]);
+        else
+            model.seen(index, words[pick]);
+    }
+}
+}
+
+class TestCompletion : public QObject {
+    Q_OBJECT
+private slots:
+    void rankingMatchesBruteForce();
+    void prefixWordIsLeftOut();
+    void recentUsesRankHigher();
+    void rescaleKeepsRanking();
+    void pruneKeepsBest();
+};
+
+// Cached short prefixes and scanned long ones both give the brute-force
+// best, as scores grow and words move up the caches.
+void TestCompletion::rankingMatchesBruteForce() {
+    Model model;
+    CompletionIndex index;
+    index.setClock([&model]() { return model.ms; });
+    QRandomGenerator random(20);
+    const QVector<QByteArray> words = vocabulary(random, 1500);
+    for (int round = 0; round < 10; ++round) {
+        feed(index, model, random, words, 3000, 2000);
+        expectAllPrefixes(index, model, words);
+        if (QTest::currentTestFailed()) return;
+    }
+    QCOMPARE(index.wordCount(), model.scores.size());
+}
+
+// A cached prefix that is a word itself, and the best one under it, still
+// gets a full list of other words.
+void TestCompletion::prefixWordIsLeftOut() {
+    Model model;
+    CompletionIndex index;
+    index.setClock([&model]() { return model.ms; });
+    for (int i = 0; i < 20; ++i) model.typed(index, "axe");
+    for (int i = 0; i < CompletionIndex::CacheSize + 2; ++i) model.seen(index, "axe" + QByteArray(1, char('a' + i)));
+    const QStringList got = index.complete("axe");
+    QCOMPARE(got.size(), CompletionIndex::CacheSize);
+    QVERIFY(!got.contains("axe"));
+    expectTop(index, model, "axe", CompletionIndex::CacheSize);
+    expectTop(index, model, "ax", CompletionIndex::CacheSize);
+}
+
+// Ten uses ten half-lives ago count for less than one use now.
+void TestCompletion::recentUsesRankHigher() {
+    Model model;
+    CompletionIndex index;
+    index.setClock([&model]() { return model.ms; });
+    for (int i = 0; i < 10; ++i) model.seen(index, "goblin");
+    model.seen(index, "gold");
+    QCOMPARE(index.complete("go"), QStringList({"goblin", "gold"}));
+    model.ms += qint64(10 * HalfLifeMs);
+    model.seen(index, "gold");
+    QCOMPARE(index.complete("go"), QStringList({"gold", "goblin"}));
+}
+
+// After 60 half-lives the scores are rebased; nothing changes rank, and
+// uses after it compare right with uses before.
+void TestCompletion::rescaleKeepsRanking() {
+    Model model;
+    CompletionIndex index;
+    index.setClock([&model]() { return model.ms; });
+    QRandomGenerator random(60);
+    const QVector<QByteArray> words = vocabulary(random, 800);
+    feed(index, model, random, words, 5000, 60000);
+    expectAllPrefixes(index, model, words);
+    if (QTest::currentTestFailed()) return;
+
+    model.ms += qint64(61 * HalfLifeMs);
+    feed(index, model, random, words, 1, 0);
+    expectAllPrefixes(index, model, words);
+    if (QTest::currentTestFailed()) return;
+    feed(index, model, random, words, 5000, 60000);
+    expectAllPrefixes(index, model, words);
+}
+
+// Past the word limit the lowest-ranked quarter goes; the rest keep their
+// scores and their ranking.
+void TestCompletion::pruneKeepsBest() {
+    Model model;
+    CompletionIndex index;
+    index.setClock([&model]() { return model.ms; });
+    // Every word distinct and spelled from letters; later ones are worth
+    // more, except the first thousand, which are used three times.
+    auto word = [](int i) {
+        QByteArray w("q");
+        for (int k = 0; k < 4; ++k, i /= 26) w.append(char('a' + i % 26));
+        return w;
+    };
+    const int limit = 400000;
+    for (int i = 0; i < limit; ++i) {
+        model.ms += 1;
+        model.seen(index, word(i));
+        if (i < 1000) {
+            model.seen(index, word(i));
+            model.seen(index, word(i));
+        }
+    }
+    QCOMPARE(index.wordCount(), limit);
+    model.ms += 1;
+    model.seen(index, word(limit));
+    QCOMPARE(index.wordCount(), limit * 3 / 4);
+
+    QVector<double> scores(model.scores.cbegin(), model.scores.cend());
+    std::nth_element(scores.begin(), scores.begin() + (limit * 3 / 4 - 1), scores.end(), std::greater<double>());
+    const double lowest = scores[limit * 3 / 4 - 1];
+    for (auto it = model.scores.begin(); it != model.scores.end();)
+        it = it.value() < lowest ? model.scores.erase(it) : std::next(it);
+    QCOMPARE(model.scores.size(), limit * 3 / 4);
+
+    // Short prefixes come from the caches. Longer ones are scanned, and
+    // hold few enough words for every survivor to be listed.
+    for (const QByteArray &p : {QByteArray("q"), QByteArray("qa"), QByteArray("qz"), QByteArray("qab")}) {
+        expectTop(index, model, p, CompletionIndex::CacheSize);
+        if (QTest::currentTestFailed()) return;
+    }
+    for (int i : {10, 1500, 150000, 399999, limit}) {
+        expectTop(index, model, word(i).left(4), 100);
+        if (QTest::currentTestFailed()) return;
+    }
+}
+
+AMLP_TEST(TestCompletion)
+#include "tst_completion.moc"
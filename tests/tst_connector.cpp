@@ -0,0 +1,313 @@
+// Address interleaving, the host cache's freshness, the reconnect backoff
+// and telling a logout from a drop.
+
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QRandomGenerator>
+#include <QSignalSpy>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include <memory>
+
+#include "amlp_connector.h"
+#include "amlp_test.h"
+
+namespace {
+const qint64 MinuteMs = 60 * 1000;
+
+QList<QHostAddress> addresses(const QStringList &texts) {
+    QList<QHostAddress> out;
+    for (const QString &text : texts) out.append(QHostAddress(text));
+    return out;
+}
+
+QStringList texts(const QList<QHostAddress> &addresses) {
+    QStringList out;
+    for (const QHostAddress &address : addresses) out.append(address.toString());
+    return out;
+}
+
+// Lookups the test answers by hand, in the order they were asked.
+struct FakeDns {
+    QStringList asked;
+    QList<HostCache::Callback> answers;
+
+    HostCache::Resolver resolver() {
+        return [this](const QString &host, HostCache::Callback answer) {
+            asked.append(host);
+            answers.append(std::move(answer));
+        };
+    }
+    void answer(const QStringList &found) {
+        const HostCache::Callback next = answers.takeFirst();
+        next(addresses(found), found.isEmpty() ? QString("Host not found") : QString());
+    }
+};
+
+// What resolve() handed back, and whether it has yet.
+struct Result {
+    bool done = false;
+    QStringList addresses;
+    QString error;
+
+    HostCache::Callback callback() {
+        return [this](const QList<QHostAddress> &found, const QString &why) {
+            done = true;
+            addresses = texts(found);
+            error = why;
+        };
+    }
+};
+}
+
+class TestConnector : public QObject {
+    Q_OBJECT
+private slots:
+    void interleave_data();
+    void interleave();
+    void literalSkipsLookup();
+    void cachedWhileFresh();
+    void staleIsUsedAndRefreshed();
+    void failedLookups();
+    void prefetch();
+    void backoffStaysUnderCeiling();
+    void logoutOutlastsLaterCommands();
+    void connectsToListener();
+    void refusedConnectFails();
+};
+
+void TestConnector::interleave_data() {
+    QTest::addColumn<QStringList>("in");
+    QTest::addColumn<QStringList>("out");
+
+    QTest::newRow("empty") << QStringList() << QStringList();
+    QTest::newRow("one family") << QStringList({"10.0.0.1", "10.0.0.2"}) << QStringList({"10.0.0.1", "10.0.0.2"});
+    QTest::newRow("IPv6 first") << QStringList({"2001:db8::1", "2001:db8::2", "10.0.0.1", "10.0.0.2"})
+                                << QStringList({"2001:db8::1", "10.0.0.1", "2001:db8::2", "10.0.0.2"});
+    QTest::newRow("IPv4 first") << QStringList({"10.0.0.1", "2001:db8::1", "2001:db8::2"})
+                                << QStringList({"10.0.0.1", "2001:db8::1", "2001:db8::2"});
+    QTest::newRow("uneven") << QStringList({"2001:db8::1", "10.0.0.1", "10.0.0.2", "10.0.0.3"})
+                            << QStringList({"2001:db8::1", "10.0.0.1", "10.0.0.2", "10.0.0.3"});
+    QTest::newRow("mixed order") << QStringList({"10.0.0.1", "10.0.0.2", "2001:db8::1", "10.0.0.3", "2001:db8::2"})
+                                 << QStringList({"10.0.0.1", "2001:db8::1", "10.0.0.2", "2001:db8::2", "10.0.0.3"});
+}
+
+// Alternating families from the one listed first; each family keeps the
+// resolver's order.
+void TestConnector::interleave() {
+    QFETCH(QStringList, in);
+    QFETCH(QStringList, out);
+    QCOMPARE(texts(Connector::interleave(addresses(in))), out);
+}
+
+void TestConnector::literalSkipsLookup() {
+    FakeDns dns;
+    HostCache cache;
+    cache.setResolver(dns.resolver());
+    Result result;
+    cache.resolve("192.0.2.7", nullptr, result.callback());
+    QVERIFY(result.done);
+    QCOMPARE(result.addresses, QStringList({"192.0.2.7"}));
+    QVERIFY(dns.asked.isEmpty());
+}
+
+// One lookup per host, whatever its case or spacing, until it goes stale.
+void TestConnector::cachedWhileFresh() {
+    qint64 ms = 0;
+    FakeDns dns;
+    HostCache cache;
+    cache.setClock([&ms]() { return ms; });
+    cache.setResolver(dns.resolver());
+
+    Result first;
+    cache.resolve("MUD.example.org", nullptr, first.callback());
+    QVERIFY(!first.done);
+    QCOMPARE(dns.asked, QStringList({"mud.example.org"}));
+    dns.answer({"192.0.2.1", "2001:db8::1"});
+    QVERIFY(first.done);
+    QCOMPARE(first.addresses, QStringList({"192.0.2.1", "2001:db8::1"}));
+    QVERIFY(first.error.isEmpty());
+
+    ms += 10 * MinuteMs;
+    Result second;
+    cache.resolve(" mud.example.org ", nullptr, second.callback());
+    QVERIFY(second.done);
+    QCOMPARE(second.addresses, first.addresses);
+    QCOMPARE(dns.asked.size(), 1);
+}
+
+// Past its age an entry is still answered at once, from the old addresses,
+// and refreshed once behind it; the next resolve sees the new ones.
+void TestConnector::staleIsUsedAndRefreshed() {
+    qint64 ms = 0;
+    FakeDns dns;
+    HostCache cache;
+    cache.setClock([&ms]() { return ms; });
+    cache.setResolver(dns.resolver());
+    Result result;
+    cache.resolve("mud.example.org", nullptr, result.callback());
+    dns.answer({"192.0.2.1"});
+
+    ms += 10 * MinuteMs + 1;
+    Result stale;
+    cache.resolve("mud.example.org", nullptr, stale.callback());
+    QVERIFY(stale.done);
+    QCOMPARE(stale.addresses, QStringList({"192.0.2.1"}));
+    QCOMPARE(dns.asked.size(), 2);
+
+    // A refresh in flight is not asked for again.
+    Result during;
+    cache.resolve("mud.example.org", nullptr, during.callback());
+    QVERIFY(during.done);
+    QCOMPARE(dns.asked.size(), 2);
+
+    dns.answer({"192.0.2.9"});
+    Result fresh;
+    cache.resolve("mud.example.org", nullptr, fresh.callback());
+    QCOMPARE(fresh.addresses, QStringList({"192.0.2.9"}));
+    QCOMPARE(dns.asked.size(), 2);
+
+    // The refresh reset the age.
+    ms += 10 * MinuteMs;
+    cache.resolve("mud.example.org", nullptr, fresh.callback());
+    QCOMPARE(dns.asked.size(), 2);
+}
+
+// A failed first lookup reports its error and caches nothing; a failed
+// refresh keeps the addresses it had.
+void TestConnector::failedLookups() {
+    qint64 ms = 0;
+    FakeDns dns;
+    HostCache cache;
+    cache.setClock([&ms]() { return ms; });
+    cache.setResolver(dns.resolver());
+
+    Result missing;
+    cache.resolve("gone.example.org", nullptr, missing.callback());
+    dns.answer({});
+    QVERIFY(missing.done);
+    QVERIFY(missing.addresses.isEmpty());
+    QCOMPARE(missing.error, QString("Host not found"));
+    cache.resolve("gone.example.org", nullptr, missing.callback());
+    QCOMPARE(dns.asked.size(), 2);
+    dns.answer({"192.0.2.3"});
+    QCOMPARE(missing.addresses, QStringList({"192.0.2.3"}));
+
+    ms += 11 * MinuteMs;
+    Result stale;
+    cache.resolve("gone.example.org", nullptr, stale.callback());
+    QCOMPARE(dns.asked.size(), 3);
+    dns.answer({});
+    Result kept;
+    cache.resolve("gone.example.org", nullptr, kept.callback());
+    QVERIFY(kept.done);
+    QCOMPARE(kept.addresses, QStringList({"192.0.2.3"}));
+    // Still stale, so the next resolve tries again.
+    QCOMPARE(dns.asked.size(), 4);
+}
+
+// Each uncached name is looked up once; literals and blanks are skipped,
+// and once the answer is in, resolving the name asks nothing.
+void TestConnector::prefetch() {
+    FakeDns dns;
+    HostCache cache;
+    cache.setResolver(dns.resolver());
+    cache.prefetch({"Aardmud.org", "192.0.2.5", "  ", "aardmud.org", "discworld.atuin.net"});
+    QCOMPARE(dns.asked, QStringList({"aardmud.org", "discworld.atuin.net"}));
+    cache.prefetch({"aardmud.org"});
+    QCOMPARE(dns.asked.size(), 2);
+
+    dns.answer({"192.0.2.10"});
+    Result result;
+    cache.resolve("aardmud.org", nullptr, result.callback());
+    QVERIFY(result.done);
+    QCOMPARE(result.addresses, QStringList({"192.0.2.10"}));
+    QCOMPARE(dns.asked.size(), 2);
+}
+
+// Every delay is in the upper half of its step's ceiling, the ceiling
+// doubling from 250 ms and never passing a second.
+void TestConnector::backoffStaysUnderCeiling() {
+    QRandomGenerator random(22);
+    for (int attempt = -1; attempt < 40; ++attempt) {
+        const int ceiling = attempt <= 0 ? 250 : attempt == 1 ? 500 : 1000;
+        int lowest = ceiling;
+        int highest = 0;
+        for (int i = 0; i < 2000; ++i) {
+            const int delay = reconnectDelayMs(attempt, random);
+            lowest = qMin(lowest, delay);
+            highest = qMax(highest, delay);
+        }
+        QVERIFY2(lowest >= ceiling / 2 && highest <= ceiling, qPrintable(QString("attempt %1").arg(attempt)));
+        // Jittered across the whole range, not pinned to one value.
+        QVERIFY(lowest < ceiling / 2 + ceiling / 20);
+        QVERIFY(highest > ceiling - ceiling / 20);
+    }
+    QVERIFY(reconnectDelayMs(1 << 20, random) <= 1000);
+}
+
+// "quit" followed by a trigger's or ticker's command is still a logout;
+// only a new connection clears it.
+void TestConnector::logoutOutlastsLaterCommands() {
+    LogoutWatch watch;
+    watch.setPattern(DefaultQuitPattern);
+    watch.commandSent("say quit it");
+    watch.commandSent("look");
+    QVERIFY(!watch.loggedOut());
+    watch.commandSent("  QUIT ");
+    QVERIFY(watch.loggedOut());
+    watch.commandSent("get all from corpse");
+    QVERIFY(watch.loggedOut());
+    watch.reset();
+    QVERIFY(!watch.loggedOut());
+
+    // An empty or broken pattern never matches.
+    watch.setPattern(QString());
+    watch.commandSent("");
+    QVERIFY(!watch.loggedOut());
+    watch.setPattern("(quit");
+    watch.commandSent("(quit");
+    QVERIFY(!watch.loggedOut());
+}
+
+void TestConnector::connectsToListener() {
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    Connector connector;
+    QSignalSpy connected(&connector, &Connector::connected);
+    QSignalSpy failed(&connector, &Connector::failed);
+    connector.start("127.0.0.1", server.serverPort(), Connector::ReconnectTimeoutMs);
+    QVERIFY(connector.isActive());
+    QVERIFY(connected.wait(Connector::ReconnectTimeoutMs));
+    QVERIFY(failed.isEmpty());
+    QVERIFY(!connector.isActive());
+    QCOMPARE(connected[0][1].toString(), QString("127.0.0.1"));
+    std::unique_ptr<QTcpSocket> socket(connected[0][0].value<QTcpSocket *>());
+    QCOMPARE(socket->state(), QAbstractSocket::ConnectedState);
+    QCOMPARE(socket->parent(), nullptr);
+}
+
+// A refused port fails straight away, well inside the attempt's timeout.
+void TestConnector::refusedConnectFails() {
+    quint16 port = 0;
+    {
+        QTcpServer server;
+        QVERIFY(server.listen(QHostAddress::LocalHost));
+        port = server.serverPort();
+    }
+    Connector connector;
+    QSignalSpy connected(&connector, &Connector::connected);
+    QSignalSpy failed(&connector, &Connector::failed);
+    QElapsedTimer timer;
+    timer.start();
+    connector.start("127.0.0.1", port, Connector::ReconnectTimeoutMs);
+    QVERIFY(failed.wait(Connector::ReconnectTimeoutMs + 500));
+    QVERIFY(timer.elapsed() < Connector::ReconnectTimeoutMs);
+    QVERIFY(connected.isEmpty());
+    QVERIFY(!failed[0][0].toString().isEmpty());
+    QVERIFY(!connector.isActive());
+}
+
+AMLP_TEST(TestConnector)
+#include "tst_connector.moc"
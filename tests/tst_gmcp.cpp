@@ -0,0 +1,171 @@
+// Out-of-band dispatch while handlers change the subscriptions, and the
+// per-frame queue in front of the UI-side dispatcher.
+
+#include "amlp_gmcp.h"
+#include "amlp_test.h"
+
+namespace {
+OobUpdate update(const QByteArray &package) {
+    OobUpdate u;
+    u.package = package;
+    return u;
+}
+
+OobUpdate gmcp(const QByteArray &payload) {
+    OobUpdate u;
+    decodeGmcp(payload, u);
+    return u;
+}
+}
+
+class TestOobDispatcher : public QObject {
+    Q_OBJECT
+private slots:
+    void parentPackagesHear();
+    void packagesIgnoreCase();
+    void subscribeWhileDispatching();
+    void unsubscribeWhileDispatching();
+    void nestedDispatch();
+    void frameQueueMergesState();
+    void frameQueueKeepsRooms();
+};
+
+// "Char.Vitals" reaches "Char.Vitals" subscribers first, then "Char" ones.
+void TestOobDispatcher::parentPackagesHear() {
+    OobDispatcher d;
+    QStringList heard;
+    d.subscribe("Char", [&](const OobUpdate &u) { heard.append("Char:" + QString(u.package)); });
+    d.subscribe("Char.Vitals", [&](const OobUpdate &u) { heard.append("Vitals:" + QString(u.package)); });
+    d.subscribe("Room", [&](const OobUpdate &) { heard.append("Room"); });
+    d.dispatch(update("Char.Vitals"));
+    d.dispatch(update("Char.Status"));
+    QCOMPARE(heard, QStringList({"Vitals:Char.Vitals", "Char:Char.Vitals", "Char:Char.Status"}));
+}
+
+// "char.vitals" reaches "Char.Vitals" and "CHAR" subscribers, and the
+// handler still sees the name as the server sent it.
+void TestOobDispatcher::packagesIgnoreCase() {
+    OobDispatcher d;
+    QStringList heard;
+    d.subscribe("CHAR", [&](const OobUpdate &u) { heard.append("CHAR:" + QString(u.package)); });
+    const int vitals =
+        d.subscribe("Char.Vitals", [&](const OobUpdate &u) { heard.append("Vitals:" + QString(u.package)); });
+    d.subscribe("room.info", [&](const OobUpdate &u) { heard.append("Room:" + QString(u.package)); });
+    d.dispatch(update("char.vitals"));
+    d.dispatch(update("Room.Info"));
+    d.dispatch(update("CHAR.VITALS"));
+    d.unsubscribe(vitals);
+    d.dispatch(update("char.Vitals"));
+    QCOMPARE(heard, QStringList({"Vitals:char.vitals", "CHAR:char.vitals", "Room:Room.Info", "Vitals:CHAR.VITALS",
+                                 "CHAR:CHAR.VITALS", "CHAR:char.Vitals"}));
+}
+
+// A handler like a Lua script calling amlp.gmcp(): enough subscriptions to
+// grow the list being walked, and new packages to grow the hash. The new
+// handlers hear from the next update on.
+void TestOobDispatcher::subscribeWhileDispatching() {
+    OobDispatcher d;
+    int calls = 0;
+    int added = 0;
+    d.subscribe("Char", [&](const OobUpdate &) {
+        for (int i = 0; i < 100; ++i) {
+            d.subscribe("Char", [&](const OobUpdate &) { ++added; });
+            d.subscribe("Char.Extra" + QByteArray::number(i), [&](const OobUpdate &) { ++added; });
+        }
+    });
+    d.subscribe("Char", [&](const OobUpdate &) { ++calls; });
+    d.dispatch(update("Char.Vitals"));
+    QCOMPARE(calls, 1);
+    QCOMPARE(added, 0);
+    d.dispatch(update("Char.Extra7"));
+    QCOMPARE(calls, 2);
+    QCOMPARE(added, 1 + 100);
+}
+
+// A handler that unsubscribes itself, one later in its list and one in a
+// parent package: none of them runs again, this update or later.
+void TestOobDispatcher::unsubscribeWhileDispatching() {
+    OobDispatcher d;
+    QStringList heard;
+    int later = 0;
+    int parent = 0;
+    int self = 0;
+    const QByteArray payload(4096, 'x');
+    self = d.subscribe("Char.Vitals", [&, payload](const OobUpdate &) {
+        heard.append(QString("self %1").arg(payload.size()));
+        d.unsubscribe(self);
+        d.unsubscribe(later);
+        d.unsubscribe(parent);
+        // The closure that is running must outlive its own removal.
+        heard.append(QString("after %1").arg(payload.size()));
+    });
+    later = d.subscribe("Char.Vitals", [&](const OobUpdate &) { heard.append("later"); });
+    parent = d.subscribe("Char", [&](const OobUpdate &) { heard.append("parent"); });
+    d.subscribe("Char", [&](const OobUpdate &) { heard.append("kept"); });
+    d.dispatch(update("Char.Vitals"));
+    d.dispatch(update("Char.Vitals"));
+    QCOMPARE(heard, QStringList({"self 4096", "after 4096", "kept", "kept"}));
+}
+
+// Removals made in a nested dispatch still apply when the outer one goes on.
+void TestOobDispatcher::nestedDispatch() {
+    OobDispatcher d;
+    QStringList heard;
+    int victim = 0;
+    d.subscribe("Room", [&](const OobUpdate &) {
+        heard.append("room");
+        d.dispatch(update("Char"));
+    });
+    d.subscribe("Char", [&](const OobUpdate &) {
+        heard.append("char");
+        d.unsubscribe(victim);
+    });
+    victim = d.subscribe("Room", [&](const OobUpdate &) { heard.append("victim"); });
+    d.dispatch(update("Room"));
+    d.dispatch(update("Room"));
+    QCOMPARE(heard, QStringList({"room", "char", "room", "char"}));
+}
+
+// Vitals sent twice in a frame arrive once, holding the newest value of
+// every field either message carried.
+void TestOobDispatcher::frameQueueMergesState() {
+    OobFrameQueue queue;
+    queue.append(gmcp(R"(Char.Vitals {"hp": 10, "sp": 5})"));
+    queue.append(gmcp(R"(Char.Vitals {"hp": 8, "mv": 30})"));
+    QCOMPARE(queue.size(), 1);
+
+    OobDispatcher d;
+    QVector<OobUpdate> heard;
+    d.subscribe("Char.Vitals", [&](const OobUpdate &u) { heard.append(u); });
+    queue.dispatchTo(d);
+    QCOMPARE(queue.size(), 0);
+    QCOMPARE(heard.size(), 1);
+    QCOMPARE(heard[0].field("hp")->number, 8.0);
+    QCOMPARE(heard[0].field("sp")->number, 5.0);
+    QCOMPARE(heard[0].field("mv")->number, 30.0);
+}
+
+// Two rooms passed in one frame of a speedwalk: each arrives on its own,
+// in order, and the second carries only its own exits.
+void TestOobDispatcher::frameQueueKeepsRooms() {
+    OobFrameQueue queue;
+    queue.append(gmcp(R"(Room.Info {"num": 1, "exits": {"n": 2, "e": 7}})"));
+    queue.append(gmcp(R"(Char.Vitals {"hp": 10})"));
+    queue.append(gmcp(R"(room.info {"num": 2, "exits": {"s": 1}})"));
+    QCOMPARE(queue.size(), 3);
+
+    OobDispatcher d;
+    QVector<OobUpdate> rooms;
+    d.subscribe("Room.Info", [&](const OobUpdate &u) { rooms.append(u); });
+    queue.dispatchTo(d);
+    QCOMPARE(rooms.size(), 2);
+    QCOMPARE(rooms[0].field("num")->number, 1.0);
+    QVERIFY(rooms[0].field("exits.e"));
+    QCOMPARE(rooms[1].field("num")->number, 2.0);
+    QCOMPARE(rooms[1].field("exits.s")->number, 1.0);
+    QVERIFY(!rooms[1].field("exits.n"));
+    QVERIFY(!rooms[1].field("exits.e"));
+}
+
+AMLP_TEST(TestOobDispatcher)
+#include "tst_gmcp.moc"
@@ -0,0 +1,228 @@
+// Gags, highlights, substitutions and captures on completed lines.
+
+#include "amlp_line_router.h"
+#include "amlp_test.h"
+
+namespace {
+StyleId styleId(QRgb fg) {
+    TextStyle style;
+    style.fg = fg;
+    return StyleTable::instance().intern(style);
+}
+
+const StyleId Red = styleId(qRgb(0xcc, 0, 0));
+const StyleId Green = styleId(qRgb(0, 0xcc, 0));
+const StyleId Blue = styleId(qRgb(0, 0, 0xcc));
+
+// A line built from (text, style) pieces.
+TerminalLine styled(const QVector<QPair<QByteArray, StyleId>> &pieces) {
+    TerminalLine line;
+    for (const auto &piece : pieces) {
+        line.text += piece.first;
+        line.runs.append({quint32(piece.first.size()), piece.second});
+    }
+    return line;
+}
+
+TerminalLine plain(const QByteArray &text) {
+    TerminalLine line;
+    line.text = text;
+    return line;
+}
+
+// "text|style" per run, so the text and the runs are compared together. An
+// empty run list is the default style over the whole line.
+QStringList segments(const TerminalLine &line) {
+    if (line.runs.isEmpty()) return {QString::fromUtf8(line.text) + "|0"};
+    QStringList out;
+    int at = 0;
+    for (const StyleRun &run : line.runs) {
+        out.append(QString::fromUtf8(line.text.mid(at, int(run.length))) + '|' + QString::number(run.style));
+        at += int(run.length);
+    }
+    if (at != line.text.size()) out.append(QString("runs cover %1 of %2 bytes").arg(at).arg(line.text.size()));
+    return out;
+}
+
+QString seg(const char *text, StyleId style) {
+    return QString::fromUtf8(text) + '|' + QString::number(style);
+}
+
+LineRule rule(LineRule::Action action, const QString &pattern) {
+    LineRule r;
+    r.action = action;
+    r.pattern = pattern;
+    return r;
+}
+
+LineRule substitution(const QString &pattern, const QString &replacement, bool regex = false) {
+    LineRule r = rule(LineRule::Substitute, pattern);
+    r.replacement = replacement;
+    r.regex = regex;
+    return r;
+}
+
+LineRule capture(const QString &pattern, const QString &pane, bool keep) {
+    LineRule r = rule(LineRule::Capture, pattern);
+    r.pane = pane;
+    r.keep = keep;
+    return r;
+}
+}
+
+class TestLineRouter : public QObject {
+    Q_OBJECT
+private slots:
+    void longerSubstitutionAcrossStyles();
+    void shorterSubstitutionAfterMultibyte();
+    void everyMatchIsReplaced();
+    void highlightRecoloursMatchOnly();
+    void gagAndCapture();
+    void rulesApplyInOrder();
+    void skippedRules();
+};
+
+// The replacement takes the style the match began in; the text after the
+// match keeps its own runs at their new offsets.
+void TestLineRouter::longerSubstitutionAcrossStyles() {
+    LineRouter router;
+    router.setRules({substitution("the orc", "the big ugly orc")});
+    TerminalLine line = styled({{"You hit the ", Red}, {"orc", Green}, {" hard.", Blue}});
+    QVector<CapturedLine> captured;
+    QVERIFY(router.route(line, captured));
+    QCOMPARE(line.text, QByteArray("You hit the big ugly orc hard."));
+    QCOMPARE(segments(line), QStringList({seg("You hit the big ugly orc", Red), seg(" hard.", Blue)}));
+    QVERIFY(captured.isEmpty());
+}
+
+// Two-byte characters before the match: the runs are cut at byte offsets,
+// not at character positions.
+void TestLineRouter::shorterSubstitutionAfterMultibyte() {
+    LineRouter router;
+    router.setRules({substitution("(\\w+) flees in terror", "$1 runs", true)});
+    TerminalLine line = styled({{"Épée: a ", Red}, {"goblin", Green}, {" flees in terror!", Blue}});
+    QVector<CapturedLine> captured;
+    QVERIFY(router.route(line, captured));
+    QCOMPARE(QString::fromUtf8(line.text), QString("Épée: a goblin runs!"));
+    QCOMPARE(segments(line), QStringList({seg("Épée: a ", Red), seg("goblin runs", Green), seg("!", Blue)}));
+}
+
+void TestLineRouter::everyMatchIsReplaced() {
+    LineRouter router;
+    router.setRules({substitution("ORC", "troll")});
+    TerminalLine line = styled({{"orc", Red}, {" and ", Green}, {"Orc", Blue}});
+    QVector<CapturedLine> captured;
+    QVERIFY(router.route(line, captured));
+    QCOMPARE(segments(line), QStringList({seg("troll", Red), seg(" and ", Green), seg("troll", Blue)}));
+
+    TerminalLine untouched = plain("no match here");
+    QVERIFY(router.route(untouched, captured));
+    QCOMPARE(untouched.text, QByteArray("no match here"));
+    QVERIFY(untouched.runs.isEmpty());
+}
+
+// Only the matched bytes change colour, each keeping the rest of its style.
+void TestLineRouter::highlightRecoloursMatchOnly() {
+    LineRule r = rule(LineRule::Highlight, "p: l");
+    r.color = qRgb(0xff, 0xff, 0);
+    LineRouter router;
+    router.setRules({r});
+    TextStyle bold = StyleTable::instance().style(Green);
+    bold.set(TextStyle::Bold, true);
+    const StyleId boldGreen = StyleTable::instance().intern(bold);
+    TerminalLine line = styled({{"HP: ", Red}, {"low", boldGreen}});
+    QVector<CapturedLine> captured;
+    QVERIFY(router.route(line, captured));
+
+    TextStyle yellow;
+    yellow.fg = r.color;
+    bold.fg = r.color;
+    QCOMPARE(line.text, QByteArray("HP: low"));
+    QCOMPARE(segments(line), QStringList({seg("H", Red), seg("P: ", StyleTable::instance().intern(yellow)),
+                                          seg("l", StyleTable::instance().intern(bold)), seg("ow", boldGreen)}));
+}
+
+// A capture copies the line as it arrived, runs included; without keep the
+// main output loses it. A gag drops it without a copy.
+void TestLineRouter::gagAndCapture() {
+    LineRouter router;
+    router.setRules({capture("tells you", "Chat", false), rule(LineRule::Gag, "auction"),
+                     capture("[Newbie]", "Chat", true)});
+    QVector<CapturedLine> captured;
+
+    TerminalLine tell = styled({{"Bob tells you", Green}, {" hi", Red}});
+    const TerminalLine original = tell;
+    QVERIFY(!router.route(tell, captured));
+    QCOMPARE(captured.size(), 1);
+    QCOMPARE(captured[0].pane, QString("Chat"));
+    QCOMPARE(segments(captured[0].line), segments(original));
+
+    TerminalLine auction = plain("AUCTION: a sword");
+    QVERIFY(!router.route(auction, captured));
+    QCOMPARE(captured.size(), 1);
+
+    TerminalLine newbie = plain("[Newbie] Ann: help");
+    QVERIFY(router.route(newbie, captured));
+    QCOMPARE(captured.size(), 2);
+    QCOMPARE(captured[1].line.text, QByteArray("[Newbie] Ann: help"));
+    QCOMPARE(newbie.text, QByteArray("[Newbie] Ann: help"));
+}
+
+// Rules run in list order on one line: a capture sees the rewrites made by
+// the rules before it, and nothing after a gag or a non-keeping capture runs.
+void TestLineRouter::rulesApplyInOrder() {
+    QVector<CapturedLine> captured;
+    {
+        LineRouter router;
+        router.setRules({substitution("orc", "goblin"), capture("orc", "Fight", true)});
+        TerminalLine line = plain("You see an orc.");
+        QVERIFY(router.route(line, captured));
+        QCOMPARE(line.text, QByteArray("You see an goblin."));
+        QCOMPARE(captured.size(), 1);
+        QCOMPARE(captured[0].line.text, QByteArray("You see an goblin."));
+    }
+    captured.clear();
+    {
+        LineRouter router;
+        router.setRules({capture("orc", "Fight", true), substitution("orc", "goblin")});
+        TerminalLine line = plain("You see an orc.");
+        QVERIFY(router.route(line, captured));
+        QCOMPARE(line.text, QByteArray("You see an goblin."));
+        QCOMPARE(captured.size(), 1);
+        QCOMPARE(captured[0].line.text, QByteArray("You see an orc."));
+    }
+    captured.clear();
+    {
+        LineRouter router;
+        router.setRules({rule(LineRule::Gag, "orc"), capture("orc", "Fight", true)});
+        TerminalLine line = plain("You see an orc.");
+        QVERIFY(!router.route(line, captured));
+        QVERIFY(captured.isEmpty());
+    }
+    {
+        LineRouter router;
+        router.setRules({capture("orc", "Fight", false), capture("orc", "Other", true)});
+        TerminalLine line = plain("You see an orc.");
+        QVERIFY(!router.route(line, captured));
+        QCOMPARE(captured.size(), 1);
+        QCOMPARE(captured[0].pane, QString("Fight"));
+    }
+}
+
+// Disabled rules and captures without a pane are left out when compiling.
+void TestLineRouter::skippedRules() {
+    LineRule disabled = rule(LineRule::Gag, "orc");
+    disabled.enabled = false;
+    LineRouter router;
+    router.setRules({disabled, capture("orc", "  ", false)});
+    QVERIFY(router.isEmpty());
+    TerminalLine line = plain("You see an orc.");
+    QVector<CapturedLine> captured;
+    QVERIFY(router.route(line, captured));
+    QVERIFY(captured.isEmpty());
+    QCOMPARE(LineRouter::paneNames({capture("x", " Chat ", false), disabled, capture("y", "Chat", true)}),
+             QStringList({"Chat"}));
+}
+
+AMLP_TEST(TestLineRouter)
+#include "tst_line_router.moc"
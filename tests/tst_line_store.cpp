@@ -0,0 +1,130 @@
+// Line assembly and the bounded line store.
+
+#include "amlp_line_store.h"
+#include "amlp_test.h"
+
+namespace {
+StyledText plain(const QString &text) {
+    StyledText out;
+    out.text = text;
+    if (!text.isEmpty()) out.spans.append(StyleSpan{0, int(text.size()), 0});
+    return out;
+}
+
+void appendNumbered(LineStore &store, int count) {
+    for (int i = 0; i < count; ++i) {
+        TerminalLine line;
+        line.text = "line " + QByteArray::number(store.endSeq());
+        store.append(std::move(line));
+    }
+}
+
+QByteArrayList texts(const QVector<TerminalLine> &lines) {
+    QByteArrayList out;
+    for (const TerminalLine &l : lines) out.append(l.text);
+    return out;
+}
+}
+
+class TestLineStore : public QObject {
+    Q_OBJECT
+private slots:
+    void promptEndsLine();
+    void promptSpansReads();
+    void promptAfterNewlineIsIgnored();
+    void followingKeepsCap();
+    void pinHoldsBelowCeiling();
+    void pinIsBounded();
+    void noArchiveDropsLines();
+};
+
+void TestLineStore::promptEndsLine() {
+    LineAssembler assembler;
+    QVector<TerminalLine> lines;
+    StyledText pending = plain("You rest.\nHP 10> ");
+    QVERIFY(assembler.endPrompt(pending));
+    assembler.feed(pending, lines);
+    QCOMPARE(texts(lines), QByteArrayList({"You rest.", "HP 10> "}));
+    QVERIFY(assembler.partial().text.isEmpty());
+}
+
+// The prompt text arrived in an earlier read, the GA on its own.
+void TestLineStore::promptSpansReads() {
+    LineAssembler assembler;
+    QVector<TerminalLine> lines;
+    assembler.feed(plain("HP 10> "), lines);
+    QVERIFY(lines.isEmpty());
+    StyledText pending;
+    QVERIFY(assembler.endPrompt(pending));
+    assembler.feed(pending, lines);
+    QCOMPARE(texts(lines), QByteArrayList({"HP 10> "}));
+}
+
+void TestLineStore::promptAfterNewlineIsIgnored() {
+    LineAssembler assembler;
+    StyledText empty;
+    QVERIFY(!assembler.endPrompt(empty));
+    StyledText pending = plain("done\n");
+    QVERIFY(!assembler.endPrompt(pending));
+    QCOMPARE(pending.text, QString("done\n"));
+}
+
+void TestLineStore::followingKeepsCap() {
+    LineStore store(1000, 1024);
+    for (int round = 0; round < 50; ++round) {
+        appendNumbered(store, 100);
+        store.trim(true);
+        QVERIFY(store.count() <= 1000 + 512);
+    }
+    QCOMPARE(store.firstSeq() + store.count(), qint64(5000));
+}
+
+// A reader at the oldest line keeps it while the store is under three caps.
+void TestLineStore::pinHoldsBelowCeiling() {
+    LineStore store(1000, 1024);
+    appendNumbered(store, 2600);
+    QCOMPARE(store.trim(false, 0), 0);
+    QCOMPARE(store.firstSeq(), qint64(0));
+}
+
+// Output keeps flooding while the reader stays parked: the store stops
+// growing at the ceiling, and what was evicted pages back in intact.
+void TestLineStore::pinIsBounded() {
+    LineStore store(1000, 1024);
+    for (int round = 0; round < 100; ++round) {
+        appendNumbered(store, 100);
+        store.trim(false, store.firstSeq());
+        QVERIFY2(store.count() <= 3000 + 512, qPrintable(QString::number(store.count())));
+    }
+    QVERIFY(store.firstSeq() > 0);
+    QCOMPARE(store.firstSeq(), store.archive().lineCount());
+
+    const qint64 first = store.firstSeq();
+    QVERIFY(store.pageIn() > 0);
+    QVERIFY(store.firstSeq() < first);
+    QCOMPARE(store.at(store.firstSeq()).text, "line " + QByteArray::number(store.firstSeq()));
+    QCOMPARE(store.at(first).text, "line " + QByteArray::number(first));
+}
+
+// A store without an archive (a capture pane) evicts straight away, and
+// there is nothing to page back in.
+void TestLineStore::noArchiveDropsLines() {
+    LineStore store(1000, 0);
+    appendNumbered(store, 2000);
+    QCOMPARE(store.trim(true), 1000);
+    QCOMPARE(store.firstSeq(), qint64(1000));
+    QCOMPARE(store.at(1000).text, QByteArray("line 1000"));
+    QVERIFY(store.archive().isEmpty());
+    QCOMPARE(store.pageIn(), 0);
+
+    // An index reserve that takes the whole cap leaves no room either.
+    LineStore reserved(1000, 1);
+    reserved.setArchiveReserve(4096);
+    appendNumbered(reserved, 2000);
+    QCOMPARE(reserved.trim(true), 1000);
+    QVERIFY(reserved.archive().isEmpty());
+}
+
+AMLP_TEST(TestLineStore)
+
+#include "tst_line_store.moc"
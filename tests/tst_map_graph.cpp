@@ -0,0 +1,185 @@
+// The room graph's file: saving, and edits made while a save is written.
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+
+#include <algorithm>
+
+#include "amlp_map_graph.h"
+#include "amlp_test.h"
+
+namespace {
+// The graph by room key, so maps that differ only in indices compare equal.
+QStringList describe(const MapGraph &map) {
+    QStringList out;
+    for (quint32 i = 0; i < quint32(map.roomCount()); ++i) {
+        const MapGraph::Room &r = map.room(i);
+        QString line = QString("%1 %2/%3 %4,%5,%6:")
+                           .arg(r.key)
+                           .arg(map.string(r.name), map.string(r.area))
+                           .arg(r.x)
+                           .arg(r.y)
+                           .arg(r.z);
+        const MapGraph::Exit *e = nullptr;
+        const int count = map.exits(i, e);
+        for (int k = 0; k < count; ++k) line += QString(" %1>%2").arg(map.string(e[k].name)).arg(map.room(e[k].to).key);
+        out.append(line);
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+// A ring of rooms with keys in reverse order, so saving reorders them all.
+void buildRing(MapGraph &map, int count) {
+    for (int i = 0; i < count; ++i)
+        map.addRoom(quint64(1000 - i), QString("Room %1").arg(i), i % 2 ? "Forest" : "Town", i, -i, 0);
+    for (int i = 0; i < count; ++i) {
+        map.setExit(quint32(i), "e", quint32((i + 1) % count));
+        map.setExit(quint32((i + 1) % count), "w", quint32(i));
+    }
+}
+}
+
+class TestMapGraph : public QObject {
+    Q_OBJECT
+private slots:
+    void saveKeepsGraph();
+    void editsDuringSaveCarryOver();
+    void failedWriteKeepsEverything();
+    void interruptedSaveIsRecovered();
+    void duplicateKeyIsOneRoom();
+};
+
+// Writes, maps again and reopens without losing a room, name or exit.
+void TestMapGraph::saveKeepsGraph() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("maps/test.amlpmap");
+    MapGraph map;
+    QVERIFY(map.open(path));
+    buildRing(map, 200);
+    const QStringList before = describe(map);
+    QVERIFY(map.save());
+    QVERIFY(!map.isDirty());
+    QCOMPARE(describe(map), before);
+    QCOMPARE(map.room(0).key, quint64(801));
+    QVERIFY(!QFile::exists(path + ".saving"));
+
+    MapGraph reopened;
+    QVERIFY(reopened.open(path));
+    QCOMPARE(describe(reopened), before);
+}
+
+// Rooms and exits learned between startSave() and finishSave() land on the
+// new file, pointing at the right rooms after the re-sort.
+void TestMapGraph::editsDuringSaveCarryOver() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("test.amlpmap");
+    MapGraph map;
+    QVERIFY(map.open(path));
+    buildRing(map, 50);
+    QVERIFY(map.save());
+    map.addRoom(5, "Gate", "Town", 0, 1, 0);
+    map.setExit(map.find(1000), "s", map.find(5));
+
+    const QSharedPointer<MapGraph::SaveJob> job = map.startSave();
+    QVERIFY(job);
+    QVERIFY(map.isSaving());
+    QVERIFY(!map.startSave());
+    const quint32 cellar = map.addRoom(2000, "Cellar", "Town", 0, 0, -1);
+    map.setExit(map.find(5), "d", cellar);
+    map.setExit(cellar, "u", map.find(5));
+    map.updateRoom(map.find(990), "Clearing", QString());
+    map.setExit(map.find(990), "e", map.find(1000));
+    const QStringList expected = describe(map);
+
+    MapGraph::writeSave(*job);
+    QVERIFY(map.finishSave(job));
+    QVERIFY(!map.isSaving());
+    QCOMPARE(describe(map), expected);
+    QVERIFY(map.isDirty());
+    QCOMPARE(map.room(0).key, quint64(5));
+
+    QVERIFY(map.save());
+    MapGraph reopened;
+    QVERIFY(reopened.open(path));
+    QCOMPARE(describe(reopened), expected);
+}
+
+// If the new file cannot be written, the old one and every edit stay.
+void TestMapGraph::failedWriteKeepsEverything() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("test.amlpmap");
+    MapGraph map;
+    QVERIFY(map.open(path));
+    buildRing(map, 20);
+    QVERIFY(map.save());
+    map.addRoom(1, "Well", "Town", 5, 5, 0);
+    QVERIFY(QDir().mkpath(path + ".saving"));
+
+    const QSharedPointer<MapGraph::SaveJob> job = map.startSave();
+    QVERIFY(job);
+    map.setExit(map.find(1), "n", map.find(1000));
+    const QStringList expected = describe(map);
+    MapGraph::writeSave(*job);
+    QVERIFY(!map.finishSave(job));
+    QCOMPARE(describe(map), expected);
+    QVERIFY(map.isDirty());
+
+    QVERIFY(QDir().rmdir(path + ".saving"));
+    QVERIFY(map.save());
+    MapGraph reopened;
+    QVERIFY(reopened.open(path));
+    QCOMPARE(describe(reopened), expected);
+}
+
+// A new file left beside the map by a save that never swapped it in is
+// whole and newer than the map, so it replaces it on open.
+void TestMapGraph::interruptedSaveIsRecovered() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("test.amlpmap");
+    QStringList expected;
+    {
+        MapGraph map;
+        QVERIFY(map.open(path));
+        buildRing(map, 10);
+        QVERIFY(map.save());
+        expected = describe(map);
+    }
+    QVERIFY(QFile::rename(path, path + ".saving"));
+    QFile old(path);
+    QVERIFY(old.open(QIODevice::WriteOnly));
+    old.close();
+
+    MapGraph map;
+    QVERIFY(map.open(path));
+    QCOMPARE(describe(map), expected);
+    QVERIFY(!QFile::exists(path + ".saving"));
+}
+
+// Adding a key the map already has, in the file or the overlay, gives back
+// that room, so the saved file still has unique keys and opens again.
+void TestMapGraph::duplicateKeyIsOneRoom() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("test.amlpmap");
+    MapGraph map;
+    QVERIFY(map.open(path));
+    buildRing(map, 10);
+    QVERIFY(map.save());
+    const quint32 saved = map.find(1000);
+    QCOMPARE(map.addRoom(1000, "Again", "Town", 5, 5, 5), saved);
+    const quint32 added = map.addRoom(2000, "New", "Town", 0, 0, 1);
+    QCOMPARE(map.addRoom(2000, "Again", "Town", 0, 0, 2), added);
+    QCOMPARE(map.roomCount(), 11);
+    QCOMPARE(map.string(map.room(added).name), QString("New"));
+    const QStringList expected = describe(map);
+    QVERIFY(map.save());
+
+    MapGraph reopened;
+    QVERIFY(reopened.open(path));
+    QCOMPARE(describe(reopened), expected);
+    QVERIFY(!QFile::exists(path + ".bad"));
+}
+
+AMLP_TEST(TestMapGraph)
+#include "tst_map_graph.moc"
@@ -0,0 +1,118 @@
+// Latency histogram buckets and the percentiles read from them.
+
+#include <limits>
+
+#include "amlp_metrics.h"
+#include "amlp_test.h"
+
+namespace {
+const qint64 Us = 1000;
+const qint64 Ms = 1000 * Us;
+
+LatencyHistogram::Snapshot recorded(const QVector<qint64> &samples) {
+    LatencyHistogram histogram;
+    for (qint64 ns : samples) histogram.record(ns);
+    return histogram.snapshot();
+}
+}
+
+class TestMetrics : public QObject {
+    Q_OBJECT
+private slots:
+    void bucketBoundaries_data();
+    void bucketBoundaries();
+    void bucketsTile();
+    void emptyAndOneSample();
+    void knownDistributions();
+    void since();
+};
+
+void TestMetrics::bucketBoundaries_data() {
+    QTest::addColumn<qint64>("ns");
+    QTest::addColumn<int>("bucket");
+    QTest::addColumn<qint64>("upper");
+
+    QTest::newRow("negative") << qint64(-5) << 0 << Us;
+    QTest::newRow("zero") << qint64(0) << 0 << Us;
+    QTest::newRow("under 1 us") << Us - 1 << 0 << Us;
+    QTest::newRow("1 us") << Us << 1 << 2 * Us;
+    QTest::newRow("last linear") << 8 * Us - 1 << 7 << 8 * Us;
+    QTest::newRow("first octave") << 8 * Us << 8 << 9 * Us;
+    QTest::newRow("end of first octave") << 16 * Us - 1 << 15 << 16 * Us;
+    QTest::newRow("second octave") << 16 * Us << 16 << 18 * Us;
+    QTest::newRow("100 us") << 100 * Us << 36 << 104 * Us;
+    QTest::newRow("10 ms") << 10 * Ms << 89 << 10240 * Us;
+    QTest::newRow("clamped") << std::numeric_limits<qint64>::max() << LatencyHistogram::Buckets - 1
+                             << LatencyHistogram::bucketUpperNs(LatencyHistogram::Buckets - 1);
+}
+
+void TestMetrics::bucketBoundaries() {
+    QFETCH(qint64, ns);
+    QFETCH(int, bucket);
+    QFETCH(qint64, upper);
+    QCOMPARE(LatencyHistogram::bucketFor(ns), bucket);
+    QCOMPARE(LatencyHistogram::bucketUpperNs(bucket), upper);
+}
+
+// Every bucket starts where the one before ends, and past the linear first
+// eight none is wider than an eighth of its start.
+void TestMetrics::bucketsTile() {
+    qint64 lower = 0;
+    for (int b = 0; b < LatencyHistogram::Buckets; ++b) {
+        const qint64 upper = LatencyHistogram::bucketUpperNs(b);
+        QCOMPARE(LatencyHistogram::bucketFor(lower), b);
+        QCOMPARE(LatencyHistogram::bucketFor(upper - 1), b);
+        if (b >= LatencyHistogram::SubBuckets) QVERIFY(upper - lower <= lower / 8);
+        lower = upper;
+    }
+    QVERIFY(lower > 60 * 1000 * Ms);
+}
+
+void TestMetrics::emptyAndOneSample() {
+    const LatencyHistogram::Snapshot empty = recorded({});
+    QCOMPARE(empty.total, quint64(0));
+    QCOMPARE(empty.percentile(0.5), qint64(0));
+    QCOMPARE(empty.percentile(0.99), qint64(0));
+
+    // Every percentile of one sample is the bucket holding it.
+    const LatencyHistogram::Snapshot one = recorded({5 * Ms});
+    QCOMPARE(one.total, quint64(1));
+    const qint64 upper = LatencyHistogram::bucketUpperNs(LatencyHistogram::bucketFor(5 * Ms));
+    QVERIFY(upper > 5 * Ms && upper <= 5 * Ms + 5 * Ms / 8);
+    for (double p : {0.0, 0.5, 0.99, 1.0}) QCOMPARE(one.percentile(p), upper);
+}
+
+// The p-quantile is the upper bound of the bucket holding the sample of
+// rank p * (n - 1) + 1, rounded down.
+void TestMetrics::knownDistributions() {
+    QVector<qint64> uniform;
+    for (int i = 1; i <= 100; ++i) uniform.append(i * Us);
+    const LatencyHistogram::Snapshot flat = recorded(uniform);
+    QCOMPARE(flat.percentile(0.0), 2 * Us);
+    QCOMPARE(flat.percentile(0.5), 52 * Us);
+    QCOMPARE(flat.percentile(0.99), 104 * Us);
+    QCOMPARE(flat.percentile(1.0), 104 * Us);
+
+    // A fast mode with a slow tail one sample in a hundred.
+    QVector<qint64> tail(990, 100 * Us);
+    tail += QVector<qint64>(10, 10 * Ms);
+    const LatencyHistogram::Snapshot bimodal = recorded(tail);
+    QCOMPARE(bimodal.total, quint64(1000));
+    QCOMPARE(bimodal.percentile(0.5), 104 * Us);
+    QCOMPARE(bimodal.percentile(0.99), 104 * Us);
+    QCOMPARE(bimodal.percentile(0.999), 10240 * Us);
+}
+
+// Only samples recorded after the earlier snapshot count.
+void TestMetrics::since() {
+    LatencyHistogram histogram;
+    for (int i = 0; i < 50; ++i) histogram.record(10 * Ms);
+    const LatencyHistogram::Snapshot earlier = histogram.snapshot();
+    for (int i = 0; i < 20; ++i) histogram.record(3 * Us);
+    const LatencyHistogram::Snapshot delta = histogram.snapshot().since(earlier);
+    QCOMPARE(delta.total, quint64(20));
+    QCOMPARE(delta.percentile(0.99), 4 * Us);
+}
+
+AMLP_TEST(TestMetrics)
+#include "tst_metrics.moc"
@@ -0,0 +1,90 @@
+// Required-literal extraction and the prefiltered matcher built on it.
+
+#include "amlp_pattern_matcher.h"
+#include "amlp_test.h"
+
+class TestPatternMatcher : public QObject {
+    Q_OBJECT
+private slots:
+    void requiredLiteral_data();
+    void requiredLiteral();
+    void escapedLettersStillMatch();
+    void inlineOptionsRunUnfiltered();
+    void hitsAreAscending();
+};
+
+void TestPatternMatcher::requiredLiteral_data() {
+    QTest::addColumn<QString>("regex");
+    QTest::addColumn<QByteArray>("literal");
+
+    QTest::newRow("plain") << "You hit" << QByteArray("you hit");
+    QTest::newRow("escaped dot") << "ab\\.cd" << QByteArray("ab.cd");
+    QTest::newRow("group ends run") << "hp: (\\d+)" << QByteArray("hp: ");
+    QTest::newRow("optional char") << "colou?r" << QByteArray("colo");
+    QTest::newRow("alternation") << "north|south" << QByteArray();
+    QTest::newRow("too short") << "a.b" << QByteArray();
+    // Escape operands are not literal text.
+    QTest::newRow("hex") << "\\x41BC" << QByteArray("bc");
+    QTest::newRow("hex braces") << "\\x{263A}ab" << QByteArray("ab");
+    QTest::newRow("octal") << "\\101zz" << QByteArray("zz");
+    QTest::newRow("octal zero") << "\\0123ab" << QByteArray("3ab");
+    QTest::newRow("octal braces") << "\\o{101}zz" << QByteArray("zz");
+    QTest::newRow("backreference") << "(a)\\12345xy" << QByteArray("xy");
+    QTest::newRow("control") << "\\cAqq" << QByteArray("qq");
+    QTest::newRow("named reference") << "(?<name>a)\\k<name>xy" << QByteArray("xy");
+    QTest::newRow("named reference braces") << "(?<name>a)\\k{name}xy" << QByteArray("xy");
+    QTest::newRow("relative reference") << "(a)\\g-1xy" << QByteArray("xy");
+    QTest::newRow("reference braces") << "(a)\\g{1}xy" << QByteArray("xy");
+    QTest::newRow("named character") << "\\N{U+263A}xy" << QByteArray("xy");
+    QTest::newRow("property") << "\\p{Lu}xy" << QByteArray("xy");
+    QTest::newRow("short property") << "\\pLxy" << QByteArray("xy");
+    QTest::newRow("quoted") << "\\Qa.bc\\Ecd" << QByteArray("cd");
+    // Inline options change how the rest of the pattern reads.
+    QTest::newRow("case option") << "(?i)hello" << QByteArray();
+    QTest::newRow("extended option") << "(?x) h e l l o" << QByteArray();
+    QTest::newRow("unset option") << "ab(?-i)cd" << QByteArray();
+    QTest::newRow("non-capturing group") << "(?:abc)def" << QByteArray("def");
+}
+
+void TestPatternMatcher::requiredLiteral() {
+    QFETCH(QString, regex);
+    QFETCH(QByteArray, literal);
+    QCOMPARE(PatternMatcher::requiredLiteral(regex), literal);
+}
+
+// Used to be filtered on "41cme", which never appears, so it never fired.
+void TestPatternMatcher::escapedLettersStillMatch() {
+    PatternMatcher m;
+    m.add("\\x41cme", PatternMatcher::Regex | PatternMatcher::CaseSensitive);
+    m.add("\\101\\102CD", PatternMatcher::Regex | PatternMatcher::CaseSensitive);
+    m.compile();
+    QVector<int> hits;
+    m.match("Acme sells ABCD", hits);
+    QCOMPARE(hits, QVector<int>({0, 1}));
+}
+
+void TestPatternMatcher::inlineOptionsRunUnfiltered() {
+    PatternMatcher m;
+    m.add("(?x) you \\s hit", PatternMatcher::Regex | PatternMatcher::CaseSensitive);
+    m.add("(?i)GOBLIN", PatternMatcher::Regex | PatternMatcher::CaseSensitive);
+    m.compile();
+    QVector<int> hits;
+    m.match("you hit the goblin", hits);
+    QCOMPARE(hits, QVector<int>({0, 1}));
+}
+
+void TestPatternMatcher::hitsAreAscending() {
+    PatternMatcher m;
+    m.add("goblin", PatternMatcher::Literal);
+    m.add("hp: (\\d+)", PatternMatcher::Regex);
+    m.add("HIT", PatternMatcher::Literal | PatternMatcher::CaseSensitive);
+    m.add("hit", PatternMatcher::Literal);
+    m.compile();
+    QVector<int> hits;
+    m.match("You hit the Goblin. hp: 12", hits);
+    QCOMPARE(hits, QVector<int>({0, 1, 3}));
+}
+
+AMLP_TEST(TestPatternMatcher)
+
+#include "tst_pattern_matcher.moc"
@@ -0,0 +1,276 @@
+// The saved connections file: saving, opening, damage and migration.
+
+#include <QFile>
+#include <QSettings>
+#include <QTemporaryDir>
+
+#include <cstring>
+
+#include "amlp_profile_store.h"
+#include "amlp_test.h"
+
+namespace {
+// The file layout, as ProfileStore writes it: a 32-byte header, then one
+// 32-byte record per profile, the string pool and the detail blobs.
+const int HeaderSize = 32;
+const int RecordSize = 32;
+const int HeaderStrings = 20;
+const int RecordName = 0;
+const int RecordDetail = 8;
+const int RecordDetailSize = 12;
+
+quint32 word(const QByteArray &file, int offset) {
+    quint32 value = 0;
+    std::memcpy(&value, file.constData() + offset, sizeof value);
+    return value;
+}
+
+void setWord(QByteArray &file, int offset, quint32 value) {
+    std::memcpy(file.data() + offset, &value, sizeof value);
+}
+
+QByteArray readFile(const QString &path) {
+    QFile f(path);
+    return f.open(QIODevice::ReadOnly) ? f.readAll() : QByteArray();
+}
+
+bool writeFile(const QString &path, const QByteArray &bytes) {
+    QFile f(path);
+    return f.open(QIODevice::WriteOnly | QIODevice::Truncate) && f.write(bytes) == bytes.size();
+}
+
+// Where profile `index`'s detail blob sits in the file.
+int detailOffset(const QByteArray &file, int index) {
+    const quint32 profiles = word(file, 16);
+    const int record = HeaderSize + index * RecordSize;
+    return HeaderSize + int(profiles) * RecordSize + int(word(file, HeaderStrings)) + int(word(file, record + RecordDetail));
+}
+
+Profile mud(const QString &name) {
+    Profile p;
+    p.name = name;
+    p.host = name.toLower() + ".example.org";
+    p.port = 4000;
+    return p;
+}
+
+// A profile with everything set, triggers and aliases included.
+Profile fullProfile() {
+    Profile p = mud("Aardwolf");
+    p.port = 23;
+    p.scrollbackLines = 5000;
+    p.archiveKB = 256;
+    p.encoding = TextEncoding::Cp437;
+    Trigger t;
+    t.pattern = "^You are hungry";
+    t.command = "eat bread";
+    t.regex = true;
+    t.caseSensitive = true;
+    p.triggers.append(t);
+    t.pattern = "tells you";
+    t.command = "reply busy";
+    t.regex = false;
+    t.caseSensitive = false;
+    t.enabled = false;
+    p.triggers.append(t);
+    p.aliases.append(Alias{"k", "kill $*"});
+    return p;
+}
+
+void compareProfiles(const Profile &got, const Profile &want) {
+    QCOMPARE(got.name, want.name);
+    QCOMPARE(got.host, want.host);
+    QCOMPARE(got.port, want.port);
+    QCOMPARE(got.scrollbackLines, want.scrollbackLines);
+    QCOMPARE(got.archiveKB, want.archiveKB);
+    QCOMPARE(got.encoding, want.encoding);
+    QCOMPARE(got.triggers.size(), want.triggers.size());
+    for (int i = 0; i < want.triggers.size(); ++i) {
+        QCOMPARE(got.triggers[i].pattern, want.triggers[i].pattern);
+        QCOMPARE(got.triggers[i].command, want.triggers[i].command);
+        QCOMPARE(got.triggers[i].regex, want.triggers[i].regex);
+        QCOMPARE(got.triggers[i].caseSensitive, want.triggers[i].caseSensitive);
+        QCOMPARE(got.triggers[i].enabled, want.triggers[i].enabled);
+    }
+    QCOMPARE(got.aliases.size(), want.aliases.size());
+    for (int i = 0; i < want.aliases.size(); ++i) {
+        QCOMPARE(got.aliases[i].name, want.aliases[i].name);
+        QCOMPARE(got.aliases[i].expansion, want.aliases[i].expansion);
+    }
+}
+}
+
+class TestProfileStore : public QObject {
+    Q_OBJECT
+private slots:
+    void saveAndOpen();
+    void untouchedRecordsAreCopied();
+    void damagedFileIsSetAside_data();
+    void damagedFileIsSetAside();
+    void migratesSettingsList();
+};
+
+// Every field survives a save and a fresh open, and edits made on a mapped
+// store (update, remove, move) survive the next one.
+void TestProfileStore::saveAndOpen() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("profiles/test.amlpprof");
+    ProfileStore store;
+    QVERIFY(store.open(path));
+    QCOMPARE(store.count(), 0);
+    const Profile full = fullProfile();
+    store.add(full);
+    store.add(mud("Discworld"));
+    store.add(mud("Batmud"));
+    QVERIFY(store.isDirty());
+    QVERIFY(store.save());
+    QVERIFY(!store.isDirty());
+
+    ProfileStore reopened;
+    QVERIFY(reopened.open(path));
+    QCOMPARE(reopened.count(), 3);
+    QCOMPARE(reopened.name(1), QString("Discworld"));
+    QCOMPARE(reopened.host(2), QString("batmud.example.org"));
+    QCOMPARE(reopened.port(0), 23);
+    compareProfiles(reopened.profile(0), full);
+    if (QTest::currentTestFailed()) return;
+    compareProfiles(reopened.profile(1), mud("Discworld"));
+    if (QTest::currentTestFailed()) return;
+
+    Profile renamed = reopened.profile(1);
+    renamed.name = "Discworld MUD";
+    reopened.update(1, renamed);
+    reopened.remove(2);
+    reopened.move(1, 0);
+    QVERIFY(reopened.save());
+
+    ProfileStore again;
+    QVERIFY(again.open(path));
+    QCOMPARE(again.count(), 2);
+    QCOMPARE(again.name(0), QString("Discworld MUD"));
+    compareProfiles(again.profile(1), full);
+}
+
+// save() copies a record nobody touched byte for byte: a detail blob that
+// would not even decode comes out the same, next to an edited profile.
+void TestProfileStore::untouchedRecordsAreCopied() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("test.amlpprof");
+    {
+        ProfileStore store;
+        QVERIFY(store.open(path));
+        store.add(fullProfile());
+        store.add(mud("Discworld"));
+        QVERIFY(store.save());
+    }
+    QByteArray bytes = readFile(path);
+    const int size = int(word(bytes, HeaderSize + RecordDetailSize));
+    QVERIFY(size > 8);
+    const QByteArray garbage(size, char(0xEE));
+    bytes.replace(detailOffset(bytes, 0), size, garbage);
+    QVERIFY(writeFile(path, bytes));
+
+    ProfileStore store;
+    QVERIFY(store.open(path));
+    Profile edited = store.profile(1);
+    edited.port = 6666;
+    store.update(1, edited);
+    QVERIFY(store.save());
+
+    const QByteArray saved = readFile(path);
+    QCOMPARE(int(word(saved, HeaderSize + RecordDetailSize)), size);
+    QCOMPARE(saved.mid(detailOffset(saved, 0), size), garbage);
+    QCOMPARE(store.name(0), QString("Aardwolf"));
+    QCOMPARE(store.port(1), 6666);
+}
+
+void TestProfileStore::damagedFileIsSetAside_data() {
+    QTest::addColumn<int>("offset");
+    QTest::addColumn<quint32>("value");
+    QTest::addColumn<int>("cut");
+
+    QTest::newRow("truncated") << -1 << quint32(0) << 1;
+    QTest::newRow("header only") << -1 << quint32(0) << -HeaderSize;
+    QTest::newRow("bad magic") << 0 << quint32(0x58585858) << 0;
+    QTest::newRow("bad version") << 8 << quint32(2) << 0;
+    QTest::newRow("name past the pool") << HeaderSize + RecordSize + RecordName << quint32(0x10000) << 0;
+    QTest::newRow("detail past the end") << HeaderSize + RecordDetail << quint32(0xFFFFFFF0) << 0;
+    QTest::newRow("profile count") << 16 << quint32(0x08000000) << 0;
+}
+
+// A file that fails any check is renamed to .bad and the store opens empty,
+// reading nothing through its offsets.
+void TestProfileStore::damagedFileIsSetAside() {
+    QFETCH(int, offset);
+    QFETCH(quint32, value);
+    QFETCH(int, cut);
+
+    QTemporaryDir dir;
+    const QString path = dir.filePath("test.amlpprof");
+    {
+        ProfileStore store;
+        QVERIFY(store.open(path));
+        store.add(fullProfile());
+        store.add(mud("Discworld"));
+        QVERIFY(store.save());
+    }
+    QByteArray bytes = readFile(path);
+    if (offset >= 0) setWord(bytes, offset, value);
+    if (cut > 0) bytes.chop(cut);
+    if (cut < 0) bytes.truncate(-cut);
+    QVERIFY(writeFile(path, bytes));
+    QVERIFY(writeFile(path + ".bad", "older damage"));
+
+    ProfileStore store;
+    QVERIFY(!store.open(path));
+    QCOMPARE(store.count(), 0);
+    QVERIFY(!QFile::exists(path));
+    QCOMPARE(readFile(path + ".bad"), bytes);
+
+    // The store still works, and saves a new file in its place.
+    store.add(mud("Batmud"));
+    QVERIFY(store.save());
+    ProfileStore reopened;
+    QVERIFY(reopened.open(path));
+    QCOMPARE(reopened.count(), 1);
+}
+
+// The old QSettings list moves into the store, short entries take the
+// defaults, malformed ones are skipped, and the key goes.
+void TestProfileStore::migratesSettingsList() {
+    QTemporaryDir dir;
+    QSettings settings(dir.filePath("settings.ini"), QSettings::IniFormat);
+    settings.setValue("connections", QStringList({"Aardwolf|aardmud.org|23|5000|256|CP437", "Discworld|discworld.atuin.net|4242",
+                                                  "broken entry", "Latin|latin.example.org|7000|100|0|ISO-8859-1"}));
+    const QString path = dir.filePath("test.amlpprof");
+    ProfileStore store;
+    QVERIFY(store.open(path));
+    QCOMPARE(store.migrate(settings), 3);
+    QVERIFY(!settings.contains("connections"));
+    QVERIFY(!store.isDirty());
+
+    ProfileStore reopened;
+    QVERIFY(reopened.open(path));
+    QCOMPARE(reopened.count(), 3);
+    const Profile first = reopened.profile(0);
+    QCOMPARE(first.host, QString("aardmud.org"));
+    QCOMPARE(first.port, 23);
+    QCOMPARE(first.scrollbackLines, 5000);
+    QCOMPARE(first.archiveKB, 256);
+    QCOMPARE(first.encoding, TextEncoding::Cp437);
+    const Profile second = reopened.profile(1);
+    QCOMPARE(second.name, QString("Discworld"));
+    QCOMPARE(second.scrollbackLines, DefaultScrollbackLines);
+    QCOMPARE(second.archiveKB, DefaultArchiveKB);
+    QCOMPARE(second.encoding, TextEncoding::Utf8);
+    QCOMPARE(reopened.profile(2).encoding, TextEncoding::Latin1);
+
+    // A store that already has profiles leaves the settings alone.
+    settings.setValue("connections", QStringList({"Again|again.example.org|23"}));
+    QCOMPARE(reopened.migrate(settings), 0);
+    QVERIFY(settings.contains("connections"));
+    QCOMPARE(reopened.count(), 3);
+}
+
+AMLP_TEST(TestProfileStore)
+#include "tst_profile_store.moc"
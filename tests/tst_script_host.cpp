@@ -0,0 +1,149 @@
+// The Lua sandbox: which libraries scripts get, the instruction budget,
+// failing handlers, and timer arguments. Built only when Lua is found.
+
+#include "amlp_script_host.h"
+#include "amlp_test.h"
+
+namespace {
+// A session's worth of what ScriptHost talks to, on a clock the test moves.
+struct Session {
+    qint64 clock = 0;
+    TimerWheel timers;
+    OobDispatcher oob;
+    QStringList sent;
+    QStringList echoed;
+    ScriptHost host;
+
+    Session() : host(&timers, &oob, hooks()) { timers.setClock([this]() { return clock; }); }
+
+    ScriptHooks hooks() {
+        ScriptHooks h;
+        h.send = [this](const QString &command) { sent.append(command); };
+        h.echo = [this](const QString &text) { echoed.append(text); };
+        h.sendGmcp = [](const QByteArray &, const QByteArray &) {};
+        return h;
+    }
+
+    bool run(const QByteArray &chunk, QString &error) { return host.run(chunk, "test", error); }
+
+    void advance(qint64 ms) {
+        clock += ms;
+        timers.poll();
+    }
+};
+
+TerminalLine textLine(const QByteArray &text) {
+    return TerminalLine{text, {}};
+}
+}
+
+class TestScriptHost : public QObject {
+    Q_OBJECT
+private slots:
+    void safeLibrariesOnly();
+    void budgetStopsRunaways();
+    void failingHandlerSwitchedOff();
+    void timerSeconds_data();
+    void timerSeconds();
+    void timerRejectsNonFinite_data();
+    void timerRejectsNonFinite();
+};
+
+// Nothing that reaches outside the state: no os, io, package loading or
+// file loaders; the pure libraries are all there.
+void TestScriptHost::safeLibrariesOnly() {
+    Session s;
+    QString error;
+    QVERIFY2(s.run("local gone = {}\n"
+                   "for _, name in ipairs({'os', 'io', 'package', 'require', 'debug', 'dofile', 'loadfile'}) do\n"
+                   "  if _G[name] ~= nil then gone[#gone + 1] = name end\n"
+                   "end\n"
+                   "amlp.send('present: ' .. table.concat(gone, ' '))\n"
+                   "amlp.send(string.format('%d %s %d', math.floor(2.5), utf8.char(233), select('#', pcall(type, 1))))",
+                   error),
+             qPrintable(error));
+    QCOMPARE(s.sent, QStringList({"present: ", QString::fromUtf8("2 \xc3\xa9 2")}));
+}
+
+// A loop that never ends is cut off, at load and in a callback, and the
+// session carries on.
+void TestScriptHost::budgetStopsRunaways() {
+    Session s;
+    QString error;
+    QVERIFY(!s.run("while true do end", error));
+    QVERIFY2(error.contains("instruction budget exceeded"), qPrintable(error));
+
+    s.host.setBudget(10000);
+    QVERIFY2(s.run("amlp.line(function(line) while true do end end)\n"
+                   "amlp.line(function(line) amlp.send('saw ' .. line:text()) end)",
+                   error),
+             qPrintable(error));
+    s.host.line(textLine("hello"));
+    QCOMPARE(s.echoed.size(), 1);
+    QVERIFY2(s.echoed.first().contains("instruction budget exceeded"), qPrintable(s.echoed.first()));
+    QCOMPARE(s.sent, QStringList({"saw hello"}));
+}
+
+// Five errors in a row switch a handler off and its alias stops taking the
+// command; a success in between starts the count again.
+void TestScriptHost::failingHandlerSwitchedOff() {
+    Session s;
+    QString error;
+    QVERIFY2(s.run("amlp.alias('boom', function() error('bang') end)\n"
+                   "local n = 0\n"
+                   "amlp.alias('flaky', function() n = n + 1; if n % 4 ~= 0 then error('again') end end)",
+                   error),
+             qPrintable(error));
+    for (int i = 0; i < 5; ++i) QVERIFY(s.host.alias("boom"));
+    QVERIFY(s.echoed.last().contains("switched off after 5 errors"));
+    QVERIFY(!s.host.alias("boom"));
+
+    for (int i = 0; i < 20; ++i) QVERIFY(s.host.alias("flaky"));
+    for (const QString &line : s.echoed.mid(5)) QVERIFY2(!line.contains("switched off"), qPrintable(line));
+}
+
+void TestScriptHost::timerSeconds_data() {
+    QTest::addColumn<QByteArray>("seconds");
+    QTest::addColumn<qint64>("firesAfterMs");
+
+    QTest::newRow("half a second") << QByteArray("0.5") << qint64(500);
+    QTest::newRow("zero") << QByteArray("0") << qint64(1);
+    QTest::newRow("negative") << QByteArray("-3") << qint64(1);
+    QTest::newRow("past the cap") << QByteArray("1e300") << qint64(7) * 24 * 3600 * 1000;
+}
+
+// Out-of-range seconds are cut into range rather than overflowing.
+void TestScriptHost::timerSeconds() {
+    QFETCH(QByteArray, seconds);
+    QFETCH(qint64, firesAfterMs);
+    Session s;
+    QString error;
+    QVERIFY2(s.run("amlp.timer(" + seconds + ", function() amlp.send('tick') end)", error), qPrintable(error));
+    s.advance(firesAfterMs - 1);
+    QVERIFY(s.sent.isEmpty());
+    s.advance(1);
+    QCOMPARE(s.sent, QStringList({"tick"}));
+    QCOMPARE(s.timers.count(), 0);
+}
+
+void TestScriptHost::timerRejectsNonFinite_data() {
+    QTest::addColumn<QByteArray>("seconds");
+    QTest::newRow("nan") << QByteArray("0/0");
+    QTest::newRow("infinity") << QByteArray("math.huge");
+    QTest::newRow("minus infinity") << QByteArray("-math.huge");
+}
+
+// A Lua error the script can catch; no timer is started.
+void TestScriptHost::timerRejectsNonFinite() {
+    QFETCH(QByteArray, seconds);
+    Session s;
+    QString error;
+    QVERIFY(!s.run("amlp.timer(" + seconds + ", function() end)", error));
+    QVERIFY2(error.contains("finite"), qPrintable(error));
+    QCOMPARE(s.timers.count(), 0);
+    QVERIFY2(s.run("amlp.send(tostring(pcall(amlp.timer, " + seconds + ", print)))", error), qPrintable(error));
+    QCOMPARE(s.sent, QStringList({"false"}));
+}
+
+AMLP_TEST(TestScriptHost)
+#include "tst_script_host.moc"
@@ -0,0 +1,84 @@
+// Scrollback search over the store's lines and its compressed archive.
+
+#include <QSignalSpy>
+
+#include "amlp_line_store.h"
+#include "amlp_search.h"
+#include "amlp_test.h"
+
+namespace {
+QByteArray lineText(qint64 seq) {
+    if (seq % 37 == 0) return "You find a Needle " + QByteArray::number(seq);
+    return "A cloaked figure arrives " + QByteArray::number(seq);
+}
+
+// Feeds the store and the index the way OutputRenderer does.
+void feed(LineStore &store, ScrollbackSearch &search, int count) {
+    for (int i = 0; i < count; ++i) {
+        TerminalLine line;
+        line.text = lineText(store.endSeq());
+        search.append(line);
+        store.append(std::move(line));
+        if (store.endSeq() % 100 == 0) {
+            store.setArchiveReserve(search.indexedBytes());
+            if (store.trim(true) > 0) search.dropBefore(store.firstSeq() - store.archive().lineCount());
+        }
+    }
+}
+
+QVector<qint64> expected(const LineStore &store, const QByteArray &needle) {
+    QVector<qint64> seqs;
+    for (qint64 seq = store.firstSeq() - store.archive().lineCount(); seq < store.endSeq(); ++seq)
+        if (lineText(seq).contains(needle)) seqs.append(seq);
+    return seqs;
+}
+
+QVector<qint64> run(ScrollbackSearch &search, const QString &query, bool regex) {
+    QSignalSpy done(&search, &ScrollbackSearch::finished);
+    search.start(std::make_shared<SearchPattern>(query, regex, false));
+    if (done.isEmpty() && !done.wait(10000)) return {qint64(-1)};
+    return search.results();
+}
+}
+
+class TestScrollbackSearch : public QObject {
+    Q_OBJECT
+private slots:
+    void findsLiveAndArchivedLines();
+    void findsPagedInLines();
+    void indexCountsAgainstArchiveCap();
+};
+
+void TestScrollbackSearch::findsLiveAndArchivedLines() {
+    LineStore store(1000, 1024);
+    ScrollbackSearch search(&store);
+    feed(store, search, 20000);
+    QVERIFY(store.archive().lineCount() > 0);
+    const QVector<qint64> want = expected(store, "Needle");
+    QVERIFY(!want.isEmpty() && want.first() < store.firstSeq());
+    QCOMPARE(run(search, "needle", false), want);
+    QCOMPARE(run(search, "needle \\d+", true), want);
+}
+
+// Lines paged back in leave the archive for the store; both are read.
+void TestScrollbackSearch::findsPagedInLines() {
+    LineStore store(1000, 1024);
+    ScrollbackSearch search(&store);
+    feed(store, search, 20000);
+    QVERIFY(store.pageIn() > 0);
+    QCOMPARE(run(search, "needle", false), expected(store, "Needle"));
+}
+
+// The bitsets take their share of the cap, so the archive holds less.
+void TestScrollbackSearch::indexCountsAgainstArchiveCap() {
+    LineStore store(1000, 64);
+    ScrollbackSearch search(&store);
+    feed(store, search, 50000);
+    QVERIFY(search.indexedBytes() > 0);
+    QVERIFY(store.archive().compressedBytes() + search.indexedBytes() <= 64 * 1024 + 8 * 1024);
+    QCOMPARE(run(search, "needle", false), expected(store, "Needle"));
+}
+
+AMLP_TEST(TestScrollbackSearch)
+
+#include "tst_search.moc"
@@ -0,0 +1,236 @@
+// Session logs written block by block, then found again through the index.
+
+#include <QDir>
+#include <QFileInfo>
+#include <QTemporaryDir>
+
+#include "amlp_session_log.h"
+#include "amlp_test.h"
+
+namespace {
+const qint64 Start = 1700000000000;
+const int BatchLines = 250;
+const int Batches = 40;
+
+// About 100 bytes, numbered so any line can be checked on its own.
+QByteArray lineText(qint64 n) {
+    return "line " + QByteArray::number(n) + ' ' + QByteArray(90, char('a' + n % 26));
+}
+
+QList<QByteArray> texts(qint64 first, int count) {
+    QList<QByteArray> out;
+    for (int i = 0; i < count; ++i) out.append(lineText(first + i));
+    return out;
+}
+
+QVector<TerminalLine> batch(qint64 first, int count) {
+    QVector<TerminalLine> lines;
+    for (int i = 0; i < count; ++i) lines.append(TerminalLine{lineText(first + i), {}});
+    return lines;
+}
+
+LogOptions options(const QString &directory, bool compress) {
+    LogOptions o;
+    o.enabled = true;
+    o.directory = directory;
+    o.compress = compress;
+    o.rotateMB = 0;
+    o.rotateHours = 0;
+    return o;
+}
+
+// Batches of lines a second apart: about 1 MB, so several blocks.
+QString writeLog(const LogOptions &o) {
+    LogFile log;
+    log.open(o, "test server", Start);
+    for (int b = 0; b < Batches; ++b) log.write(batch(qint64(b) * BatchLines, BatchLines), Start + b * 1000);
+    const QString path = log.fileName();
+    log.close();
+    return path;
+}
+
+QList<QByteArray> blockLines(LogReader &reader, int block) {
+    QList<QByteArray> lines = reader.readBlock(block).split('\n');
+    if (!lines.isEmpty() && lines.last().isEmpty()) lines.removeLast();
+    return lines;
+}
+
+QStringList logFiles(const QString &directory) {
+    return QDir(directory).entryList({"*.txt", "*.txt.gz"}, QDir::Files, QDir::Name);
+}
+}
+
+class TestSessionLog : public QObject {
+    Q_OBJECT
+private slots:
+    void seekByLine_data();
+    void seekByLine();
+    void seekByTime();
+    void rotatesOnTime();
+    void rotatesOnSize();
+    void notesDroppedLines();
+    void writerThread();
+};
+
+void TestSessionLog::seekByLine_data() {
+    QTest::addColumn<bool>("compress");
+    QTest::newRow("gzip") << true;
+    QTest::newRow("plain") << false;
+}
+
+// Each block starts where the last ended, a line is found in the block the
+// index names, and reading that block alone gives it back.
+void TestSessionLog::seekByLine() {
+    QFETCH(bool, compress);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = writeLog(options(dir.path(), compress));
+    QCOMPARE(path.endsWith(".gz"), compress);
+
+    LogReader reader;
+    QVERIFY(reader.open(path));
+    QVERIFY(reader.blockCount() >= 4);
+    qint64 total = 0;
+    for (int b = 0; b < reader.blockCount(); ++b) {
+        QCOMPARE(reader.firstLine(b), total);
+        total += blockLines(reader, b).size();
+    }
+    QCOMPARE(total, qint64(Batches * BatchLines));
+
+    for (qint64 line : {qint64(0), qint64(1), qint64(2620), qint64(5000), total - 1}) {
+        const int b = reader.blockForLine(line);
+        QVERIFY(b >= 0);
+        QVERIFY(line >= reader.firstLine(b));
+        QVERIFY(b + 1 == reader.blockCount() || line < reader.firstLine(b + 1));
+        QCOMPARE(blockLines(reader, b).at(int(line - reader.firstLine(b))), lineText(line));
+    }
+    // Blocks are read in any order.
+    QCOMPARE(blockLines(reader, reader.blockCount() - 1).last(), lineText(total - 1));
+    QCOMPARE(blockLines(reader, 0).first(), lineText(0));
+    QVERIFY(reader.readBlock(reader.blockCount()).isEmpty());
+}
+
+// A time finds the first block that started at or after it.
+void TestSessionLog::seekByTime() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    LogReader reader;
+    QVERIFY(reader.open(writeLog(options(dir.path(), true))));
+    const int blocks = reader.blockCount();
+    QVERIFY(blocks >= 4);
+
+    QCOMPARE(reader.startTime(0), QDateTime::fromMSecsSinceEpoch(Start));
+    QCOMPARE(reader.blockForTime(QDateTime::fromMSecsSinceEpoch(Start - 60000)), 0);
+    for (int b = 0; b < blocks; ++b) {
+        const QDateTime start = reader.startTime(b);
+        QCOMPARE(reader.blockForTime(start), b);
+        QCOMPARE(reader.blockForTime(start.addMSecs(1)), b + 1 < blocks ? b + 1 : -1);
+        // Blocks close between writes, so each starts with a whole batch.
+        QCOMPARE(reader.firstLine(b), (start.toMSecsSinceEpoch() - Start) / 1000 * BatchLines);
+    }
+}
+
+// A write past the age limit finishes in the old file; the next one starts
+// a new file, numbered from line 0.
+void TestSessionLog::rotatesOnTime() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    LogOptions o = options(dir.path(), true);
+    o.rotateHours = 1;
+    LogFile log;
+    log.open(o, "test server", Start);
+    log.write(batch(0, 10), Start);
+    const QString first = log.fileName();
+    log.write(batch(10, 10), Start + 3600 * 1000);
+    const QString second = log.fileName();
+    QVERIFY(second != first);
+    log.write(batch(20, 10), Start + 3600 * 1000 + 1);
+    log.close();
+    QCOMPARE(logFiles(dir.path()).size(), 2);
+
+    LogReader reader;
+    QVERIFY(reader.open(first));
+    QCOMPARE(reader.blockCount(), 1);
+    QCOMPARE(blockLines(reader, 0), texts(0, 20));
+    QVERIFY(reader.open(second));
+    QCOMPARE(reader.firstLine(0), qint64(0));
+    QCOMPARE(blockLines(reader, 0).first(), lineText(20));
+    QCOMPARE(reader.startTime(0), QDateTime::fromMSecsSinceEpoch(Start + 3600 * 1000 + 1));
+}
+
+// Over the size limit within one second: the new file gets a "-2" name
+// instead of overwriting, and holds the lines that follow.
+void TestSessionLog::rotatesOnSize() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    LogOptions o = options(dir.path(), false);
+    o.rotateMB = 1;
+    LogFile log;
+    log.open(o, "test server", Start);
+    const QString first = log.fileName();
+    qint64 written = 0;
+    while (logFiles(dir.path()).size() < 2) {
+        QVERIFY(written < 20000);
+        log.write(batch(written, 100), Start + 10);
+        written += 100;
+    }
+    log.write(batch(written, 100), Start + 20);
+    const QString second = log.fileName();
+    log.close();
+
+    QCOMPARE(logFiles(dir.path()).size(), 2);
+    QCOMPARE(second, first.chopped(4) + "-2.txt");
+    QVERIFY(QFileInfo(first).size() >= 1024 * 1024);
+    LogReader reader;
+    QVERIFY(reader.open(first));
+    QCOMPARE(blockLines(reader, reader.blockCount() - 1).last(), lineText(written - 1));
+    QVERIFY(reader.open(second));
+    QCOMPARE(reader.blockCount(), 1);
+    QCOMPARE(blockLines(reader, 0), texts(written, 100));
+}
+
+// The note is a line of its own, between the lines written around it.
+void TestSessionLog::notesDroppedLines() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    LogFile log;
+    log.open(options(dir.path(), true), "test server", Start);
+    log.write(batch(0, 5), Start);
+    log.noteDropped(17, Start + 1);
+    log.write(batch(5, 5), Start + 2);
+    const QString path = log.fileName();
+    log.close();
+
+    LogReader reader;
+    QVERIFY(reader.open(path));
+    const QList<QByteArray> lines = blockLines(reader, 0);
+    QCOMPARE(lines.size(), 11);
+    QCOMPARE(lines[4], lineText(4));
+    QCOMPARE(lines[5], QByteArray("[17 lines not logged: the log writer fell behind]"));
+    QCOMPARE(lines[6], lineText(5));
+}
+
+// Through SessionLog: the writer thread opens, fills and closes the file.
+void TestSessionLog::writerThread() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    {
+        SessionLog log(options(dir.path(), true));
+        log.open("mud.example.org");
+        const QVector<TerminalLine> lines = batch(0, 1000);
+        for (int i = 0; i < lines.size(); i += 100) log.append(lines.constData() + i, 100);
+        log.close();
+    }
+    QTRY_COMPARE(logFiles(dir.path()).size(), 1);
+    const QString path = dir.filePath(logFiles(dir.path()).first());
+    QVERIFY(QFileInfo(path).fileName().startsWith("mud.example.org_"));
+    LogReader reader;
+    QTRY_VERIFY(reader.open(path) && reader.blockCount() == 1);
+    const QList<QByteArray> lines = blockLines(reader, 0);
+    QCOMPARE(lines.size(), 1000);
+    QCOMPARE(lines.first(), lineText(0));
+    QCOMPARE(lines.last(), lineText(999));
+}
+
+AMLP_TEST(TestSessionLog)
+#include "tst_session_log.moc"
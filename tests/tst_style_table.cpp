@@ -0,0 +1,87 @@
+// Interning styles, and what a full table does with new ones.
+
+#include "amlp_style_table.h"
+#include "amlp_test.h"
+
+namespace {
+TextStyle colored(QRgb fg, QRgb bg = 0, quint8 flags = 0) {
+    TextStyle style;
+    style.fg = fg;
+    style.bg = bg;
+    style.flags = flags;
+    return style;
+}
+}
+
+class TestStyleTable : public QObject {
+    Q_OBJECT
+private slots:
+    void internRoundTrip();
+    void fullTableApproximates();
+    void cacheStartsOver();
+};
+
+// Equal styles share an id, and an id reads back the style it was given.
+void TestStyleTable::internRoundTrip() {
+    StyleTable table(64);
+    QCOMPARE(table.size(), 1);
+    QCOMPARE(table.intern(TextStyle()), StyleId(0));
+
+    const TextStyle red = colored(qRgb(0xff, 0, 0));
+    const TextStyle onBlue = colored(qRgb(0xff, 0, 0), qRgb(0, 0, 0xff));
+    const TextStyle bold = colored(qRgb(0xff, 0, 0), 0, TextStyle::Bold);
+    const StyleId redId = table.intern(red);
+    const StyleId onBlueId = table.intern(onBlue);
+    const StyleId boldId = table.intern(bold);
+    QVERIFY(redId != 0 && redId != onBlueId && redId != boldId && onBlueId != boldId);
+    QCOMPARE(table.intern(colored(qRgb(0xff, 0, 0))), redId);
+    QVERIFY(table.style(redId) == red);
+    QVERIFY(table.style(onBlueId) == onBlue);
+    QVERIFY(table.style(boldId) == bold);
+    QCOMPARE(table.size(), 4);
+    QCOMPARE(table.approximated(), quint64(0));
+}
+
+// Past capacity, a new style gets the nearest one: matching attributes and
+// background first, then the closest foreground. The table does not grow.
+void TestStyleTable::fullTableApproximates() {
+    StyleTable table(4);
+    const StyleId red = table.intern(colored(qRgb(0xff, 0, 0)));
+    const StyleId boldBlue = table.intern(colored(qRgb(0, 0, 0xff), 0, TextStyle::Bold));
+    const StyleId onGreen = table.intern(colored(qRgb(0xff, 0xff, 0xff), qRgb(0, 0x80, 0)));
+    QCOMPARE(table.size(), 4);
+
+    // A gradient prompt's next shade of red.
+    QCOMPARE(table.intern(colored(qRgb(0xf0, 0x10, 0x08))), red);
+    // Bold wins over the closer colour of plain red.
+    QCOMPARE(table.intern(colored(qRgb(0xc0, 0, 0x40), 0, TextStyle::Bold)), boldBlue);
+    // A background is kept, even at the cost of the foreground.
+    QCOMPARE(table.intern(colored(qRgb(0xff, 0, 0), qRgb(0, 0x90, 0))), onGreen);
+    // Close to the default white.
+    QCOMPARE(table.intern(colored(qRgb(0xf8, 0xf8, 0xf0))), StyleId(0));
+    // Asked again: answered from the remembered approximation, still counted.
+    QCOMPARE(table.intern(colored(qRgb(0xf0, 0x10, 0x08))), red);
+
+    QCOMPARE(table.size(), 4);
+    QCOMPARE(table.approximated(), quint64(5));
+    // Styles that were interned still resolve exactly.
+    QCOMPARE(table.intern(colored(qRgb(0xff, 0, 0))), red);
+    QCOMPARE(table.approximated(), quint64(5));
+}
+
+// A cache fed more distinct styles than it keeps starts over, and its ids
+// still read back the styles they were asked for.
+void TestStyleTable::cacheStartsOver() {
+    StyleCache cache;
+    StyleTable &table = StyleTable::instance();
+    const int distinct = StyleCache::MaxEntries + 100;
+    for (int i = 0; i < distinct; ++i) {
+        const TextStyle style = colored(qRgb(0x10, i >> 8, i & 0xff), qRgb(0x20, 0x30, 0x40));
+        QVERIFY(table.style(cache.intern(style)) == style);
+        QVERIFY(cache.size() <= StyleCache::MaxEntries);
+    }
+    QCOMPARE(cache.size(), distinct - StyleCache::MaxEntries);
+}
+
+AMLP_TEST(TestStyleTable)
+#include "tst_style_table.moc"
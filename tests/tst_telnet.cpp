@@ -0,0 +1,163 @@
+// Scripted server side of telnet negotiation: bytes a MUD would send go
+// through AnsiParser into TelnetNegotiator, and the replies are checked.
+
+#include <QSignalSpy>
+
+#include "amlp_ansi_parser.h"
+#include "amlp_line_store.h"
+#include "amlp_telnet.h"
+#include "amlp_test.h"
+
+using namespace Telnet;
+
+namespace {
+QByteArray command(quint8 verb, quint8 option) {
+    const char bytes[3] = {char(IAC), char(verb), char(option)};
+    return QByteArray(bytes, 3);
+}
+
+// The client end of one connection.
+struct Client {
+    Client() {
+        parser.setTelnetHandler(&negotiator);
+        QObject::connect(&negotiator, &TelnetNegotiator::send, [this](const QByteArray &bytes) { sent += bytes; });
+    }
+    // Feeds server bytes; returns how many the parser took.
+    int receive(const QByteArray &bytes) {
+        text.clear();
+        return parser.feed(bytes.constData(), int(bytes.size()), text);
+    }
+    QByteArray take() {
+        const QByteArray out = sent;
+        sent.clear();
+        return out;
+    }
+
+    AnsiParser parser;
+    TelnetNegotiator negotiator;
+    StyledText text;
+    QByteArray sent;
+};
+}
+
+class TestTelnet : public QObject {
+    Q_OBJECT
+private slots:
+    void acceptsOfferOnce();
+    void refusesUnknownOptions();
+    void answersOwnRequestWithoutEcho();
+    void disableIsAcknowledgedOnce();
+    void mccp2PausesParserAfterStart();
+    void mccp2StartIgnoredUnlessAgreed();
+    void mccp3StartsOutgoingCompression();
+    void gaAndEorMarkPrompts();
+    void eorOfferEndsPrompts();
+};
+
+// Q method: a repeated WILL for an enabled option gets no second DO.
+void TestTelnet::acceptsOfferOnce() {
+    Client c;
+    c.receive(command(WILL, Gmcp));
+    QVERIFY(c.negotiator.remoteEnabled(Gmcp));
+    QVERIFY(c.take().startsWith(command(DO, Gmcp)));
+    c.receive(command(WILL, Gmcp));
+    QCOMPARE(c.take(), QByteArray());
+}
+
+void TestTelnet::refusesUnknownOptions() {
+    Client c;
+    c.receive(command(WILL, 99) + command(DO, 98));
+    QCOMPARE(c.take(), command(DONT, 99) + command(WONT, 98));
+    QVERIFY(!c.negotiator.remoteEnabled(99));
+    QVERIFY(!c.negotiator.localEnabled(98));
+}
+
+// Our WILL NAWS answered by DO completes the request: no WILL back, just the size.
+void TestTelnet::answersOwnRequestWithoutEcho() {
+    Client c;
+    c.negotiator.start();
+    QCOMPARE(c.take(), command(WILL, Naws));
+    c.receive(command(DO, Naws));
+    QVERIFY(c.negotiator.localEnabled(Naws));
+    const char size[] = {0, 80, 0, 24};
+    QCOMPARE(c.take(), TelnetNegotiator::subnegotiation(Naws, QByteArray(size, 4)));
+    c.receive(command(DO, Naws));
+    QCOMPARE(c.take(), QByteArray());
+}
+
+void TestTelnet::disableIsAcknowledgedOnce() {
+    Client c;
+    c.receive(command(WILL, Echo));
+    c.take();
+    c.receive(command(WONT, Echo));
+    QCOMPARE(c.take(), command(DONT, Echo));
+    QVERIFY(!c.negotiator.remoteEnabled(Echo));
+    c.receive(command(WONT, Echo));
+    QCOMPARE(c.take(), QByteArray());
+}
+
+// The parser stops right after IAC SE so the rest can go through zlib.
+void TestTelnet::mccp2PausesParserAfterStart() {
+    Client c;
+    c.receive(command(WILL, Mccp2));
+    QCOMPARE(c.take(), command(DO, Mccp2));
+    const QByteArray start = "ok" + TelnetNegotiator::subnegotiation(Mccp2, QByteArray());
+    const QByteArray zlib("\x78\x9c\x01\x02", 4);
+    QCOMPARE(c.receive(start + zlib), int(start.size()));
+    QCOMPARE(c.text.text, QString("ok"));
+    QVERIFY(c.negotiator.takeCompressionStart());
+    QVERIFY(!c.negotiator.takeCompressionStart());
+}
+
+void TestTelnet::mccp2StartIgnoredUnlessAgreed() {
+    Client c;
+    const QByteArray bytes = TelnetNegotiator::subnegotiation(Mccp2, QByteArray()) + "text";
+    QCOMPARE(c.receive(bytes), int(bytes.size()));
+    QVERIFY(!c.negotiator.takeCompressionStart());
+}
+
+// Agreeing to MCCP3 sends the start marker, then switches our output over.
+void TestTelnet::mccp3StartsOutgoingCompression() {
+    Client c;
+    QSignalSpy started(&c.negotiator, &TelnetNegotiator::outgoingCompressionStarted);
+    c.receive(command(WILL, Mccp3));
+    QCOMPARE(c.take(), command(DO, Mccp3) + TelnetNegotiator::subnegotiation(Mccp3, QByteArray()));
+    QCOMPARE(started.count(), 1);
+    c.receive(command(WILL, Mccp3));
+    QCOMPARE(started.count(), 1);
+}
+
+void TestTelnet::gaAndEorMarkPrompts() {
+    Client c;
+    QSignalSpy prompts(&c.negotiator, &TelnetNegotiator::promptMarked);
+    const char ga[] = {char(IAC), char(GA)};
+    const char eor[] = {char(IAC), char(EOR)};
+    c.receive("HP 10> " + QByteArray(ga, 2) + "MP 5> " + QByteArray(eor, 2));
+    QCOMPARE(prompts.count(), 2);
+    QCOMPARE(c.text.text, QString("HP 10> MP 5> "));
+    QCOMPARE(c.take(), QByteArray());
+}
+
+// WILL EOR is taken, so the server goes on to end its prompts with IAC
+// EOR, each of which completes the prompt as a line the way the worker does.
+void TestTelnet::eorOfferEndsPrompts() {
+    Client c;
+    c.receive(command(WILL, EndOfRecord));
+    QCOMPARE(c.take(), command(DO, EndOfRecord));
+    QVERIFY(c.negotiator.remoteEnabled(EndOfRecord));
+
+    LineAssembler assembler;
+    QVector<TerminalLine> lines;
+    QObject::connect(&c.negotiator, &TelnetNegotiator::promptMarked, [&]() { assembler.endPrompt(c.text); });
+    const char eor[] = {char(IAC), char(EOR)};
+    c.receive("You wake.\r\nHP 10> " + QByteArray(eor, 2));
+    assembler.feed(c.text, lines);
+    QCOMPARE(lines.size(), 2);
+    QCOMPARE(lines[0].text, QByteArray("You wake."));
+    QCOMPARE(lines[1].text, QByteArray("HP 10> "));
+    QVERIFY(assembler.partial().text.isEmpty());
+}
+
+AMLP_TEST(TestTelnet)
+
+#include "tst_telnet.moc"
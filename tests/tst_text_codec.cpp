@@ -0,0 +1,99 @@
+// The printable-ASCII scanner at every level the CPU has, against a plain loop.
+
+#include <QRandomGenerator>
+#include <QVector>
+
+#include "amlp_test.h"
+#include "amlp_text_codec.h"
+
+namespace {
+int reference(const char *data, int length) {
+    for (int i = 0; i < length; ++i) {
+        const quint8 c = quint8(data[i]);
+        if (c < 0x20 || c > 0x7e) return i;
+    }
+    return length;
+}
+
+// A level set for one test and put back after it.
+struct LevelScope {
+    explicit LevelScope(ScanLevel level) { setScanLevel(level); }
+    ~LevelScope() { setScanLevel(bestScanLevel()); }
+};
+
+QVector<ScanLevel> levels() {
+    QVector<ScanLevel> out;
+    for (int level = int(ScanLevel::Scalar); level <= int(bestScanLevel()); ++level) out.append(ScanLevel(level));
+    return out;
+}
+}
+
+class TestTextCodec : public QObject {
+    Q_OBJECT
+private slots:
+    void everyStopByteAtEveryPosition();
+    void lengthEndsTheRun();
+    void randomText();
+};
+
+// Each byte value, printable or not, alone in a run of letters: at every
+// position across two AVX2 blocks and the scalar tail, from every start
+// alignment.
+void TestTextCodec::everyStopByteAtEveryPosition() {
+    QByteArray buffer(128, 'a');
+    for (ScanLevel level : levels()) {
+        LevelScope scope(level);
+        QCOMPARE(scanLevel(), level);
+        for (int offset = 0; offset < 32; ++offset) {
+            for (int at = 0; at < 70; ++at) {
+                for (int byte = 0; byte < 256; ++byte) {
+                    buffer.fill('a');
+                    buffer[offset + at] = char(byte);
+                    const char *data = buffer.constData() + offset;
+                    const int got = printableAsciiRun(data, 70);
+                    if (got != reference(data, 70))
+                        QFAIL(qPrintable(QString("%1: byte %2 at %3 from offset %4 gave %5")
+                                             .arg(scanLevelName(level)).arg(byte).arg(at).arg(offset).arg(got)));
+                }
+            }
+        }
+    }
+}
+
+// A stop byte just past the length does not count, at every length.
+void TestTextCodec::lengthEndsTheRun() {
+    QByteArray buffer(100, 'x');
+    for (ScanLevel level : levels()) {
+        LevelScope scope(level);
+        for (int length = 0; length < 90; ++length) {
+            buffer.fill('x');
+            buffer[length] = '\x1b';
+            QCOMPARE(printableAsciiRun(buffer.constData(), length), length);
+            QCOMPARE(printableAsciiRun(buffer.constData(), length + 1), length);
+        }
+    }
+}
+
+// Server-like text: long printable runs broken by escapes, line ends,
+// UTF-8 and telnet bytes, scanned run by run as the parser does.
+void TestTextCodec::randomText() {
+    QRandomGenerator random(21);
+    const char stops[] = {'\x1b', '\r', '\n', '\t', '\x7f', char(0xff), char(0xc3), char(0xa9), '\0'};
+    QByteArray text;
+    while (text.size() < 1 << 20) {
+        const int run = random.bounded(200);
+        for (int k = 0; k < run; ++k) text.append(char(0x20 + random.bounded(0x5f)));
+        text.append(stops[random.bounded(int(sizeof stops))]);
+    }
+    for (ScanLevel level : levels()) {
+        LevelScope scope(level);
+        for (int i = 0; i < text.size();) {
+            const int got = printableAsciiRun(text.constData() + i, text.size() - i);
+            QCOMPARE(got, reference(text.constData() + i, text.size() - i));
+            i += got + 1;
+        }
+    }
+}
+
+AMLP_TEST(TestTextCodec)
+#include "tst_text_codec.moc"
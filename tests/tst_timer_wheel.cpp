@@ -0,0 +1,157 @@
+// The timing wheel against a simple model, on a clock the test moves.
+
+#include <QRandomGenerator>
+
+#include "amlp_test.h"
+#include "amlp_timer_wheel.h"
+
+namespace {
+// What the wheel should do with one timer.
+struct Expected {
+    TimerWheel::Handle handle;
+    qint64 due = 0;
+    qint64 interval = 0;
+    quint64 fires = 0;
+    bool active = true;
+    bool cancelled = false;
+};
+}
+
+class TestTimerWheel : public QObject {
+    Q_OBJECT
+private slots:
+    void randomTimersFireOnTime();
+    void pauseFromCallback();
+};
+
+// 3000 timers over every level and past the horizon, one-shot and
+// repeating, some cancelled. After each step of the clock, every timer
+// due by then has fired exactly as often as it should, none early, and
+// in due order.
+void TestTimerWheel::randomTimersFireOnTime() {
+    qint64 clock = 0;
+    TimerWheel wheel;
+    wheel.setClock([&clock]() { return clock; });
+    QRandomGenerator random(18);
+    QVector<Expected> timers;
+    QVector<int> fired;
+
+    auto startTimer = [&](qint64 delay, qint64 interval) {
+        const int id = timers.size();
+        Expected e;
+        e.due = clock + delay;
+        e.interval = interval;
+        e.handle = wheel.start(delay, [&fired, id]() { fired.append(id); }, interval);
+        timers.append(e);
+    };
+    for (int i = 0; i < 3000; ++i) {
+        const int kind = random.bounded(10);
+        if (kind < 6)
+            startTimer(1 + random.bounded(400000), 0);
+        else if (kind < 9)
+            startTimer(1 + random.bounded(400000), 1 + random.bounded(20000));
+        else
+            startTimer(1 + random.bounded(20000000), 0);
+    }
+
+    // Checks what fired during the last step, then that nothing due is left.
+    qint64 before = 0;
+    auto check = [&]() {
+        qint64 lastDue = 0;
+        for (int id : fired) {
+            Expected &e = timers[id];
+            QVERIFY2(e.active, qPrintable(QString("timer %1 fired while inactive").arg(id)));
+            QVERIFY2(e.due <= clock && e.due > before, qPrintable(QString("timer %1 fired off time").arg(id)));
+            QVERIFY(e.due >= lastDue);
+            lastDue = e.due;
+            ++e.fires;
+            if (e.interval > 0)
+                e.due += e.interval;
+            else
+                e.active = false;
+        }
+        fired.clear();
+        int active = 0;
+        for (const Expected &e : timers) {
+            QCOMPARE(wheel.isActive(e.handle), e.active);
+            if (!e.active) continue;
+            ++active;
+            QVERIFY(e.due > clock);
+            QCOMPARE(wheel.remaining(e.handle), e.due - clock);
+            QCOMPARE(wheel.fireCount(e.handle), e.fires);
+        }
+        QCOMPARE(wheel.count(), active);
+        before = clock;
+    };
+
+    while (clock < 500000) {
+        clock += 1 + random.bounded(3000);
+        wheel.poll();
+        check();
+        if (QTest::currentTestFailed()) return;
+        // Cancel a few, and start some more from where the clock is now.
+        for (int k = 0; k < 3; ++k) {
+            Expected &e = timers[random.bounded(timers.size())];
+            QCOMPARE(wheel.cancel(e.handle), e.active);
+            e.cancelled = e.cancelled || e.active;
+            e.active = false;
+        }
+        startTimer(1 + random.bounded(100000), random.bounded(2) ? 0 : 1 + random.bounded(5000));
+    }
+    // The long ones, with the repeating ones gone.
+    for (Expected &e : timers) {
+        if (e.interval > 0 && e.active) QVERIFY(wheel.cancel(e.handle));
+        if (e.interval > 0) e.active = false;
+    }
+    while (wheel.count() > 0) {
+        clock += 1 + random.bounded(600000);
+        wheel.poll();
+        check();
+        if (QTest::currentTestFailed()) return;
+    }
+    for (const Expected &e : timers)
+        if (e.interval == 0) QCOMPARE(e.fires, quint64(e.cancelled ? 0 : 1));
+}
+
+// `#timers pause` run by a ticker pauses the wheel from inside a callback.
+// The advance under way finishes in order instead of starting another, and
+// what is left keeps its remaining time until resumed.
+void TestTimerWheel::pauseFromCallback() {
+    qint64 clock = 0;
+    TimerWheel wheel;
+    wheel.setClock([&clock]() { return clock; });
+    QStringList order;
+    wheel.start(10, [&]() { order.append("same slot"); });
+    // Started last, so it runs first in the slot they share.
+    const TimerWheel::Handle ticker = wheel.start(10, [&]() {
+        order.append("pause");
+        wheel.setPaused(true);
+    }, 50);
+    wheel.start(20, [&]() { order.append("later slot"); });
+    const TimerWheel::Handle last = wheel.start(100, [&]() { order.append("after resume"); });
+
+    clock = 25;
+    wheel.poll();
+    QCOMPARE(order, QStringList({"pause", "same slot", "later slot"}));
+    QVERIFY(wheel.isPaused());
+    QVERIFY(wheel.isActive(ticker));
+    QCOMPARE(wheel.remaining(ticker), qint64(35));
+    QCOMPARE(wheel.remaining(last), qint64(75));
+
+    clock = 1000;
+    wheel.poll();
+    QCOMPARE(order.size(), 3);
+    QCOMPARE(wheel.remaining(ticker), qint64(35));
+    QCOMPARE(wheel.remaining(last), qint64(75));
+
+    wheel.setPaused(false);
+    clock = 1075;
+    wheel.poll();
+    QCOMPARE(order.mid(3), QStringList({"pause", "after resume"}));
+    QVERIFY(wheel.isPaused());
+    QCOMPARE(wheel.fireCount(ticker), quint64(2));
+    QCOMPARE(wheel.count(), 1);
+}
+
+AMLP_TEST(TestTimerWheel)
+#include "tst_timer_wheel.moc"